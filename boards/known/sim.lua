@@ -9,9 +9,15 @@ return {
     shell = { advanced = true },
     term = { lines = 25, cols = 80 },
     mmcfs = { spi = 0, cs_port = 0, cs_pin = 0 },
+    heap_regions = true,
+    compact_space = { size = 32768 },
+  },
+  config = {
+    -- Two RAM regions of different sizes to exercise the region aware heap
+    ram = { internal_rams = 2 },
   },
   modules = {
-    generic = { 'pd', 'all_lua', 'term', 'elua' }
+    generic = { 'pd', 'all_lua', 'term', 'elua', 'sched', 'fix' }
   }
 }
 
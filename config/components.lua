@@ -106,6 +106,29 @@ function init()
   -- Not really a component, not quite a config ... Implementation wise,
   -- it is easier to declare it as a component
   components.uart_buffers = { macro = 'BUF_ENABLE_UART' }
+  -- Memory pools for small Lua objects (same remark as above)
+  components.mempool = {
+    macro = 'BUILD_MEMPOOL',
+    attrs = {
+      slab_size = at.make_optional( at.int_attr( 'MEMPOOL_SLAB_SIZE', 128, 16384 ) )
+    }
+  }
+  -- Region aware heap (same remark as above)
+  components.heap_regions = {
+    macro = 'BUILD_HEAP_REGIONS',
+    attrs = {
+      split = at.make_optional( at.int_attr( 'HEAP_REGIONS_SPLIT', 8 ) )
+    }
+  }
+  -- Compacting space for table parts (same remark as above)
+  components.compact_space = {
+    macro = 'BUILD_COMPACT_SPACE',
+    attrs = {
+      size = at.make_optional( at.int_attr( 'COMPACT_SPACE_SIZE', 1024 ) )
+    }
+  }
+  -- Allocation trace recorder/replayer (same remark as above)
+  components.alloctrace = { macro = 'BUILD_ALLOC_TRACE' }
   -- XMODEM
   components.xmodem = {
     macro = 'BUILD_XMODEM',
@@ -167,7 +190,11 @@ function init()
       timer = at.timer_attr( 'RFS_TIMER_ID' ),
       flow = at.flow_control_attr( 'RFS_FLOW_TYPE' ),
       buf_size = at.int_log2_attr( 'RFS_BUFFER_SIZE', nil, nil, 9 ),
-      timeout = at.int_attr( 'RFS_TIMEOUT', nil, nil, 100000 )
+      timeout = at.int_attr( 'RFS_TIMEOUT', nil, nil, 100000 ),
+      readahead = at.int_attr( 'RFS_READAHEAD', 0, 16, 2 ),
+      write_buffers = at.int_attr( 'RFS_WRITE_BUFFERS', 0, 4, 1 ),
+      dir_buffer = at.int_attr( 'RFS_DIR_BUFFER', 0, nil, 256 ),
+      compress = at.bool_attr( 'RFS_COMPRESS', false )
     }
   }
   -- MMCFS
@@ -188,7 +215,17 @@ function init()
     attrs = {
       uart = at.make_optional( at.uart_attr( 'RPC_UART_ID' ) ),
       speed = at.make_optional( at.int_attr( 'RPC_UART_SPEED' ) ),
-      timer = at.make_optional( at.timer_attr( 'RPC_TIMER_ID' ) )
+      timer = at.make_optional( at.timer_attr( 'RPC_TIMER_ID' ) ),
+      compress = at.bool_attr( 'RPC_COMPRESS', false )
+    }
+  }
+  -- RPC over TCP/IP (instead of UART)
+  components.rpc_tcp = {
+    macro = 'BUILD_RPC_TCP',
+    needs = { 'rpc', 'tcpip' },
+    attrs = {
+      port = at.int_attr( 'RPC_TCP_PORT', 1, 65535, 12346 ),
+      clients = at.make_optional( at.int_attr( 'RPC_MAX_CLIENTS', 1 ) )
     }
   }
   -- TCP/IP
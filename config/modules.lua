@@ -28,9 +28,11 @@ local elua_generic_modules = {
   can = { guards = { "NUM_CAN > 0" } }, 
   cpu = {}, 
   elua = {}, 
+  fix = {},
   i2c = { guards = { "NUM_I2C > 0" } },
   pack = {}, 
   rpc = { guards = { "BUILD_RPC" } },
+  sched = {},
   net = { guards = { "BUILD_UIP" } },
   pd = {}, 
   pio = { guards = { "NUM_PIO > 0" } },
@@ -0,0 +1,160 @@
+-- eLua reference manual - fix
+
+data_en =
+{
+
+  -- Title
+  title = "eLua reference manual - fix",
+
+  -- Menu name
+  menu_name = "fix",
+
+  -- Overview
+  overview = [[This module implements fixed point arithmetic, mainly for the eLua builds that use integers as Lua numbers (see $LUA_NUMBER_INTEGRAL$), where the $math$ module is not usable.
+A fixed point number is a Lua integer that holds a $Q16.16$ value: 16 integer bits and 16 fractional bits, so the range is [-32768, 32768) with a resolution of 1/65536. The functions of this module
+take and return $Q16.16$ numbers unless specified otherwise. The $Q1.31$ functions work on values in [-1, 1) with 31 fractional bits.</p>
+<p>Addition and subtraction of two fixed point numbers can be done with the regular Lua operators, but they wrap around on overflow. All the functions of this module saturate instead: a result that
+does not fit is replaced by @#fix.MAX@fix.MAX@ or @#fix.MIN@fix.MIN@. An argument that is not a 32 bit integer is an error.</p>
+<p>The trigonometric functions are computed with CORDIC and the logarithm and exponential with shift and add reductions. They are accurate to about one unit in the last place and their tables are kept in ROM.]],
+
+  -- Data structures, constants and types
+  structures =
+  {
+    { text = [[fix.ONE
+fix.PI
+fix.E]],
+      name = "Constants",
+      desc = "The values 1, pi and e as fixed point numbers."
+    },
+
+    { text = [[fix.MAX
+fix.MIN]],
+      name = "Limits",
+      desc = "The largest and smallest fixed point numbers (also the largest and smallest $Q1.31$ numbers)."
+    },
+  },
+
+  -- Functions
+  funcs =
+  {
+    { sig = "f = #fix.new#( n )",
+      desc = "Converts a Lua number to a fixed point number.",
+      args = "$n$ - the number (an integer in integer builds).",
+      ret = "$f$ - the fixed point number."
+    },
+
+    { sig = "f = #fix.parse#( s )",
+      desc = "Converts a decimal string (for example $\"-12.375\"$) to a fixed point number. Useful in integer builds, which cannot read numbers with decimals.",
+      args = "$s$ - the string.",
+      ret = "$f$ - the fixed point number."
+    },
+
+    { sig = "n = #fix.tonumber#( f )",
+      desc = "Converts a fixed point number to a Lua number. In integer builds this is the same as @#fix.toint@fix.toint@.",
+      args = "$f$ - the fixed point number.",
+      ret = "$n$ - the Lua number."
+    },
+
+    { sig = "i = #fix.toint#( f )",
+      desc = "Returns the largest integer smaller than or equal to a fixed point number.",
+      args = "$f$ - the fixed point number.",
+      ret = "$i$ - the integer."
+    },
+
+    { sig = "s = #fix.tostring#( f, [decimals] )",
+      desc = "Converts a fixed point number to a decimal string.",
+      args =
+      {
+        "$f$ - the fixed point number.",
+        "$decimals$ - $(optional)$ the number of decimals, from 0 to 9 (4 if not specified)."
+      },
+      ret = "$s$ - the string."
+    },
+
+    { sig = "f = #fix.add#( a, b )",
+      desc = "Saturating addition.",
+      args = "$a, b$ - the operands.",
+      ret = "$f$ - $a + b$."
+    },
+
+    { sig = "f = #fix.sub#( a, b )",
+      desc = "Saturating subtraction.",
+      args = "$a, b$ - the operands.",
+      ret = "$f$ - $a - b$."
+    },
+
+    { sig = "f = #fix.mul#( a, b )",
+      desc = "Saturating multiplication (rounded to nearest).",
+      args = "$a, b$ - the operands.",
+      ret = "$f$ - $a * b$."
+    },
+
+    { sig = "f = #fix.div#( a, b )",
+      desc = "Saturating division (rounded toward zero). Raises an error if $b$ is 0.",
+      args = "$a, b$ - the operands.",
+      ret = "$f$ - $a / b$."
+    },
+
+    { sig = "f = #fix.abs#( a )",
+      desc = "Saturating absolute value.",
+      args = "$a$ - the operand.",
+      ret = "$f$ - the absolute value of $a$."
+    },
+
+    { sig = "q = #fix.mul31#( a, b )",
+      desc = "Saturating multiplication of two $Q1.31$ numbers.",
+      args = "$a, b$ - the $Q1.31$ operands.",
+      ret = "$q$ - $a * b$ as a $Q1.31$ number."
+    },
+
+    { sig = "q = #fix.toq31#( f )",
+      desc = "Converts a fixed point number to $Q1.31$ (saturating).",
+      args = "$f$ - the fixed point number.",
+      ret = "$q$ - the $Q1.31$ number."
+    },
+
+    { sig = "f = #fix.fromq31#( q )",
+      desc = "Converts a $Q1.31$ number to a fixed point number.",
+      args = "$q$ - the $Q1.31$ number.",
+      ret = "$f$ - the fixed point number."
+    },
+
+    { sig = "f = #fix.sqrt#( a )",
+      desc = "Square root. Raises an error if $a$ is negative.",
+      args = "$a$ - the operand.",
+      ret = "$f$ - the square root of $a$."
+    },
+
+    { sig = "f = #fix.sin#( a )",
+      desc = "Sine.",
+      args = "$a$ - the angle in radians.",
+      ret = "$f$ - the sine of $a$."
+    },
+
+    { sig = "f = #fix.cos#( a )",
+      desc = "Cosine.",
+      args = "$a$ - the angle in radians.",
+      ret = "$f$ - the cosine of $a$."
+    },
+
+    { sig = "f = #fix.atan2#( y, x )",
+      desc = "Arc tangent of $y/x$, using the signs of both arguments to find the quadrant.",
+      args = "$y, x$ - the coordinates.",
+      ret = "$f$ - the angle in radians, in [-pi, pi]."
+    },
+
+    { sig = "f = #fix.exp#( a )",
+      desc = "Exponential (saturates above about 10.4).",
+      args = "$a$ - the operand.",
+      ret = "$f$ - e raised to the power $a$."
+    },
+
+    { sig = "f = #fix.log#( a )",
+      desc = "Natural logarithm. Raises an error if $a$ is not positive.",
+      args = "$a$ - the operand.",
+      ret = "$f$ - the natural logarithm of $a$."
+    },
+  },
+}
+
+data_pt = data_en
@@ -12,7 +12,7 @@ data_en =
   -- Overview
   overview = [[This module allows for arbitrary packing of data into Lua strings and unpacking data from Lua strings. In this way, a string can be used to store data in a platform-indepdendent 
 manner. It is based on the ^http://www.tecgraf.puc-rio.br/~~lhf/ftp/lua/#lpack^lpack^ module from Luiz Henrique de Figueiredo (with some minor tweaks). </p>
-<p>Both methods of this module (@#pack@pack@ and @#unpack@unpack@) use a $format string$ to describe how to pack/unpack the data. The format string contains one or more $data specifiers$, each
+<p>The functions of this module use a $format string$ to describe how to pack/unpack the data. The format string contains one or more $data specifiers$, each
 data specifier is applied to a single variable that must be packed/unpacked. The data specifier has the following general format:</p>
 ~[endianness]<<format specifier>>[count]~
 <p>where:</p>
@@ -99,7 +99,9 @@ data specifier is applied to a single variable that must be packed/unpacked. The
   </table></li>
   <li>$count$ is an optional counter for the $format specifier$. For example, $i5$ instructs the code to pack/unpack 5 integer variables, as opposed to $i$ that specifies a
   single integer variable.</li>
-</ul><p>]],
+</ul><p>A format string is translated to a list of operations before it is used. The translations of the last few short format strings are remembered, and @#pack.compile@pack.compile@
+returns a translated format that can be used instead of a format string. The data can also be packed into (and unpacked from) a @#pack.buffer@buffer@, a fixed size block of memory
+that can be reused without creating new strings.]],
 
   -- Functions
   funcs = 
@@ -131,6 +133,43 @@ data specifier is applied to a single variable that must be packed/unpacked. The
         "$val2$ - the second unpacked value.",
         "$valn$ - the nth unpacked value."
       }
+    },
+
+    { sig = "fmt = #pack.compile#( format )",
+      desc = "Translates a format string. The result can be given to the functions of this module instead of the format string, or used with the methods $fmt:pack( val1, val2, ..., valn )$, $fmt:unpack( string, [ init ] )$ and $fmt:packinto( buffer, pos, val1, val2, ..., valn )$.",
+      args = "$format$ - format specifier (as described @#overview@here@).",
+      ret = "$fmt$ - the translated format."
+    },
+
+    { sig = "buffer = #pack.buffer#( size )",
+      desc = "Creates a buffer. The buffer can be given to @#pack.unpack@pack.unpack@ instead of a string, and its size is returned by the $#$ operator.",
+      args = "$size$ - the size of the buffer in bytes (the buffer is filled with zeros), or a string with the initial contents of the buffer.",
+      ret = "$buffer$ - the new buffer."
+    },
+
+    { sig = "nextpos = #pack.packinto#( buffer, pos, format, val1, val2, ..., valn )",
+      desc = "Packs variables in a buffer, starting at the given position. It is an error if the packed data does not fit in the buffer.",
+      args =
+      {
+        "$buffer$ - the buffer (created by @#pack.buffer@pack.buffer@).",
+        "$pos$ - the position of the first byte to write (1 for the start of the buffer).",
+        "$format$ - format specifier (as described @#overview@here@).",
+        "$val1$ - first variable to pack.",
+        "$val2$ - second variable to pack.",
+        "$valn$ - nth variable to pack.",
+      },
+      ret = "$nextpos$ - the position in the buffer after the packed data."
+    },
+
+    { sig = "string = #pack.tostring#( buffer, [ i ], [ j ] )",
+      desc = "Returns the contents of a buffer (or a part of it) as a string.",
+      args =
+      {
+        "$buffer$ - the buffer.",
+        "$i$ - $(optional)$ the position of the first byte (1 if not specified).",
+        "$j$ - $(optional)$ the position of the last byte (the end of the buffer if not specified)."
+      },
+      ret = "$string$ - the bytes from $i$ to $j$."
     }
   },
 }
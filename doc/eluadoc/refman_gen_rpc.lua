@@ -15,7 +15,7 @@ data_en =
   be called in the remote environment and variables can be manipulated by treating the $handle$ (representing 
   the remote global table) as if it were a local table.</p>
   <p>In order to open a connection, it is necessary to specify the interface through wich the connection is made.
-  Currently the connections are limited to serial ports on the desktop side, and uart devices on the eLua side.
+  Connections are made over serial ports and uarts, or over TCP/IP.
   For a number of the connections below, a parameter labeled $transport_identifiers$ is used to specify the port
   to be used in a platform specific manner.:
   <ul>
@@ -30,13 +30,43 @@ data_en =
         <li>$uart_path$ - the path to the serial port to use (e.g.: "/dev/ttyS0")</li>
       </ul>
     </li>
+    <li>eLua with the $rpc_tcp$ component (see @configurator.html@the configurator@): $transport_identifiers$ = $ip$, $port$, [$timer_id$] for
+    @#rpc.connect@rpc.connect@ and $port$, [$timer_id$] for the server functions
+      <ul>
+        <li>$ip$ - the address of the server, either a string ("192.168.1.100" or a host name) or a number returned by $net.packip$</li>
+        <li>$port$ - the TCP port of the server</li>
+        <li>$timer_id$ - the ID of the timer used for receive timeouts (the system timer by default)</li>
+      </ul>
+    </li>
+    <li>Linux/Mac OS X luarpc built with $transport=socket$: $transport_identifiers$ = $host$, $port$ for @#rpc.connect@rpc.connect@ and
+    [$address$], $port$ for the server functions
+      <ul>
+        <li>$host$ - the host name or address of the server (e.g.: "localhost")</li>
+        <li>$address$ - the local address to listen on (all addresses if not given)</li>
+        <li>$port$ - the TCP port of the server</li>
+      </ul>
+    </li>
   </ul>
   </p>
+  <p>Over TCP/IP a server accepts up to $RPC_MAX_CLIENTS$ clients at the same time (4 on the desktop and 2 on eLua by default) and serves their
+  requests in turn. A client that closes its connection or sends bad data is disconnected without stopping the server.
+  </p>
   
+  <p>Requests and replies are sent in frames of up to $RPC_FRAME_SIZE$ bytes (256 by default), so a call usually takes a single write
+  on the link in each direction. With @#rpc.async@rpc.async@ a client can send many calls without waiting for their replies
+  and collect the results later with @#rpc.wait@rpc.wait@, which hides the latency of the link. $test/bench-rpc.lua$ measures
+  the call rate of both modes.</p>
+  <p>The numbers at the start of a table (from index 1 up to the first entry that is not a number) are sent as one block of 8, 16 or 32 bit
+  integers when they are all integers in that range, or as a block of numbers otherwise. The string keys of the tables in a message are sent
+  only once; the next uses of a key refer to the first one. This makes arrays of samples and arrays of records much smaller on the link.</p>
+  <p>The first call of a remote function sends its name (for example $"mod.func"$) and the server returns a number for it; the next calls
+  from the same connection send only that number. The server still looks the function up on every call, so assigning a new function to
+  the name takes effect at once.</p>
+
   <p>See @using.html#rpc@Using eLua@ for a basic tutorial on getting started with the RPC module.</p>
 
   <p><span class="warning">NOTE</span>: This module is considered experimental. It currently works over a 
-  serial port with eLua targets and on desktop systems implementing POSIX serial communications (Linux, Mac OS X, etc).
+  serial port or TCP/IP with eLua targets and on desktop systems implementing POSIX serial communications or sockets (Linux, Mac OS X, etc).
   ]],
 
   -- Functions
@@ -46,7 +76,7 @@ data_en =
       desc = "Initiate connection from client to server.",
       args = 
       {
-        "$transport_identifiers$ - platform-specific serial port identification (see @#overview@overview@)"
+        "$transport_identifiers$ - platform-specific transport identification (see @#overview@overview@)"
       },
       ret = [[$handle$ - handle used to interact with the remote Lua state.  Usage styles are as follows:</p>
     <table style="text-align: left; margin-left: 2em;">
@@ -81,9 +111,31 @@ data_en =
       args = "$handle$ - handle associated with the connection.",
     },
 
+    { sig = "#rpc.async#( handle, flag )",
+      desc = [[Set the calling mode of a connection. In async mode a remote function call returns an id as soon as the request
+      is sent, and the results are read with @#rpc.wait@rpc.wait@. At most 128 async calls can be waiting for @#rpc.wait@rpc.wait@;
+      a call made past this limit raises an error. Getting or assigning remote variables, and calls made after the async mode is turned
+      off, read all the outstanding replies first (they are kept for @#rpc.wait@rpc.wait@).]],
+      args =
+      {
+        "$handle$ - handle associated with the connection.",
+        "$flag$ - $true$ (or any value except $nil$, $false$ and 0) to enable the async mode, $false$ to disable it."
+      }
+    },
+
+    { sig = "val1, val2, ..., valn = #rpc.wait#( handle, id )",
+      desc = "Wait for the reply of an async call. An error returned by the remote function is handled like the error of a synchronous call.",
+      args =
+      {
+        "$handle$ - handle associated with the connection.",
+        "$id$ - the id returned by the async call."
+      },
+      ret = "$val1, val2, ..., valn$ - the results of the remote function."
+    },
+
     { sig = "#rpc.server#( transport_identifiers )",
       desc = "Start a blocking/captive RPC server, which will wait for incoming connections.",
-      args = "$transport_identifiers$ - platform-specific serial port identification (see @#overview@overview@)",
+      args = "$transport_identifiers$ - platform-specific transport identification (see @#overview@overview@)",
     },
 
     { sig = "#rpc.on_error#( err_handler )",
@@ -93,7 +145,7 @@ data_en =
 
     { sig = "server_handle = #rpc.listen#( transport_identifiers )",
       desc = "Open a listener on transport and await incoming connections.",
-      args = "$transport_identifiers$ - platform-specific serial port identification (see @#overview@overview@)",
+      args = "$transport_identifiers$ - platform-specific transport identification (see @#overview@overview@)",
       ret = "server handle to use with @#rpc.peek@rpc.peek@ and @#rpc.dispatch@rpc.dispatch@"
     },
     
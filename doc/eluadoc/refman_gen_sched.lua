@@ -0,0 +1,99 @@
+-- eLua reference manual - sched
+
+data_en =
+{
+
+  -- Title
+  title = "eLua reference manual - sched",
+
+  -- Menu name
+  menu_name = "sched",
+
+  -- Overview
+  overview = [[This module implements a cooperative scheduler for Lua coroutines. A $task$ is a coroutine started with @#sched.spawn@sched.spawn@. Instead of polling a resource in a loop, a task calls
+one of the $wait$ functions of this module, which suspends it until its condition is met (or until an optional timeout expires). @#sched.run@sched.run@ checks the conditions of the waiting tasks
+in C and resumes only the tasks that are ready, so no Lua code runs while all the tasks are waiting.</p>
+<p>The wait functions can only be called from a task (not from a coroutine started by a task). A task that calls $coroutine.yield$ or @#sched.yield@sched.yield@ stays ready and runs again
+after all the other ready tasks. The timeouts and @#sched.sleep@sched.sleep@ need the system timer. At most 16 tasks can exist at the same time (this can be changed with the $SCHED_MAX_TASKS$ macro).]],
+
+  -- Functions
+  funcs =
+  {
+    { sig = "id = #sched.spawn#( f, [arg1], [arg2], ..., [argn] )",
+      desc = "Creates a new task that runs $f$. The task starts the next time the scheduler looks for ready tasks.",
+      args =
+      {
+        "$f$ - the task function.",
+        "$arg1, arg2, ..., argn$ - $(optional)$ arguments for $f$."
+      },
+      ret = "$id$ - the task number."
+    },
+
+    { sig = "#sched.run#()",
+      desc = "Runs the tasks until all of them finish or @#sched.stop@sched.stop@ is called. If a task raises an error, the task is removed and the error is propagated (the other tasks are kept and $run$ can be called again).",
+    },
+
+    { sig = "#sched.stop#()",
+      desc = "Makes @#sched.run@sched.run@ return after the current task yields. The tasks are kept.",
+    },
+
+    { sig = "#sched.yield#()",
+      desc = "Suspends the current task and lets the other ready tasks run.",
+    },
+
+    { sig = "#sched.sleep#( us )",
+      desc = "Suspends the current task for the given time.",
+      args = "$us$ - time to sleep in microseconds."
+    },
+
+    { sig = "ok = #sched.wait_uart#( id, count, [timeout] )",
+      desc = "Suspends the current task until the receive buffer of the given UART holds at least $count$ bytes. The UART must be buffered (see @refman_gen_uart.html#uart.set_buffer@uart.set_buffer@).",
+      args =
+      {
+        "$id$ - the ID of the UART.",
+        "$count$ - the number of bytes to wait for.",
+        "$timeout$ - $(optional)$ timeout in microseconds (no timeout if not specified)."
+      },
+      ret = "$ok$ - $true$ if the bytes are available, $false$ on timeout."
+    },
+
+    { sig = "ok = #sched.wait_adc#( id, count, [timeout] )",
+      desc = "Suspends the current task until at least $count$ samples are available on the given ADC channel (the sampling must be started with @refman_gen_adc.html#adc.sample@adc.sample@).",
+      args =
+      {
+        "$id$ - the ADC channel ID.",
+        "$count$ - the number of samples to wait for.",
+        "$timeout$ - $(optional)$ timeout in microseconds (no timeout if not specified)."
+      },
+      ret = "$ok$ - $true$ if the samples are available, $false$ on timeout."
+    },
+
+    { sig = "ok = #sched.wait_accept#( port, [timeout] )",
+      desc = "Suspends the current task until a connection request is pending on the given port (see $net.listen$). The connection is then taken with $net.accept$.",
+      args =
+      {
+        "$port$ - the port number.",
+        "$timeout$ - $(optional)$ timeout in microseconds (no timeout if not specified)."
+      },
+      ret = "$ok$ - $true$ if a connection is pending, $false$ on timeout."
+    },
+
+    { sig = "resnum = #sched.wait_int#( type, [resnum], [timeout] )",
+      desc = "Suspends the current task until the given interrupt occurs. The interrupt must be enabled with @refman_gen_cpu.html#cpu.sei@cpu.sei@. Only the last 8 interrupts are remembered between two checks of the scheduler.",
+      args =
+      {
+        "$type$ - the interrupt type (for example $cpu.INT_GPIO_POSEDGE$).",
+        "$resnum$ - $(optional)$ the resource number of the interrupt (any resource if not specified).",
+        "$timeout$ - $(optional)$ timeout in microseconds (no timeout if not specified)."
+      },
+      ret = "$resnum$ - the resource number of the interrupt, or $false$ on timeout."
+    },
+
+    { sig = "n = #sched.count#()",
+      desc = "Returns the number of tasks.",
+      ret = "$n$ - the number of tasks that did not finish yet."
+    },
+  },
+}
+
+data_pt = data_en
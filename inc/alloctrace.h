@@ -0,0 +1,45 @@
+// Allocation trace recorder and replayer
+
+#ifndef __ALLOCTRACE_H__
+#define __ALLOCTRACE_H__
+
+#include "type.h"
+#include <stddef.h>
+
+// Default number of operations between two fragmentation samples
+#define ALLOCTRACE_DEF_INTERVAL 1000
+
+// Sample taken while replaying a trace
+typedef struct
+{
+  u32 ops;                      // operations replayed so far
+  u32 inuse;                    // bytes allocated by the trace
+  u32 largest;                  // largest block that can still be allocated
+  u32 free;                     // free memory reported by the allocator
+} alloctrace_sample;
+
+// Replay results
+typedef struct
+{
+  u32 ops, allocs, reallocs, frees, failed;
+  u32 peak;                     // maximum value of 'inuse'
+  u32 time_us;                  // replay time (0 if the system timer is not available)
+  u32 nsamples;
+  alloctrace_sample *samples;   // allocated with malloc(), freed by the caller
+} alloctrace_result;
+
+// Return values for the replayer
+enum
+{
+  ALLOCTRACE_OK = 0,
+  ALLOCTRACE_ERR_OPEN,
+  ALLOCTRACE_ERR_FORMAT,
+  ALLOCTRACE_ERR_NOMEM
+};
+
+int alloctrace_start( const char *fname );
+void alloctrace_stop();
+void alloctrace_record( void *optr, size_t osize, void *nptr, size_t nsize );
+int alloctrace_replay( const char *fname, unsigned interval, alloctrace_result *res );
+
+#endif // #ifndef __ALLOCTRACE_H__
@@ -7,7 +7,12 @@
 #include "auxmods.h"
 
 #define BUILD_RPC
+#ifndef LUARPC_ENABLE_SOCKET
 #define LUARPC_ENABLE_SERIAL
+#endif
+#ifndef RPC_COMPRESS
+#define RPC_COMPRESS 1
+#endif
 
 #define LUA_PLATFORM_LIBS_REG \
   {LUA_LOADLIBNAME,	luaopen_package },\
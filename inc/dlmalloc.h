@@ -9,7 +9,11 @@
 extern void* elua_sbrk( ptrdiff_t incr );
 #define MORECORE                  elua_sbrk  
 #define USE_DL_PREFIX 
+#ifdef BUILD_HEAP_REGIONS
+#define MSPACES                   1
+#else
 #define MSPACES                   0
+#endif
 #define HAVE_MORECORE             1
 #define MORECORE_CONTIGUOUS       1
 #define MORECORE_CANNOT_TRIM 
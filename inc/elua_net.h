@@ -45,7 +45,10 @@ int elua_net_close( int s );
 elua_net_size elua_net_recvbuf( int s, luaL_Buffer *buf, elua_net_size maxsize, s16 readto, unsigned timer_id, timer_data_type to_us );
 elua_net_size elua_net_recv( int s, void *buf, elua_net_size maxsize, s16 readto, unsigned timer_id, timer_data_type to_us );
 elua_net_size elua_net_send( int s, const void* buf, elua_net_size len );
+int elua_net_recv_start( int s, void* buf, elua_net_size maxsize );
+elua_net_size elua_net_recv_poll( int s, elua_net_size maxsize );
 int elua_accept( u16 port, unsigned timer_id, timer_data_type to_us, elua_net_ip* pfrom );
+int elua_net_accept_ready( u16 port );
 int elua_net_connect( int s, elua_net_ip addr, u16 port );
 elua_net_ip elua_net_lookup( const char* hostname );
 int elua_listen( u16 port,BOOL flisten ); // Added TH
@@ -0,0 +1,50 @@
+// Region aware heap: one dlmalloc mspace per RAM region
+
+#ifndef __HEAPREG_H__
+#define __HEAPREG_H__
+
+#include "type.h"
+#include <stddef.h>
+
+// Regions are the memory spaces from MEM_START_ADDRESS/MEM_END_ADDRESS, in
+// the same order. The internal RAMs come first, so they are considered
+// faster than the external ones.
+
+// Lua allocations up to this size prefer the fast regions, larger ones
+// prefer the slow regions
+#ifndef HEAP_REGIONS_SPLIT
+#define HEAP_REGIONS_SPLIT      128
+#endif
+
+// Placement hints
+enum
+{
+  HEAPREG_FAST,                 // try the regions from the first to the last
+  HEAPREG_SLOW                  // try the regions from the last to the first
+};
+
+#define heapreg_hint( size )    ( ( size ) <= HEAP_REGIONS_SPLIT ? HEAPREG_FAST : HEAPREG_SLOW )
+
+// Per-region statistics
+typedef struct
+{
+  u32 start;                    // region start address
+  u32 size;                     // region size
+  u32 used;                     // bytes currently allocated (including dlmalloc overhead)
+  u32 peak;                     // maximum value of 'used'
+  u32 allocs;                   // blocks allocated in this region
+  u32 failed;                   // allocations that preferred this region and failed in all of them
+} heapreg_stats;
+
+struct mallinfo;
+
+void* heapreg_malloc( size_t size );
+void* heapreg_calloc( size_t nelem, size_t elem_size );
+void* heapreg_realloc( void *ptr, size_t size );
+void heapreg_free( void *ptr );
+void* heapreg_realloc_hint( void *ptr, size_t size, int hint );
+unsigned heapreg_num_regions();
+int heapreg_get_stats( unsigned id, heapreg_stats *pstats );
+struct mallinfo heapreg_mallinfo();
+
+#endif // #ifndef __HEAPREG_H__
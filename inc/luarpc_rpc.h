@@ -7,9 +7,34 @@
 // Parameters
 
 #define NUM_FUNCNAME_CHARS 20 // Maximum function name length
+#define RPC_MAX_DEPTH 16 // Maximum number of names in a remote path (a.b.c)
+#define RPC_MAX_NAME_CHARS ( RPC_MAX_DEPTH * ( NUM_FUNCNAME_CHARS + 1 ) ) // Maximum remote path length
 
 #define MAX_LINK_ERRS ( 2 ) // Maximum number of framing errors before connection reset
 
+#ifndef RPC_FRAME_SIZE
+#define RPC_FRAME_SIZE 256 // Maximum frame payload (size of the transport buffers)
+#endif
+#define RPC_FRAME_HEADER 4 // Frame marker, sequence number, payload length (2 bytes)
+
+#define RPC_MAX_PENDING 128 // Maximum number of async calls not waited for yet
+
+#define RPC_DICT_SIZE 255 // Maximum number of table keys remembered per message
+
+#define RPC_MAX_FUNCS 255 // Maximum number of function ids per connection
+
+// Maximum number of clients served by one server (the serial transports have
+// a single client, every eLua TCP client needs a packet sized buffer)
+#ifndef RPC_MAX_CLIENTS
+#if defined( LUARPC_ENABLE_SOCKET )
+#define RPC_MAX_CLIENTS 4
+#elif defined( BUILD_RPC_TCP )
+#define RPC_MAX_CLIENTS 2
+#else
+#define RPC_MAX_CLIENTS 1
+#endif
+#endif
+
 #define LUARPC_MODE "elua"
 
 // a kind of silly way to get the maximum int, but oh well ...
@@ -61,7 +86,8 @@ enum {
   ERR_NODATA    = MAXINT - 103,
   ERR_COMMAND   = MAXINT - 106,
   ERR_HEADER    = MAXINT - 107,
-  ERR_LONGFNAME = MAXINT - 108
+  ERR_LONGFNAME = MAXINT - 108,
+  ERR_CONNECT   = MAXINT - 109   // can't open or accept a connection
 };
 
 enum exception_type { done, nonfatal, fatal };
@@ -88,8 +114,20 @@ struct _Transport
          loc_armflt: 1,               // local float representation is arm float?
          loc_intnum: 1,               // Local is integer only?
          net_little: 1,               // Network is little endian?
-         net_intnum: 1;               // Network is integer only?
+         net_intnum: 1,               // Network is integer only?
+         listening: 1,                // Listening transport? (TCP transports)
+         compress: 1;                 // Frames compressed with LZF?
   u8     lnum_bytes;
+  u8     seq;                         // sequence number of the message being written
+  u8     rseq;                        // sequence number of the frame being read
+  u16    wlen;                        // payload bytes in wbuf
+  u16    rpos, rlen;                  // read position and payload bytes in rbuf
+  u8     wdict_n, rdict_n;            // string keys written / read in the current message
+  int    wdict_ref, rdict_ref;        // key dictionaries (key -> index and index -> key)
+  u8     fn_n;                        // function ids given (server side)
+  int    fn_ref;                      // function ids of the connection
+  u8     wbuf[ RPC_FRAME_HEADER + RPC_FRAME_SIZE ];
+  u8     rbuf[ RPC_FRAME_SIZE ];
 };
 
 typedef struct _Handle Handle;
@@ -99,6 +137,10 @@ struct _Handle
   int error_handler;                  // function reference
   int async;                          // nonzero if async mode being used
   int read_reply_count;               // number of async call return values to read
+  int pending_ref;                    // table of async replies read before they were waited for
+  int pending_count;                  // number of replies in the pending table
+  u32 call_id;                        // id of the last async call
+  int fn_gen;                         // changed when the function ids are forgotten
 };
 
 typedef struct _Helper Helper;
@@ -107,14 +149,18 @@ struct _Helper {
   Helper *parent;                         // parent helper
   int pref;                               // Parent reference idx in registry
   u8 nparents;                            // number of parents
+  u8 fid;                                 // function id (0 if not known)
+  u16 fhash;                              // hash of the name sent with fid
+  int fgen;                               // fn_gen of the handle when fid was set
   char funcname[NUM_FUNCNAME_CHARS + 1];  // name of the function
 };
 
 typedef struct _ServerHandle ServerHandle;
 struct _ServerHandle {
-  Transport ltpt;   // listening transport, always valid if no error
-  Transport atpt;   // accepting transport, valid if connection established
-  int link_errs;
+  Transport ltpt;                         // listening transport, always valid if no error
+  Transport atpt[ RPC_MAX_CLIENTS ];      // accepting transports, valid if connection established
+  int link_errs[ RPC_MAX_CLIENTS ];
+  int next;                               // next client to serve
 };
 
 
@@ -152,6 +198,11 @@ int transport_open_connection(lua_State *L, Handle *handle);
 // Accept Connection 
 void transport_accept (Transport *tpt, Transport *atpt);
 
+// Wait until a connection is pending on the listening transport (if
+// 'accept' is nonzero) or one of the accepted transports is readable
+// (only used when RPC_MAX_CLIENTS > 1)
+void transport_wait (ServerHandle *handle, int accept);
+
 // Read & Write to Transport 
 void transport_read_buffer (Transport *tpt, u8 *buffer, int length);
 void transport_write_buffer (Transport *tpt, const u8 *buffer, int length);
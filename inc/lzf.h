@@ -0,0 +1,25 @@
+// LZF block compression for the RPC transports (RFS and LuaRPC)
+
+#ifndef __LZF_H__
+#define __LZF_H__
+
+#include "type.h"
+
+// Size of the compressor hash table (1 << LZF_HLOG 16-bit entries). Larger
+// tables find more matches but use more RAM.
+#ifndef LZF_HLOG
+#define LZF_HLOG              8
+#endif
+
+// Largest block that can be compressed
+#define LZF_MAX_BLOCK         0xFFFF
+
+// Compress 'inlen' bytes from 'in' to at most 'outlen' bytes at 'out'.
+// Returns the compressed size or 0 if it doesn't fit in 'outlen' bytes.
+u32 lzf_compress( const u8 *in, u32 inlen, u8 *out, u32 outlen );
+
+// Decompress 'inlen' bytes from 'in' to at most 'outlen' bytes at 'out'.
+// Returns the decompressed size or 0 if the data is invalid or too large.
+u32 lzf_decompress( const u8 *in, u32 inlen, u8 *out, u32 outlen );
+
+#endif
@@ -0,0 +1,42 @@
+// Size-class slab pools for small, fixed size Lua objects
+
+#ifndef __MPOOL_H__
+#define __MPOOL_H__
+
+#include "type.h"
+#include <stddef.h>
+
+// Size of a slab (the unit of memory requested from the system allocator)
+#ifndef MEMPOOL_SLAB_SIZE
+#define MEMPOOL_SLAB_SIZE       512
+#endif
+
+// Objects are grouped in size classes that are multiples of MPOOL_GRANULE
+// Requests larger than MPOOL_MAX_SIZE are not pooled
+#define MPOOL_GRANULE           8
+#define MPOOL_GRANULE_SHIFT     3
+#define MPOOL_MAX_SIZE          64
+#define MPOOL_NUM_CLASSES       ( MPOOL_MAX_SIZE / MPOOL_GRANULE )
+
+// Size class for a given request size
+#define mpool_class( size )     ( ( ( size ) - 1 ) >> MPOOL_GRANULE_SHIFT )
+#define mpool_pooled( size )    ( ( size ) > 0 && ( size ) <= MPOOL_MAX_SIZE )
+
+// Per-class statistics
+typedef struct
+{
+  u16 objsize;                  // object size for this class
+  u16 perslab;                  // objects in a slab
+  u32 slabs;                    // slabs currently allocated
+  u32 inuse;                    // objects currently in use
+  u32 peak;                     // maximum value of 'inuse'
+  u32 allocs;                   // total number of allocations
+} mpool_stats;
+
+void* mpool_alloc( size_t size );
+int mpool_free( void *ptr, size_t size );
+void* mpool_realloc( void *ptr, size_t osize, size_t nsize );
+void mpool_trim();
+int mpool_get_stats( unsigned cls, mpool_stats *pstats );
+
+#endif // #ifndef __MPOOL_H__
@@ -7,6 +7,7 @@
 #include <reent.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 
 // Maximum number of devices in the system
 #define DM_MAX_DEVICES        16
@@ -65,6 +66,8 @@ typedef struct
   int ( *p_unlink_r )( struct _reent *r, const char *fname, void *pdata );
   int ( *p_rmdir_r )( struct _reent *r, const char *fname, void *pdata );
   int ( *p_rename_r )( struct _reent *r, const char *oldname, const char *newname, void *pdata );
+  int ( *p_fsync_r )( struct _reent *r, int fd, void *pdata );
+  int ( *p_stat_r )( struct _reent *r, const char *path, struct stat *st, void *pdata );
 } DM_DEVICE;
 
 // Additional registration data for each FS (per FS instance)
@@ -110,6 +113,7 @@ DM_DIR *dm_opendir( const char* dirname );
 struct dm_dirent* dm_readdir( DM_DIR *d );
 int dm_closedir( DM_DIR *d );
 const char* dm_getaddr( int fd );
+int dm_fsync( int fd );
 
 #endif
 
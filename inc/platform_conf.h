@@ -17,5 +17,11 @@
 #include ELUA_BOARD_HEADER
 #include "platform_generic.h"     // generic platform header (include whatever else is missing here)
 
+// Heap regions are dlmalloc mspaces, so they are only used with the 'multiple'
+// allocator (the other allocators ignore them)
+#if defined( BUILD_HEAP_REGIONS ) && !defined( USE_MULTIPLE_ALLOCATOR )
+#undef BUILD_HEAP_REGIONS
+#endif
+
 #endif
 
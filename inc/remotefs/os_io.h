@@ -24,6 +24,7 @@ int os_isdir( const char *name );
 u32 os_opendir( const char* name );
 void os_readdir( u32 d, const char **pname );
 int os_closedir( u32 d );
+int os_stat( const char *name, u32 *psize, u32 *pftime );
 
 #endif
 
@@ -4,6 +4,7 @@
 #define __REMOTEFS_H__
 
 #include "type.h"
+#include "eluarpc.h"
 
 // Operation IDs
 #define   RFS_OP_OPEN     0x01
@@ -15,9 +16,28 @@
 #define   RFS_OP_OPENDIR  0x06
 #define   RFS_OP_READDIR  0x07
 #define   RFS_OP_CLOSEDIR 0x08
-#define   RFS_OP_LAST     RFS_OP_CLOSEDIR
+#define   RFS_OP_PREAD    0x09
+#define   RFS_OP_VERSION  0x0A
+#define   RFS_OP_READDIRB 0x0B
+#define   RFS_OP_STAT     0x0C
+#define   RFS_OP_WRITEZ   0x0D
+#define   RFS_OP_PREADZ   0x0E
+#define   RFS_OP_LAST     RFS_OP_PREADZ
 #define   RFS_OP_RES_MOD  0x80
 
+// Protocol version: 1 has the operations up to "pread", 2 adds "version",
+// "readdirb" and "stat", 3 adds "writez" and "preadz". A server that doesn't
+// know "version" sends the request back, so the client finds out that it
+// speaks version 1.
+#define   RFS_PROTOCOL_VERSION      3
+
+// Compression methods of the data in "writez" and "preadz"
+#define   RFS_COMPRESS_NONE         0
+#define   RFS_COMPRESS_LZF          1
+
+// Flags returned by "stat"
+#define   RFS_STAT_FLAG_DIR         0x01
+
 // Platform independent constants for "flags" in "open"
 #define   RFS_OPEN_FLAG_APPEND      0x01
 #define   RFS_OPEN_FLAG_CREAT       0x02
@@ -40,6 +60,29 @@
 // Max filename size on a RFS instance
 #define   RFS_MAX_FNAME_SIZE        31
 
+// Offset of the data in a "write" request
+#define   RFS_WRITE_BUF_OFFSET      ( ELUARPC_START_OFFSET + ELUARPC_START_SIZE + ELUARPC_OP_ID_SIZE + ELUARPC_U32_SIZE + ELUARPC_PTR_HEADER_SIZE )
+
+// Offset of the data in a "pread" response, size of a "pread" request and
+// size of a "pread" response without the data
+#define   RFS_PREAD_BUF_OFFSET      ( ELUARPC_START_OFFSET + ELUARPC_START_SIZE + ELUARPC_RESPONSE_SIZE + ELUARPC_U8_SIZE + ELUARPC_U32_SIZE + ELUARPC_PTR_HEADER_SIZE )
+#define   RFS_PREAD_REQUEST_SIZE    ( ELUARPC_START_OFFSET + ELUARPC_START_SIZE + ELUARPC_OP_ID_SIZE + ELUARPC_U32_SIZE + ELUARPC_U8_SIZE + 2 * ELUARPC_U32_SIZE + ELUARPC_END_SIZE )
+#define   RFS_PREAD_RESPONSE_EXTRA  ( RFS_PREAD_BUF_OFFSET + ELUARPC_END_SIZE )
+
+// Offset of the data in a "writez" request and in a "preadz" response, size
+// of a "writez" request and of a "preadz" response without the data
+#define   RFS_WRITEZ_BUF_OFFSET     ( RFS_WRITE_BUF_OFFSET + ELUARPC_U8_SIZE )
+#define   RFS_WRITEZ_REQUEST_EXTRA  ( ELUARPC_WRITE_REQUEST_EXTRA + ELUARPC_U8_SIZE )
+#define   RFS_PREADZ_BUF_OFFSET     ( RFS_PREAD_BUF_OFFSET + ELUARPC_U8_SIZE )
+#define   RFS_PREADZ_RESPONSE_EXTRA ( RFS_PREAD_RESPONSE_EXTRA + ELUARPC_U8_SIZE )
+
+// Offset of the entries in a "readdirb" response, size of a "readdirb"
+// response without the entries and maximum size of an entry (size, ftime,
+// name with the terminating 0)
+#define   RFS_READDIRB_BUF_OFFSET   ( ELUARPC_START_OFFSET + ELUARPC_START_SIZE + ELUARPC_RESPONSE_SIZE + ELUARPC_U8_SIZE + ELUARPC_PTR_HEADER_SIZE )
+#define   RFS_READDIRB_RESPONSE_EXTRA ( RFS_READDIRB_BUF_OFFSET + ELUARPC_END_SIZE )
+#define   RFS_READDIRB_MAX_ENTRY    ( 8 + RFS_MAX_FNAME_SIZE + 1 )
+
 // Function: int open(const char *pathname,int flags, mode_t mode)
 void remotefs_open_write_response( u8 *p, int result );
 int remotefs_open_read_response( const u8 *p, int *presult );
@@ -89,5 +132,58 @@ int remotefs_closedir_read_response( const u8 *p, int *pd );
 void remotefs_closedir_write_request( u8 *p, u32 d );
 int remotefs_closedir_read_request( const u8 *p, u32 *pd );
 
+// Function: ssize_t pread( int fd, void *buf, size_t count, off_t offset )
+// Reads from 'offset' (or from the current position if 'offset' is -1) and
+// leaves the file position after the data. The response has the offset the
+// data was read from (-1 on error) and the 'seq' of the request, so a client
+// can have more requests in flight and match the responses
+void remotefs_pread_write_response( u8 *p, u8 seq, s32 offset, u32 readbytes );
+int remotefs_pread_read_response( const u8 *p, u8 *pseq, s32 *poffset, const u8 **ppdata, u32 *preadbytes );
+void remotefs_pread_write_request( u8 *p, int fd, u8 seq, s32 offset, u32 count );
+int remotefs_pread_read_request( const u8 *p, int *pfd, u8 *pseq, s32 *poffset, u32 *pcount );
+
+// Function: u8 version( u8 version )
+// The client sends the highest protocol version it knows, the server answers
+// with the version both sides will use
+void remotefs_version_write_response( u8 *p, u8 version );
+int remotefs_version_read_response( const u8 *p, u8 *pversion );
+void remotefs_version_write_request( u8 *p, u8 version );
+int remotefs_version_read_request( const u8 *p, u8 *pversion );
+
+// Function: u8 readdirb( u32 d, u32 maxsize )
+// Returns as many directory entries as fit in 'maxsize' bytes (0 entries at
+// the end of the directory). The server puts the entries at
+// RFS_READDIRB_BUF_OFFSET with remotefs_readdirb_put_entry, the client takes
+// them from the returned data with remotefs_readdirb_get_entry.
+void remotefs_readdirb_write_response( u8 *p, u8 nentries, u32 size );
+int remotefs_readdirb_read_response( const u8 *p, u8 *pnentries, const u8 **ppdata, u32 *psize );
+void remotefs_readdirb_write_request( u8 *p, u32 d, u32 maxsize );
+int remotefs_readdirb_read_request( const u8 *p, u32 *pd, u32 *pmaxsize );
+u32 remotefs_readdirb_put_entry( u8 *p, const char *name, u32 size, u32 ftime );
+const u8* remotefs_readdirb_get_entry( const u8 *p, const char **pname, u32 *psize, u32 *pftime );
+
+// Function: int stat( const char *name, u32 *psize, u32 *pftime )
+// Returns -1 on error or the RFS_STAT_FLAG_xxx flags of the file
+void remotefs_stat_write_response( u8 *p, int result, u32 size, u32 ftime );
+int remotefs_stat_read_response( const u8 *p, int *presult, u32 *psize, u32 *pftime );
+void remotefs_stat_write_request( u8 *p, const char *name );
+int remotefs_stat_read_request( const u8 *p, const char **pname );
+
+// Function: ssize_t writez( int fd, u8 method, const void *buf, size_t count )
+// Like "write", but the data is compressed with 'method' (RFS_COMPRESS_xxx).
+// The response has the number of uncompressed bytes written.
+void remotefs_writez_write_response( u8 *p, u32 result );
+int remotefs_writez_read_response( const u8 *p, u32 *presult );
+void remotefs_writez_write_request( u8 *p, int fd, u8 method, const void *buf, u32 count );
+int remotefs_writez_read_request( const u8 *p, int *pfd, u8 *pmethod, const void **pbuf, u32 *pcount );
+
+// Function: ssize_t preadz( int fd, void *buf, size_t count, off_t offset )
+// Like "pread", but the server can compress the data it returns. 'count' is
+// the uncompressed size, the response has the compression method of the data.
+void remotefs_preadz_write_response( u8 *p, u8 seq, s32 offset, u8 method, u32 size );
+int remotefs_preadz_read_response( const u8 *p, u8 *pseq, s32 *poffset, u8 *pmethod, const u8 **ppdata, u32 *psize );
+void remotefs_preadz_write_request( u8 *p, int fd, u8 seq, s32 offset, u32 count );
+int remotefs_preadz_read_request( const u8 *p, int *pfd, u8 *pseq, s32 *poffset, u32 *pcount );
+
 #endif
 
@@ -9,6 +9,7 @@ void* smalloc( size_t size );
 void sfree( void* ptr );
 void* scalloc( size_t nmemb, size_t size );
 void* srealloc( void* ptr, size_t size );
+size_t sfreebytes();
 
 #endif // #ifndef __SALLOC_H__
 
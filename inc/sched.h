@@ -0,0 +1,11 @@
+// Cooperative scheduler (sched module): interface to the rest of eLua
+
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include "elua_int.h"
+
+// Called by the common interrupt handler for every interrupt
+void sched_int_notify( elua_int_id id, elua_int_resnum resnum );
+
+#endif // #ifndef __SCHED_H__
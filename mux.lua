@@ -19,7 +19,7 @@ else
   exeprefix = ""
 end
 
-local full_files = utils.prepend_path( flist, "mux_src" ) .. utils.prepend_path( rfs_flist, "rfs_server_src" ) .. "src/remotefs/remotefs.c src/eluarpc.c"
+local full_files = utils.prepend_path( flist, "mux_src" ) .. utils.prepend_path( rfs_flist, "rfs_server_src" ) .. "src/remotefs/remotefs.c src/eluarpc.c src/lzf.c"
 local local_include = "mux_src rfs_server_src inc inc/remotefs"
 local compcmd = builder:compile_cmd{ flags = "-m32 -O0 -Wall -g", defines = cdefs, includes = local_include }
 local linkcmd = builder:link_cmd{ flags = "-m32", libraries = socklib }
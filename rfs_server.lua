@@ -5,11 +5,13 @@ local utils = b.utils
 
 -- Set builder options BEFORE calling builder:init
 builder:add_option( 'sim', 'run under the eLua simulator', false )
+builder:add_option( 'loadgen', 'build the RFS load generator (rfs_loadgen) instead of the server', false )
 builder:init( args )
 builder:set_build_mode( builder.BUILD_DIR_LINEARIZED )
 
 local sim = builder:get_option( 'sim' )
 sim = sim and 1 or 0
+local loadgen = builder:get_option( 'loadgen' )
 
 local flist, socklib
 local cdefs = "RFS_STANDALONE_MODE"
@@ -20,17 +22,23 @@ if utils.is_windows() then
     print "SIM target not supported under Windows"
     os.exit( 1 )
   end
-  flist = "main.c server.c os_io_win32.c log.c net_win32.c serial_win32.c deskutils.c rfs_transports.c"
+  if loadgen then
+    flist = "loadgen.c log.c net_win32.c serial_win32.c deskutils.c"
+  else
+    flist = "main.c server.c os_io_win32.c log.c net_win32.c serial_win32.c deskutils.c rfs_transports.c"
+  end
   cdefs = cdefs .. " WIN32_BUILD"
   exeprefix = ".exe"
   socklib = 'ws2_32'
+elseif loadgen then
+  flist = "loadgen.c log.c net_posix.c serial_posix.c deskutils.c"
 else
   flist = mainname .. " server.c os_io_posix.c log.c net_posix.c serial_posix.c deskutils.c rfs_transports.c"
 end
 
-local output = sim == 0 and 'rfs_server' or 'rfs_sim_server'
+local output = loadgen and 'rfs_loadgen' or sim == 0 and 'rfs_server' or 'rfs_sim_server'
 local local_include = "rfs_server_src inc/remotefs inc"
-local full_files = utils.prepend_path( flist, 'rfs_server_src' ) .. " src/remotefs/remotefs.c src/eluarpc.c"
+local full_files = utils.prepend_path( flist, 'rfs_server_src' ) .. " src/remotefs/remotefs.c src/eluarpc.c src/lzf.c"
 local compcmd = builder:compile_cmd{ flags = "-m32 -O0 -Wall -g", defines = cdefs, includes = local_include }
 local linkcmd = builder:link_cmd{ flags = "-m32", libraries = socklib }
 builder:set_compile_cmd( compcmd )
@@ -0,0 +1,522 @@
+// RFS load generator: simulates many eLua clients of a RFS server
+
+#include "net.h"
+#include "remotefs.h"
+#include "eluarpc.h"
+#include "rfs_serial.h"
+#include "type.h"
+#include "log.h"
+#include "lzf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "deskutils.h"
+#ifndef WIN32_BUILD
+#include <sys/time.h>
+#endif
+
+// ****************************************************************************
+// Data structures and local variables
+
+// Each client reads and writes its own file in requests that fit in
+// LG_BUFFER_SIZE bytes (the RFS buffer of the simulated board), waiting up to
+// LG_TIMEOUT ms for a response
+#define LG_BUFFER_SIZE        512
+#define LG_TIMEOUT            5000
+#define LG_MAX_CLIENTS        256
+
+#define LG_WRITE_SIZE         ( LG_BUFFER_SIZE - RFS_WRITEZ_REQUEST_EXTRA )
+#define LG_READ_SIZE          ( LG_BUFFER_SIZE - RFS_PREADZ_RESPONSE_EXTRA )
+#define LG_DIR_SIZE           ( LG_BUFFER_SIZE - RFS_READDIRB_RESPONSE_EXTRA )
+
+// Transport types
+enum
+{
+  LG_TRANSPORT_SER,
+  LG_TRANSPORT_UDP,
+  LG_TRANSPORT_TCP
+};
+
+// Steps of a client session, a request for each
+enum
+{
+  LG_STEP_VERSION,
+  LG_STEP_CREATE,
+  LG_STEP_WRITE,
+  LG_STEP_CLOSE_WRITE,
+  LG_STEP_OPEN,
+  LG_STEP_READ,
+  LG_STEP_BAD_FD,
+  LG_STEP_STAT,
+  LG_STEP_OPENDIR,
+  LG_STEP_READDIR,
+  LG_STEP_CLOSEDIR,
+  LG_STEP_CLOSE,
+  LG_STEP_DONE
+};
+
+typedef struct
+{
+  int type;
+  ser_handler ser;
+  NET_SOCKET sock;
+  char fname[ RFS_MAX_FNAME_SIZE + 1 ];
+  u8 *data;                       // contents of the client file
+  int step;
+  int fd;
+  u32 d;
+  u32 pos;
+  u32 count;
+  int found;
+  u8 buf[ LG_BUFFER_SIZE ];
+} LG_CLIENT;
+
+static LG_CLIENT *lg_clients[ LG_MAX_CLIENTS ];
+static unsigned lg_num_clients;
+static u32 lg_bytes;
+static u32 lg_requests, lg_traffic;
+static u8 lg_zbuf[ LG_BUFFER_SIZE ];
+
+// ****************************************************************************
+// Helpers
+
+// Time in milliseconds
+static u32 lg_time()
+{
+#ifdef WIN32_BUILD
+  return ( u32 )GetTickCount();
+#else
+  struct timeval tv;
+
+  gettimeofday( &tv, NULL );
+  return ( u32 )( tv.tv_sec * 1000 + tv.tv_usec / 1000 );
+#endif
+}
+
+// Fill the contents of the file of client 'id' (text, like most of the files
+// on a RFS directory)
+static u8* lg_make_data( unsigned id )
+{
+  u8 *p;
+  char line[ 64 ];
+  u32 i, len;
+
+  if( ( p = ( u8* )malloc( lg_bytes + 1 ) ) == NULL )
+    return NULL;
+  for( i = 0; i < lg_bytes; i += len )
+  {
+    len = sprintf( line, "client %u, offset %u\n", id, ( unsigned )i );
+    if( len > lg_bytes - i )
+      len = lg_bytes - i;
+    memcpy( p + i, line, len );
+  }
+  return p;
+}
+
+// Send a request
+static int lg_send( LG_CLIENT *pc )
+{
+  u16 size;
+
+  eluarpc_get_packet_size( pc->buf, &size );
+  lg_requests ++;
+  lg_traffic += size;
+  if( pc->type == LG_TRANSPORT_SER )
+    return ser_write( pc->ser, pc->buf, size ) == size;
+  return net_sendto( pc->sock, ( char* )pc->buf, size, 0, NULL, 0 ) == size;
+}
+
+// Helper: read exactly 'size' bytes from a serial port or a TCP connection
+static int lg_read_stream( LG_CLIENT *pc, u8 *dest, u32 size )
+{
+  net_ssize_t res;
+
+  if( pc->type == LG_TRANSPORT_SER )
+    return ser_read( pc->ser, dest, size, LG_TIMEOUT ) == size;
+  while( size > 0 )
+  {
+    if( ( res = net_recvfrom( pc->sock, ( char* )dest, size, 0, NULL, NULL, LG_TIMEOUT ) ) <= 0 )
+      return 0;
+    dest += res;
+    size -= ( u32 )res;
+  }
+  return 1;
+}
+
+// Receive a response
+static int lg_recv( LG_CLIENT *pc )
+{
+  u16 size;
+
+  if( pc->type == LG_TRANSPORT_UDP )
+  {
+    if( net_recvfrom( pc->sock, ( char* )pc->buf, LG_BUFFER_SIZE, 0, NULL, NULL, LG_TIMEOUT ) <= 0 )
+      return 0;
+    if( eluarpc_get_packet_size( pc->buf, &size ) == ELUARPC_ERR )
+      return 0;
+    lg_traffic += size;
+    return 1;
+  }
+  if( !lg_read_stream( pc, pc->buf, ELUARPC_START_OFFSET ) )
+    return 0;
+  if( eluarpc_get_packet_size( pc->buf, &size ) == ELUARPC_ERR || size <= ELUARPC_START_OFFSET || size > LG_BUFFER_SIZE )
+    return 0;
+  lg_traffic += size;
+  return lg_read_stream( pc, pc->buf + ELUARPC_START_OFFSET, size - ELUARPC_START_OFFSET );
+}
+
+// ****************************************************************************
+// Client session
+
+// Put the request for the current step in the client buffer
+static void lg_request( LG_CLIENT *pc )
+{
+  u32 size;
+
+  switch( pc->step )
+  {
+    case LG_STEP_VERSION:
+      remotefs_version_write_request( pc->buf, RFS_PROTOCOL_VERSION );
+      break;
+
+    case LG_STEP_CREATE:
+      remotefs_open_write_request( pc->buf, pc->fname, RFS_OPEN_FLAG_WRONLY | RFS_OPEN_FLAG_CREAT | RFS_OPEN_FLAG_TRUNC, 0 );
+      break;
+
+    case LG_STEP_WRITE:
+      // Compress the data like a client built with RFS_COMPRESS
+      if( ( pc->count = lg_bytes - pc->pos ) > LG_WRITE_SIZE )
+        pc->count = LG_WRITE_SIZE;
+      if( ( size = lzf_compress( pc->data + pc->pos, pc->count, pc->buf + RFS_WRITEZ_BUF_OFFSET, pc->count - 1 ) ) > 0 )
+        remotefs_writez_write_request( pc->buf, pc->fd, RFS_COMPRESS_LZF, NULL, size );
+      else
+        remotefs_writez_write_request( pc->buf, pc->fd, RFS_COMPRESS_NONE, pc->data + pc->pos, pc->count );
+      break;
+
+    case LG_STEP_OPEN:
+      remotefs_open_write_request( pc->buf, pc->fname, RFS_OPEN_FLAG_RDONLY, 0 );
+      break;
+
+    case LG_STEP_READ:
+      remotefs_preadz_write_request( pc->buf, pc->fd, 0, ( s32 )pc->pos, LG_READ_SIZE );
+      break;
+
+    case LG_STEP_BAD_FD:
+      // A file that the client didn't open
+      remotefs_lseek_write_request( pc->buf, pc->fd + 1, 0, RFS_LSEEK_SET );
+      break;
+
+    case LG_STEP_STAT:
+      remotefs_stat_write_request( pc->buf, pc->fname );
+      break;
+
+    case LG_STEP_OPENDIR:
+      remotefs_opendir_write_request( pc->buf, "" );
+      break;
+
+    case LG_STEP_READDIR:
+      remotefs_readdirb_write_request( pc->buf, pc->d, LG_DIR_SIZE );
+      break;
+
+    case LG_STEP_CLOSEDIR:
+      remotefs_closedir_write_request( pc->buf, pc->d );
+      break;
+
+    case LG_STEP_CLOSE_WRITE:
+    case LG_STEP_CLOSE:
+      remotefs_close_write_request( pc->buf, pc->fd );
+      break;
+  }
+}
+
+// Check the response of the current step and go to the next step, return 0
+// if the response is wrong
+static int lg_response( LG_CLIENT *pc )
+{
+  int res;
+  u32 size, fsize, ftime;
+  s32 offset;
+  u8 version, seq, method, nentries;
+  const u8 *pdata;
+  const char *name;
+
+  switch( pc->step )
+  {
+    case LG_STEP_VERSION:
+      if( remotefs_version_read_response( pc->buf, &version ) == ELUARPC_ERR || version < RFS_PROTOCOL_VERSION )
+        return 0;
+      break;
+
+    case LG_STEP_CREATE:
+    case LG_STEP_OPEN:
+      if( remotefs_open_read_response( pc->buf, &pc->fd ) == ELUARPC_ERR || pc->fd < 0 )
+        return 0;
+      pc->pos = 0;
+      break;
+
+    case LG_STEP_WRITE:
+      if( remotefs_writez_read_response( pc->buf, &size ) == ELUARPC_ERR || size != pc->count )
+        return 0;
+      if( ( pc->pos += size ) < lg_bytes )
+        return 1;
+      break;
+
+    case LG_STEP_READ:
+      if( remotefs_preadz_read_response( pc->buf, &seq, &offset, &method, &pdata, &size ) == ELUARPC_ERR || offset != ( s32 )pc->pos )
+        return 0;
+      if( method == RFS_COMPRESS_LZF && size > 0 )
+      {
+        size = lzf_decompress( pdata, size, lg_zbuf, LG_READ_SIZE );
+        pdata = lg_zbuf;
+      }
+      if( pc->pos + size > lg_bytes || ( size > 0 && memcmp( pdata, pc->data + pc->pos, size ) ) )
+        return 0;
+      pc->pos += size;
+      if( size > 0 )
+        return 1;
+      if( pc->pos != lg_bytes )
+        return 0;
+      break;
+
+    case LG_STEP_BAD_FD:
+      if( remotefs_lseek_read_response( pc->buf, &offset ) == ELUARPC_ERR || offset != -1 )
+        return 0;
+      break;
+
+    case LG_STEP_STAT:
+      if( remotefs_stat_read_response( pc->buf, &res, &fsize, &ftime ) == ELUARPC_ERR || res == -1 || fsize != lg_bytes )
+        return 0;
+      break;
+
+    case LG_STEP_OPENDIR:
+      if( remotefs_opendir_read_response( pc->buf, &pc->d ) == ELUARPC_ERR || pc->d == 0 )
+        return 0;
+      pc->found = 0;
+      break;
+
+    case LG_STEP_READDIR:
+      if( remotefs_readdirb_read_response( pc->buf, &nentries, &pdata, &size ) == ELUARPC_ERR )
+        return 0;
+      if( nentries == 0 )
+      {
+        // The directory must have the client file
+        if( !pc->found )
+          return 0;
+        break;
+      }
+      while( nentries -- > 0 )
+      {
+        pdata = remotefs_readdirb_get_entry( pdata, &name, &fsize, &ftime );
+        if( !strcmp( name, pc->fname ) && fsize == lg_bytes )
+          pc->found = 1;
+      }
+      return 1;
+
+    case LG_STEP_CLOSEDIR:
+      if( remotefs_closedir_read_response( pc->buf, &res ) == ELUARPC_ERR || res != 0 )
+        return 0;
+      break;
+
+    case LG_STEP_CLOSE_WRITE:
+    case LG_STEP_CLOSE:
+      if( remotefs_close_read_response( pc->buf, &res ) == ELUARPC_ERR || res != 0 )
+        return 0;
+      break;
+  }
+  pc->step ++;
+  return 1;
+}
+
+// ****************************************************************************
+// Transports
+
+// Connect to '<host>:<port>'
+static NET_SOCKET lg_connect( const char *s, int type )
+{
+  const char *c;
+  char *host;
+  long port;
+  struct hostent *h;
+  struct sockaddr_in addr;
+  NET_SOCKET sock;
+
+  if( ( c = strrchr( s, ':' ) ) == NULL || secure_atoi( c + 1, &port ) == 0 )
+  {
+    log_err( "Invalid network transport syntax\n" );
+    return INVALID_SOCKET_VALUE;
+  }
+  host = l_strndup( s, c - s );
+  h = gethostbyname( host );
+  free( host );
+  if( h == NULL )
+  {
+    log_err( "Unknown host in %s\n", s );
+    return INVALID_SOCKET_VALUE;
+  }
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sin_family = AF_INET;
+  memcpy( &addr.sin_addr, h->h_addr, sizeof( addr.sin_addr ) );
+  addr.sin_port = htons( ( u16 )port );
+  if( ( sock = net_create_socket( AF_INET, type, 0 ) ) == INVALID_SOCKET_VALUE )
+  {
+    log_err( "Unable to create socket\n" );
+    return INVALID_SOCKET_VALUE;
+  }
+  if( connect( net_socket( sock ), ( struct sockaddr* )&addr, sizeof( addr ) ) < 0 )
+  {
+    log_err( "Unable to connect to %s\n", s );
+    net_close( sock );
+    return INVALID_SOCKET_VALUE;
+  }
+  return sock;
+}
+
+// Open a serial port given as '<sername>,<serspeed>'
+static ser_handler lg_open_serial( const char *s )
+{
+  const char *c;
+  char *portname;
+  long speed;
+  ser_handler ser;
+
+  if( ( c = strchr( s, ',' ) ) == NULL || secure_atoi( c + 1, &speed ) == 0 )
+  {
+    log_err( "Invalid serial transport syntax\n" );
+    return SER_HANDLER_INVALID;
+  }
+  portname = l_strndup( s, c - s );
+  if( ( ser = ser_open( portname ) ) == SER_HANDLER_INVALID )
+    log_err( "Cannot open port %s\n", portname );
+  else if( ser_setup( ser, ( u32 )speed, SER_DATABITS_8, SER_PARITY_NONE, SER_STOPBITS_1, SER_FLOW_NONE ) != SER_OK )
+  {
+    log_err( "Unable to initialize serial port %s\n", portname );
+    ser_close( ser );
+    ser = SER_HANDLER_INVALID;
+  }
+  free( portname );
+  return ser;
+}
+
+// Create a client on a transport
+static int lg_new_client( const char *s )
+{
+  LG_CLIENT *pc;
+
+  if( lg_num_clients == LG_MAX_CLIENTS )
+  {
+    log_err( "Too many clients, maximum is %d\n", LG_MAX_CLIENTS );
+    return 0;
+  }
+  if( ( pc = ( LG_CLIENT* )malloc( sizeof( LG_CLIENT ) ) ) == NULL || ( memset( pc, 0, sizeof( LG_CLIENT ) ), pc->data = lg_make_data( lg_num_clients ) ) == NULL )
+  {
+    log_err( "Not enough memory\n" );
+    return 0;
+  }
+  pc->ser = SER_HANDLER_INVALID;
+  pc->sock = INVALID_SOCKET_VALUE;
+  sprintf( pc->fname, "load%03u.txt", lg_num_clients );
+  lg_clients[ lg_num_clients ++ ] = pc;
+  if( strstr( s, "ser:" ) == s )
+  {
+    pc->type = LG_TRANSPORT_SER;
+    return ( pc->ser = lg_open_serial( s + strlen( "ser:" ) ) ) != SER_HANDLER_INVALID;
+  }
+  if( strstr( s, "udp:" ) == s || strstr( s, "tcp:" ) == s )
+  {
+    pc->type = strstr( s, "udp:" ) == s ? LG_TRANSPORT_UDP : LG_TRANSPORT_TCP;
+    pc->sock = lg_connect( s + strlen( "udp:" ), pc->type == LG_TRANSPORT_UDP ? SOCK_DGRAM : SOCK_STREAM );
+    return pc->sock != INVALID_SOCKET_VALUE;
+  }
+  log_err( "Error: unsupported transport\n" );
+  return 0;
+}
+
+// ****************************************************************************
+// Program entry point
+
+#define CLIENTS_ARG_IDX       1
+#define BYTES_ARG_IDX         2
+#define FIRST_TRANSPORT_IDX   3
+#define MIN_ARGC_COUNT        4
+
+int main( int argc, const char **argv )
+{
+  long nclients, bytes;
+  int i, failed = 0;
+  unsigned j, active;
+  u32 t;
+  LG_CLIENT *pc;
+
+  setvbuf( stdout, NULL, _IONBF, 0 );
+  if( argc > 1 && !strcmp( argv[ argc - 1 ], "-v" ) )
+  {
+    argc --;
+    log_init( LOG_ALL );
+  }
+  else
+    log_init( LOG_NONE );
+  if( argc < MIN_ARGC_COUNT || secure_atoi( argv[ CLIENTS_ARG_IDX ], &nclients ) == 0 || nclients < 1 ||
+      secure_atoi( argv[ BYTES_ARG_IDX ], &bytes ) == 0 || bytes < 1 )
+  {
+    log_err( "Usage: %s <clients> <bytes> <transport> [<transport>] ... [-v]\n", argv[ 0 ] );
+    log_err( "  Serial transport: 'ser:<sername>,<serspeed>' (a single client)\n" );
+    log_err( "  UDP transport: 'udp:<host>:<port>' (<clients> clients)\n" );
+    log_err( "  TCP transport: 'tcp:<host>:<port>' (<clients> clients)\n" );
+    log_err( "Each client writes, reads back, checks and lists a file of <bytes> bytes.\n" );
+    log_err( "Use -v for verbose output.\n" );
+    return 1;
+  }
+  lg_bytes = ( u32 )bytes;
+  if( net_init() == 0 )
+  {
+    log_err( "Unable to initialize network\n" );
+    return 1;
+  }
+  for( i = FIRST_TRANSPORT_IDX; i < argc; i ++ )
+    for( j = 0; j < ( strstr( argv[ i ], "ser:" ) == argv[ i ] ? 1 : ( unsigned )nclients ); j ++ )
+      if( lg_new_client( argv[ i ] ) == 0 )
+        return 1;
+  printf( "Running %u clients with %u byte files\n", lg_num_clients, ( unsigned )lg_bytes );
+
+  // All the clients send their next request, then wait for the responses, so
+  // the server always has a request from every client that isn't done
+  t = lg_time();
+  do
+  {
+    active = 0;
+    for( j = 0; j < lg_num_clients; j ++ )
+      if( ( pc = lg_clients[ j ] )->step != LG_STEP_DONE )
+      {
+        lg_request( pc );
+        if( lg_send( pc ) == 0 )
+        {
+          log_err( "Client %u: unable to send the request of step %d\n", j, pc->step );
+          pc->step = LG_STEP_DONE;
+          failed ++;
+        }
+      }
+    for( j = 0; j < lg_num_clients; j ++ )
+      if( ( pc = lg_clients[ j ] )->step != LG_STEP_DONE )
+      {
+        if( lg_recv( pc ) == 0 || lg_response( pc ) == 0 )
+        {
+          log_err( "Client %u: invalid response in step %d\n", j, pc->step );
+          pc->step = LG_STEP_DONE;
+          failed ++;
+        }
+        else
+        {
+          log_msg( "Client %u: step %d\n", j, pc->step );
+          active ++;
+        }
+      }
+  } while( active > 0 );
+  t = lg_time() - t;
+  if( t == 0 )
+    t = 1;
+
+  printf( "%u requests (%u bytes) in %u ms: %u requests/s, %u file bytes/s\n", ( unsigned )lg_requests, ( unsigned )lg_traffic,
+          ( unsigned )t, ( unsigned )( lg_requests * 1000.0 / t ), ( unsigned )( 2.0 * lg_bytes * lg_num_clients * 1000.0 / t ) );
+  printf( "%d client(s) failed\n", failed );
+  return failed ? 1 : 0;
+}
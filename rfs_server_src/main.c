@@ -20,26 +20,15 @@
 #ifdef RFS_STANDALONE_MODE
 int main( int argc, const char **argv )
 {  
+  int res;
+
   // Initialize data
   if( rfs_init( argc, argv ) != 0 )
     return 1;
   
-  // 'mem' transport doesn't work in this mode
-  if( p_transport_data == &mem_transport_data )
-  {
-    log_err( "Invalid transport in standalone mode.\n" );
-    return 1;
-  }
-  
-  // Enter the server endless loop
-  while( 1 )
-  {
-    p_transport_data->f_read_request();
-    server_execute_request( rfs_buffer );
-    p_transport_data->f_send_response();
-  }
-
-  p_transport_data->f_cleanup();
-  return 0;
+  // Enter the server endless loop (the 'mem' transport doesn't work in this mode)
+  res = rfs_serve();
+  rfs_cleanup();
+  return res;
 }
 #endif
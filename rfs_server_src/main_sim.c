@@ -1,6 +1,7 @@
 // Remote FS server
 
 #include "remotefs.h"
+#include "eluarpc.h"
 #include "server.h"
 #include "type.h"
 #include "log.h"
@@ -14,21 +15,35 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include "rfs_transports.h"
 
 // ****************************************************************************
 // Local variables
 
-#define   MAX_PACKET_SIZE     4096
-
-static u8 rfs_buffer[ MAX_PACKET_SIZE + RFS_WRITE_REQUEST_EXTRA ]; 
 static int rfs_read_fd;
 static int rfs_write_fd;
+static SERVER_CLIENT *rfs_client;
 
 // ****************************************************************************
 // Helpers
 
-// Read a packet from the serial port
-static void read_request_packet()
+// Read from the pipe (a read can return only a part of the data)
+static u32 read_pipe( u8 *dest, u32 size )
+{
+  u32 readbytes = 0;
+  int res;
+
+  while( readbytes < size )
+  {
+    if( ( res = read( rfs_read_fd, dest + readbytes, size - readbytes ) ) <= 0 )
+      break;
+    readbytes += ( u32 )res;
+  }
+  return readbytes;
+}
+
+// Read a packet from the pipe, return 0 if the simulator closed the pipe
+static int read_request_packet()
 {
   u16 temp16;
   u32 readbytes;
@@ -36,36 +51,38 @@ static void read_request_packet()
   while( 1 )
   {
     // First read the length
-    if( ( readbytes = read( rfs_read_fd, rfs_buffer, RFS_START_OFFSET ) ) != RFS_START_OFFSET )
+    if( ( readbytes = read_pipe( rfs_buffer, ELUARPC_START_OFFSET ) ) != ELUARPC_START_OFFSET )
     {
-//      log_msg( "read_request_packet: ERROR reading packet length. Requested %d bytes, got %d bytes\n", RFS_START_OFFSET, readbytes );
+      if( readbytes == 0 )
+        return 0;
+      log_msg( "read_request_packet: ERROR reading packet length. Requested %d bytes, got %d bytes\n", ELUARPC_START_OFFSET, ( int )readbytes );
       continue;
     }
 
-    if( remotefs_get_packet_size( rfs_buffer, &temp16 ) == REMOTEFS_ERR )
+    if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) == ELUARPC_ERR )
     {
-      // log_msg( "read_request_packet: ERROR getting packet size.\n" );
+      log_msg( "read_request_packet: ERROR getting packet size.\n" );
       continue;
     }
 
     // Then the rest of the data
-    if( ( readbytes = read( rfs_read_fd, rfs_buffer + RFS_START_OFFSET, temp16 - RFS_START_OFFSET ) ) != temp16 - RFS_START_OFFSET )
+    if( ( readbytes = read_pipe( rfs_buffer + ELUARPC_START_OFFSET, temp16 - ELUARPC_START_OFFSET ) ) != temp16 - ELUARPC_START_OFFSET )
     {
-      // log_msg( "read_request_packet: ERROR reading full packet, got %u bytes, expected %u bytes\n", ( unsigned )readbytes, ( unsigned )temp16 - RFS_START_OFFSET );
+      log_msg( "read_request_packet: ERROR reading full packet, got %u bytes, expected %u bytes\n", ( unsigned )readbytes, ( unsigned )temp16 - ELUARPC_START_OFFSET );
       continue;
     }
     else
-      break;
+      return 1;
   }
 }
 
-// Send a packet to the serial port
+// Send a packet to the pipe
 static void send_response_packet()
 {
   u16 temp16;
 
   // Send request
-  if( remotefs_get_packet_size( rfs_buffer, &temp16 ) != REMOTEFS_ERR )
+  if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) != ELUARPC_ERR )
   {
     log_msg( "send_response_packet: sending response packet of %u bytes\n", ( unsigned )temp16 );
     write( rfs_write_fd, rfs_buffer, temp16 );
@@ -109,16 +126,20 @@ int main( int argc, const char **argv )
   printf( "Running in SIM mode (pipes)\n" );
 
   // Setup RFS server
-  server_setup( argv[ DIRNAME_ARG_IDX ] );
+  if( ( rfs_client = server_setup( argv[ DIRNAME_ARG_IDX ] ) ) == NULL )
+  {
+    fprintf( stderr, "Not enough memory\n" );
+    return 1;
+  }
 
   // Enter the server endless loop
-  while( 1 )
+  while( read_request_packet() )
   {
-    read_request_packet();
-    server_execute_request( rfs_buffer );
+    server_execute_request( rfs_client, rfs_buffer );
     send_response_packet();
   }
 
+  server_cleanup( rfs_client );
   close( rfs_write_fd );
   close( rfs_read_fd );
   unlink( RFS_SRV_READ_PIPE );
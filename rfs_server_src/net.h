@@ -25,6 +25,7 @@ typedef HANDLE net_sync_object;
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <sys/select.h>
 typedef int NET_SOCKET;
@@ -38,6 +39,7 @@ typedef int net_sync_object;
 int net_init();
 NET_SOCKET net_create_socket( int domain, int type, int protocol );
 net_ssize_t net_recvfrom( NET_SOCKET s, void *buf, size_t len, int flags, struct sockaddr* from, socklen_t *fromlen, int timeout );
+NET_SOCKET net_accept( NET_SOCKET s, struct sockaddr *addr, socklen_t *addrlen );
 net_ssize_t net_sendto( NET_SOCKET s, const void *buf, size_t len, int flags, const struct sockaddr *to, socklen_t tolen );
 int net_close( NET_SOCKET s );
 net_sync_object net_get_sync_object( NET_SOCKET s );
@@ -27,13 +27,18 @@ net_ssize_t net_recvfrom( NET_SOCKET s, void *buf, size_t len, int flags, struct
   
   FD_ZERO( &fds );
   FD_SET( s, &fds );
-  tv.tv_sec = timeout / 1000000;
-  tv.tv_usec = ( timeout % 1000000 ) * 1000;
+  tv.tv_sec = timeout / 1000;
+  tv.tv_usec = ( timeout % 1000 ) * 1000;
   if( select( s + 1, &fds, NULL, NULL, timeout == NET_INF_TIMEOUT ? NULL : &tv ) <= 0 )
     return 0;
   return recvfrom( s, buf, len, flags, from, fromlen );      
 }
 
+NET_SOCKET net_accept( NET_SOCKET s, struct sockaddr *addr, socklen_t *addrlen )
+{
+  return accept( s, addr, addrlen );
+}
+
 net_ssize_t net_sendto( NET_SOCKET s, const void *buf, size_t len, int flags, const struct sockaddr *to, socklen_t tolen )
 {
   return sendto( s, buf, len, flags, to, tolen );
@@ -22,13 +22,11 @@ int net_init()
   return 1;
 }
 
-NET_SOCKET net_create_socket( int domain, int type, int protocol )
+// Helper: create the socket data of a socket
+static NET_SOCKET net_new_socket_data( SOCKET s )
 {
-  SOCKET s;
   NET_SOCKET d;
-  
-  if( ( s = WSASocket( domain, type, protocol, NULL, 0, WSA_FLAG_OVERLAPPED ) ) == INVALID_SOCKET )
-    return INVALID_SOCKET_VALUE;
+
   if( ( d = malloc( sizeof( NET_DATA ) ) ) == NULL )
   {
     closesocket( s );
@@ -39,11 +37,30 @@ NET_SOCKET net_create_socket( int domain, int type, int protocol )
   if( ( d->o.hEvent = CreateEvent( NULL, TRUE, FALSE, NULL ) ) == NULL )
   {
     closesocket( s );
+    free( d );
     return INVALID_SOCKET_VALUE;
   }
   return d;  
 }
 
+NET_SOCKET net_create_socket( int domain, int type, int protocol )
+{
+  SOCKET s;
+
+  if( ( s = WSASocket( domain, type, protocol, NULL, 0, WSA_FLAG_OVERLAPPED ) ) == INVALID_SOCKET )
+    return INVALID_SOCKET_VALUE;
+  return net_new_socket_data( s );
+}
+
+NET_SOCKET net_accept( NET_SOCKET s, struct sockaddr *addr, socklen_t *addrlen )
+{
+  SOCKET c;
+
+  if( ( c = accept( s->s, addr, addrlen ) ) == INVALID_SOCKET )
+    return INVALID_SOCKET_VALUE;
+  return net_new_socket_data( c );
+}
+
 net_ssize_t net_recvfrom( NET_SOCKET s, void *buf, size_t len, int flags, struct sockaddr* from, socklen_t *fromlen, int timeout )
 {
   DWORD readbytes = 0;
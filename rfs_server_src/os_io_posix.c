@@ -144,3 +144,14 @@ int os_closedir( u32 d )
   return closedir( ( DIR* )d );
 }
 
+// Return -1 on error or the RFS_STAT_FLAG_xxx flags of the file
+int os_stat( const char *name, u32 *psize, u32 *pftime )
+{
+  struct stat res;
+
+  if( stat( name, &res ) == -1 )
+    return -1;
+  *psize = ( u32 )res.st_size;
+  *pftime = ( u32 )res.st_mtime;
+  return S_ISDIR( res.st_mode ) ? RFS_STAT_FLAG_DIR : 0;
+}
@@ -153,3 +153,15 @@ int os_closedir( u32 d )
 {
   return FindClose( win32_dir_hnd ) == 0 ? -1 : 0;
 }
+
+// Return -1 on error or the RFS_STAT_FLAG_xxx flags of the file
+int os_stat( const char *name, u32 *psize, u32 *pftime )
+{
+  struct _stat res;
+
+  if( _stat( name, &res ) == -1 )
+    return -1;
+  *psize = ( u32 )res.st_size;
+  *pftime = ( u32 )res.st_mtime;
+  return ( res.st_mode & _S_IFDIR ) ? RFS_STAT_FLAG_DIR : 0;
+}
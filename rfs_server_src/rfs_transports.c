@@ -13,191 +13,416 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "rfs.h"
 #include "deskutils.h"
 #include "rfs_transports.h"
+#ifndef WIN32_BUILD
+#include <poll.h>
+#include <signal.h>
+#endif
 
 // ****************************************************************************
 // Local variables
 
+// Transport types
+enum
+{
+  RFS_TRANSPORT_SER,
+  RFS_TRANSPORT_UDP,
+  RFS_TRANSPORT_TCP,
+  RFS_TRANSPORT_MEM
+};
 
-u8 rfs_buffer[ MAX_PACKET_SIZE + ELUARPC_WRITE_REQUEST_EXTRA ];
-const RFS_TRANSPORT_DATA *p_transport_data; 
+// A transport given in the command line
+typedef struct
+{
+  int type;
+  ser_handler ser;
+  NET_SOCKET sock;                // UDP socket or listening TCP socket
+  char *basedir;                  // directory shared with its clients
+} RFS_TRANSPORT;
+
+// A client: the device on a serial port, at an UDP address or on a TCP
+// connection. The request is received in 'buf' and the response is sent
+// from there, 'len' has the bytes received or sent so far and 'size' the
+// size of the packet (0 until its length is received).
+#define RFS_MAX_CLIENT_NAME   63
+
+typedef struct
+{
+  RFS_TRANSPORT *ptrans;
+  NET_SOCKET sock;                // TCP connection
+  struct sockaddr_in addr;        // UDP address
+  SERVER_CLIENT *pserver;
+  u32 lastused;                   // number of the last request, to find the LRU client
+  time_t lastseen;                // time of the last request
+  u16 len;
+  u16 size;
+  int sending;
+  char name[ RFS_MAX_CLIENT_NAME + 1 ];
+  u8 buf[ MAX_BUFFER_SIZE ];
+} RFS_CLIENT;
+
+u8 rfs_buffer[ MAX_BUFFER_SIZE ];
+
+static RFS_TRANSPORT rfs_transports[ RFS_MAX_TRANSPORTS ];
+static unsigned rfs_num_transports;
+static RFS_CLIENT *rfs_clients[ RFS_MAX_CLIENTS ];
+static u32 rfs_num_requests;
+
+// The standalone server waits for all its transports with poll() and reads
+// only the data that is already there. Win32 serves a single serial or UDP
+// transport, so it waits for the data in the read itself.
+#ifdef WIN32_BUILD
+#define RFS_SER_TIMEOUT       SER_INF_TIMEOUT
+#define RFS_NET_TIMEOUT       NET_INF_TIMEOUT
+#define RFS_SEND_FLAGS        0
+#else
+#define RFS_SER_TIMEOUT       SER_NO_TIMEOUT
+#define RFS_NET_TIMEOUT       0
+#define RFS_SEND_FLAGS        MSG_DONTWAIT
+#endif
 
 // ****************************************************************************
-// Serial transport implementation
+// Clients
+
+// Put the name of a network client in 'dest'
+static void client_addr_name( char *dest, const char *type, const struct sockaddr_in *addr )
+{
+  u32 ip = ( u32 )ntohl( addr->sin_addr.s_addr );
 
-static ser_handler ser;
+  sprintf( dest, "%s:%u.%u.%u.%u:%u", type, ( unsigned )( ip >> 24 ) & 0xFF, ( unsigned )( ip >> 16 ) & 0xFF,
+           ( unsigned )( ip >> 8 ) & 0xFF, ( unsigned )ip & 0xFF, ( unsigned )ntohs( addr->sin_port ) );
+}
 
-static void flush_serial()
+// Free a client, closing the files and directories it left open
+static void client_free( RFS_CLIENT *pc )
 {
-  // Flush all data in serial port
-  while( ser_read_byte( ser, SER_NO_TIMEOUT ) != -1 );
+  unsigned i;
+
+  log_msg( "Removing client %s\n", pc->name );
+  for( i = 0; i < RFS_MAX_CLIENTS; i ++ )
+    if( rfs_clients[ i ] == pc )
+      rfs_clients[ i ] = NULL;
+  server_cleanup( pc->pserver );
+  if( pc->sock != INVALID_SOCKET_VALUE )
+    net_close( pc->sock );
+  free( pc );
 }
 
-// Read a packet from the serial port
-static void ser_read_request_packet()
+// Create a client of a transport, return NULL if there are too many clients.
+// An UDP client never says that it's gone, so a new UDP client replaces the
+// UDP client that didn't send a request for the longest time if there's no
+// room (the replaced client loses its open files and directories). A client
+// of another transport replaces it only if it's idle for RFS_UDP_IDLE_TIMEOUT
+// seconds, otherwise it's refused.
+static RFS_CLIENT* client_new( RFS_TRANSPORT *ptrans, const char *name )
 {
-  u16 temp16;
-  u32 readbytes;
+  unsigned i, lru = RFS_MAX_CLIENTS;
+  RFS_CLIENT *pc;
 
-  while( 1 )
+  for( i = 0; i < RFS_MAX_CLIENTS; i ++ )
   {
-    // First read the length
-    if( ( readbytes = ser_read( ser, rfs_buffer, ELUARPC_START_OFFSET, SER_INF_TIMEOUT ) ) != ELUARPC_START_OFFSET )
-    {
-      log_msg( "read_request_packet: ERROR reading packet length. Requested %d bytes, got %d bytes\n", ELUARPC_START_OFFSET, readbytes );
-      flush_serial();
-      continue;
-    }
+    if( ( pc = rfs_clients[ i ] ) == NULL )
+      break;
+    if( pc->ptrans->type == RFS_TRANSPORT_UDP && ( lru == RFS_MAX_CLIENTS || pc->lastused < rfs_clients[ lru ]->lastused ) )
+      lru = i;
+  }
+  if( i == RFS_MAX_CLIENTS )
+  {
+    if( lru == RFS_MAX_CLIENTS )
+      return NULL;
+    if( ptrans->type != RFS_TRANSPORT_UDP && time( NULL ) - rfs_clients[ lru ]->lastseen < RFS_UDP_IDLE_TIMEOUT )
+      return NULL;
+    client_free( rfs_clients[ lru ] );
+    i = lru;
+  }
+  if( ( pc = ( RFS_CLIENT* )malloc( sizeof( RFS_CLIENT ) ) ) == NULL )
+    return NULL;
+  memset( pc, 0, sizeof( RFS_CLIENT ) );
+  if( ( pc->pserver = server_setup( ptrans->basedir ) ) == NULL )
+  {
+    free( pc );
+    return NULL;
+  }
+  pc->ptrans = ptrans;
+  pc->sock = INVALID_SOCKET_VALUE;
+  pc->lastseen = time( NULL );
+  strncpy( pc->name, name, RFS_MAX_CLIENT_NAME );
+  rfs_clients[ i ] = pc;
+  log_msg( "New client %s, sharing directory %s\n", pc->name, ptrans->basedir );
+  return pc;
+}
 
-    if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) == ELUARPC_ERR )
-    {
-      log_msg( "read_request_packet: ERROR getting packet size.\n" );
-      flush_serial();
-      continue;
-    }
+// Number of bytes still needed to complete the length or the request packet
+static u32 client_wanted( const RFS_CLIENT *pc )
+{
+  return ( pc->size ? pc->size : ELUARPC_START_OFFSET ) - pc->len;
+}
 
-    // Then the rest of the data
-    if( ( readbytes = ser_read( ser, rfs_buffer + ELUARPC_START_OFFSET, temp16 - ELUARPC_START_OFFSET, SER_INF_TIMEOUT ) ) != temp16 - ELUARPC_START_OFFSET )
+// Send what's left of the response of a client, return 0 on error
+static int client_send( RFS_CLIENT *pc )
+{
+  u32 size = pc->size - pc->len;
+  net_ssize_t res;
+
+  switch( pc->ptrans->type )
+  {
+    case RFS_TRANSPORT_SER:
+      size = ser_write_nowait( pc->ptrans->ser, pc->buf + pc->len, size );
+      break;
+
+    case RFS_TRANSPORT_UDP:
+      net_sendto( pc->ptrans->sock, ( char* )pc->buf, size, 0, ( struct sockaddr* )&pc->addr, sizeof( pc->addr ) );
+      break;
+
+    case RFS_TRANSPORT_TCP:
+      if( ( res = net_sendto( pc->sock, ( char* )pc->buf + pc->len, size, RFS_SEND_FLAGS, NULL, 0 ) ) < 0 )
+      {
+        if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+          return 0;
+        res = 0;
+      }
+      size = ( u32 )res;
+      break;
+  }
+  pc->len += size;
+  if( pc->len == pc->size )
+  {
+    pc->sending = 0;
+    pc->len = pc->size = 0;
+  }
+  return 1;
+}
+
+// Got 'size' more bytes for a client, execute the request when it's complete
+// and start sending the response. Returns 0 if the packet is invalid.
+static int client_received( RFS_CLIENT *pc, u32 size )
+{
+  pc->len += size;
+  if( pc->size == 0 )
+  {
+    if( pc->len < ELUARPC_START_OFFSET )
+      return 1;
+    if( eluarpc_get_packet_size( pc->buf, &pc->size ) == ELUARPC_ERR || pc->size <= ELUARPC_START_OFFSET || pc->size > MAX_BUFFER_SIZE )
     {
-      log_msg( "read_request_packet: ERROR reading full packet, got %u bytes, expected %u bytes\n", ( unsigned )readbytes, ( unsigned )temp16 - ELUARPC_START_OFFSET );
-      flush_serial();
-      continue;
+      log_msg( "%s: ERROR getting packet size.\n", pc->name );
+      pc->len = pc->size = 0;
+      return 0;
     }
-    else
-      break;
   }
+  if( pc->len < pc->size )
+    return 1;
+
+  // Execute the request, the response replaces it in the buffer (an unknown
+  // request is sent back as it is)
+  pc->lastused = ++ rfs_num_requests;
+  pc->lastseen = time( NULL );
+  server_execute_request( pc->pserver, pc->buf );
+  pc->len = 0;
+  if( eluarpc_get_packet_size( pc->buf, &pc->size ) == ELUARPC_ERR )
+  {
+    log_msg( "%s: ERROR in send_response_packet!\n", pc->name );
+    pc->size = 0;
+    return 1;
+  }
+  log_msg( "%s: sending response packet of %u bytes\n", pc->name, ( unsigned )pc->size );
+  pc->sending = 1;
+  return client_send( pc );
 }
 
-// Send a packet to the serial port
-static void ser_send_response_packet()
+// ****************************************************************************
+// Serial transport implementation
+
+static void flush_serial( ser_handler ser )
 {
-  u16 temp16;
+  // Flush all data in serial port
+  while( ser_read_byte( ser, SER_NO_TIMEOUT ) != -1 );
+}
+
+// Read the request data from a serial port, return 0 if the port is lost
+static int ser_read_request( RFS_CLIENT *pc )
+{
+  u32 wanted = client_wanted( pc );
+  u32 readbytes;
 
-  // Send request
-  if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) != ELUARPC_ERR )
+  if( ( readbytes = ser_read( pc->ptrans->ser, pc->buf + pc->len, wanted, RFS_SER_TIMEOUT ) ) == 0 || readbytes > wanted )
   {
-    log_msg( "send_response_packet: sending response packet of %u bytes\n", ( unsigned )temp16 );
-    ser_write( ser, rfs_buffer, temp16 );
+    log_err( "Error reading serial port %s\n", pc->name );
+    return 0;
   }
+  if( client_received( pc, readbytes ) == 0 )
+    flush_serial( pc->ptrans->ser );
+  return 1;
 }
 
-static int ser_server_init( const char *portname, int serspeed, int flow )
+static int ser_server_init( RFS_TRANSPORT *ptrans, const char *portname, int serspeed, int flow )
 {
   // Setup serial port
-  if( ( ser = ser_open( portname ) ) == SER_HANDLER_INVALID )
+  if( ( ptrans->ser = ser_open( portname ) ) == SER_HANDLER_INVALID )
   {
     log_err( "Cannot open port %s\n", portname );
     return 0;
   }
-  if( ser_setup( ser, ( u32 )serspeed, SER_DATABITS_8, SER_PARITY_NONE, SER_STOPBITS_1, flow ) != SER_OK )
+  if( ser_setup( ptrans->ser, ( u32 )serspeed, SER_DATABITS_8, SER_PARITY_NONE, SER_STOPBITS_1, flow ) != SER_OK )
   {
     log_err( "Unable to initialize serial port\n" );
     return 0;
-  }  
-  flush_serial();
-  
+  }
+  flush_serial( ptrans->ser );
+
+  // The device on the port is the only client of the transport
+  if( client_new( ptrans, portname ) == NULL )
+  {
+    log_err( "Too many clients\n" );
+    return 0;
+  }
+
   // User report
   log_msg( "Running RFS server on serial port %s (%u baud).\n", portname, ( unsigned )serspeed );
-  return 1; 
-}
-
-static void ser_cleanup()
-{
-  ser_close( ser );
+  return 1;
 }
 
-const RFS_TRANSPORT_DATA ser_transport_data = { ser_read_request_packet, ser_send_response_packet, ser_cleanup };
-
 // ****************************************************************************
 // UDP transport implementation
 
-static NET_SOCKET trans_socket = INVALID_SOCKET_VALUE;
-static struct sockaddr_in trans_from;
-
-// Helper: read (blocking) the specified number of bytes
-
-static void udp_read_helper( u8 *dest, u32 size )
+// Find the client at the given address, creating it if needed
+static RFS_CLIENT* udp_get_client( RFS_TRANSPORT *ptrans, const struct sockaddr_in *addr )
 {
-  socklen_t fromlen;
-  int readbytes;
+  unsigned i;
+  RFS_CLIENT *pc;
+  char name[ RFS_MAX_CLIENT_NAME + 1 ];
+
+  for( i = 0; i < RFS_MAX_CLIENTS; i ++ )
+    if( ( pc = rfs_clients[ i ] ) != NULL && pc->ptrans == ptrans &&
+        pc->addr.sin_addr.s_addr == addr->sin_addr.s_addr && pc->addr.sin_port == addr->sin_port )
+      return pc;
+  client_addr_name( name, "udp", addr );
+  if( ( pc = client_new( ptrans, name ) ) == NULL )
+    log_msg( "Too many clients, ignoring the request from %s\n", name );
+  else
+    pc->addr = *addr;
+  return pc;
+}
 
-  while( size )
+// Read a datagram, which has a part of a request, a request or more requests
+static void udp_read_request( RFS_TRANSPORT *ptrans )
+{
+  static u8 data[ MAX_BUFFER_SIZE ];
+  struct sockaddr_in from;
+  socklen_t fromlen = sizeof( from );
+  net_ssize_t size;
+  u32 wanted;
+  const u8 *p = data;
+  RFS_CLIENT *pc;
+
+  if( ( size = net_recvfrom( ptrans->sock, ( char* )data, MAX_BUFFER_SIZE, 0, ( struct sockaddr* )&from, &fromlen, RFS_NET_TIMEOUT ) ) <= 0 )
+    return;
+  if( ( pc = udp_get_client( ptrans, &from ) ) == NULL )
+    return;
+  while( size > 0 )
   {
-    fromlen = sizeof( trans_from );
-    readbytes = net_recvfrom( trans_socket, ( char* )dest, size, 0, ( struct sockaddr* )&trans_from, &fromlen, NET_INF_TIMEOUT );
-    size -= readbytes;
-    if( size == 0 )
+    if( ( wanted = client_wanted( pc ) ) > ( u32 )size )
+      wanted = ( u32 )size;
+    memcpy( pc->buf + pc->len, p, wanted );
+    if( client_received( pc, wanted ) == 0 )
       break;
-    dest += readbytes;
+    p += wanted;
+    size -= ( net_ssize_t )wanted;
   }
 }
 
-static void udp_read_request_packet()
+static int udp_server_init( RFS_TRANSPORT *ptrans, unsigned server_port )
 {
-  u16 temp16;
- 
-  while( 1 )
+  int length;
+  struct sockaddr_in server;
+
+  if( ( ptrans->sock = net_create_socket( AF_INET, SOCK_DGRAM, 0 ) ) == INVALID_SOCKET_VALUE )
   {
-    // First read the length
-    udp_read_helper( rfs_buffer, ELUARPC_START_OFFSET );
+    log_err( "Unable to create socket\n" );
+    return 0;
+  }
+  length = sizeof( server );
+  memset( &server, 0, sizeof( server ) );
+  server.sin_family = AF_INET;
+  server.sin_addr.s_addr = INADDR_ANY;
+  server.sin_port = htons( server_port );
+  if( bind( net_socket( ptrans->sock ), ( struct sockaddr * )&server, length ) < 0 )
+  {
+   log_err( "Unable to bind socket\n" );
+   return 0;
+  }
+  log_msg( "Running RFS server on UDP port %u.\n", ( unsigned )server_port );
+  return 1;
+}
 
-    if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) == ELUARPC_ERR )
-    {
-      log_msg( "read_request_packet: ERROR getting packet size.\n" );
-      continue;
-    }
+// ****************************************************************************
+// TCP transport implementation
 
-    // Then the rest of the data
-    udp_read_helper( rfs_buffer + ELUARPC_START_OFFSET, temp16 - ELUARPC_START_OFFSET );
-    break;
+// Accept a connection, which becomes a new client
+static void tcp_accept( RFS_TRANSPORT *ptrans )
+{
+  struct sockaddr_in from;
+  socklen_t fromlen = sizeof( from );
+  NET_SOCKET sock;
+  RFS_CLIENT *pc;
+  char name[ RFS_MAX_CLIENT_NAME + 1 ];
+  int on = 1;
+
+  if( ( sock = net_accept( ptrans->sock, ( struct sockaddr* )&from, &fromlen ) ) == INVALID_SOCKET_VALUE )
+    return;
+  client_addr_name( name, "tcp", &from );
+  if( ( pc = client_new( ptrans, name ) ) == NULL )
+  {
+    log_err( "Too many clients, closing the connection from %s\n", name );
+    net_close( sock );
+    return;
   }
+  // The requests and responses are small, send them right away
+  setsockopt( net_socket( sock ), IPPROTO_TCP, TCP_NODELAY, ( const char* )&on, sizeof( on ) );
+  pc->sock = sock;
 }
 
-static void udp_send_response_packet()
+// Read the request data from a connection, return 0 if it's closed
+static int tcp_read_request( RFS_CLIENT *pc )
 {
-  u16 temp16;
-  
-  // Send request
-  if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) != ELUARPC_ERR )
-  {
-    log_msg( "send_response_packet: sending response packet of %u bytes\n", ( unsigned )temp16 );
-    net_sendto( trans_socket, ( char* )rfs_buffer, temp16, 0, ( struct sockaddr* )&trans_from, sizeof( trans_from ) );
-  }  
+  u32 wanted = client_wanted( pc );
+  net_ssize_t readbytes;
+
+  if( ( readbytes = net_recvfrom( pc->sock, ( char* )pc->buf + pc->len, wanted, 0, NULL, NULL, RFS_NET_TIMEOUT ) ) <= 0 )
+    return 0;
+  return client_received( pc, ( u32 )readbytes );
 }
 
-static int udp_server_init( unsigned server_port )
+static int tcp_server_init( RFS_TRANSPORT *ptrans, unsigned server_port )
 {
-  int length;
   struct sockaddr_in server;
-     
-  if( ( trans_socket = net_create_socket( AF_INET, SOCK_DGRAM, 0 ) ) == INVALID_SOCKET_VALUE )
+  int on = 1;
+
+  if( ( ptrans->sock = net_create_socket( AF_INET, SOCK_STREAM, 0 ) ) == INVALID_SOCKET_VALUE )
   {
     log_err( "Unable to create socket\n" );
-    return 1;
+    return 0;
   }
-  length = sizeof( server );
+  setsockopt( net_socket( ptrans->sock ), SOL_SOCKET, SO_REUSEADDR, ( const char* )&on, sizeof( on ) );
   memset( &server, 0, sizeof( server ) );
   server.sin_family = AF_INET;
   server.sin_addr.s_addr = INADDR_ANY;
   server.sin_port = htons( server_port );
-  if( bind( net_socket( trans_socket ), ( struct sockaddr * )&server, length ) < 0 )
+  if( bind( net_socket( ptrans->sock ), ( struct sockaddr * )&server, sizeof( server ) ) < 0 || listen( net_socket( ptrans->sock ), RFS_MAX_CLIENTS ) < 0 )
   {
-   log_err( "Unable to bind socket\n" );
-   return 0; 
+    log_err( "Unable to bind socket\n" );
+    return 0;
   }
-  log_msg( "Running RFS server on UDP port %u.\n", ( unsigned )server_port );
-  return 1;    
-}
-
-static void udp_cleanup()
-{
-  net_close( trans_socket );
+#ifndef WIN32_BUILD
+  // A client that closes its connection must not stop the server
+  signal( SIGPIPE, SIG_IGN );
+#endif
+  log_msg( "Running RFS server on TCP port %u.\n", ( unsigned )server_port );
+  return 1;
 }
 
-const RFS_TRANSPORT_DATA udp_transport_data = { udp_read_request_packet, udp_send_response_packet, udp_cleanup };
-
 // ****************************************************************************
 // Memory transport implementation
 
@@ -213,6 +438,7 @@ static int mem_read_len;
 static int mem_expected_len;
 static int mem_read_state;
 static int mem_response_flag;
+static SERVER_CLIENT *mem_client;
 
 void rfs_mem_start_request()
 {
@@ -225,13 +451,13 @@ int rfs_mem_read_request_packet( int c )
 {
   u16 temp16;
   int res = 1;
-  
+
   if( c == -1 )
   {
     rfs_mem_start_request();
     return 0;
   }
-  
+
   switch( mem_read_state )
   {
     case MEM_STATE_READ_LENGTH:
@@ -239,7 +465,7 @@ int rfs_mem_read_request_packet( int c )
       if( mem_read_len == ELUARPC_START_OFFSET )
       {
         mem_read_len = 0;
-        if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) == ELUARPC_ERR )
+        if( eluarpc_get_packet_size( rfs_buffer, &temp16 ) == ELUARPC_ERR || temp16 <= ELUARPC_START_OFFSET || temp16 > MAX_BUFFER_SIZE )
         {
           log_msg( "RFS read_request_packet: ERROR getting packet size.\n" );
           mem_read_state = MEM_STATE_REQUEST_DONE;
@@ -249,21 +475,21 @@ int rfs_mem_read_request_packet( int c )
         {
           mem_read_state = MEM_STATE_READ_REQUEST;
           mem_expected_len = temp16 - ELUARPC_START_OFFSET;
-        }        
+        }
       }
       break;
-      
+
     case MEM_STATE_READ_REQUEST:
       rfs_buffer[ ELUARPC_START_OFFSET + mem_read_len ] = c;
       mem_read_len ++;
-      if( mem_read_len == mem_expected_len )  
+      if( mem_read_len == mem_expected_len )
       {
         mem_read_state = MEM_STATE_REQUEST_DONE;
         mem_response_flag = 1;
-      }     
+      }
       break;
   }
-  
+
   return res;
 }
 
@@ -273,16 +499,16 @@ int rfs_mem_has_response()
 }
 
 void rfs_mem_write_response( u16 *plen, u8 **pdata )
-{  
-  // Execute request  
-  server_execute_request( rfs_buffer );
-  
+{
+  // Execute request
+  server_execute_request( mem_client, rfs_buffer );
+
   // Send response
   if( eluarpc_get_packet_size( rfs_buffer, plen ) != ELUARPC_ERR )
   {
     log_msg( "send_response_packet: sending response packet of %u bytes\n", ( unsigned )*plen );
-    *pdata = rfs_buffer;    
-  } 
+    *pdata = rfs_buffer;
+  }
   else
   {
     log_msg( "ERROR in send_response_packet!\n" );
@@ -290,48 +516,76 @@ void rfs_mem_write_response( u16 *plen, u8 **pdata )
   }
 }
 
-static int mem_server_init()
+static int mem_server_init( RFS_TRANSPORT *ptrans )
 {
-  rfs_mem_start_request();  
+  if( ( mem_client = server_setup( ptrans->basedir ) ) == NULL )
+    return 0;
+  rfs_mem_start_request();
   log_msg( "RFS: using memory transport.\n" );
-  return 1;   
+  return 1;
 }
 
-const RFS_TRANSPORT_DATA mem_transport_data = { NULL, NULL, NULL };
-
 // ****************************************************************************
 // Helper functions
 
-// Transport parser
-static int parse_transport_and_init( const char* s )
+// Transport parser. The transport shares 'dirname', unless it's followed by
+// '=<dirname>'.
+static int parse_transport_and_init( const char* arg, const char *dirname )
 {
   const char *c, *c2;
-  char *temps, *tempb;
+  char *s, *temps, *tempb;
   long tempi = 0;
-  int flow;
-  
+  int flow, res = 0;
+  RFS_TRANSPORT *ptrans;
+
+  if( rfs_num_transports == RFS_MAX_TRANSPORTS )
+  {
+    log_err( "Too many transports, maximum is %d\n", RFS_MAX_TRANSPORTS );
+    return 0;
+  }
+  ptrans = rfs_transports + rfs_num_transports;
+  ptrans->ser = SER_HANDLER_INVALID;
+  ptrans->sock = INVALID_SOCKET_VALUE;
+  if( ( c = strchr( arg, '=' ) ) != NULL )
+  {
+    dirname = c + 1;
+    s = l_strndup( arg, c - arg );
+  }
+  else
+    s = l_strndup( arg, strlen( arg ) );
+  if( !os_isdir( dirname ) )
+  {
+    log_err( "Invalid directory %s\n", dirname );
+    goto done;
+  }
+  ptrans->basedir = strdup( dirname );
+
   if( strstr( s, "ser:" ) == s )
   {
-    p_transport_data = &ser_transport_data;
-    s += strlen( "ser:" );
-    if( ( c = strchr( s, ',' ) ) == NULL )
+    ptrans->type = RFS_TRANSPORT_SER;
+    c = s + strlen( "ser:" );
+    if( ( c2 = strchr( c, ',' ) ) == NULL )
     {
       log_err( "Invalid serial transport syntax\n" );
-      return 0;
+      goto done;
     }
-    temps = l_strndup( s, c - s );
+    temps = l_strndup( c, c2 - c );
+    c = c2;
     if( ( c2 = strchr( c + 1, ',' ) ) == NULL )
     {
       log_err( "Invalid serial transport syntax.\n" );
-      return 0;
+      free( temps );
+      goto done;
     }
     tempb = l_strndup( c + 1, c2 - c - 1 );
     if( secure_atoi( tempb, &tempi ) == 0 )
     {
       log_err( "Invalid port speed\n" );
-      return 0;
+      free( tempb );
+      free( temps );
+      goto done;
     }
-    free( tempb );   
+    free( tempb );
     if( !strcmp( c2 + 1, "none" ) )
       flow = SER_FLOW_NONE;
     else if( !strcmp( c2 + 1, "rtscts" ) )
@@ -339,75 +593,223 @@ static int parse_transport_and_init( const char* s )
     else
     {
       log_err( "Invalid flow control type.\n" );
-      return 0;
+      free( temps );
+      goto done;
     }
-    tempi = ser_server_init( temps, tempi, flow );
-    free( temps );    
-    return tempi;
+    res = ser_server_init( ptrans, temps, tempi, flow );
+    free( temps );
   }
-  else if( strstr( s, "udp:" ) == s )
+  else if( strstr( s, "udp:" ) == s || strstr( s, "tcp:" ) == s )
   {
-    p_transport_data = &udp_transport_data;
-    s += strlen( "udp:" );
-    if( secure_atoi( s, &tempi ) == 0 )
+    ptrans->type = strstr( s, "udp:" ) == s ? RFS_TRANSPORT_UDP : RFS_TRANSPORT_TCP;
+    if( secure_atoi( s + strlen( "udp:" ), &tempi ) == 0 )
     {
       log_err( "Invalid port number\n" );
-      return 0;
-    }    
+      goto done;
+    }
     if( net_init() == 0 )
-    { 
+    {
       log_err( "Unable to initialize network\n" );
-      return 0;
+      goto done;
     }
-    return udp_server_init( tempi );   
+    if( ptrans->type == RFS_TRANSPORT_UDP )
+      res = udp_server_init( ptrans, tempi );
+    else
+      res = tcp_server_init( ptrans, tempi );
   }
   else if( !strcmp( s, "mem" ) )
   {
     // Direct memory transport, only used with mux in rfsmux mode
-    p_transport_data = &mem_transport_data;
-    return mem_server_init( tempi ); 
-  }  
-  log_err( "Error: unsupported transport\n" );
+    ptrans->type = RFS_TRANSPORT_MEM;
+    res = mem_server_init( ptrans );
+  }
+  else
+    log_err( "Error: unsupported transport\n" );
+done:
+  free( s );
+  if( res )
+  {
+    log_msg( "Sharing directory %s\n", ptrans->basedir );
+    rfs_num_transports ++;
+  }
+  return res;
+}
+
+// Serve a client with a serial port or a TCP connection, return 0 if it has
+// to be removed
+static int client_serve( RFS_CLIENT *pc )
+{
+  if( pc->sending )
+    return client_send( pc );
+  if( pc->ptrans->type == RFS_TRANSPORT_SER )
+    return ser_read_request( pc );
+  return tcp_read_request( pc );
+}
+
+// *****************************************************************************
+// Standalone server loop
+
+#ifdef WIN32_BUILD
+
+int rfs_serve()
+{
+  RFS_TRANSPORT *ptrans = rfs_transports;
+
+  if( ptrans->type == RFS_TRANSPORT_MEM )
+  {
+    log_err( "Invalid transport in standalone mode.\n" );
+    return 1;
+  }
+  while( 1 )
+  {
+    if( ptrans->type == RFS_TRANSPORT_UDP )
+      udp_read_request( ptrans );
+    else if( rfs_clients[ 0 ] == NULL || client_serve( rfs_clients[ 0 ] ) == 0 )
+      return 1;
+  }
   return 0;
 }
 
+#else // #ifdef WIN32_BUILD
+
+int rfs_serve()
+{
+  struct pollfd fds[ RFS_MAX_TRANSPORTS + RFS_MAX_CLIENTS ];
+  RFS_TRANSPORT *wtrans[ RFS_MAX_TRANSPORTS + RFS_MAX_CLIENTS ];
+  RFS_CLIENT *wclients[ RFS_MAX_TRANSPORTS + RFS_MAX_CLIENTS ];
+  RFS_CLIENT *pc;
+  unsigned i, n;
+
+  if( rfs_transports[ 0 ].type == RFS_TRANSPORT_MEM )
+  {
+    log_err( "Invalid transport in standalone mode.\n" );
+    return 1;
+  }
+  while( 1 )
+  {
+    // Wait for the sockets of the UDP and TCP transports and for the
+    // clients on serial ports and TCP connections. A client waits to send
+    // the rest of its response before its next request is read.
+    n = 0;
+    for( i = 0; i < rfs_num_transports; i ++ )
+      if( rfs_transports[ i ].type != RFS_TRANSPORT_SER )
+      {
+        fds[ n ].fd = net_get_sync_object( rfs_transports[ i ].sock );
+        fds[ n ].events = POLLIN;
+        wtrans[ n ] = rfs_transports + i;
+        wclients[ n ++ ] = NULL;
+      }
+    for( i = 0; i < RFS_MAX_CLIENTS; i ++ )
+      if( ( pc = rfs_clients[ i ] ) != NULL && pc->ptrans->type != RFS_TRANSPORT_UDP )
+      {
+        fds[ n ].fd = pc->ptrans->type == RFS_TRANSPORT_SER ? pc->ptrans->ser : net_get_sync_object( pc->sock );
+        fds[ n ].events = pc->sending ? POLLOUT : POLLIN;
+        wtrans[ n ] = NULL;
+        wclients[ n ++ ] = pc;
+      }
+    if( n == 0 )
+    {
+      log_err( "No transport left to serve\n" );
+      return 1;
+    }
+    if( poll( fds, n, -1 ) < 0 )
+    {
+      if( errno == EINTR )
+        continue;
+      log_err( "Error on poll, aborting program\n" );
+      return 1;
+    }
+
+    for( i = 0; i < n; i ++ )
+    {
+      if( fds[ i ].revents == 0 )
+        continue;
+      if( wtrans[ i ] == NULL )
+      {
+        if( ( fds[ i ].revents & ( POLLERR | POLLNVAL ) ) || client_serve( wclients[ i ] ) == 0 )
+          client_free( wclients[ i ] );
+      }
+      else if( wtrans[ i ]->type == RFS_TRANSPORT_UDP )
+        udp_read_request( wtrans[ i ] );
+      else
+        tcp_accept( wtrans[ i ] );
+    }
+  }
+  return 0;
+}
+
+#endif // #ifdef WIN32_BUILD
+
+// Close all the clients and transports
+void rfs_cleanup()
+{
+  unsigned i;
+
+  for( i = 0; i < RFS_MAX_CLIENTS; i ++ )
+    if( rfs_clients[ i ] )
+      client_free( rfs_clients[ i ] );
+  for( i = 0; i < rfs_num_transports; i ++ )
+  {
+    if( rfs_transports[ i ].ser != SER_HANDLER_INVALID )
+      ser_close( rfs_transports[ i ].ser );
+    if( rfs_transports[ i ].sock != INVALID_SOCKET_VALUE )
+      net_close( rfs_transports[ i ].sock );
+    free( rfs_transports[ i ].basedir );
+  }
+  rfs_num_transports = 0;
+  if( mem_client )
+    server_cleanup( mem_client );
+  mem_client = NULL;
+}
+
 // *****************************************************************************
 // Entry point
 
-#define TRANSPORT_ARG_IDX     1
-#define DIRNAME_ARG_IDX       2
-#define VERBOSE_ARG_IDX       3
-#define MIN_ARGC_COUNT        3
-#define VERBOSE_ARGC_COUNT    4
+#define FIRST_TRANSPORT_ARG_IDX   1
+#define MIN_ARGC_COUNT            3
 
 int rfs_init( int argc, const char **argv )
 {
+  int i;
+
   setvbuf( stdout, NULL, _IONBF, 0 );
+  if( argc > 1 && !strcmp( argv[ argc - 1 ], "-v" ) )
+  {
+    argc --;
+    log_init( LOG_ALL );
+  }
+  else
+    log_init( LOG_NONE );
   if( argc < MIN_ARGC_COUNT )
   {
-    log_err( "Usage: %s <transport> <dirname> [-v]\n", argv[ 0 ] );
+    log_err( "Usage: %s <transport> [<transport>] ... <dirname> [-v]\n", argv[ 0 ] );
     log_err( "  Serial transport: 'ser:<sername>,<serspeed>,<flow> ('flow' defines the flow control and can be either 'none' or 'rtscts')\n" );
     log_err( "  UDP transport: 'udp:<port>'\n" );
+    log_err( "  TCP transport: 'tcp:<port>'\n" );
+    log_err( "  Append '=<dirname>' to a transport to share another directory on it.\n" );
+    log_err( "At most %d clients are served. When the server is full a new UDP client replaces\n", RFS_MAX_CLIENTS );
+    log_err( "the UDP client idle for the longest time, which loses its open files (a TCP\n" );
+    log_err( "client replaces it only after %d seconds).\n", RFS_UDP_IDLE_TIMEOUT );
     log_err( "Use -v for verbose output.\n" );
     return 1;
   }
-  
-  if( ( argc >= VERBOSE_ARGC_COUNT ) && !strcmp( argv[ VERBOSE_ARG_IDX ], "-v" ) )
-    log_init( LOG_ALL );
-  else
-    log_init( LOG_NONE );  
-  
-  if( !os_isdir( argv[ DIRNAME_ARG_IDX ] ) )
+
+  // The last argument is the directory, the others are the transports
+  for( i = FIRST_TRANSPORT_ARG_IDX; i < argc - 1; i ++ )
+    if( parse_transport_and_init( argv[ i ], argv[ argc - 1 ] ) == 0 )
+      return 1;
+  for( i = 0; i < rfs_num_transports; i ++ )
+    if( rfs_num_transports > 1 && rfs_transports[ i ].type == RFS_TRANSPORT_MEM )
+    {
+      log_err( "The 'mem' transport can't be used with other transports.\n" );
+      return 1;
+    }
+#ifdef WIN32_BUILD
+  if( rfs_num_transports > 1 || rfs_transports[ 0 ].type == RFS_TRANSPORT_TCP )
   {
-    log_err( "Invalid directory %s\n", argv[ DIRNAME_ARG_IDX ] );
-    return 1;
-  }  
-  if( parse_transport_and_init( argv[ TRANSPORT_ARG_IDX ] ) == 0 )
+    log_err( "The Win32 server supports a single serial or UDP transport.\n" );
     return 1;
-    
-    // Setup RFS server
-  server_setup( argv[ DIRNAME_ARG_IDX ] );   
-  log_msg( "Sharing directory %s\n", argv[ DIRNAME_ARG_IDX ] );
+  }
+#endif
   return 0;
-} 
-
+}
@@ -1,22 +1,26 @@
 #ifndef _RFS_TRANSPORTS_H
 #define _RFS_TRANSPORTS_H
 
-typedef void ( *p_read_request )( void );
-typedef void ( *p_send_response )( void );
-typedef void ( *p_cleanup )( void );
-typedef struct
-{
-  p_read_request f_read_request;
-  p_send_response f_send_response;
-  p_cleanup f_cleanup;
-} RFS_TRANSPORT_DATA;
-
 #define   MAX_PACKET_SIZE     4096
 
-extern const RFS_TRANSPORT_DATA *p_transport_data; 
-extern const RFS_TRANSPORT_DATA mem_transport_data;
-extern const RFS_TRANSPORT_DATA udp_transport_data;
-extern const RFS_TRANSPORT_DATA ser_transport_data;
-extern u8 rfs_buffer[ MAX_PACKET_SIZE + ELUARPC_WRITE_REQUEST_EXTRA ];
+// Largest request or response packet
+#define   MAX_BUFFER_SIZE     ( MAX_PACKET_SIZE + ELUARPC_WRITE_REQUEST_EXTRA )
+
+// Transports given in the command line and clients served at the same time
+// (a serial port has a single client, an UDP port has one for each address
+// it gets requests from and a TCP port one for each connection)
+#define   RFS_MAX_TRANSPORTS  32
+#define   RFS_MAX_CLIENTS     64
+
+// Seconds after which an UDP client that sent no requests can be replaced by
+// a TCP client when the server is full
+#ifndef RFS_UDP_IDLE_TIMEOUT
+#define   RFS_UDP_IDLE_TIMEOUT 60
+#endif
+
+extern u8 rfs_buffer[ MAX_BUFFER_SIZE ];
+
+int rfs_serve();
+void rfs_cleanup();
 
-#endif
\ No newline at end of file
+#endif
@@ -178,9 +178,24 @@ int ser_read_byte( ser_handler id, u32 timeout )
 // Write up to the specified number of bytes, return bytes actually written
 u32 ser_write( ser_handler id, const u8 *src, u32 size )
 {
-  u32 res;
-  
-  res = ( u32 )write( ( int )id, src, size );
+  u32 res = 0;
+  int n;
+  fd_set writefs;
+
+  // The port is in non-blocking mode, so a large write can be partial
+  while( res < size )
+  {
+    if( ( n = write( ( int )id, src + res, size - res ) ) > 0 )
+      res += ( u32 )n;
+    else if( n == -1 && ( errno == EAGAIN || errno == EINTR ) )
+    {
+      FD_ZERO( &writefs );
+      FD_SET( ( int )id, &writefs );
+      select( ( int )id + 1, NULL, &writefs, NULL, NULL );
+    }
+    else
+      break;
+  }
   tcdrain( ( int )id );
   return res;
 }
@@ -191,6 +206,15 @@ u32 ser_write_byte( ser_handler id, u8 data )
   return ( u32 )write( id, &data, 1 );
 }
 
+// Write as many bytes as the port takes without waiting, return bytes
+// actually written
+u32 ser_write_nowait( ser_handler id, const u8 *src, u32 size )
+{
+  int n = write( ( int )id, src, size );
+
+  return n > 0 ? ( u32 )n : 0;
+}
+
 // Perform 'select' on the specified handler(s), returning a single byte 
 // if it could be read (plus the object ID in the upper 8 bits) and -1
 // otherwise
@@ -226,6 +226,13 @@ u32 ser_write_byte( ser_handler id, u8 data )
   return ser_write( id, &data, 1 );
 }
 
+// Write without waiting for the port: the Win32 RFS server serves a single
+// port, so it simply waits for the write to finish
+u32 ser_write_nowait( ser_handler id, const u8 *src, u32 size )
+{
+  return ser_write( id, src, size );
+}
+
 // Perform 'select' on the specified handler(s), returning a single byte 
 // if it could be read (plus the object ID in the upper 8 bits) and -1
 // otherwise
@@ -8,12 +8,105 @@
 #include "type.h"
 #include "os_io.h"
 #include "log.h"
+#include "rfs_transports.h"
+#include "lzf.h"
 
-static char* server_basedir;
 static char server_fullname[ PLATFORM_MAX_FNAME_LEN + 1 ];
 
 typedef int ( *p_server_handler )( u8 *p );
 
+// The client whose request is executed
+static SERVER_CLIENT *server_pclient;
+
+// The uncompressed data of "writez" and "preadz"
+static u8 server_zbuf[ MAX_PACKET_SIZE ];
+
+// Largest "pread" and "preadz" response data that fits in rfs_buffer
+#define SERVER_MAX_PREAD      ( MAX_BUFFER_SIZE - RFS_PREAD_RESPONSE_EXTRA )
+#define SERVER_MAX_PREADZ     ( MAX_BUFFER_SIZE - RFS_PREADZ_RESPONSE_EXTRA )
+
+// *****************************************************************************
+// Internal helpers: file names
+
+// Put the full name of 'name' from the directory 'dir' in server_fullname
+static const char* server_get_fullname( const char *dir, const char *name )
+{
+  char separator[ 2 ] = { PLATFORM_PATH_SEPARATOR, 0 };
+
+  server_fullname[ 0 ] = server_fullname[ PLATFORM_MAX_FNAME_LEN ] = 0;
+  strncpy( server_fullname, dir, PLATFORM_MAX_FNAME_LEN );
+  if( name && strlen( name ) > 0 )
+  {
+    if( server_fullname[ strlen( server_fullname ) - 1 ] != PLATFORM_PATH_SEPARATOR )
+      strncat( server_fullname, separator, PLATFORM_MAX_FNAME_LEN );
+    strncat( server_fullname, name, PLATFORM_MAX_FNAME_LEN );
+  }
+  return server_fullname;
+}
+
+// *****************************************************************************
+// Internal helpers: client files and directories
+
+// Get the OS file of the client file 'fd' (-1 if it's not open)
+static int server_get_file( int fd )
+{
+  if( fd < 1 || fd > SERVER_MAX_FILES )
+    return -1;
+  return server_pclient->files[ fd - 1 ];
+}
+
+// Add an OS file to the client files, return the client file or -1 if the
+// client has too many open files
+static int server_add_file( int osfd )
+{
+  unsigned i;
+
+  for( i = 0; i < SERVER_MAX_FILES; i ++ )
+    if( server_pclient->files[ i ] == -1 )
+    {
+      server_pclient->files[ i ] = osfd;
+      return i + 1;
+    }
+  os_close( osfd );
+  return -1;
+}
+
+// Get the client directory 'd' (NULL if it's not open)
+static SERVER_DIR* server_get_dir( u32 d )
+{
+  if( d < 1 || d > SERVER_MAX_DIRS || server_pclient->dirs[ d - 1 ].d == 0 )
+    return NULL;
+  return server_pclient->dirs + d - 1;
+}
+
+// Add an OS directory to the client directories, return the client directory
+// or 0 if the client has too many open directories
+static u32 server_add_dir( u32 osd, const char *name )
+{
+  unsigned i;
+
+  for( i = 0; i < SERVER_MAX_DIRS; i ++ )
+    if( server_pclient->dirs[ i ].d == 0 )
+    {
+      server_pclient->dirs[ i ].d = osd;
+      server_pclient->dirs[ i ].name = strdup( name );
+      return i + 1;
+    }
+  os_closedir( osd );
+  return 0;
+}
+
+// Close an OS directory of the client
+static int server_close_dir( SERVER_DIR *pdir )
+{
+  int res = os_closedir( pdir->d );
+
+  free( pdir->name );
+  pdir->name = NULL;
+  pdir->d = 0;
+  return res;
+}
+
 // *****************************************************************************
 // Internal helpers: execute the given request, build the response
 
@@ -21,7 +114,6 @@ static int server_open( u8 *p )
 {
   const char *filename;
   int mode, flags, fd;
-  char separator[ 2 ] = { PLATFORM_PATH_SEPARATOR, 0 };
   
   // Validate request
   log_msg( "server_open: request handler starting\n" );
@@ -31,17 +123,11 @@ static int server_open( u8 *p )
     return SERVER_ERR;
   }
   // Get real filename
-  server_fullname[ 0 ] = server_fullname[ PLATFORM_MAX_FNAME_LEN ] = 0;
-  strncpy( server_fullname, server_basedir, PLATFORM_MAX_FNAME_LEN );
-  if( filename && strlen( filename ) > 0 )
-  {
-    if( server_fullname[ strlen( server_fullname ) - 1 ] != PLATFORM_PATH_SEPARATOR )
-      strncat( server_fullname, separator, PLATFORM_MAX_FNAME_LEN );
-    strncat( server_fullname, filename, PLATFORM_MAX_FNAME_LEN );
-  }
+  server_get_fullname( server_pclient->basedir, filename );
   log_msg( "server_open: full file path is %s\n", server_fullname ); 
-  fd = os_open( server_fullname, flags, mode );
-  log_msg( "server_open: OS file handler is %d\n", fd );
+  if( ( fd = os_open( server_fullname, flags, mode ) ) != -1 )
+    fd = server_add_file( fd );
+  log_msg( "server_open: client file handler is %d\n", fd );
   remotefs_open_write_response( p, fd );
   return SERVER_OK;
 }
@@ -59,7 +145,8 @@ static int server_write( u8 *p )
     return SERVER_ERR;
   }
   log_msg( "server_write: fd = %d, buf = %p, count = %u\n", fd, buf, ( unsigned )count );
-  count = ( u32 )os_write( fd, buf, count );
+  fd = server_get_file( fd );
+  count = fd == -1 ? ( u32 )-1 : ( u32 )os_write( fd, buf, count );
   log_msg( "server_write: OS response is %u\n", ( unsigned )count );
   remotefs_write_write_response( p, count );
   return SERVER_OK;
@@ -69,6 +156,7 @@ static int server_read( u8 *p )
 {
   int fd;
   u32 count;
+  s32 res = 0;
   
   log_msg( "server_read: request handler starting\n" );
   if( remotefs_read_read_request( p, &fd, &count ) == ELUARPC_ERR )
@@ -77,15 +165,19 @@ static int server_read( u8 *p )
     return SERVER_ERR;
   }
   log_msg( "server_read: fd = %d, count = %u\n", fd, ( unsigned )count );
-  count = ( u32 )os_read( fd, p + ELUARPC_READ_BUF_OFFSET, count );
-  log_msg( "server_read: OS response is %u\n", ( unsigned )count );
-  remotefs_read_write_response( p, count );
+  if( count > MAX_PACKET_SIZE )
+    count = MAX_PACKET_SIZE;
+  // An error is sent as no data (the data size can't be -1)
+  if( ( fd = server_get_file( fd ) ) == -1 || ( res = os_read( fd, p + ELUARPC_READ_BUF_OFFSET, count ) ) == -1 )
+    res = 0;
+  log_msg( "server_read: OS response is %d\n", ( int )res );
+  remotefs_read_write_response( p, ( u32 )res );
   return SERVER_OK;
 }
 
 static int server_close( u8 *p )
 {
-  int fd;
+  int fd, res;
   
   log_msg( "server_close: request handler starting\n" );
   if( remotefs_close_read_request( p, &fd ) == ELUARPC_ERR )
@@ -94,9 +186,13 @@ static int server_close( u8 *p )
     return SERVER_ERR;
   }
   log_msg( "server_close: fd = %d\n", fd );
-  fd = os_close( fd );
-  log_msg( "server_close: OS response is %d\n", fd );
-  remotefs_close_write_response( p, fd );
+  if( ( res = server_get_file( fd ) ) != -1 )
+  {
+    server_pclient->files[ fd - 1 ] = -1;
+    res = os_close( res );
+  }
+  log_msg( "server_close: OS response is %d\n", res );
+  remotefs_close_write_response( p, res );
   return SERVER_OK;
 }
 
@@ -112,7 +208,8 @@ static int server_lseek( u8 *p )
     return SERVER_ERR;
   }
   log_msg( "server_lseek: fd = %d, offset = %d, whence = %d\n", fd, ( int )offset, whence );
-  offset = os_lseek( fd, offset, whence );
+  fd = server_get_file( fd );
+  offset = fd == -1 ? -1 : os_lseek( fd, offset, whence );
   log_msg( "server_lseek: OS response is %d\n", ( int )offset );
   remotefs_lseek_write_response( p, offset );
   return SERVER_OK;
@@ -122,7 +219,6 @@ static int server_opendir( u8 *p )
 {
   const char* name;
   u32 d;
-  char separator[ 2 ] = { PLATFORM_PATH_SEPARATOR, 0 };
 
   log_msg( "server_opendir: request handler starting\n" );
   if( remotefs_opendir_read_request( p, &name ) == ELUARPC_ERR )
@@ -131,27 +227,20 @@ static int server_opendir( u8 *p )
     return SERVER_ERR;
   }
   // Get real filename
-  server_fullname[ 0 ] = server_fullname[ PLATFORM_MAX_FNAME_LEN ] = 0;
-  strncpy( server_fullname, server_basedir, PLATFORM_MAX_FNAME_LEN );
-  if( name && strlen( name ) > 0 )
-  {
-    if( server_fullname[ strlen( server_fullname ) - 1 ] != PLATFORM_PATH_SEPARATOR )
-      strncat( server_fullname, separator, PLATFORM_MAX_FNAME_LEN );
-    strncat( server_fullname, name, PLATFORM_MAX_FNAME_LEN );
-  }
+  server_get_fullname( server_pclient->basedir, name );
   log_msg( "server_opendir: full dirname is %s\n", server_fullname );
-  d = os_opendir( server_fullname );
-  log_msg( "server_opendir: OS response is %08X\n", d );
+  if( ( d = os_opendir( server_fullname ) ) != 0 )
+    d = server_add_dir( d, server_fullname );
+  log_msg( "server_opendir: client DIR is %08X\n", ( unsigned )d );
   remotefs_opendir_write_response( p, d );
   return SERVER_OK;
 }
 
 static int server_readdir( u8 *p )
 {
-  const char* name;
-  u32 fsize = 0, d;
-  int fd;
-  char separator[ 2 ] = { PLATFORM_PATH_SEPARATOR, 0 };
+  const char* name = NULL;
+  u32 fsize = 0, ftime = 0, d;
+  SERVER_DIR *pdir;
 
   log_msg( "server_readdir: request handler starting\n" );
   if( remotefs_readdir_read_request( p, &d ) == ELUARPC_ERR )
@@ -160,40 +249,23 @@ static int server_readdir( u8 *p )
     return SERVER_ERR;
   }
   log_msg( "server_readdir: DIR = %08X\n", d );
-  os_readdir( d, &name );
-  if( name )
-  {
-    // Need to compute size now
-    // Get real filename
-    server_fullname[ 0 ] = server_fullname[ PLATFORM_MAX_FNAME_LEN ] = 0;
-    strncpy( server_fullname, server_basedir, PLATFORM_MAX_FNAME_LEN );
-    if( name && strlen( name ) > 0 )
-    {
-      if( server_fullname[ strlen( server_fullname ) - 1 ] != PLATFORM_PATH_SEPARATOR )
-        strncat( server_fullname, separator, PLATFORM_MAX_FNAME_LEN );
-      strncat( server_fullname, name, PLATFORM_MAX_FNAME_LEN );
-    }
-    fd = os_open( server_fullname, RFS_OPEN_FLAG_RDONLY, 0 );
-    if( fd )
-    {
-      fsize = os_lseek( fd, 0, RFS_LSEEK_END );
-      os_close( fd );
-    }
-    else
-    {
-      log_msg( "server_readdir: unable to open file %s\n", server_fullname );
-      name = NULL;
-    }
+  if( ( pdir = server_get_dir( d ) ) != NULL )
+    os_readdir( pdir->d, &name );
+  if( name && os_stat( server_get_fullname( pdir->name, name ), &fsize, &ftime ) == -1 )
+  {
+    log_msg( "server_readdir: unable to stat file %s\n", server_fullname );
+    name = NULL;
   }
   log_msg( "server_readdir: OS response is fname = %s, fsize = %u\n", name, ( unsigned )fsize );
-  remotefs_readdir_write_response( p, name, fsize, 0 );
+  remotefs_readdir_write_response( p, name, fsize, ftime );
   return SERVER_OK;
 }
 
 static int server_closedir( u8 *p )
 {
   u32 d;
-  int res;
+  int res = -1;
+  SERVER_DIR *pdir;
 
   log_msg( "server_closedir: request handler starting\n" );
   if( remotefs_closedir_read_request( p, &d ) == ELUARPC_ERR )
@@ -202,9 +274,188 @@ static int server_closedir( u8 *p )
     return SERVER_ERR;
   }
   log_msg( "server_closedir: DIR = %08X\n", d );
-  res = os_closedir( d );
+  if( ( pdir = server_get_dir( d ) ) != NULL )
+    res = server_close_dir( pdir );
   log_msg( "server_closedir: OS response is %d\n", res );
-  remotefs_closedir_write_response( p, d );
+  remotefs_closedir_write_response( p, res );
+  return SERVER_OK;
+}
+
+static int server_pread( u8 *p )
+{
+  int fd;
+  u8 seq;
+  s32 offset, res;
+  u32 count;
+
+  log_msg( "server_pread: request handler starting\n" );
+  if( remotefs_pread_read_request( p, &fd, &seq, &offset, &count ) == ELUARPC_ERR )
+  {
+    log_msg( "server_pread: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  log_msg( "server_pread: fd = %d, seq = %u, offset = %d, count = %u\n", fd, ( unsigned )seq, ( int )offset, ( unsigned )count );
+  if( count > SERVER_MAX_PREAD )
+    count = SERVER_MAX_PREAD;
+  if( ( fd = server_get_file( fd ) ) == -1 )
+    offset = -1;
+  else if( offset == -1 )
+    offset = os_lseek( fd, 0, RFS_LSEEK_CUR );
+  else
+    offset = os_lseek( fd, offset, RFS_LSEEK_SET );
+  if( offset == -1 || ( res = os_read( fd, p + RFS_PREAD_BUF_OFFSET, count ) ) == -1 )
+  {
+    offset = -1;
+    res = 0;
+  }
+  log_msg( "server_pread: OS response is %d bytes from offset %d\n", ( int )res, ( int )offset );
+  remotefs_pread_write_response( p, seq, offset, ( u32 )res );
+  return SERVER_OK;
+}
+
+static int server_version( u8 *p )
+{
+  u8 version;
+
+  log_msg( "server_version: request handler starting\n" );
+  if( remotefs_version_read_request( p, &version ) == ELUARPC_ERR )
+  {
+    log_msg( "server_version: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  log_msg( "server_version: client version is %u\n", ( unsigned )version );
+  if( version > RFS_PROTOCOL_VERSION )
+    version = RFS_PROTOCOL_VERSION;
+  remotefs_version_write_response( p, version );
+  return SERVER_OK;
+}
+
+static int server_readdirb( u8 *p )
+{
+  const char *name;
+  u32 d, maxsize, size = 0, fsize, ftime;
+  u8 nentries = 0;
+  SERVER_DIR *pdir;
+
+  log_msg( "server_readdirb: request handler starting\n" );
+  if( remotefs_readdirb_read_request( p, &d, &maxsize ) == ELUARPC_ERR )
+  {
+    log_msg( "server_readdirb: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  log_msg( "server_readdirb: DIR = %08X, maxsize = %u\n", d, ( unsigned )maxsize );
+  if( maxsize > MAX_PACKET_SIZE )
+    maxsize = MAX_PACKET_SIZE;
+  // An entry is added only if the largest entry still fits after it, as the
+  // directory can't go back to an entry that doesn't fit
+  pdir = server_get_dir( d );
+  while( pdir && size + RFS_READDIRB_MAX_ENTRY <= maxsize && nentries < 255 )
+  {
+    os_readdir( pdir->d, &name );
+    if( name == NULL )
+      break;
+    if( os_stat( server_get_fullname( pdir->name, name ), &fsize, &ftime ) == -1 )
+    {
+      log_msg( "server_readdirb: unable to stat file %s\n", server_fullname );
+      continue;
+    }
+    size += remotefs_readdirb_put_entry( p + RFS_READDIRB_BUF_OFFSET + size, name, fsize, ftime );
+    nentries ++;
+  }
+  log_msg( "server_readdirb: OS response is %u entries in %u bytes\n", ( unsigned )nentries, ( unsigned )size );
+  remotefs_readdirb_write_response( p, nentries, size );
+  return SERVER_OK;
+}
+
+static int server_stat( u8 *p )
+{
+  const char *name;
+  u32 fsize = 0, ftime = 0;
+  int res;
+
+  log_msg( "server_stat: request handler starting\n" );
+  if( remotefs_stat_read_request( p, &name ) == ELUARPC_ERR )
+  {
+    log_msg( "server_stat: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  server_get_fullname( server_pclient->basedir, name );
+  log_msg( "server_stat: full file path is %s\n", server_fullname );
+  res = os_stat( server_fullname, &fsize, &ftime );
+  log_msg( "server_stat: OS response is %d, fsize = %u\n", res, ( unsigned )fsize );
+  remotefs_stat_write_response( p, res, fsize, ftime );
+  return SERVER_OK;
+}
+
+static int server_writez( u8 *p )
+{
+  int fd;
+  u8 method;
+  const void *buf;
+  u32 count;
+
+  log_msg( "server_writez: request handler starting\n" );
+  if( remotefs_writez_read_request( p, &fd, &method, &buf, &count ) == ELUARPC_ERR )
+  {
+    log_msg( "server_writez: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  log_msg( "server_writez: fd = %d, method = %u, count = %u\n", fd, ( unsigned )method, ( unsigned )count );
+  if( method == RFS_COMPRESS_LZF && count > 0 )
+  {
+    count = lzf_decompress( buf, count, server_zbuf, MAX_PACKET_SIZE );
+    buf = server_zbuf;
+  }
+  else if( method != RFS_COMPRESS_NONE )
+    count = 0;
+  if( ( fd = server_get_file( fd ) ) == -1 )
+    count = ( u32 )-1;
+  else if( count == 0 )
+    log_msg( "server_writez: invalid data\n" );
+  else
+    count = ( u32 )os_write( fd, buf, count );
+  log_msg( "server_writez: OS response is %u\n", ( unsigned )count );
+  remotefs_writez_write_response( p, count );
+  return SERVER_OK;
+}
+
+static int server_preadz( u8 *p )
+{
+  int fd;
+  u8 seq, method = RFS_COMPRESS_NONE;
+  s32 offset, res = 0;
+  u32 count, size = 0;
+
+  log_msg( "server_preadz: request handler starting\n" );
+  if( remotefs_preadz_read_request( p, &fd, &seq, &offset, &count ) == ELUARPC_ERR )
+  {
+    log_msg( "server_preadz: unable to read request\n" );
+    return SERVER_ERR;
+  }
+  log_msg( "server_preadz: fd = %d, seq = %u, offset = %d, count = %u\n", fd, ( unsigned )seq, ( int )offset, ( unsigned )count );
+  if( count > SERVER_MAX_PREADZ )
+    count = SERVER_MAX_PREADZ;
+  if( ( fd = server_get_file( fd ) ) == -1 )
+    offset = -1;
+  else if( offset == -1 )
+    offset = os_lseek( fd, 0, RFS_LSEEK_CUR );
+  else
+    offset = os_lseek( fd, offset, RFS_LSEEK_SET );
+  if( offset == -1 || ( res = os_read( fd, server_zbuf, count ) ) == -1 )
+    offset = -1;
+  else if( res > 0 )
+  {
+    // Send the data as it is if it doesn't get smaller
+    if( ( size = lzf_compress( server_zbuf, ( u32 )res, p + RFS_PREADZ_BUF_OFFSET, ( u32 )res - 1 ) ) > 0 )
+      method = RFS_COMPRESS_LZF;
+    else
+    {
+      memcpy( p + RFS_PREADZ_BUF_OFFSET, server_zbuf, res );
+      size = ( u32 )res;
+    }
+  }
+  log_msg( "server_preadz: OS response is %d bytes from offset %d, sent in %u bytes\n", ( int )res, ( int )offset, ( unsigned )size );
+  remotefs_preadz_write_response( p, seq, offset, method, size );
   return SERVER_OK;
 }
 
@@ -213,20 +464,45 @@ static int server_closedir( u8 *p )
 
 static const p_server_handler server_handlers[] = 
 { 
-  server_open, server_write, server_read, server_close, server_lseek, server_opendir, server_readdir, server_closedir
+  server_open, server_write, server_read, server_close, server_lseek, server_opendir, server_readdir, server_closedir,
+  server_pread, server_version, server_readdirb, server_stat, server_writez, server_preadz
 };
 
-void server_setup( const char* basedir )
+// Create a client that shares the directory 'basedir'
+SERVER_CLIENT* server_setup( const char* basedir )
 {
-  server_basedir = strdup( basedir );
+  SERVER_CLIENT *pclient;
+  unsigned i;
+
+  if( ( pclient = ( SERVER_CLIENT* )malloc( sizeof( SERVER_CLIENT ) ) ) == NULL )
+    return NULL;
+  memset( pclient, 0, sizeof( SERVER_CLIENT ) );
+  if( ( pclient->basedir = strdup( basedir ) ) == NULL )
+  {
+    free( pclient );
+    return NULL;
+  }
+  for( i = 0; i < SERVER_MAX_FILES; i ++ )
+    pclient->files[ i ] = -1;
+  return pclient;
 }
 
-void server_cleanup()
+// Close the files and directories that the client left open and free it
+void server_cleanup( SERVER_CLIENT *pclient )
 {
-  free( server_basedir );
-  server_basedir = NULL;
+  unsigned i;
+
+  for( i = 0; i < SERVER_MAX_FILES; i ++ )
+    if( pclient->files[ i ] != -1 )
+      os_close( pclient->files[ i ] );
+  for( i = 0; i < SERVER_MAX_DIRS; i ++ )
+    if( pclient->dirs[ i ].d )
+      server_close_dir( pclient->dirs + i );
+  free( pclient->basedir );
+  free( pclient );
 }
-int server_execute_request( u8 *pdata )
+
+int server_execute_request( SERVER_CLIENT *pclient, u8 *pdata )
 {
   u8 req;
   
@@ -234,6 +510,7 @@ int server_execute_request( u8 *pdata )
   if( eluarpc_get_request_id( pdata, &req ) == ELUARPC_ERR )
     return SERVER_ERR;
   log_msg( "server_execute_request: got request with ID %d\n", req );
+  server_pclient = pclient;
   if( req >= RFS_OP_FIRST && req <= RFS_OP_LAST ) 
     return server_handlers[ req - RFS_OP_FIRST ]( pdata );
   else
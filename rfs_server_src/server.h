@@ -9,9 +9,29 @@
 #define SERVER_OK     0
 #define SERVER_ERR    1
 
-// Server function                     
-void server_setup( const char *basedir );
-void server_cleanup();
-int server_execute_request( u8 *pdata );
+// Files and directories that a client can have open at the same time
+#define SERVER_MAX_FILES      32
+#define SERVER_MAX_DIRS       8
+
+// An open directory and its full name, to find the files it lists
+typedef struct
+{
+  u32 d;
+  char *name;
+} SERVER_DIR;
+
+// Per client state. A client sees its files and directories as indexes
+// (starting at 1) in its own tables, so it can't use those of another client.
+typedef struct
+{
+  char *basedir;
+  int files[ SERVER_MAX_FILES ];
+  SERVER_DIR dirs[ SERVER_MAX_DIRS ];
+} SERVER_CLIENT;
+
+// Server function
+SERVER_CLIENT* server_setup( const char *basedir );
+void server_cleanup( SERVER_CLIENT *pclient );
+int server_execute_request( SERVER_CLIENT *pclient, u8 *pdata );
 
 #endif
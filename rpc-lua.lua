@@ -3,6 +3,7 @@ local b = require "utils.build"
 local builder = b.new_builder( ".build/rpc-lua" )
 local utils = b.utils
 local sf = string.format
+builder:add_option( 'transport', 'RPC transport: serial port or TCP socket', 'serial', { 'serial', 'socket' } )
 builder:init( args )
 builder:set_build_mode( builder.BUILD_DIR_LINEARIZED )
 
@@ -11,12 +12,16 @@ local cdefs = "-DLUA_CROSS_COMPILER -DLUA_RPC"
 
 local lua_files = [[lapi.c lcode.c ldebug.c ldo.c ldump.c lfunc.c lgc.c llex.c lmem.c lobject.c lopcodes.c
    lparser.c lstate.c lstring.c ltable.c ltm.c lundump.c lvm.c lzio.c lauxlib.c lbaselib.c
-   ldblib.c liolib.c lmathlib.c loslib.c ltablib.c lstrlib.c loadlib.c linit.c lua.c print.c lrotable.c]]
+   ldblib.c liolib.c lmathlib.c loslib.c ltablib.c lstrlib.c loadlib.c linit.c lua.c print.c lrotable.c lcompact.c]]
 lua_files = lua_files:gsub( "\n", "" )
 local lua_full_files = utils.prepend_path( lua_files, "src/lua" )
-lua_full_files = lua_full_files .. " src/modules/luarpc.c src/modules/lpack.c src/modules/bitarray.c src/modules/bit.c src/luarpc_desktop_serial.c "
+lua_full_files = lua_full_files .. " src/modules/luarpc.c src/modules/lpack.c src/modules/bitarray.c src/modules/bit.c src/luarpc_desktop_serial.c src/luarpc_desktop_socket.c src/lzf.c "
 local local_include = "-Isrc/lua -Iinc -Isrc/modules -Iinc/desktop"
 
+if builder:get_option( 'transport' ) == 'socket' then
+  cdefs = cdefs .. " -DLUARPC_ENABLE_SOCKET"
+end
+
 if utils.is_windows() then
   lua_full_files = lua_full_files .. " src/serial/serial_win32.c"
   cdefs = cdefs .. " -DWIN32_BUILD"
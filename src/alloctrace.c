@@ -0,0 +1,338 @@
+// Allocation trace recorder and replayer
+// The recorder writes every successful operation of the Lua allocator to a
+// text file, one operation per line: "<old ptr> <old size> <new ptr> <new size>"
+// (all in hex, a NULL old pointer is an allocation, a 0 new size is a free).
+// The replayer runs a recorded trace against the allocator this image was
+// built with and reports its throughput, peak usage, largest free block and
+// fragmentation over time, so that the allocators can be compared.
+
+#include "platform_conf.h"
+
+#ifdef BUILD_ALLOC_TRACE
+
+#include "alloctrace.h"
+#include "platform.h"
+#include "type.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef BUILD_MEMPOOL
+#include "mpool.h"
+#endif
+#if defined( USE_MULTIPLE_ALLOCATOR )
+#include "dlmalloc.h"
+#elif defined( USE_SIMPLE_ALLOCATOR )
+#include "salloc.h"
+#else
+#include <malloc.h>
+#endif
+#ifdef BUILD_HEAP_REGIONS
+#include "heapreg.h"
+#endif
+
+// The replayer goes through the memory pools too when they are enabled
+#ifdef BUILD_MEMPOOL
+#define at_malloc( s )          mpool_realloc( NULL, 0, s )
+#define at_realloc( p, os, s )  mpool_realloc( p, os, s )
+#define at_free( p, os )        mpool_realloc( p, os, 0 )
+#else
+#define at_malloc( s )          malloc( s )
+#define at_realloc( p, os, s )  realloc( p, s )
+#define at_free( p, os )        free( p )
+#endif
+
+// Live blocks of the replayed trace (open addressing, linear probing)
+typedef struct
+{
+  unsigned long key;            // pointer from the trace, 0 for an empty slot
+  void *ptr;                    // block allocated by the replayer
+  u32 size;
+} at_block;
+
+static FILE *at_file;
+static at_block *at_blocks;
+static unsigned at_mask, at_count;
+
+// ****************************************************************************
+// Recorder
+
+int alloctrace_start( const char *fname )
+{
+  alloctrace_stop();
+  return ( at_file = fopen( fname, "w" ) ) != NULL;
+}
+
+void alloctrace_stop()
+{
+  FILE *f = at_file;
+
+  // Clear 'at_file' first, fclose() might go through the Lua allocator
+  at_file = NULL;
+  if( f )
+    fclose( f );
+}
+
+void alloctrace_record( void *optr, size_t osize, void *nptr, size_t nsize )
+{
+  if( at_file )
+    fprintf( at_file, "%lx %lx %lx %lx\n", ( unsigned long )optr, ( unsigned long )osize, ( unsigned long )nptr, ( unsigned long )nsize );
+}
+
+// ****************************************************************************
+// Replayer helpers
+
+static unsigned at_home( unsigned long key )
+{
+  return ( ( u32 )( key >> 3 ) * 2654435761UL ) & at_mask;
+}
+
+static at_block* at_find( unsigned long key )
+{
+  unsigned i;
+
+  for( i = at_home( key ); at_blocks[ i ].key; i = ( i + 1 ) & at_mask )
+    if( at_blocks[ i ].key == key )
+      return at_blocks + i;
+  return NULL;
+}
+
+static void at_put( unsigned long key, void *ptr, u32 size )
+{
+  unsigned i;
+
+  for( i = at_home( key ); at_blocks[ i ].key; i = ( i + 1 ) & at_mask );
+  at_blocks[ i ].key = key;
+  at_blocks[ i ].ptr = ptr;
+  at_blocks[ i ].size = size;
+  at_count ++;
+}
+
+// Insert a block, growing the table if needed
+// The table is sized from the trace, so it only grows when the trace
+// reallocates blocks that were allocated before the recording started
+static int at_insert( unsigned long key, void *ptr, u32 size )
+{
+  at_block *old = at_blocks;
+  unsigned i, oldsize = at_mask + 1;
+
+  if( 2 * ( at_count + 1 ) > oldsize )
+  {
+    if( ( at_blocks = ( at_block* )calloc( 2 * oldsize, sizeof( at_block ) ) ) == NULL )
+    {
+      at_blocks = old;
+      return 0;
+    }
+    at_mask = 2 * oldsize - 1;
+    at_count = 0;
+    for( i = 0; i < oldsize; i ++ )
+      if( old[ i ].key )
+        at_put( old[ i ].key, old[ i ].ptr, old[ i ].size );
+    free( old );
+  }
+  at_put( key, ptr, size );
+  return 1;
+}
+
+// Remove a block, shifting back the entries that follow it in its cluster
+static void at_remove( at_block *pb )
+{
+  unsigned i = pb - at_blocks, j = i, k;
+
+  while( 1 )
+  {
+    j = ( j + 1 ) & at_mask;
+    if( at_blocks[ j ].key == 0 )
+      break;
+    k = at_home( at_blocks[ j ].key );
+    if( i <= j ? ( i < k && k <= j ) : ( i < k || k <= j ) )
+      continue;
+    at_blocks[ i ] = at_blocks[ j ];
+    i = j;
+  }
+  at_blocks[ i ].key = 0;
+  at_count --;
+}
+
+// Size of the largest block that can be allocated, found by probing
+static u32 at_largest( u32 hi )
+{
+  u32 lo = 0, mid;
+  void *p;
+
+  while( lo < hi )
+  {
+    mid = lo + ( hi - lo + 1 ) / 2;
+    if( ( p = malloc( mid ) ) != NULL )
+    {
+      free( p );
+      lo = mid;
+    }
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+// Free memory as seen by the allocator, so the Lua heap and the replayer's
+// own tables are accounted for. For dlmalloc this is the free space in the
+// heap plus the RAM not taken through sbrk yet.
+static u32 at_free_memory( u32 ram )
+{
+#if defined( USE_SIMPLE_ALLOCATOR )
+  return ( u32 )sfreebytes();
+#else
+#if defined( BUILD_HEAP_REGIONS )
+  struct mallinfo m = heapreg_mallinfo();
+#elif defined( USE_MULTIPLE_ALLOCATOR )
+  struct mallinfo m = dlmallinfo();
+#else
+  struct mallinfo m = mallinfo();
+#endif
+
+  return ( ( u32 )m.arena < ram ? ram - ( u32 )m.arena : 0 ) + ( u32 )m.fordblks;
+#endif
+}
+
+static timer_data_type at_time()
+{
+  return platform_timer_sys_available() ? platform_timer_read_sys() : 0;
+}
+
+static u32 at_elapsed( timer_data_type start )
+{
+  return platform_timer_sys_available() ? ( u32 )platform_timer_get_diff_us( PLATFORM_TIMER_SYS_ID, start, platform_timer_read_sys() ) : 0;
+}
+
+// ****************************************************************************
+// Replayer
+
+int alloctrace_replay( const char *fname, unsigned interval, alloctrace_result *res )
+{
+  FILE *f;
+  unsigned long optr, osize, nptr, nsize;
+  s32 live = 0, maxlive = 0;
+  u32 ops = 0, inuse = 0, ram = 0, parse_us, sample_us = 0;
+  unsigned i, size;
+  char *start;
+  at_block *pb;
+  void *p;
+  alloctrace_sample *ps;
+  timer_data_type t;
+  int n, err = ALLOCTRACE_OK;
+
+  memset( res, 0, sizeof( *res ) );
+  if( interval == 0 )
+    interval = ALLOCTRACE_DEF_INTERVAL;
+  if( ( f = fopen( fname, "r" ) ) == NULL )
+    return ALLOCTRACE_ERR_OPEN;
+  // First pass: validate the trace, size the block table and time the parsing
+  t = at_time();
+  while( ( n = fscanf( f, "%lx %lx %lx %lx", &optr, &osize, &nptr, &nsize ) ) == 4 )
+  {
+    if( nsize == 0 )
+      live --;
+    else if( optr == 0 && ++ live > maxlive )
+      maxlive = live;
+    ops ++;
+  }
+  parse_us = at_elapsed( t );
+  if( n != EOF )
+  {
+    fclose( f );
+    return ALLOCTRACE_ERR_FORMAT;
+  }
+  for( size = 16; size < 2 * ( u32 )maxlive; size <<= 1 );
+  at_mask = size - 1;
+  at_count = 0;
+  at_blocks = ( at_block* )calloc( size, sizeof( at_block ) );
+  res->samples = ( alloctrace_sample* )malloc( ( ops / interval + 1 ) * sizeof( alloctrace_sample ) );
+  if( at_blocks == NULL || res->samples == NULL )
+  {
+    err = ALLOCTRACE_ERR_NOMEM;
+    goto out;
+  }
+  for( i = 0; ( start = ( char* )platform_get_first_free_ram( i ) ) != NULL; i ++ )
+    ram += ( char* )platform_get_last_free_ram( i ) - start;
+  // Second pass: replay the trace
+  rewind( f );
+  t = at_time();
+  while( fscanf( f, "%lx %lx %lx %lx", &optr, &osize, &nptr, &nsize ) == 4 )
+  {
+    pb = optr ? at_find( optr ) : NULL;
+    if( nsize == 0 )
+    {
+      res->frees ++;
+      if( pb )
+      {
+        at_free( pb->ptr, pb->size );
+        inuse -= pb->size;
+        at_remove( pb );
+      }
+    }
+    else if( pb == NULL )
+    {
+      res->allocs ++;
+      if( ( p = at_malloc( nsize ) ) == NULL )
+        res->failed ++;
+      else if( !at_insert( nptr, p, nsize ) )
+      {
+        at_free( p, nsize );
+        err = ALLOCTRACE_ERR_NOMEM;
+        break;
+      }
+      else
+        inuse += nsize;
+    }
+    else
+    {
+      res->reallocs ++;
+      inuse -= pb->size;
+      p = at_realloc( pb->ptr, pb->size, nsize );
+      if( p == NULL )
+      {
+        at_free( pb->ptr, pb->size );
+        res->failed ++;
+      }
+      at_remove( pb );
+      if( p && !at_insert( nptr, p, nsize ) )
+      {
+        at_free( p, nsize );
+        err = ALLOCTRACE_ERR_NOMEM;
+        break;
+      }
+      else if( p )
+        inuse += nsize;
+    }
+    if( inuse > res->peak )
+      res->peak = inuse;
+    if( ++ res->ops % interval == 0 || res->ops == ops )
+    {
+      timer_data_type ts = at_time();
+
+      ps = res->samples + res->nsamples ++;
+      ps->ops = res->ops;
+      ps->inuse = inuse;
+      ps->free = at_free_memory( ram );
+      ps->largest = at_largest( ps->free );
+      sample_us += at_elapsed( ts );
+    }
+  }
+  res->time_us = at_elapsed( t );
+  res->time_us = res->time_us > parse_us + sample_us ? res->time_us - parse_us - sample_us : 0;
+  // Release everything that is still allocated
+  for( i = 0; i <= at_mask; i ++ )
+    if( at_blocks[ i ].key )
+      at_free( at_blocks[ i ].ptr, at_blocks[ i ].size );
+out:
+  free( at_blocks );
+  at_blocks = NULL;
+  if( err != ALLOCTRACE_OK )
+  {
+    free( res->samples );
+    res->samples = NULL;
+  }
+  fclose( f );
+  return err;
+}
+
+#endif // #ifdef BUILD_ALLOC_TRACE
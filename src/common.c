@@ -12,6 +12,7 @@
 #include "elua_adc.h"
 #include "term.h"
 #include "xmodem.h"
+#include "sched.h"
 #include "lua.h"
 #include "lapi.h"
 #include "lauxlib.h"
@@ -448,6 +449,7 @@ int platform_cpu_get_interrupt_flag( elua_int_id id, elua_int_resnum resnum, int
 void cmn_int_handler( elua_int_id id, elua_int_resnum resnum )
 {
   elua_int_add( id, resnum );
+  sched_int_notify( id, resnum );
 #ifdef BUILD_C_INT_HANDLERS
   elua_int_c_handler phnd = elua_int_get_c_handler( id );
   if( phnd )
@@ -626,6 +626,35 @@ elua_net_size elua_net_recvbuf( int s, luaL_Buffer* buf, elua_net_size maxsize,
   return elua_net_recv_internal( s, buf, maxsize, readto, timer_id, to_us, 1 );
 }
 
+// Start receiving up to "maxsize" bytes in "buf" without waiting for them.
+// "maxsize" must be at least UIP_RECEIVE_WINDOW (a packet can't be split).
+// Returns 0 if OK, -1 on error.
+int elua_net_recv_start( int s, void* buf, elua_net_size maxsize )
+{
+  volatile struct elua_uip_state *pstate = ( volatile struct elua_uip_state* )&( uip_conns[ s ].appstate );
+
+  if( !ELUA_UIP_IS_SOCK_OK( s ) || !uip_conn_active( s ) || maxsize == 0 )
+    return -1;
+  elua_prep_socket_state( pstate, buf, maxsize, ELUA_NET_NO_LASTCHAR, 0, ELUA_UIP_STATE_RECV );
+  return 0;
+}
+
+// Check a receive started with elua_net_recv_start ("maxsize" must be the
+// same). Returns the number of bytes received, 0 if the receive is still in
+// progress or -1 on error (for example if the connection was closed).
+elua_net_size elua_net_recv_poll( int s, elua_net_size maxsize )
+{
+  volatile struct elua_uip_state *pstate = ( volatile struct elua_uip_state* )&( uip_conns[ s ].appstate );
+
+  if( !ELUA_UIP_IS_SOCK_OK( s ) )
+    return -1;
+  if( pstate->state != ELUA_UIP_STATE_IDLE )
+    return 0;
+  if( pstate->res != ELUA_NET_ERR_OK )
+    return -1;
+  return maxsize - pstate->len;
+}
+
 // Return the socket associated with the "telnet" application (or -1 if it does
 // not exist). The socket only exists if a client connected to the board.
 int elua_net_get_telnet_socket()
@@ -704,6 +733,12 @@ int i;
 }
 
 
+// Returns 1 if a connection request on the given port is waiting to be accepted
+int elua_net_accept_ready( u16 port )
+{
+  return elua_net_find_pending( port ) != -1;
+}
+
 // Accept a connection on the given port, return its socket id (and the IP of the remote host by side effect)
 // TH: Changed behaviour: Does no own listen to the port, this has to be done before with a call to elua_listen
 // accept will just look for pending connections to the port and will return the socket of the first one
@@ -0,0 +1,207 @@
+// Region aware heap: one dlmalloc mspace per RAM region
+// All the memory spaces given by MEM_START_ADDRESS/MEM_END_ADDRESS get their
+// own mspace instead of being glued together by elua_sbrk(), so the caller
+// can choose where a block goes. C code (newlib's malloc) uses the regions
+// in order, while the Lua allocator sends small objects to the first (fast)
+// regions and large ones to the last (slow) regions.
+
+#include "platform_conf.h"
+
+#ifdef BUILD_HEAP_REGIONS
+
+#include "heapreg.h"
+#include "dlmalloc.h"
+#include "platform.h"
+#include "type.h"
+#include <string.h>
+
+#define HEAPREG_MAX_REGIONS     8
+
+static mspace heapreg_spaces[ HEAPREG_MAX_REGIONS ];
+static heapreg_stats heapreg_data[ HEAPREG_MAX_REGIONS ];
+static unsigned heapreg_count;
+static u8 heapreg_initialized;
+
+// ****************************************************************************
+// Helpers
+
+static void heapreg_init()
+{
+  unsigned i;
+  char *start, *end;
+
+  for( i = 0; i < HEAPREG_MAX_REGIONS && ( start = platform_get_first_free_ram( i ) ) != NULL; i ++ )
+  {
+    end = platform_get_last_free_ram( i );
+    if( ( heapreg_spaces[ heapreg_count ] = create_mspace_with_base( start, end - start, 0 ) ) == NULL )
+      continue;
+    heapreg_data[ heapreg_count ].start = ( u32 )start;
+    heapreg_data[ heapreg_count ++ ].size = end - start;
+  }
+  heapreg_initialized = 1;
+}
+
+// Return the region that contains 'ptr'
+static unsigned heapreg_find( const void *ptr )
+{
+  unsigned i;
+
+  for( i = 0; i + 1 < heapreg_count; i ++ )
+    if( ( u32 )ptr >= heapreg_data[ i ].start && ( u32 )ptr < heapreg_data[ i ].start + heapreg_data[ i ].size )
+      break;
+  return i;
+}
+
+// Region to try at position 'pos' for the given hint
+#define heapreg_order( pos, hint ) ( ( hint ) == HEAPREG_FAST ? ( pos ) : heapreg_count - 1 - ( pos ) )
+
+// An allocation that failed in every region counts against the region it
+// preferred
+#define heapreg_failed( hint )    heapreg_data[ heapreg_order( 0, hint ) ].failed ++
+
+static void heapreg_add( unsigned id, void *ptr )
+{
+  heapreg_stats *pd = heapreg_data + id;
+
+  pd->allocs ++;
+  if( ( pd->used += mspace_usable_size( ptr ) ) > pd->peak )
+    pd->peak = pd->used;
+}
+
+static void* heapreg_malloc_in( unsigned id, size_t size )
+{
+  void *ptr;
+
+  if( ( ptr = mspace_malloc( heapreg_spaces[ id ], size ) ) != NULL )
+    heapreg_add( id, ptr );
+  return ptr;
+}
+
+static void* heapreg_malloc_hint( size_t size, int hint )
+{
+  unsigned i;
+  void *ptr = NULL;
+
+  if( !heapreg_initialized )
+    heapreg_init();
+  for( i = 0; i < heapreg_count && ptr == NULL; i ++ )
+    ptr = heapreg_malloc_in( heapreg_order( i, hint ), size );
+  if( ptr == NULL && heapreg_count > 0 )
+    heapreg_failed( hint );
+  return ptr;
+}
+
+// ****************************************************************************
+// Public interface
+
+// The malloc() family goes through the regions in order
+void* heapreg_malloc( size_t size )
+{
+  return heapreg_malloc_hint( size, HEAPREG_FAST );
+}
+
+void* heapreg_calloc( size_t nelem, size_t elem_size )
+{
+  void *ptr;
+
+  if( ( ptr = heapreg_malloc_hint( nelem * elem_size, HEAPREG_FAST ) ) != NULL )
+    memset( ptr, 0, nelem * elem_size );
+  return ptr;
+}
+
+void heapreg_free( void *ptr )
+{
+  unsigned id;
+
+  if( ptr == NULL )
+    return;
+  id = heapreg_find( ptr );
+  heapreg_data[ id ].used -= mspace_usable_size( ptr );
+  mspace_free( heapreg_spaces[ id ], ptr );
+}
+
+// Resize a block. The block moves to a region that comes before its current
+// region in the order given by 'hint' if possible, otherwise it is resized in
+// place and moved to any other region only if that fails.
+void* heapreg_realloc_hint( void *ptr, size_t size, int hint )
+{
+  unsigned id, i, r;
+  size_t osize;
+  void *nptr = NULL;
+
+  if( ptr == NULL )
+    return heapreg_malloc_hint( size, hint );
+  if( size == 0 )
+  {
+    heapreg_free( ptr );
+    return NULL;
+  }
+  id = heapreg_find( ptr );
+  osize = mspace_usable_size( ptr );
+  for( i = 0; i < heapreg_count && nptr == NULL; i ++ )
+  {
+    if( ( r = heapreg_order( i, hint ) ) == id )
+    {
+      if( ( nptr = mspace_realloc( heapreg_spaces[ id ], ptr, size ) ) != NULL )
+      {
+        heapreg_data[ id ].used -= osize;
+        heapreg_add( id, nptr );
+        heapreg_data[ id ].allocs --;
+        return nptr;
+      }
+    }
+    else
+      nptr = heapreg_malloc_in( r, size );
+  }
+  if( nptr != NULL )
+  {
+    memcpy( nptr, ptr, osize < size ? osize : size );
+    heapreg_free( ptr );
+  }
+  else
+    heapreg_failed( hint );
+  return nptr;
+}
+
+void* heapreg_realloc( void *ptr, size_t size )
+{
+  return heapreg_realloc_hint( ptr, size, HEAPREG_FAST );
+}
+
+unsigned heapreg_num_regions()
+{
+  if( !heapreg_initialized )
+    heapreg_init();
+  return heapreg_count;
+}
+
+// Get statistics for a region, returns 0 if the region doesn't exist
+int heapreg_get_stats( unsigned id, heapreg_stats *pstats )
+{
+  if( id >= heapreg_num_regions() )
+    return 0;
+  *pstats = heapreg_data[ id ];
+  return 1;
+}
+
+// mallinfo() for all the regions together
+struct mallinfo heapreg_mallinfo()
+{
+  struct mallinfo m, r;
+  unsigned i;
+
+  memset( &m, 0, sizeof( m ) );
+  for( i = 0; i < heapreg_num_regions(); i ++ )
+  {
+    r = mspace_mallinfo( heapreg_spaces[ i ] );
+    m.arena += r.arena;
+    m.ordblks += r.ordblks;
+    m.usmblks += r.usmblks;
+    m.uordblks += r.uordblks;
+    m.fordblks += r.fordblks;
+    m.keepcost += r.keepcost;
+  }
+  return m;
+}
+
+#endif // #ifdef BUILD_HEAP_REGIONS
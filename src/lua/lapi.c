@@ -16,6 +16,7 @@
 #include "lua.h"
 
 #include "lapi.h"
+#include "lcompact.h"
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
@@ -139,10 +140,16 @@ LUA_API lua_CFunction lua_atpanic (lua_State *L, lua_CFunction panicf) {
 
 
 LUA_API lua_State *lua_newthread (lua_State *L) {
+  return lua_newthreadsize(L, 0);
+}
+
+
+LUA_API lua_State *lua_newthreadsize (lua_State *L, int stacksize) {
   lua_State *L1;
   lua_lock(L);
+  api_check(L, stacksize >= 0 && stacksize <= LUAI_MAXCSTACK);
   luaC_checkGC(L);
-  L1 = luaE_newthread(L);
+  L1 = luaE_newthread(L, stacksize);
   setthvalue(L, L->top, L1);
   api_incr_top(L);
   lua_unlock(L);
@@ -469,6 +476,15 @@ LUA_API void lua_pushrolstring (lua_State *L, const char *s, size_t len) {
 }
 
 
+LUA_API void lua_pushchunks (lua_State *L, const lua_Chunk *c, size_t len) {
+  lua_lock(L);
+  luaC_checkGC(L);
+  setsvalue2s(L, L->top, luaS_newchunks(L, c, len));
+  api_incr_top(L);
+  lua_unlock(L);
+}
+
+
 LUA_API void lua_pushstring (lua_State *L, const char *s) {
   if (s == NULL)
     lua_pushnil(L);
@@ -964,6 +980,8 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
     }
     case LUA_GCCOLLECT: {
       luaC_fullgc(L);
+      if (!is_block_gc(L))
+        luaCS_compact(L);
       break;
     }
     case LUA_GCCOUNT: {
@@ -988,6 +1006,7 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
       while (g->GCthreshold <= g->totalbytes) {
         luaC_step(L);
         if (g->gcstate == GCSpause) {  /* end of cycle? */
+          luaCS_step(L);
           res = 1;  /* signal it */
           break;
         }
@@ -1022,6 +1041,23 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
       res = cast_int(g->memlimit >> 10);
       break;
     }
+    case LUA_GCSTACKCOUNT: {
+      /* GC values are expressed in Kbytes: #bytes/2^10 */
+      res = cast_int(g->stackbytes >> 10);
+      break;
+    }
+    case LUA_GCSTACKCOUNTB: {
+      res = cast_int(g->stackbytes & 0x3ff);
+      break;
+    }
+    case LUA_GCCOMPACT: {
+      CSStats s;
+      if (!is_block_gc(L))
+        luaCS_compact(L);
+      /* free space in the compacting space, in Kbytes (-1 if none) */
+      res = luaCS_getstats(L, &s) ? cast_int((s.size - s.used) >> 10) : -1;
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   lua_unlock(L);
@@ -1061,6 +1097,23 @@ LUA_API int lua_next (lua_State *L, int idx) {
 }
 
 
+/*
+** Sorts t[1..n] in place in the default order, without calling any
+** metamethod, if they are all numbers or all strings (and t[1..n] is in
+** the array part). Returns 0, leaving the table untouched, otherwise.
+*/
+LUA_API int lua_rawsort (lua_State *L, int idx, int n, int stable) {
+  StkId t;
+  int res;
+  lua_lock(L);
+  t = index2adr(L, idx);
+  api_check(L, ttistable(t));
+  res = luaH_sort(L, hvalue(t), n, stable);
+  lua_unlock(L);
+  return res;
+}
+
+
 LUA_API void lua_concat (lua_State *L, int n) {
   lua_lock(L);
   api_checknelems(L, n);
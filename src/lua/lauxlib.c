@@ -27,11 +27,22 @@
 #include "lauxlib.h"
 #include "lgc.h"
 #include "ldo.h"
+#include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
 #include "legc.h"
 #ifndef LUA_CROSS_COMPILER
 #include "devman.h"
+#include "platform_conf.h"
+#endif
+#ifdef BUILD_MEMPOOL
+#include "mpool.h"
+#endif
+#ifdef BUILD_ALLOC_TRACE
+#include "alloctrace.h"
+#endif
+#ifdef BUILD_HEAP_REGIONS
+#include "heapreg.h"
 #endif
 
 #define FREELIST_REF	0	/* free list of references */
@@ -449,50 +460,123 @@ LUALIB_API const char *luaL_findtable (lua_State *L, int idx,
 #define bufflen(B)	((B)->p - (B)->buffer)
 #define bufffree(B)	((size_t)(LUAL_BUFFERSIZE - bufflen(B)))
 
-#define LIMIT	(LUA_MINSTACK/2)
+/*
+** When the contents of a buffer outgrow LUAL_BUFFERSIZE they are moved to
+** a list of chunks, instead of being pushed as partial strings and
+** concatenated. The final string is then built only once by
+** luaL_pushresult. The chunks act as a scratch arena of the buffer: they
+** are allocated through luaM_ so the collector (and the emergency
+** collector) count them, and they are all freed when the buffer is done.
+** The chunk list is anchored by a userdata kept in the stack, so its chunks
+** are released by __gc if an error is raised before the buffer is finished.
+*/
+
+#define ROPE_META	"_LBUFFERROPE"
 
+typedef struct BuffChunk {
+  lua_Chunk c;
+  size_t size;  /* size of the data area following the header */
+} BuffChunk;
 
-static int emptybuffer (luaL_Buffer *B) {
-  size_t l = bufflen(B);
-  if (l == 0) return 0;  /* put nothing on stack */
-  else {
-    lua_pushlstring(B->L, B->buffer, l);
-    B->p = B->buffer;
-    B->lvl++;
-    return 1;
+typedef struct luaL_Rope {
+  BuffChunk *first;
+  BuffChunk *last;
+  size_t len;  /* total length of the chunks */
+} luaL_Rope;
+
+
+static void freechunks (lua_State *L, luaL_Rope *r) {
+  BuffChunk *c = r->first;
+  while (c != NULL) {
+    /* 'next' of the last chunk is not owned by the rope */
+    BuffChunk *next = c == r->last ? NULL : (BuffChunk *)c->c.next;
+    luaM_freemem(L, c, sizeof(BuffChunk) + c->size);
+    c = next;
   }
+  r->first = r->last = NULL;
+  r->len = 0;
 }
 
 
-static void adjuststack (luaL_Buffer *B) {
-  if (B->lvl > 1) {
-    lua_State *L = B->L;
-    int toget = 1;  /* number of levels to concat */
-    size_t toplen = lua_strlen(L, -1);
-    do {
-      size_t l = lua_strlen(L, -(toget+1));
-      if (B->lvl - toget + 1 >= LIMIT || toplen > l) {
-        toplen += l;
-        toget++;
-      }
-      else break;
-    } while (toget < B->lvl);
-    lua_concat(L, toget);
-    B->lvl = B->lvl - toget + 1;
+static int rope_gc (lua_State *L) {
+  freechunks(L, (luaL_Rope *)lua_touserdata(L, 1));
+  return 0;
+}
+
+
+static void newrope (luaL_Buffer *B) {
+  lua_State *L = B->L;
+  luaL_Rope *r = (luaL_Rope *)lua_newuserdata(L, sizeof(luaL_Rope));
+  r->first = r->last = NULL;
+  r->len = 0;
+  if (luaL_newmetatable(L, ROPE_META)) {
+    lua_pushcfunction(L, rope_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+  B->rope = r;
+  B->lvl++;
+}
+
+
+static void ropeadd (luaL_Buffer *B, const char *s, size_t l) {
+  luaL_Rope *r = B->rope;
+  BuffChunk *c = r->last;
+  if (c != NULL) {  /* fill the last chunk first */
+    size_t n = c->size - c->c.len;
+    if (n > l) n = l;
+    memcpy((char *)(c + 1) + c->c.len, s, n);
+    c->c.len += n;
+    r->len += n;
+    s += n;
+    l -= n;
+  }
+  if (l > 0) {
+    size_t size = l > LUAL_BUFFERCHUNKSIZE ? l : LUAL_BUFFERCHUNKSIZE;
+    c = (BuffChunk *)luaM_malloc(B->L, sizeof(BuffChunk) + size);
+    c->c.next = NULL;
+    c->c.len = l;
+    c->c.data = (const char *)(c + 1);
+    c->size = size;
+    memcpy(c + 1, s, l);
+    if (r->last != NULL)
+      r->last->c.next = &c->c;
+    else
+      r->first = c;
+    r->last = c;
+    r->len += l;
   }
 }
 
 
+static void spillbuffer (luaL_Buffer *B) {
+  size_t l = bufflen(B);
+  if (l == 0) return;  /* nothing to move */
+  if (B->rope == NULL)
+    newrope(B);
+  ropeadd(B, B->buffer, l);
+  B->p = B->buffer;
+}
+
+
 LUALIB_API char *luaL_prepbuffer (luaL_Buffer *B) {
-  if (emptybuffer(B))
-    adjuststack(B);
+  spillbuffer(B);
   return B->buffer;
 }
 
 
 LUALIB_API void luaL_addlstring (luaL_Buffer *B, const char *s, size_t l) {
-  while (l--)
-    luaL_addchar(B, *s++);
+  if (l > bufffree(B)) {
+    spillbuffer(B);
+    if (l > LUAL_BUFFERSIZE) {  /* too big for the buffer? */
+      if (B->rope == NULL)
+        newrope(B);
+      ropeadd(B, s, l);
+      return;
+    }
+  }
+  memcpy(B->p, s, l);
+  B->p += l;
 }
 
 
@@ -502,8 +586,23 @@ LUALIB_API void luaL_addstring (luaL_Buffer *B, const char *s) {
 
 
 LUALIB_API void luaL_pushresult (luaL_Buffer *B) {
-  emptybuffer(B);
-  lua_concat(B->L, B->lvl);
+  lua_State *L = B->L;
+  luaL_Rope *r = B->rope;
+  if (r == NULL || r->first == NULL)
+    lua_pushlstring(L, B->buffer, bufflen(B));
+  else {
+    lua_Chunk tail;  /* what is still in the buffer goes last */
+    tail.next = NULL;
+    tail.len = bufflen(B);
+    tail.data = B->buffer;
+    r->last->c.next = &tail;
+    lua_pushchunks(L, &r->first->c, r->len + tail.len);
+    freechunks(L, r);
+  }
+  if (r != NULL)
+    lua_remove(L, -2);  /* remove rope */
+  B->rope = NULL;
+  B->p = B->buffer;
   B->lvl = 1;
 }
 
@@ -515,14 +614,16 @@ LUALIB_API void luaL_addvalue (luaL_Buffer *B) {
   if (vl <= bufffree(B)) {  /* fit into buffer? */
     memcpy(B->p, s, vl);  /* put it there */
     B->p += vl;
-    lua_pop(L, 1);  /* remove from stack */
   }
   else {
-    if (emptybuffer(B))
-      lua_insert(L, -2);  /* put buffer before new value */
-    B->lvl++;  /* add new value into B stack */
-    adjuststack(B);
+    if (B->rope == NULL) {
+      newrope(B);
+      lua_insert(L, -2);  /* put rope before new value */
+    }
+    spillbuffer(B);
+    ropeadd(B, s, vl);
   }
+  lua_pop(L, 1);  /* remove from stack */
 }
 
 
@@ -530,6 +631,7 @@ LUALIB_API void luaL_buffinit (lua_State *L, luaL_Buffer *B) {
   B->L = L;
   B->p = B->buffer;
   B->lvl = 0;
+  B->rope = NULL;
 }
 
 /* }====================================================== */
@@ -710,6 +812,32 @@ LUALIB_API int (luaL_loadstring) (lua_State *L, const char *s) {
 /* }====================================================== */
 
 
+/*
+** Small blocks are served from the size-class pools when they are enabled.
+** With heap regions, small blocks go to the fast RAM regions and large
+** blocks to the slow ones.
+*/
+#if defined(BUILD_MEMPOOL)
+#define l_realloc(p,os,ns)	mpool_realloc(p, os, ns)
+#define l_free(p,os)	mpool_realloc(p, os, 0)
+#define l_trim()	mpool_trim()
+#elif defined(BUILD_HEAP_REGIONS)
+#define l_realloc(p,os,ns)	heapreg_realloc_hint(p, ns, heapreg_hint(ns))
+#define l_free(p,os)	heapreg_free(p)
+#define l_trim()	((void)0)
+#else
+#define l_realloc(p,os,ns)	realloc(p, ns)
+#define l_free(p,os)	free(p)
+#define l_trim()	((void)0)
+#endif
+
+#ifdef BUILD_ALLOC_TRACE
+#define l_trace(p,os,np,ns)	alloctrace_record(p, os, np, ns)
+#else
+#define l_trace(p,os,np,ns)	((void)0)
+#endif
+
+
 static int l_check_memlimit(lua_State *L, size_t needbytes) {
   global_State *g = G(L);
   int cycle_count = 0;
@@ -734,7 +862,8 @@ static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
   void *nptr;
 
   if (nsize == 0) {
-    free(ptr);
+    l_free(ptr, osize);
+    if (ptr != NULL) l_trace(ptr, osize, NULL, 0);
     return NULL;
   }
   if (L != NULL && (mode & EGC_ALWAYS)) /* always collect memory if requested */
@@ -746,11 +875,13 @@ static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
     if(G(L)->memlimit > 0 && (mode & EGC_ON_MEM_LIMIT) && l_check_memlimit(L, nsize - osize))
       return NULL;
   }
-  nptr = realloc(ptr, nsize);
+  nptr = l_realloc(ptr, osize, nsize);
   if (nptr == NULL && L != NULL && (mode & EGC_ON_ALLOC_FAILURE)) {
     luaC_fullgc(L); /* emergency full collection. */
-    nptr = realloc(ptr, nsize); /* try allocation again */
+    l_trim(); /* return the spare pool slabs */
+    nptr = l_realloc(ptr, osize, nsize); /* try allocation again */
   }
+  if (nptr != NULL) l_trace(ptr, osize, nptr, nsize);
   return nptr;
 }
 
@@ -133,8 +133,9 @@ LUALIB_API const char *(luaL_findtable) (lua_State *L, int idx,
 
 typedef struct luaL_Buffer {
   char *p;			/* current position in buffer */
-  int lvl;  /* number of strings in the stack (level) */
+  int lvl;  /* number of values in the stack (level) */
   lua_State *L;
+  struct luaL_Rope *rope;  /* spilled contents, NULL while all fits in 'buffer' */
   char buffer[LUAL_BUFFERSIZE];
 } luaL_Buffer;
 
@@ -194,10 +194,11 @@ static int luaB_gcinfo (lua_State *L) {
 
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
-    "count", "step", "setpause", "setstepmul","setmemlimit","getmemlimit", NULL};
+    "count", "step", "setpause", "setstepmul","setmemlimit","getmemlimit",
+    "stackcount", "compact", NULL};
   static const int optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
     LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL,
-		LUA_GCSETMEMLIMIT,LUA_GCGETMEMLIMIT};
+		LUA_GCSETMEMLIMIT,LUA_GCGETMEMLIMIT,LUA_GCSTACKCOUNT,LUA_GCCOMPACT};
   int o = luaL_checkoption(L, 1, "collect", opts);
   int ex = luaL_optint(L, 2, 0);
   int res = lua_gc(L, optsnum[o], ex);
@@ -207,6 +208,11 @@ static int luaB_collectgarbage (lua_State *L) {
       lua_pushnumber(L, res + ((lua_Number)b/1024));
       return 1;
     }
+    case LUA_GCSTACKCOUNT: {
+      int b = lua_gc(L, LUA_GCSTACKCOUNTB, 0);
+      lua_pushnumber(L, res + ((lua_Number)b/1024));
+      return 1;
+    }
     case LUA_GCSTEP: {
       lua_pushboolean(L, res);
       return 1;
@@ -617,7 +623,11 @@ static int luaB_auxwrap (lua_State *L) {
 
 
 static int luaB_cocreate (lua_State *L) {
-  lua_State *NL = lua_newthread(L);
+  int stacksize = luaL_optint(L, 2, 0);
+  lua_State *NL;
+  luaL_argcheck(L, stacksize >= 0 && stacksize <= LUAI_MAXCSTACK, 2,
+    "invalid stack size");
+  NL = lua_newthreadsize(L, stacksize);
   luaL_argcheck(L, lua_isfunction(L, 1) && !lua_iscfunction(L, 1), 1,
     "Lua function expected");
   lua_pushvalue(L, 1);  /* move function to top */
@@ -0,0 +1,247 @@
+/*
+** Compacting space for table parts
+** See Copyright Notice in lua.h
+*/
+
+#include <string.h>
+
+#define lcompact_c
+#define LUA_CORE
+
+#include "lua.h"
+
+#include "lcompact.h"
+#include "lgc.h"
+#include "lmem.h"
+#include "lstate.h"
+#include "ltable.h"
+
+
+/*
+** Every block starts with a header that links it back to its owner.  A
+** block is a 'slot' of 'size' bytes (header included) of which the data
+** uses 'used' bytes; the slot is larger than needed when the block was
+** shrunk in place.  Dead blocks have no owner.
+*/
+typedef union CSHeader {
+  L_Umaxalign dummy;  /* ensures maximum alignment for the data */
+  struct {
+    Table *owner;  /* table that owns the block, NULL if dead */
+    lu_int32 size;  /* size of the slot, header included */
+    lu_int32 used;  /* bytes used by the data */
+    lu_byte kind;  /* CS_ARRAY or CS_NODE */
+  } h;
+} CSHeader;
+
+#define CS_ALIGN	8
+
+#define csround(s)	(((s) + (CS_ALIGN - 1)) & ~cast(size_t, CS_ALIGN - 1))
+#define blockdata(b)	cast(void *, (b) + 1)
+#define datablock(p)	(cast(CSHeader *, (p)) - 1)
+#define inspace(cs,p)	(cast(lu_byte *, (p)) >= (cs)->base && \
+			 cast(lu_byte *, (p)) < (cs)->end)
+#define islast(cs,b)	(cast(lu_byte *, (b)) + (b)->h.size == (cs)->top)
+#define slack(b)	((b)->h.size - sizeof(CSHeader) - (b)->h.used)
+
+/* compact when this many bytes are lost in holes */
+#define CS_THRESHOLD(cs)	(((cs)->end - (cs)->base) / 4)
+
+
+void luaCS_open (lua_State *L, size_t size) {
+  global_State *g = G(L);
+  CompactSpace *cs;
+  size = csround(size);
+  cs = cast(CompactSpace *, (*g->frealloc)(g->ud, NULL, 0,
+                                            csround(sizeof(CompactSpace)) + size));
+  if (cs == NULL)  /* not enough memory? */
+    return;  /* run without a compacting space */
+  cs->base = cs->top = cast(lu_byte *, cs) + csround(sizeof(CompactSpace));
+  cs->end = cs->base + size;
+  cs->freebytes = cs->misses = cs->totalmisses = 0;
+  cs->compactions = cs->moved = 0;
+  g->cspace = cs;
+}
+
+
+void luaCS_close (lua_State *L) {
+  global_State *g = G(L);
+  CompactSpace *cs = g->cspace;
+  if (cs == NULL)
+    return;
+  lua_assert(cs->top - cs->base == cs->freebytes);
+  g->cspace = NULL;
+  (*g->frealloc)(g->ud, cs, csround(sizeof(CompactSpace)) + (cs->end - cs->base), 0);
+}
+
+
+static void *csalloc (CompactSpace *cs, Table *t, size_t size, int kind) {
+  CSHeader *b = cast(CSHeader *, cs->top);
+  size = csround(size);
+  if (size + sizeof(CSHeader) > cast(size_t, cs->end - cs->top))
+    return NULL;
+  b->h.owner = t;
+  b->h.size = sizeof(CSHeader) + size;
+  b->h.used = size;
+  b->h.kind = cast_byte(kind);
+  cs->top += b->h.size;
+  return blockdata(b);
+}
+
+
+static void csfree (CompactSpace *cs, CSHeader *b) {
+  if (islast(cs, b)) {
+    cs->freebytes -= slack(b);
+    cs->top = cast(lu_byte *, b);
+  }
+  else {
+    b->h.owner = NULL;
+    cs->freebytes += sizeof(CSHeader) + b->h.used;
+  }
+}
+
+
+/*
+** Reallocate a part of table 't'.  Like luaM_realloc_, raises an error if
+** the memory cannot be allocated.
+*/
+void *luaCS_realloc (lua_State *L, Table *t, void *block,
+                     size_t osize, size_t nsize, int kind) {
+  global_State *g = G(L);
+  CompactSpace *cs = g->cspace;
+  CSHeader *b;
+  void *nblock;
+  if (cs == NULL)
+    return luaM_realloc_(L, block, osize, nsize);
+  if (block == NULL || !inspace(cs, block)) {  /* new block or in the heap? */
+    if (nsize == 0 || (nblock = csalloc(cs, t, nsize, kind)) == NULL) {
+      if (nsize > osize) {
+        cs->misses++;
+        cs->totalmisses++;
+      }
+      return luaM_realloc_(L, block, osize, nsize);
+    }
+    if (block != NULL) {  /* move it from the heap to the space */
+      memcpy(nblock, block, osize < nsize ? osize : nsize);
+      luaM_freemem(L, block, osize);
+    }
+    g->totalbytes += nsize;
+    return nblock;
+  }
+  b = datablock(block);
+  lua_assert(b->h.owner == t && b->h.kind == kind);
+  if (nsize == 0) {
+    csfree(cs, b);
+    g->totalbytes -= osize;
+    return NULL;
+  }
+  if (islast(cs, b)) {  /* last block: resize it in place if possible */
+    size_t size = sizeof(CSHeader) + csround(nsize);
+    if (size <= cast(size_t, cs->end - cast(lu_byte *, b))) {
+      cs->freebytes -= slack(b);
+      cs->top = cast(lu_byte *, b) + size;
+      b->h.size = size;
+      b->h.used = csround(nsize);
+      g->totalbytes += nsize - osize;
+      return block;
+    }
+  }
+  else if (csround(nsize) <= b->h.used) {  /* shrink it in place */
+    cs->freebytes += b->h.used - csround(nsize);
+    b->h.used = csround(nsize);
+    g->totalbytes -= osize - nsize;
+    return block;
+  }
+  if ((nblock = csalloc(cs, t, nsize, kind)) == NULL) {  /* space is full? */
+    cs->misses++;
+    cs->totalmisses++;
+    nblock = luaM_malloc(L, nsize);
+  }
+  else
+    g->totalbytes += nsize;
+  memcpy(nblock, block, osize < nsize ? osize : nsize);
+  csfree(cs, b);
+  g->totalbytes -= osize;
+  return nblock;
+}
+
+
+/*
+** Point the owner of a block that was moved by 'delta' bytes to the new
+** copy (the hash part also has the chain links and 'lastfree' to fix)
+*/
+static void fixowner (CSHeader *b, ptrdiff_t delta) {
+  Table *t = b->h.owner;
+  if (b->h.kind == CS_ARRAY)
+    t->array = cast(TValue *, blockdata(b));
+  else {
+    Node *n = cast(Node *, blockdata(b));
+    int i;
+    for (i = 0; i < sizenode(t); i++)
+      if (gnext(&n[i]) != NULL)
+        gnext(&n[i]) = cast(Node *, cast(lu_byte *, gnext(&n[i])) + delta);
+    t->lastfree = n + (t->lastfree - t->node);
+    t->node = n;
+  }
+}
+
+
+/*
+** Slide all the live blocks to the start of the space.  Only allowed
+** when nobody holds pointers into the table parts: never inside a
+** collector step or from inside the allocator.
+*/
+void luaCS_compact (lua_State *L) {
+  CompactSpace *cs = G(L)->cspace;
+  lu_byte *src, *dst;
+  if (cs == NULL)
+    return;
+  lua_assert(!is_block_gc(L));
+  src = dst = cs->base;
+  while (src < cs->top) {
+    CSHeader *b = cast(CSHeader *, src);
+    lu_int32 size = b->h.size;
+    if (b->h.owner != NULL) {
+      lu_int32 nsize = sizeof(CSHeader) + b->h.used;
+      if (dst != src) {
+        memmove(dst, src, nsize);
+        b = cast(CSHeader *, dst);
+        fixowner(b, dst - src);
+        cs->moved += nsize;
+      }
+      b->h.size = nsize;
+      dst += nsize;
+    }
+    src += size;
+  }
+  cs->top = dst;
+  cs->freebytes = cs->misses = 0;
+  cs->compactions++;
+}
+
+
+/*
+** Called after a collector step; compacts the space at the end of a
+** cycle if it is fragmented or if blocks had to go to the heap
+*/
+void luaCS_step (lua_State *L) {
+  global_State *g = G(L);
+  CompactSpace *cs = g->cspace;
+  if (cs != NULL && g->gcstate == GCSpause && !is_block_gc(L) &&
+      cs->freebytes > 0 &&
+      (cs->misses > 0 || cs->freebytes >= cast(lu_int32, CS_THRESHOLD(cs))))
+    luaCS_compact(L);
+}
+
+
+int luaCS_getstats (lua_State *L, CSStats *s) {
+  CompactSpace *cs = G(L)->cspace;
+  if (cs == NULL)
+    return 0;
+  s->size = cast(lu_int32, cs->end - cs->base);
+  s->used = cast(lu_int32, cs->top - cs->base);
+  s->holes = cs->freebytes;
+  s->misses = cs->totalmisses;
+  s->compactions = cs->compactions;
+  s->moved = cs->moved;
+  return 1;
+}
@@ -0,0 +1,56 @@
+/*
+** Compacting space for table parts
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lcompact_h
+#define lcompact_h
+
+
+#include "lobject.h"
+
+
+/*
+** The array and hash parts of the tables are the largest objects the VM
+** resizes over and over, so they are the main source of heap fragmentation.
+** When a compacting space is open they are bump-allocated from a single
+** memory area; each block remembers the table that owns it, so the area
+** can be compacted (live blocks slid down, holes removed) while the
+** collector is paused.  Blocks that do not fit in the space go to the
+** heap and move back to the space the next time they are resized.
+*/
+
+/* kinds of blocks (what the owner points to) */
+#define CS_ARRAY	0
+#define CS_NODE		1
+
+typedef struct CompactSpace {
+  lu_byte *base;  /* start of the space */
+  lu_byte *top;  /* first free byte */
+  lu_byte *end;  /* end of the space */
+  lu_int32 freebytes;  /* bytes in holes below 'top' */
+  lu_int32 misses;  /* blocks sent to the heap since the last compaction */
+  lu_int32 totalmisses;
+  lu_int32 compactions;  /* number of compactions */
+  lu_int32 moved;  /* bytes moved by all compactions */
+} CompactSpace;
+
+typedef struct CSStats {
+  lu_int32 size;  /* size of the space */
+  lu_int32 used;  /* bytes below 'top' (including holes and headers) */
+  lu_int32 holes;  /* bytes in holes below 'top' */
+  lu_int32 misses;  /* blocks that did not fit in the space */
+  lu_int32 compactions;
+  lu_int32 moved;
+} CSStats;
+
+
+LUAI_FUNC void luaCS_open (lua_State *L, size_t size);
+LUAI_FUNC void luaCS_close (lua_State *L);
+LUAI_FUNC void *luaCS_realloc (lua_State *L, Table *t, void *block,
+                               size_t osize, size_t nsize, int kind);
+LUAI_FUNC void luaCS_compact (lua_State *L);
+LUAI_FUNC void luaCS_step (lua_State *L);
+LUAI_FUNC int luaCS_getstats (lua_State *L, CSStats *s);
+
+#endif
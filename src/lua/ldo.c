@@ -150,6 +150,7 @@ void luaD_reallocstack (lua_State *L, int newsize) {
   set_block_gc(L);       /* The GC MUST be blocked during stack reallocaiton */
   luaM_reallocvector(L, L->stack, L->stacksize, realsize, TValue);
   if (!block_status) unset_block_gc(L);  /* Honour the previous block status */
+  G(L)->stackbytes += (realsize - L->stacksize)*sizeof(TValue);
   L->stacksize = realsize;
   L->stack_last = L->stack+newsize;
   correctstack(L, oldstack);
@@ -159,6 +160,7 @@ void luaD_reallocstack (lua_State *L, int newsize) {
 void luaD_reallocCI (lua_State *L, int newsize) {
   CallInfo *oldci = L->base_ci;
   luaM_reallocvector(L, L->base_ci, L->size_ci, newsize, CallInfo);
+  G(L)->stackbytes += (newsize - L->size_ci)*sizeof(CallInfo);
   L->size_ci = newsize;
   L->ci = (L->ci - oldci) + L->base_ci;
   L->end_ci = L->base_ci + L->size_ci - 1;
@@ -504,7 +506,8 @@ int luaD_pcall (lua_State *L, Pfunc func, void *u,
 */
 struct SParser {  /* data to `f_parser' */
   ZIO *z;
-  Mbuffer buff;  /* buffer to be used by the scanner */
+  Mbuffer buff;  /* buffer to be used by the undumper */
+  MArena arena;  /* scratch memory to be used by the parser */
   const char *name;
 };
 
@@ -516,8 +519,8 @@ static void f_parser (lua_State *L, void *ud) {
   int c = luaZ_lookahead(p->z);
   luaC_checkGC(L);
   set_block_gc(L);  /* stop collector during parsing */
-  tf = ((c == LUA_SIGNATURE[0]) ? luaU_undump : luaY_parser)(L, p->z,
-                                                             &p->buff, p->name);
+  tf = (c == LUA_SIGNATURE[0]) ? luaU_undump(L, p->z, &p->buff, p->name) :
+                                 luaY_parser(L, p->z, &p->arena, p->name);
   cl = luaF_newLclosure(L, tf->nups, hvalue(gt(L)));
   cl->l.p = tf;
   for (i = 0; i < tf->nups; i++)  /* initialize eventual upvalues */
@@ -533,8 +536,10 @@ int luaD_protectedparser (lua_State *L, ZIO *z, const char *name) {
   int status;
   p.z = z; p.name = name;
   luaZ_initbuffer(L, &p.buff);
+  luaM_initarena(&p.arena);
   status = luaD_pcall(L, f_parser, &p, savestack(L, L->top), L->errfunc);
   luaZ_freebuffer(L, &p.buff);
+  luaM_freearena(L, &p.arena);
   return status;
 }
 
@@ -139,13 +139,15 @@ Proto *luaF_newproto (lua_State *L) {
 
 
 void luaF_freeproto (lua_State *L, Proto *f) {
-  luaM_freearray(L, f->p, f->sizep, Proto *);
-  luaM_freearray(L, f->k, f->sizek, TValue);
-  luaM_freearray(L, f->locvars, f->sizelocvars, struct LocVar);
-  luaM_freearray(L, f->upvalues, f->sizeupvalues, TString *);
-  if (!proto_is_readonly(f)) {
-    luaM_freearray(L, f->code, f->sizecode, Instruction);
-    luaM_freearray(L, f->lineinfo, f->sizelineinfo, int);
+  if (!proto_is_parsing(f)) {  /* else vectors are freed with the arena */
+    luaM_freearray(L, f->p, f->sizep, Proto *);
+    luaM_freearray(L, f->k, f->sizek, TValue);
+    luaM_freearray(L, f->locvars, f->sizelocvars, struct LocVar);
+    luaM_freearray(L, f->upvalues, f->sizeupvalues, TString *);
+    if (!proto_is_readonly(f)) {
+      luaM_freearray(L, f->code, f->sizecode, Instruction);
+      luaM_freearray(L, f->lineinfo, f->sizelineinfo, int);
+    }
   }
   luaM_free(L, f);
 }
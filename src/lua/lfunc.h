@@ -20,6 +20,9 @@
 
 #define proto_readonly(p) l_setbit((p)->marked, READONLYBIT)
 #define proto_is_readonly(p) testbit((p)->marked, READONLYBIT)
+#define proto_parsing(p) l_setbit((p)->marked, PARSINGBIT)
+#define proto_unsetparsing(p) resetbit((p)->marked, PARSINGBIT)
+#define proto_is_parsing(p) testbit((p)->marked, PARSINGBIT)
 
 LUAI_FUNC Proto *luaF_newproto (lua_State *L);
 LUAI_FUNC Closure *luaF_newCclosure (lua_State *L, int nelems, Table *e);
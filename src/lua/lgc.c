@@ -240,11 +240,26 @@ static void traverseclosure (global_State *g, Closure *cl) {
 }
 
 
+/* thread is suspended, dead or was never resumed */
+#define isidle(L) \
+  ((L)->status != 0 || ((L)->ci == (L)->base_ci && (L) != G(L)->mainthread))
+
+
 static void checkstacksizes (lua_State *L, StkId max) {
   int ci_used = cast_int(L->ci - L->base_ci);  /* number of `ci' in use */
   int s_used = cast_int(max - L->stack);  /* part of stack in use */
   if (L->size_ci > LUAI_MAXCALLS)  /* handling overflow? */
     return;  /* do not touch the stacks */
+  if (isidle(L)) {  /* shrink it to what it uses now */
+    int s_min = L->minstacksize - EXTRA_STACK - 1;
+    int ci_min = ci_used + 1 > BASIC_CI_SIZE ? ci_used + 1 : BASIC_CI_SIZE;
+    if (s_used < s_min) s_used = s_min;
+    if (ci_min < L->size_ci)
+      luaD_reallocCI(L, ci_min);
+    if (s_used + 1 + EXTRA_STACK < L->stacksize)
+      luaD_reallocstack(L, s_used);
+    return;
+  }
   if (4*ci_used < L->size_ci && 2*BASIC_CI_SIZE < L->size_ci)
     luaD_reallocCI(L, L->size_ci/2);  /* still big enough... */
   condhardstacktests(luaD_reallocCI(L, ci_used + 1));
@@ -8,6 +8,7 @@
 #define lgc_h
 
 
+#include "lcompact.h"
 #include "lobject.h"
 
 
@@ -63,6 +64,7 @@
 ** bit 3 - for thread: Don't resize thread's stack
 ** bit 3 - for userdata: has been finalized
 ** bit 3 - for tables: has weak keys
+** bit 3 - for prototypes: vectors still owned by the parser arena
 ** bit 4 - for tables: has weak values
 ** bit 5 - object is fixed (should not be collected)
 ** bit 6 - object is "super" fixed (only the main thread)
@@ -76,6 +78,7 @@
 #define FIXEDSTACKBIT	3
 #define FINALIZEDBIT	3
 #define KEYWEAKBIT	3
+#define PARSINGBIT	3
 #define VALUEWEAKBIT	4
 #define FIXEDBIT	5
 #define SFIXEDBIT	6
@@ -103,8 +106,9 @@
 
 #define luaC_checkGC(L) { \
   condhardstacktests(luaD_reallocstack(L, L->stacksize - EXTRA_STACK - 1)); \
-  if (G(L)->totalbytes >= G(L)->GCthreshold) \
-	luaC_step(L); }
+  if (G(L)->totalbytes >= G(L)->GCthreshold) { \
+	luaC_step(L); \
+	luaCS_step(L); } }
 
 
 #define luaC_barrier(L,p,v) { if (valiswhite(v) && isblack(obj2gco(p)))  \
@@ -18,6 +18,9 @@
 #include "lauxlib.h"
 #include "lualib.h"
 #include "lrotable.h"
+#ifndef LUA_CROSS_COMPILER
+#include "devman.h"
+#endif
 
 
 #define IO_INPUT	1
@@ -492,13 +495,23 @@ static int f_setvbuf (lua_State *L) {
 
 
 
+/* flush the stdio buffer, then the buffers of the file system */
+static int flushfile (FILE *f) {
+#ifndef LUA_CROSS_COMPILER
+  return fflush(f) == 0 && dm_fsync(fileno(f)) == 0;
+#else
+  return fflush(f) == 0;
+#endif
+}
+
+
 static int io_flush (lua_State *L) {
-  return pushresult(L, fflush(getiofile(L, IO_OUTPUT)) == 0, NULL);
+  return pushresult(L, flushfile(getiofile(L, IO_OUTPUT)), NULL);
 }
 
 
 static int f_flush (lua_State *L) {
-  return pushresult(L, fflush(tofile(L)) == 0, NULL);
+  return pushresult(L, flushfile(tofile(L)), NULL);
 }
 
 #define MIN_OPT_LEVEL 2
@@ -47,6 +47,12 @@ const char *const luaX_tokens [] = {
 
 #define save_and_next(ls) (save(ls, ls->current), next(ls))
 
+/* the token buffer lives in the parser arena, across all functions */
+#define resizebuffer(ls, b, size) \
+	(luaM_arenaresizevector((ls)->L, (ls)->arena, (b)->buffer, \
+	                        (b)->buffsize, size, char, 1), \
+	(b)->buffsize = size)
+
 
 static void save (LexState *ls, int c) {
   Mbuffer *b = ls->buff;
@@ -55,7 +61,7 @@ static void save (LexState *ls, int c) {
     if (b->buffsize >= MAX_SIZET/2)
       luaX_lexerror(ls, "lexical element too long", 0);
     newsize = b->buffsize * 2;
-    luaZ_resizebuffer(ls->L, b, newsize);
+    resizebuffer(ls, b, newsize);
   }
   b->buffer[b->n++] = cast(char, c);
 }
@@ -139,7 +145,7 @@ void luaX_setinput (lua_State *L, LexState *ls, ZIO *z, TString *source) {
   ls->linenumber = 1;
   ls->lastline = 1;
   ls->source = source;
-  luaZ_resizebuffer(ls->L, ls->buff, LUA_MINBUFFER);  /* initialize buffer */
+  resizebuffer(ls, ls->buff, LUA_MINBUFFER);  /* initialize buffer */
   next(ls);  /* read first char */
 }
 
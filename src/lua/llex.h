@@ -62,6 +62,7 @@ typedef struct LexState {
   struct lua_State *L;
   ZIO *z;  /* input stream */
   Mbuffer *buff;  /* buffer for tokens */
+  MArena *arena;  /* scratch memory for the parser */
   TString *source;  /* current source name */
   char decpoint;  /* locale decimal point */
 } LexState;
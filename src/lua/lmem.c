@@ -6,6 +6,7 @@
 
 
 #include <stddef.h>
+#include <string.h>
 
 #define lmem_c
 #define LUA_CORE
@@ -43,26 +44,259 @@
 #define MINSIZEARRAY	4
 
 
-void *luaM_growaux_ (lua_State *L, void *block, int *size, size_t size_elems,
-                     int limit, const char *errormsg) {
-  void *newblock;
-  int newsize;
-  if (*size >= limit/2) {  /* cannot double it? */
-    if (*size >= limit)  /* cannot grow even a little? */
+static int growsize (lua_State *L, int size, int limit, const char *errormsg) {
+  if (size >= limit/2) {  /* cannot double it? */
+    if (size >= limit)  /* cannot grow even a little? */
       luaG_runerror(L, errormsg);
-    newsize = limit;  /* still have at least one free place */
+    return limit;  /* still have at least one free place */
   }
   else {
-    newsize = (*size)*2;
+    int newsize = size*2;
     if (newsize < MINSIZEARRAY)
       newsize = MINSIZEARRAY;  /* minimum size */
+    return newsize;
   }
+}
+
+
+void *luaM_growaux_ (lua_State *L, void *block, int *size, size_t size_elems,
+                     int limit, const char *errormsg) {
+  void *newblock;
+  int newsize = growsize(L, *size, limit, errormsg);
   newblock = luaM_reallocv(L, block, *size, newsize, size_elems);
   *size = newsize;  /* update only when everything else is OK */
   return newblock;
 }
 
 
+/*
+** copy a vector into a new block of exactly 'n' elements
+*/
+/*
+** {======================================================
+** Scratch arena
+** =======================================================
+*/
+
+/*
+** Small allocations are carved from the current block with a bump pointer.
+** Allocations bigger than an eighth of a block (so that the old copies a
+** growing vector leaves behind stay small), and the ones that must survive the
+** release of newer space (the token buffer, the vectors of an enclosing
+** function), get a block of their own (kept in the 'own' list), so growing
+** them reallocates that block and closing a function can hand it over.
+*/
+typedef union MArenaBlock {
+  L_Umaxalign dummy;  /* ensures maximum alignment for the data */
+  struct {
+    union MArenaBlock *prev;  /* previous (older) block */
+    size_t size;  /* size of the data area */
+    size_t used;  /* bytes of the data area already handed out */
+    unsigned int seq;  /* own blocks: creation order */
+    lu_byte keep;  /* own blocks: not given back by luaM_arenarelease */
+  } b;
+} MArenaBlock;
+
+#define blockdata(b)	cast(char *, (b) + 1)
+#define datablock(p)	(cast(MArenaBlock *, (p)) - 1)
+
+#define arenaround(s) \
+  ((((s) + sizeof(L_Umaxalign) - 1) / sizeof(L_Umaxalign)) * sizeof(L_Umaxalign))
+
+#define isbig(s)	((s) > LUAI_ARENABLOCK/8)
+
+
+static void *smallalloc (lua_State *L, MArena *a, size_t need) {
+  MArenaBlock *b = a->block;
+  void *block;
+  if (b == NULL || b->b.used + need > b->b.size) {  /* need a new block? */
+    MArenaBlock *nb = cast(MArenaBlock *,
+                         luaM_malloc(L, sizeof(MArenaBlock) + LUAI_ARENABLOCK));
+    nb->b.prev = b;
+    nb->b.size = LUAI_ARENABLOCK;
+    nb->b.used = 0;
+    a->block = b = nb;
+  }
+  block = blockdata(b) + b->b.used;
+  b->b.used += need;
+  a->last = block;
+  return block;
+}
+
+
+static void *ownalloc (lua_State *L, MArena *a, size_t need, int keep) {
+  MArenaBlock *b = cast(MArenaBlock *,
+                        luaM_malloc(L, sizeof(MArenaBlock) + need));
+  b->b.prev = a->own;
+  b->b.size = b->b.used = need;
+  b->b.seq = a->nown++;
+  b->b.keep = cast_byte(keep);
+  a->own = b;
+  return blockdata(b);
+}
+
+
+/* link to the block of its own holding 'block', or to NULL if there is none */
+static MArenaBlock **findown (MArena *a, void *block) {
+  MArenaBlock **pb = &a->own;
+  while (*pb != NULL && *pb != datablock(block))
+    pb = &(*pb)->b.prev;
+  return pb;
+}
+
+
+void *luaM_arenarealloc_ (lua_State *L, MArena *a, void *block,
+                          size_t osize, size_t nsize, int keep) {
+  size_t need = arenaround(nsize);
+  void *newblock;
+  lua_assert((osize == 0) == (block == NULL));
+  if (block != NULL) {
+    MArenaBlock **pb = findown(a, block);
+    MArenaBlock *b = *pb;
+    if (b != NULL) {  /* in a block of its own? */
+      if (nsize > 0 && (keep || isbig(need))) {  /* resize that block */
+        b = cast(MArenaBlock *, luaM_realloc_(L, b,
+                     sizeof(MArenaBlock) + b->b.size, sizeof(MArenaBlock) + need));
+        b->b.size = b->b.used = need;
+        b->b.keep |= keep;
+        *pb = b;
+        return blockdata(b);
+      }
+      newblock = NULL;
+      if (nsize > 0) {
+        newblock = smallalloc(L, a, need);
+        memcpy(newblock, block, nsize);
+      }
+      *pb = b->b.prev;  /* unchain and free the old block */
+      luaM_freemem(L, b, sizeof(MArenaBlock) + b->b.size);
+      return newblock;
+    }
+  }
+  if (block != NULL && block == a->last) {  /* most recent allocation? */
+    MArenaBlock *b = a->block;
+    size_t start = cast(char *, block) - blockdata(b);
+    if (!keep && !isbig(need) && start + need <= b->b.size) {  /* in place */
+      b->b.used = start + need;
+      if (nsize == 0)
+        a->last = NULL;
+      return nsize == 0 ? NULL : block;
+    }
+    b->b.used = start;  /* give its space back; contents are still there */
+    a->last = NULL;
+  }
+  if (nsize == 0)
+    return NULL;  /* space is reclaimed by luaM_arenarelease */
+  newblock = (keep || isbig(need)) ? ownalloc(L, a, need, keep) :
+                                     smallalloc(L, a, need);
+  if (block != NULL)
+    memcpy(newblock, block, osize < nsize ? osize : nsize);
+  return newblock;
+}
+
+
+void *luaM_arenagrowaux_ (lua_State *L, MArena *a, void *block, int *size,
+                          size_t size_elems, int limit,
+                          const char *errormsg, int keep) {
+  void *newblock;
+  int newsize = growsize(L, *size, limit, errormsg);
+  if (cast(size_t, newsize)+1 > MAX_SIZET/size_elems)
+    luaM_toobig(L);
+  newblock = luaM_arenarealloc_(L, a, block, (*size)*size_elems,
+                                newsize*size_elems, keep);
+  *size = newsize;  /* update only when everything else is OK */
+  return newblock;
+}
+
+
+/*
+** take 'block' out of the arena as a general allocation of 'nsize' bytes
+** (its first 'nsize' bytes). A block of its own is shrunk where it is, a
+** small allocation is copied.
+*/
+void *luaM_arenadetach_ (lua_State *L, MArena *a, void *block,
+                         size_t nsize) {
+  MArenaBlock **pb;
+  void *newblock = NULL;
+  if (block == NULL)
+    return NULL;
+  pb = findown(a, block);
+  if (*pb != NULL) {
+    MArenaBlock *b = *pb;
+    size_t osize = sizeof(MArenaBlock) + b->b.size;
+    *pb = b->b.prev;
+    if (nsize == 0) {
+      luaM_freemem(L, b, osize);
+      return NULL;
+    }
+    memmove(b, blockdata(b), nsize);  /* overwrites the header */
+    return luaM_realloc_(L, b, osize, nsize);
+  }
+  if (nsize > 0) {
+    newblock = luaM_malloc(L, nsize);
+    memcpy(newblock, block, nsize);
+  }
+  if (block == a->last) {  /* give its space back */
+    a->block->b.used = cast(char *, block) - blockdata(a->block);
+    a->last = NULL;
+  }
+  return newblock;
+}
+
+
+void luaM_arenamark (MArena *a, MArenaMark *m) {
+  m->block = a->block;
+  m->used = a->block != NULL ? a->block->b.used : 0;
+  m->nown = a->nown;
+}
+
+
+/*
+** give back all the space allocated after mark 'm', except for the blocks
+** to keep
+*/
+void luaM_arenarelease (lua_State *L, MArena *a, const MArenaMark *m) {
+  MArenaBlock *b;
+  MArenaBlock **pb = &a->own;
+  while (*pb != NULL) {  /* free own blocks allocated after the mark */
+    b = *pb;
+    if (b->b.seq >= m->nown && !b->b.keep) {
+      *pb = b->b.prev;
+      luaM_freemem(L, b, sizeof(MArenaBlock) + b->b.size);
+    }
+    else
+      pb = &b->b.prev;
+  }
+  b = a->block;
+  while (b != m->block) {  /* free newer small blocks */
+    MArenaBlock *prev = b->b.prev;
+    luaM_freemem(L, b, sizeof(MArenaBlock) + b->b.size);
+    b = prev;
+  }
+  a->block = b;
+  a->last = NULL;
+  if (b != NULL)
+    b->b.used = m->used;
+}
+
+
+static void freeblocks (lua_State *L, MArenaBlock *b) {
+  while (b != NULL) {
+    MArenaBlock *prev = b->b.prev;
+    luaM_freemem(L, b, sizeof(MArenaBlock) + b->b.size);
+    b = prev;
+  }
+}
+
+
+void luaM_freearena (lua_State *L, MArena *a) {
+  freeblocks(L, a->block);
+  freeblocks(L, a->own);
+  luaM_initarena(a);
+}
+
+/* }====================================================== */
+
+
 void *luaM_toobig (lua_State *L) {
   luaG_runerror(L, "memory allocation error: block too big");
   return NULL;  /* to avoid warnings */
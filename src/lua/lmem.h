@@ -37,6 +37,40 @@
 #define luaM_reallocvector(L, v,oldn,n,t) \
    ((v)=cast(t *, luaM_reallocv(L, v, oldn, n, sizeof(t))))
 
+/*
+** Scratch arena: memory taken from the general allocator in blocks and
+** handed out with a bump pointer. Space is given back in stack order with
+** luaM_arenarelease and all at once by luaM_freearena. Allocations made
+** with 'keep' set survive luaM_arenarelease; luaM_arenadetach_ hands an
+** allocation over to the general allocator.
+*/
+typedef struct MArenaMark {
+  union MArenaBlock *block;
+  size_t used;
+  unsigned int nown;
+} MArenaMark;
+
+typedef struct MArena {
+  union MArenaBlock *block;  /* current block (chained to the older ones) */
+  union MArenaBlock *own;  /* blocks holding a single allocation */
+  void *last;  /* most recent allocation, can be resized in place */
+  unsigned int nown;  /* number of own blocks created so far */
+} MArena;
+
+#define luaM_initarena(a) \
+	((a)->block = (a)->own = NULL, (a)->last = NULL, (a)->nown = 0)
+
+#define luaM_arenagrowvector(L,a,v,nelems,size,t,limit,e,keep) \
+          if ((nelems)+1 > (size)) \
+            ((v)=cast(t *, luaM_arenagrowaux_(L,a,v,&(size),sizeof(t),limit,e,keep)))
+
+#define luaM_arenaresizevector(L,a,v,oldn,n,t,keep) \
+   ((v)=cast(t *, luaM_arenarealloc_(L, a, v, (oldn)*sizeof(t), (n)*sizeof(t), \
+                                     keep)))
+
+#define luaM_arenadetachvector(L,a,v,n,t) \
+   cast(t *, luaM_arenadetach_(L, a, v, (n)*sizeof(t)))
+
 
 LUAI_FUNC void *luaM_realloc_ (lua_State *L, void *block, size_t oldsize,
                                                           size_t size);
@@ -44,6 +78,17 @@ LUAI_FUNC void *luaM_toobig (lua_State *L);
 LUAI_FUNC void *luaM_growaux_ (lua_State *L, void *block, int *size,
                                size_t size_elem, int limit,
                                const char *errormsg);
+LUAI_FUNC void *luaM_arenarealloc_ (lua_State *L, MArena *a, void *block,
+                                    size_t oldsize, size_t size, int keep);
+LUAI_FUNC void *luaM_arenagrowaux_ (lua_State *L, MArena *a, void *block,
+                                    int *size, size_t size_elem, int limit,
+                                    const char *errormsg, int keep);
+LUAI_FUNC void *luaM_arenadetach_ (lua_State *L, MArena *a, void *block,
+                                   size_t size);
+LUAI_FUNC void luaM_arenamark (MArena *a, MArenaMark *m);
+LUAI_FUNC void luaM_arenarelease (lua_State *L, MArena *a,
+                                  const MArenaMark *m);
+LUAI_FUNC void luaM_freearena (lua_State *L, MArena *a);
 
 #endif
 
@@ -102,6 +102,181 @@ int luaO_str2d (const char *s, lua_Number *result) {
 }
 
 
+/*
+** Number to text conversions.  They write the same text as sprintf with
+** "%d" and "%.<prec>g", without going through stdio.  They do not add
+** a terminating '\0' and return the length of the text.
+*/
+
+static const char digitpairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233"
+  "34353637383940414243444546474849505152535455565758596061626364656667"
+  "6869707172737475767778798081828384858687888990919293949596979899";
+
+
+/* writes 'v' backwards, ending at 'e'; returns the first char */
+static char *fmtuint (char *e, unsigned LUA_INTFRM_T v) {
+  unsigned long w;
+  while (v > (unsigned long)-1) {  /* avoid long divisions if possible */
+    unsigned i = cast(unsigned, v % 100) * 2;
+    v /= 100;
+    *--e = digitpairs[i+1];
+    *--e = digitpairs[i];
+  }
+  w = cast(unsigned long, v);
+  while (w >= 100) {
+    unsigned i = cast(unsigned, w % 100) * 2;
+    w /= 100;
+    *--e = digitpairs[i+1];
+    *--e = digitpairs[i];
+  }
+  if (w >= 10) {
+    *--e = digitpairs[w*2+1];
+    *--e = digitpairs[w*2];
+  }
+  else
+    *--e = cast(char, '0' + w);
+  return e;
+}
+
+
+int luaO_fmtint (char *s, LUA_INTFRM_T v) {
+  char buff[3*sizeof(LUA_INTFRM_T) + 2];
+  char *e = buff + sizeof(buff);
+  char *p = fmtuint(e, (v < 0) ? 0u - cast(unsigned LUA_INTFRM_T, v)
+                                : cast(unsigned LUA_INTFRM_T, v));
+  if (v < 0) *--p = '-';
+  memcpy(s, p, e - p);
+  return cast_int(e - p);
+}
+
+
+#if !defined LUA_NUMBER_INTEGRAL
+
+static const double pow10tab[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+  1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* 'a' times 10^k, with a single rounding (10^k is exact up to 1e22) */
+#define scale10(a,k)	((k) >= 0 ? (a) * pow10tab[k] : (a) / pow10tab[-(k)])
+
+
+/*
+** "%.<prec>g" for 1 <= 'prec' <= 15.  The 'prec' significant digits are
+** 'a' scaled by a power of ten and rounded to an integer; as the scaling
+** rounds only once, the result is exact unless the fraction is within an
+** ulp of one half.  Returns -1 in that case (and for values too large or
+** too small to be scaled that way), leaving the job to sprintf.
+*/
+int luaO_fmtg (char *s, lua_Number n, int prec) {
+  char digits[16];
+  char *p = s;
+  double a, y, f;
+  unsigned long hi, lo;
+  int x, k, nd, e2, i;
+  lua_assert(1 <= prec && prec <= 15);
+  if (n != n || n - n != 0)  /* nan or inf? */
+    return -1;
+  if (n < 0 || (n == 0 && 1/n < 0)) {
+    *p++ = '-';
+    a = -n;
+  }
+  else a = n;
+  if (a == 0) {
+    *p++ = '0';
+    return cast_int(p - s);
+  }
+  frexp(a, &e2);
+  x = cast_int(floor((e2 - 1) * 0.30102999566398));  /* log10(a) or 1 less */
+  for (i = 0; ; i++) {  /* correct the estimate */
+    k = prec - 1 - x;
+    if (i > 1 || k < -22 || k > 22)
+      return -1;
+    y = scale10(a, k);
+    if (y >= pow10tab[prec]) x++;
+    else break;
+  }
+  if (y < pow10tab[prec - 1])  /* rounded down to the previous decade? */
+    return -1;
+  f = y - floor(y);
+  frexp(y, &e2);
+  if (fabs(f - 0.5) <= ldexp(1.0, e2 - 53))  /* too close to call? */
+    return -1;
+  y = floor(y) + (f > 0.5);
+  if (y == pow10tab[prec]) {  /* 9.99... rounded up to 10.0 */
+    y = pow10tab[prec - 1];
+    x++;
+  }
+  /* split the digits in two halves that fit in a long */
+  hi = cast(unsigned long, floor(y / 1e8));
+  lo = cast(unsigned long, y - hi * 1e8);
+  for (i = prec - 1; i >= 0 && i >= prec - 8; i--) {
+    digits[i] = cast(char, '0' + lo % 10);
+    lo /= 10;
+  }
+  for (; i >= 0; i--) {
+    digits[i] = cast(char, '0' + hi % 10);
+    hi /= 10;
+  }
+  for (nd = prec; nd > 1 && digits[nd - 1] == '0'; nd--) ;  /* strip zeros */
+  if (x < -4 || x >= prec) {  /* exponent notation */
+    *p++ = digits[0];
+    if (nd > 1) {
+      *p++ = '.';
+      memcpy(p, digits + 1, nd - 1);
+      p += nd - 1;
+    }
+    *p++ = 'e';
+    *p++ = (x < 0) ? '-' : '+';
+    if (x < 0) x = -x;
+    if (x < 10) *p++ = '0';
+    p += luaO_fmtint(p, x);
+  }
+  else if (x >= 0) {
+    for (i = 0; i <= x; i++)
+      *p++ = (i < nd) ? digits[i] : '0';
+    if (nd > x + 1) {
+      *p++ = '.';
+      memcpy(p, digits + x + 1, nd - x - 1);
+      p += nd - x - 1;
+    }
+  }
+  else {
+    *p++ = '0';
+    *p++ = '.';
+    for (i = x + 1; i < 0; i++)
+      *p++ = '0';
+    memcpy(p, digits, nd);
+    p += nd;
+  }
+  return cast_int(p - s);
+}
+
+#endif
+
+
+/* writes 'n' as LUA_NUMBER_FMT would */
+int luaO_fmtnum (char *s, lua_Number n) {
+#if defined LUA_NUMBER_INTEGRAL
+  return luaO_fmtint(s, n);
+#else
+  int l;
+  if (n > -2147483648.0 && n < 2147483648.0 && n == cast_num(cast(long, n)) &&
+      (n != 0 || 1/n > 0))  /* integral value (but not -0)? */
+    return luaO_fmtint(s, cast(long, n));
+  l = luaO_fmtg(s, n, LUAI_NUMPRECISION);
+  if (l < 0) {
+    char buff[LUAI_MAXNUMBER2STR];
+    lua_number2str(buff, n);
+    l = cast_int(strlen(buff));
+    memcpy(s, buff, l);
+  }
+  return l;
+#endif
+}
+
+
 
 static void pushstr (lua_State *L, const char *str) {
   setsvalue2s(L, L->top, luaS_new(L, str));
@@ -547,6 +547,11 @@ LUAI_FUNC int luaO_int2fb (unsigned int x);
 LUAI_FUNC int luaO_fb2int (int x);
 LUAI_FUNC int luaO_rawequalObj (const TValue *t1, const TValue *t2);
 LUAI_FUNC int luaO_str2d (const char *s, lua_Number *result);
+LUAI_FUNC int luaO_fmtint (char *s, LUA_INTFRM_T v);
+#if !defined LUA_NUMBER_INTEGRAL
+LUAI_FUNC int luaO_fmtg (char *s, lua_Number n, int prec);
+#endif
+LUAI_FUNC int luaO_fmtnum (char *s, lua_Number n);
 LUAI_FUNC const char *luaO_pushvfstring (lua_State *L, const char *fmt,
                                                        va_list argp);
 LUAI_FUNC const char *luaO_pushfstring (lua_State *L, const char *fmt, ...);
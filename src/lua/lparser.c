@@ -144,7 +144,7 @@ static int registerlocalvar (LexState *ls, TString *varname) {
   FuncState *fs = ls->fs;
   Proto *f = fs->f;
   int oldsize = f->sizelocvars;
-  luaM_growvector(ls->L, f->locvars, fs->nlocvars, f->sizelocvars,
+  luaY_growvector(fs, f->locvars, fs->nlocvars, f->sizelocvars,
                   LocVar, SHRT_MAX, "too many local variables");
   while (oldsize < f->sizelocvars) f->locvars[oldsize++].varname = NULL;
   f->locvars[fs->nlocvars].varname = varname;
@@ -192,7 +192,7 @@ static int indexupvalue (FuncState *fs, TString *name, expdesc *v) {
   }
   /* new one */
   luaY_checklimit(fs, f->nups + 1, LUAI_MAXUPVALUES, "upvalues");
-  luaM_growvector(fs->L, f->upvalues, f->nups, f->sizeupvalues,
+  luaY_growvector(fs, f->upvalues, f->nups, f->sizeupvalues,
                   TString *, MAX_INT, "");
   while (oldsize < f->sizeupvalues) f->upvalues[oldsize++] = NULL;
   f->upvalues[f->nups] = name;
@@ -312,7 +312,7 @@ static void pushclosure (LexState *ls, FuncState *func, expdesc *v) {
   Proto *f = fs->f;
   int oldsize = f->sizep;
   int i;
-  luaM_growvector(ls->L, f->p, fs->np, f->sizep, Proto *,
+  luaY_growvector(fs, f->p, fs->np, f->sizep, Proto *,
                   MAXARG_Bx, "constant table overflow");
   while (oldsize < f->sizep) f->p[oldsize++] = NULL;
   f->p[fs->np++] = func->f;
@@ -328,6 +328,8 @@ static void pushclosure (LexState *ls, FuncState *func, expdesc *v) {
 static void open_func (LexState *ls, FuncState *fs) {
   lua_State *L = ls->L;
   Proto *f = luaF_newproto(L);
+  proto_parsing(f);  /* its vectors will grow in the parser arena */
+  luaM_arenamark(ls->arena, &fs->mark);
   fs->f = f;
   fs->prev = ls->fs;  /* linked list of funcstates */
   fs->ls = ls;
@@ -357,20 +359,38 @@ static void close_func (LexState *ls) {
   lua_State *L = ls->L;
   FuncState *fs = ls->fs;
   Proto *f = fs->f;
+  Instruction *code;
+  int *lineinfo;
+  TValue *k;
+  Proto **p;
+  LocVar *locvars;
+  TString **upvalues;
   removevars(ls, 0);
   luaK_ret(fs, 0, 0);  /* final return */
-  luaM_reallocvector(L, f->code, f->sizecode, fs->pc, Instruction);
+  /* take the vectors out of the arena with their exact sizes; until that is
+     done 'f' refers only to memory it owns, in case copying one fails */
+  code = f->code; lineinfo = f->lineinfo; k = f->k;
+  p = f->p; locvars = f->locvars; upvalues = f->upvalues;
+  f->code = NULL; f->lineinfo = NULL; f->k = NULL;
+  f->p = NULL; f->locvars = NULL; f->upvalues = NULL;
+  f->sizecode = f->sizelineinfo = f->sizek = 0;
+  f->sizep = f->sizelocvars = f->sizeupvalues = 0;
+  proto_unsetparsing(f);
+  f->code = luaM_arenadetachvector(L, ls->arena, code, fs->pc, Instruction);
   f->sizecode = fs->pc;
-  luaM_reallocvector(L, f->lineinfo, f->sizelineinfo, fs->pc, int);
+  f->lineinfo = luaM_arenadetachvector(L, ls->arena, lineinfo, fs->pc, int);
   f->sizelineinfo = fs->pc;
-  luaM_reallocvector(L, f->k, f->sizek, fs->nk, TValue);
+  f->k = luaM_arenadetachvector(L, ls->arena, k, fs->nk, TValue);
   f->sizek = fs->nk;
-  luaM_reallocvector(L, f->p, f->sizep, fs->np, Proto *);
+  f->p = luaM_arenadetachvector(L, ls->arena, p, fs->np, Proto *);
   f->sizep = fs->np;
-  luaM_reallocvector(L, f->locvars, f->sizelocvars, fs->nlocvars, LocVar);
+  f->locvars = luaM_arenadetachvector(L, ls->arena, locvars, fs->nlocvars,
+                                      LocVar);
   f->sizelocvars = fs->nlocvars;
-  luaM_reallocvector(L, f->upvalues, f->sizeupvalues, f->nups, TString *);
+  f->upvalues = luaM_arenadetachvector(L, ls->arena, upvalues, f->nups,
+                                       TString *);
   f->sizeupvalues = f->nups;
+  luaM_arenarelease(L, ls->arena, &fs->mark);
   lua_assert(luaG_checkcode(f));
   lua_assert(fs->bl == NULL);
   ls->fs = fs->prev;
@@ -380,13 +400,16 @@ static void close_func (LexState *ls) {
 }
 
 
-Proto *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff, const char *name) {
+Proto *luaY_parser (lua_State *L, ZIO *z, MArena *arena, const char *name) {
   struct LexState lexstate;
   struct FuncState funcstate;
+  Mbuffer buff;
   TString *tname = luaS_new(L, name);
   setsvalue2s(L, L->top, tname);  /* protect name */
   incr_top(L);
-  lexstate.buff = buff;
+  luaZ_initbuffer(L, &buff);
+  lexstate.buff = &buff;  /* lives in the arena too */
+  lexstate.arena = arena;
   luaX_setinput(L, &lexstate, z, tname);
   open_func(&lexstate, &funcstate);
   funcstate.f->is_vararg = VARARG_ISVARARG;  /* main func. is always vararg */
@@ -62,6 +62,7 @@ typedef struct FuncState {
   struct LexState *ls;  /* lexical state */
   struct lua_State *L;  /* copy of the Lua state */
   struct BlockCnt *bl;  /* chain of current blocks */
+  MArenaMark mark;  /* parser arena space in use when the function opened */
   int pc;  /* next position to code (equivalent to `ncode') */
   int lasttarget;   /* `pc' of last `jump target' */
   int jpc;  /* list of pending jumps to `pc' */
@@ -75,7 +76,16 @@ typedef struct FuncState {
 } FuncState;
 
 
-LUAI_FUNC Proto *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
+/*
+** grow a vector of `fs' in the parser arena; the vectors of an enclosing
+** function must survive the release of the inner function's space
+*/
+#define luaY_growvector(fs,v,nelems,size,t,limit,e) \
+	luaM_arenagrowvector((fs)->L, (fs)->ls->arena, v, nelems, size, t, \
+	                     limit, e, (fs) != (fs)->ls->fs)
+
+
+LUAI_FUNC Proto *luaY_parser (lua_State *L, ZIO *z, MArena *arena,
                                             const char *name);
 
 
@@ -15,6 +15,7 @@
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
+#include "lcompact.h"
 #include "lgc.h"
 #include "llex.h"
 #include "lmem.h"
@@ -31,6 +32,10 @@
 // BogdanM: linenoise clenaup
 #include "linenoise.h"
 
+#if defined(BUILD_COMPACT_SPACE) && !defined(COMPACT_SPACE_SIZE)
+#define COMPACT_SPACE_SIZE  16384
+#endif
+
 #define state_size(x)	(sizeof(x) + LUAI_EXTRASPACE)
 #define fromstate(l)	(cast(lu_byte *, (l)) - LUAI_EXTRASPACE)
 #define tostate(l)   (cast(lua_State *, cast(lu_byte *, l) + LUAI_EXTRASPACE))
@@ -46,15 +51,18 @@ typedef struct LG {
   
 
 
-static void stack_init (lua_State *L1, lua_State *L) {
+static void stack_init (lua_State *L1, lua_State *L, int stacksize) {
   /* initialize CallInfo array */
   L1->base_ci = luaM_newvector(L, BASIC_CI_SIZE, CallInfo);
   L1->ci = L1->base_ci;
   L1->size_ci = BASIC_CI_SIZE;
   L1->end_ci = L1->base_ci + L1->size_ci - 1;
   /* initialize stack array */
-  L1->stack = luaM_newvector(L, BASIC_STACK_SIZE + EXTRA_STACK, TValue);
-  L1->stacksize = BASIC_STACK_SIZE + EXTRA_STACK;
+  L1->stack = luaM_newvector(L, stacksize + EXTRA_STACK, TValue);
+  L1->stacksize = stacksize + EXTRA_STACK;
+  L1->minstacksize = L1->stacksize;
+  G(L)->stackbytes += BASIC_CI_SIZE*sizeof(CallInfo) +
+                      L1->stacksize*sizeof(TValue);
   L1->top = L1->stack;
   L1->stack_last = L1->stack+(L1->stacksize - EXTRA_STACK)-1;
   /* initialize first ci */
@@ -66,6 +74,8 @@ static void stack_init (lua_State *L1, lua_State *L) {
 
 
 static void freestack (lua_State *L, lua_State *L1) {
+  G(L)->stackbytes -= L1->size_ci*sizeof(CallInfo) +
+                      L1->stacksize*sizeof(TValue);
   luaM_freearray(L, L1->base_ci, L1->size_ci, CallInfo);
   luaM_freearray(L, L1->stack, L1->stacksize, TValue);
 }
@@ -77,7 +87,10 @@ static void freestack (lua_State *L, lua_State *L1) {
 static void f_luaopen (lua_State *L, void *ud) {
   global_State *g = G(L);
   UNUSED(ud);
-  stack_init(L, L);  /* init stack */
+#if defined(BUILD_COMPACT_SPACE)
+  luaCS_open(L, COMPACT_SPACE_SIZE);  /* must exist before the first table */
+#endif
+  stack_init(L, L, BASIC_STACK_SIZE);  /* init stack */
   sethvalue(L, gt(L), luaH_new(L, 0, 2));  /* table of globals */
   sethvalue(L, registry(L), luaH_new(L, 0, 2));  /* registry */
   luaS_resize(L, MINSTRTABSIZE);  /* initial size of string table */
@@ -100,6 +113,7 @@ static void preinit_state (lua_State *L, global_State *g) {
   resethookcount(L);
   L->openupval = NULL;
   L->size_ci = 0;
+  L->minstacksize = 0;
   L->nCcalls = L->baseCcalls = 0;
   L->status = 0;
   L->base_ci = L->ci = NULL;
@@ -113,6 +127,7 @@ static void close_state (lua_State *L) {
   global_State *g = G(L);
   luaF_close(L, L->stack);  /* close all upvalues for this thread */
   luaC_freeall(L);  /* collect all objects */
+  luaCS_close(L);
   lua_assert(g->rootgc == obj2gco(L));
   lua_assert(g->strt.nuse == 0);
   luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size, TString *);
@@ -123,13 +138,21 @@ static void close_state (lua_State *L) {
 }
 
 
-lua_State *luaE_newthread (lua_State *L) {
+/*
+** create a thread whose stack has room for 'stacksize' slots (0 for the
+** default size); the GC will not shrink its stack below that size
+*/
+lua_State *luaE_newthread (lua_State *L, int stacksize) {
   lua_State *L1 = tostate(luaM_malloc(L, state_size(lua_State)));
   luaC_link(L, obj2gco(L1), LUA_TTHREAD);
   setthvalue(L, L->top, L1); /* put thread on stack */
   incr_top(L);
   preinit_state(L1, G(L));
-  stack_init(L1, L);  /* init stack */
+  if (stacksize == 0)
+    stacksize = BASIC_STACK_SIZE;
+  else if (stacksize < MIN_STACK_SIZE)
+    stacksize = MIN_STACK_SIZE;
+  stack_init(L1, L, stacksize);  /* init stack */
   setobj2n(L, gt(L1), gt(L));  /* share table of globals */
   L1->hookmask = L->hookmask;
   L1->basehookcount = L->basehookcount;
@@ -186,7 +209,9 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->grayagain = NULL;
   g->weak = NULL;
   g->tmudata = NULL;
+  g->cspace = NULL;
   g->totalbytes = sizeof(LG);
+  g->stackbytes = 0;
   g->memlimit = 0;
   g->gcpause = LUAI_GCPAUSE;
   g->gcstepmul = LUAI_GCMUL;
@@ -33,6 +33,9 @@ struct lua_longjmp;  /* defined in ldo.c */
 
 #define BASIC_STACK_SIZE        (2*LUA_MINSTACK)
 
+/* smallest stack a thread can be created with (see luaE_newthread) */
+#define MIN_STACK_SIZE          (LUA_MINSTACK + 2)
+
 
 
 typedef struct stringtable {
@@ -84,6 +87,7 @@ typedef struct global_State {
   lu_mem totalbytes;  /* number of bytes currently allocated */
   lu_mem memlimit;  /* maximum number of bytes that can be allocated, 0 = no limit. */
   lu_mem estimate;  /* an estimate of number of bytes actually in use */
+  lu_mem stackbytes;  /* number of bytes used by all thread stacks */
   lu_mem gcdept;  /* how much GC is `behind schedule' */
   int gcpause;  /* size of pause between successive GCs */
   int gcstepmul;  /* GC `granularity' */
@@ -94,6 +98,7 @@ typedef struct global_State {
   UpVal uvhead;  /* head of double-linked list of all open upvalues */
   struct Table *mt[NUM_TAGS];  /* metatables for basic types */
   TString *tmname[TM_N];  /* array with tag-method names */
+  struct CompactSpace *cspace;  /* space for table parts, NULL if none */
 } global_State;
 
 
@@ -114,6 +119,7 @@ struct lua_State {
   CallInfo *base_ci;  /* array of CallInfo's */
   int stacksize;
   int size_ci;  /* size of array `base_ci' */
+  int minstacksize;  /* GC does not shrink `stack' below this size */
   unsigned short nCcalls;  /* number of nested C calls */
   unsigned short baseCcalls;  /* nested C calls when resuming coroutine */
   lu_byte hookmask;
@@ -164,7 +170,7 @@ union GCObject {
 /* macro to convert any Lua object into a GCObject */
 #define obj2gco(v)	(cast(GCObject *, (v)))
 
-LUAI_FUNC lua_State *luaE_newthread (lua_State *L);
+LUAI_FUNC lua_State *luaE_newthread (lua_State *L, int stacksize);
 LUAI_FUNC void luaE_freethread (lua_State *L, lua_State *L1);
 
 #endif
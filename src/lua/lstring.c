@@ -80,13 +80,19 @@ static TString *newlstr (lua_State *L, const char *str, size_t l,
 }
 
 
-static TString *luaS_newlstr_helper (lua_State *L, const char *str, size_t l, int readonly) {
-  GCObject *o;
+static unsigned int hashstr (const char *str, size_t l) {
   unsigned int h = cast(unsigned int, l);  /* seed */
   size_t step = (l>>5)+1;  /* if string is too long, don't hash all its chars */
   size_t l1;
   for (l1=l; l1>=step; l1-=step)  /* compute hash */
     h = h ^ ((h<<5)+(h>>2)+cast(unsigned char, str[l1-1]));
+  return h;
+}
+
+
+static TString *luaS_newlstr_helper (lua_State *L, const char *str, size_t l, int readonly) {
+  GCObject *o;
+  unsigned int h = hashstr(str, l);
   for (o = G(L)->strt.hash[lmod(h, G(L)->strt.size)];
        o != NULL;
        o = o->gch.next) {
@@ -129,6 +135,58 @@ LUAI_FUNC TString *luaS_newrolstr (lua_State *L, const char *str, size_t l) {
 }
 
 
+/*
+** Build a string from a list of chunks whose lengths add up to 'l'. The
+** chunks are copied straight into the new TString, so the string is only
+** materialized once; if an equal string is already interned the new copy
+** is dropped and the existing one is returned instead.
+*/
+TString *luaS_newchunks (lua_State *L, const lua_Chunk *c, size_t l) {
+  GCObject *o;
+  TString *ts;
+  stringtable *tb;
+  char *s;
+  unsigned int h;
+  size_t totalsize;
+  if (l+1 > (MAX_SIZET - sizeof(TString))/sizeof(char))
+    luaM_toobig(L);
+  totalsize = (l+1)*sizeof(char)+sizeof(TString);
+  ts = cast(TString *, luaM_malloc(L, totalsize));
+  s = cast(char *, ts+1);
+  for (; c != NULL; c = c->next) {
+    lua_assert(s + c->len <= cast(char *, ts+1) + l);
+    memcpy(s, c->data, c->len*sizeof(char));
+    s += c->len;
+  }
+  s = cast(char *, ts+1);
+  s[l] = '\0';  /* ending 0 */
+  h = hashstr(s, l);
+  for (o = G(L)->strt.hash[lmod(h, G(L)->strt.size)];
+       o != NULL;
+       o = o->gch.next) {
+    TString *t = rawgco2ts(o);
+    if (t->tsv.len == l && (memcmp(s, getstr(t), l) == 0)) {
+      /* string may be dead */
+      if (isdead(G(L), o)) changewhite(o);
+      luaM_freemem(L, ts, totalsize);
+      return t;
+    }
+  }
+  tb = &G(L)->strt;
+  if ((tb->nuse + 1) > cast(lu_int32, tb->size) && tb->size <= MAX_INT/2)
+    luaS_resize(L, tb->size*2);  /* too crowded */
+  ts->tsv.len = l;
+  ts->tsv.hash = h;
+  ts->tsv.marked = luaC_white(G(L));
+  ts->tsv.tt = LUA_TSTRING;
+  h = lmod(h, tb->size);
+  ts->tsv.next = tb->hash[h];  /* chain new entry */
+  tb->hash[h] = obj2gco(ts);
+  tb->nuse++;
+  return ts;
+}
+
+
 Udata *luaS_newudata (lua_State *L, size_t s, Table *e) {
   Udata *u;
   if (s > MAX_SIZET - sizeof(Udata))
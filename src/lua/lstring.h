@@ -30,5 +30,6 @@ LUAI_FUNC void luaS_resize (lua_State *L, int newsize);
 LUAI_FUNC Udata *luaS_newudata (lua_State *L, size_t s, Table *e);
 LUAI_FUNC TString *luaS_newlstr (lua_State *L, const char *str, size_t l);
 LUAI_FUNC TString *luaS_newrolstr (lua_State *L, const char *str, size_t l);
+LUAI_FUNC TString *luaS_newchunks (lua_State *L, const lua_Chunk *c, size_t l);
 
 #endif
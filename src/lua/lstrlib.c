@@ -18,6 +18,7 @@
 
 #include "lauxlib.h"
 #include "lualib.h"
+#include "lobject.h"
 #include "lrotable.h"
 
 /* macro to `unsign' a character */
@@ -170,6 +171,7 @@ static int str_dump (lua_State *L) {
 typedef struct MatchState {
   const char *src_init;  /* init of source string */
   const char *src_end;  /* end (`\0') of source string */
+  const char *pat;  /* pattern text of a compiled pattern */
   lua_State *L;
   int level;  /* total number of captures (finished or unfinished) */
   struct {
@@ -440,6 +442,356 @@ static const char *match (MatchState *ms, const char *s, const char *p) {
 }
 
 
+/*
+** {======================================================
+** COMPILED PATTERNS
+** Patterns are translated into an array of items, so the matcher does
+** not scan the pattern text again for every character of the subject.
+** The last compiled patterns are kept in a small LRU cache.
+** =======================================================
+*/
+
+#if LUA_PATCACHE_SIZE > 0
+
+/* item kinds */
+#define P_END		0	/* end of pattern */
+#define P_EOS		1	/* `$' at the end of the pattern */
+#define P_CHAR		2	/* literal char (`a' or `%.'), in `a' */
+#define P_ANY		3	/* `.' */
+#define P_CLASS		4	/* `%d' and such; class letter in `a' */
+#define P_SET		5	/* `[...]'; offsets of `[' and `]' in `a' and `b' */
+#define P_OPEN		6	/* `(' */
+#define P_POSITION	7	/* `()' */
+#define P_CLOSE		8	/* `)' */
+#define P_BALANCE	9	/* `%bxy'; `x' and `y' in `a' and `b' */
+#define P_FRONTIER	10	/* `%f[...]'; same as P_SET */
+#define P_BACKREF	11	/* `%1' to `%9'; the digit in `a' */
+
+/* repetitions of single char items */
+#define R_ONE		0
+#define R_OPT		1	/* `?' */
+#define R_MAX		2	/* `*' */
+#define R_PLUS		3	/* `+' */
+#define R_MIN		4	/* `-' */
+
+typedef struct PatItem {
+  unsigned char op;
+  unsigned char rep;
+  unsigned char a, b;
+} PatItem;
+
+typedef struct PatCache {
+  unsigned int stamp;  /* time of last use (0 if the entry is free) */
+  unsigned char len;
+  char pat[LUA_PATCACHE_LEN];
+  PatItem code[LUA_PATCACHE_LEN + 1];  /* every item takes at least a char */
+} PatCache;
+
+static PatCache pat_cache[LUA_PATCACHE_SIZE];
+static unsigned int pat_clock;
+
+
+/* same as `classend', but returns NULL on a malformed item */
+static const char *pat_classend (const char *p) {
+  switch (*p++) {
+    case L_ESC: return (*p == '\0') ? NULL : p+1;
+    case '[': {
+      if (*p == '^') p++;
+      do {
+        if (*p == '\0') return NULL;
+        if (*(p++) == L_ESC && *p != '\0')
+          p++;
+      } while (*p != ']');
+      return p+1;
+    }
+    default: return p;
+  }
+}
+
+
+/*
+** Translate 'p' into 'code'.  Returns 0 if the pattern is malformed: it
+** is then left to `match', which raises the error only when it reaches
+** the bad item.
+*/
+static int pat_compile (PatItem *code, const char *p) {
+  const char *p0 = p;
+  PatItem *pi;
+  for (pi = code; ; pi++) {
+    const char *ep;
+    pi->rep = R_ONE;
+    switch (*p) {
+      case '\0': {
+        pi->op = P_END;
+        return 1;
+      }
+      case '(': {
+        pi->op = (*(p+1) == ')') ? P_POSITION : P_OPEN;
+        p += (pi->op == P_POSITION) ? 2 : 1;
+        continue;
+      }
+      case ')': {
+        pi->op = P_CLOSE;
+        p++;
+        continue;
+      }
+      case '$': {
+        if (*(p+1) == '\0') {
+          pi->op = P_EOS;
+          p++;
+          continue;
+        }
+        break;
+      }
+      case L_ESC: {
+        if (*(p+1) == 'b') {
+          if (*(p+2) == '\0' || *(p+3) == '\0') return 0;
+          pi->op = P_BALANCE;
+          pi->a = uchar(*(p+2));
+          pi->b = uchar(*(p+3));
+          p += 4;
+          continue;
+        }
+        else if (*(p+1) == 'f') {
+          p += 2;
+          if (*p != '[' || (ep = pat_classend(p)) == NULL) return 0;
+          pi->op = P_FRONTIER;
+          pi->a = (unsigned char)(p - p0);
+          pi->b = (unsigned char)(ep - 1 - p0);
+          p = ep;
+          continue;
+        }
+        else if (isdigit(uchar(*(p+1)))) {
+          pi->op = P_BACKREF;
+          pi->a = uchar(*(p+1));
+          p += 2;
+          continue;
+        }
+        break;
+      }
+    }
+    /* single char item */
+    if ((ep = pat_classend(p)) == NULL) return 0;
+    switch (*p) {
+      case '.': pi->op = P_ANY; break;
+      case L_ESC: {
+        pi->a = uchar(*(p+1));
+        pi->op = strchr("acdlpsuwxz", tolower(pi->a)) ? P_CLASS : P_CHAR;
+        break;
+      }
+      case '[': {
+        pi->op = P_SET;
+        pi->a = (unsigned char)(p - p0);
+        pi->b = (unsigned char)(ep - 1 - p0);
+        break;
+      }
+      default: pi->op = P_CHAR; pi->a = uchar(*p); break;
+    }
+    switch (*ep) {
+      case '?': pi->rep = R_OPT; ep++; break;
+      case '*': pi->rep = R_MAX; ep++; break;
+      case '+': pi->rep = R_PLUS; ep++; break;
+      case '-': pi->rep = R_MIN; ep++; break;
+    }
+    p = ep;
+  }
+}
+
+
+/*
+** Returns the compiled form of pattern 'p' (of length 'l', without the
+** anchor), or NULL if it must be interpreted by `match'
+*/
+static const PatItem *pat_get (MatchState *ms, const char *p, size_t l) {
+  PatCache *e, *lru = pat_cache;
+  int i;
+  ms->pat = p;
+  if (l == 0 || l > LUA_PATCACHE_LEN)
+    return NULL;
+  if (++pat_clock == 0) {  /* clock wrapped around? */
+    memset(pat_cache, 0, sizeof(pat_cache));
+    pat_clock = 1;
+  }
+  for (i = 0; i < LUA_PATCACHE_SIZE; i++) {
+    e = &pat_cache[i];
+    if (e->len == l && memcmp(e->pat, p, l) == 0) {
+      e->stamp = pat_clock;
+      return e->code;
+    }
+    if (e->stamp < lru->stamp) lru = e;
+  }
+  lru->len = 0;
+  if (!pat_compile(lru->code, p))
+    return NULL;
+  memcpy(lru->pat, p, l);
+  lru->len = (unsigned char)l;
+  lru->stamp = pat_clock;
+  return lru->code;
+}
+
+
+/*
+** Returns the char every match must start with, or -1 if unknown.  The
+** search can then skip to its next occurrence with `memchr'.
+*/
+static int pat_firstchar (const PatItem *code, int anchor) {
+  int i;
+  if (code == NULL || anchor)
+    return -1;
+  /* captures cannot fail before the first char (unless there are too many) */
+  for (i = 0; i < LUA_MAXCAPTURES &&
+       (code->op == P_OPEN || code->op == P_POSITION); i++)
+    code++;
+  if (code->op == P_CHAR && (code->rep == R_ONE || code->rep == R_PLUS))
+    return code->a;
+  return -1;
+}
+
+
+static int pat_single (MatchState *ms, int c, const PatItem *pi) {
+  switch (pi->op) {
+    case P_CHAR: return (pi->a == c);
+    case P_ANY: return 1;
+    case P_CLASS: return match_class(c, pi->a);
+    default: return matchbracketclass(c, ms->pat + pi->a, ms->pat + pi->b);
+  }
+}
+
+
+static const char *pat_match (MatchState *ms, const char *s,
+                              const PatItem *pi);
+
+
+static const char *pat_max_expand (MatchState *ms, const char *s,
+                                   const PatItem *pi) {
+  ptrdiff_t i = 0;
+  if (pi->op == P_ANY)
+    i = ms->src_end - s;
+  else {
+    while ((s+i)<ms->src_end && pat_single(ms, uchar(*(s+i)), pi))
+      i++;
+  }
+  while (i>=0) {
+    const char *res = pat_match(ms, (s+i), pi+1);
+    if (res) return res;
+    i--;
+  }
+  return NULL;
+}
+
+
+static const char *pat_min_expand (MatchState *ms, const char *s,
+                                   const PatItem *pi) {
+  for (;;) {
+    const char *res = pat_match(ms, s, pi+1);
+    if (res != NULL)
+      return res;
+    else if (s<ms->src_end && pat_single(ms, uchar(*s), pi))
+      s++;
+    else return NULL;
+  }
+}
+
+
+/* same as `match', on a compiled pattern */
+static const char *pat_match (MatchState *ms, const char *s,
+                              const PatItem *pi) {
+  init:
+  switch (pi->op) {
+    case P_OPEN:
+    case P_POSITION: {
+      const char *res;
+      int level = ms->level;
+      if (level >= LUA_MAXCAPTURES) luaL_error(ms->L, "too many captures");
+      ms->capture[level].init = s;
+      ms->capture[level].len = (pi->op == P_OPEN) ? CAP_UNFINISHED
+                                                   : CAP_POSITION;
+      ms->level = level+1;
+      if ((res=pat_match(ms, s, pi+1)) == NULL)  /* match failed? */
+        ms->level--;  /* undo capture */
+      return res;
+    }
+    case P_CLOSE: {
+      int l = capture_to_close(ms);
+      const char *res;
+      ms->capture[l].len = s - ms->capture[l].init;  /* close capture */
+      if ((res = pat_match(ms, s, pi+1)) == NULL)  /* match failed? */
+        ms->capture[l].len = CAP_UNFINISHED;  /* undo capture */
+      return res;
+    }
+    case P_BALANCE: {
+      int cont = 1;
+      if (s >= ms->src_end || uchar(*s) != pi->a) return NULL;
+      while (++s < ms->src_end) {
+        if (uchar(*s) == pi->b) {
+          if (--cont == 0) break;
+        }
+        else if (uchar(*s) == pi->a) cont++;
+      }
+      if (cont != 0) return NULL;  /* string ends out of balance */
+      s++; pi++; goto init;
+    }
+    case P_FRONTIER: {
+      const char *p = ms->pat + pi->a, *ec = ms->pat + pi->b;
+      char previous = (s == ms->src_init) ? '\0' : *(s-1);
+      if (matchbracketclass(uchar(previous), p, ec) ||
+         !matchbracketclass(uchar(*s), p, ec)) return NULL;
+      pi++; goto init;
+    }
+    case P_BACKREF: {
+      s = match_capture(ms, s, pi->a);
+      if (s == NULL) return NULL;
+      pi++; goto init;
+    }
+    case P_END: {
+      return s;
+    }
+    case P_EOS: {
+      return (s == ms->src_end) ? s : NULL;
+    }
+    default: {  /* single char item */
+      int m = s<ms->src_end && pat_single(ms, uchar(*s), pi);
+      switch (pi->rep) {
+        case R_OPT: {
+          const char *res;
+          if (m && ((res=pat_match(ms, s+1, pi+1)) != NULL))
+            return res;
+          pi++; goto init;
+        }
+        case R_MAX: {
+          return pat_max_expand(ms, s, pi);
+        }
+        case R_PLUS: {
+          return (m ? pat_max_expand(ms, s+1, pi) : NULL);
+        }
+        case R_MIN: {
+          return pat_min_expand(ms, s, pi);
+        }
+        default: {
+          if (!m) return NULL;
+          s++; pi++; goto init;
+        }
+      }
+    }
+  }
+}
+
+#define do_match(ms,s,p,code) \
+	((code) ? pat_match(ms, s, code) : match(ms, s, p))
+
+#else
+
+typedef struct PatItem PatItem;
+
+#define pat_get(ms,p,l)		NULL
+#define pat_firstchar(code,anchor)	((void)(code), -1)
+#define do_match(ms,s,p,code)	((void)(code), match(ms, s, p))
+
+#endif
+
+/* }====================================================== */
+
+
 
 static const char *lmemfind (const char *s1, size_t l1,
                                const char *s2, size_t l2) {
@@ -511,15 +863,20 @@ static int str_find_aux (lua_State *L, int find) {
   }
   else {
     MatchState ms;
-    int anchor = (*p == '^') ? (p++, 1) : 0;
+    int anchor = (*p == '^') ? (p++, l2--, 1) : 0;
     const char *s1=s+init;
+    const PatItem *code = pat_get(&ms, p, l2);
+    int firstc = pat_firstchar(code, anchor);
     ms.L = L;
     ms.src_init = s;
     ms.src_end = s+l1;
     do {
       const char *res;
+      if (firstc >= 0 &&  /* skip to the first possible start */
+          (s1 = (const char *)memchr(s1, firstc, ms.src_end - s1)) == NULL)
+        break;
       ms.level = 0;
-      if ((res=match(&ms, s1, p)) != NULL) {
+      if ((res=do_match(&ms, s1, p, code)) != NULL) {
         if (find) {
           lua_pushinteger(L, s1-s+1);  /* start */
           lua_pushinteger(L, res-s);   /* end */
@@ -547,9 +904,11 @@ static int str_match (lua_State *L) {
 
 static int gmatch_aux (lua_State *L) {
   MatchState ms;
-  size_t ls;
+  size_t ls, lp;
   const char *s = lua_tolstring(L, lua_upvalueindex(1), &ls);
-  const char *p = lua_tostring(L, lua_upvalueindex(2));
+  const char *p = lua_tolstring(L, lua_upvalueindex(2), &lp);
+  const PatItem *code = pat_get(&ms, p, lp);
+  int firstc = pat_firstchar(code, 0);
   const char *src;
   ms.L = L;
   ms.src_init = s;
@@ -558,8 +917,11 @@ static int gmatch_aux (lua_State *L) {
        src <= ms.src_end;
        src++) {
     const char *e;
+    if (firstc >= 0 &&
+        (src = (const char *)memchr(src, firstc, ms.src_end - src)) == NULL)
+      break;
     ms.level = 0;
-    if ((e = match(&ms, src, p)) != NULL) {
+    if ((e = do_match(&ms, src, p, code)) != NULL) {
       lua_Integer newstart = e-s;
       if (e == src) newstart++;  /* empty match? go at least one position */
       lua_pushinteger(L, newstart);
@@ -643,15 +1005,30 @@ static void add_value (MatchState *ms, luaL_Buffer *b, const char *s,
 
 
 static int str_gsub (lua_State *L) {
-  size_t srcl;
+  size_t srcl, lp;
   const char *src = luaL_checklstring(L, 1, &srcl);
-  const char *p = luaL_checkstring(L, 2);
+  const char *p = luaL_checklstring(L, 2, &lp);
   int  tr = lua_type(L, 3);
   int max_s = luaL_optint(L, 4, srcl+1);
-  int anchor = (*p == '^') ? (p++, 1) : 0;
+  int anchor = (*p == '^') ? (p++, lp--, 1) : 0;
   int n = 0;
   MatchState ms;
   luaL_Buffer b;
+#if LUA_PATCACHE_SIZE > 0
+  /* the replacement function may evict the cached copy */
+  PatItem codebuf[LUA_PATCACHE_LEN + 1];
+  const PatItem *code = pat_get(&ms, p, lp);
+  int firstc = pat_firstchar(code, anchor);
+  if (code != NULL) {
+    const PatItem *pi = code;
+    while ((pi++)->op != P_END) ;
+    memcpy(codebuf, code, (pi - code) * sizeof(PatItem));
+    code = codebuf;
+  }
+#else
+  const PatItem *code = NULL;
+  int firstc = -1;
+#endif
   luaL_argcheck(L, tr == LUA_TNUMBER || tr == LUA_TSTRING ||
                    tr == LUA_TFUNCTION || tr == LUA_TTABLE ||
                    tr == LUA_TLIGHTFUNCTION, 3,
@@ -662,8 +1039,14 @@ static int str_gsub (lua_State *L) {
   ms.src_end = src+srcl;
   while (n < max_s) {
     const char *e;
+    if (firstc >= 0) {  /* copy up to the first possible start */
+      const char *s1 = (const char *)memchr(src, firstc, ms.src_end - src);
+      if (s1 == NULL) break;
+      luaL_addlstring(&b, src, s1 - src);
+      src = s1;
+    }
     ms.level = 0;
-    e = match(&ms, src, p);
+    e = do_match(&ms, src, p, code);
     if (e) {
       n++;
       add_value(&ms, &b, src, e);
@@ -781,8 +1164,13 @@ static int str_format (lua_State *L) {
           break;
         }
         case 'd':  case 'i': {
+          LUA_INTFRM_T n = (LUA_INTFRM_T)luaL_checknumber(L, arg);
+          if (form[2] == '\0') {  /* no flags? no need for sprintf */
+            luaL_addlstring(&b, buff, luaO_fmtint(buff, n));
+            continue;
+          }
           addintlen(form);
-          sprintf(buff, form, (LUA_INTFRM_T)luaL_checknumber(L, arg));
+          sprintf(buff, form, n);
           break;
         }
         case 'o':  case 'u':  case 'x':  case 'X': {
@@ -791,8 +1179,22 @@ static int str_format (lua_State *L) {
           break;
         }
 #if !defined LUA_NUMBER_INTEGRAL        
-        case 'e':  case 'E': case 'f':
-        case 'g': case 'G': {
+        case 'g': {  /* `%g' and `%.<prec>g' don't need sprintf */
+          lua_Number n = luaL_checknumber(L, arg);
+          int prec = (form[1] == 'g') ? 6 :
+                     (form[1] == '.') ? atoi(form + 2) : -1;
+          if (prec == 0) prec = 1;
+          if (prec > 0 && prec <= 15) {
+            int l = luaO_fmtg(buff, n, prec);
+            if (l >= 0) {
+              luaL_addlstring(&b, buff, l);
+              continue;
+            }
+          }
+          sprintf(buff, form, (double)n);
+          break;
+        }
+        case 'e':  case 'E': case 'f': case 'G': {
           sprintf(buff, form, (double)luaL_checknumber(L, arg));
           break;
         }
@@ -26,6 +26,7 @@
 
 #include "lua.h"
 
+#include "lcompact.h"
 #include "ldebug.h"
 #include "ldo.h"
 #include "lgc.h"
@@ -33,6 +34,7 @@
 #include "lobject.h"
 #include "lstate.h"
 #include "ltable.h"
+#include "lvm.h"
 #include "lrotable.h"
 
 /*
@@ -70,6 +72,16 @@
 
 
 
+/*
+** array and hash parts go to the compacting space (if there is one)
+*/
+#define reallocpart(L,t,v,oldn,n,e,k) \
+   ((v)=cast(e *, (cast(size_t, (n)+1) <= MAX_SIZET/sizeof(e)) ? \
+		luaCS_realloc(L, t, (v), (oldn)*sizeof(e), (n)*sizeof(e), k) : \
+		luaM_toobig(L)))
+
+
+
 #define dummynode		(&dummynode_)
 
 static const Node dummynode_ = {
@@ -270,7 +282,7 @@ static int numusehash (const Table *t, int *nums, int *pnasize) {
 
 static void setarrayvector (lua_State *L, Table *t, int size) {
   int i;
-  luaM_reallocvector(L, t->array, t->sizearray, size, TValue);
+  reallocpart(L, t, t->array, t->sizearray, size, TValue, CS_ARRAY);
   for (i=t->sizearray; i<size; i++)
      setnilvalue(&t->array[i]);
   t->sizearray = size;
@@ -303,7 +315,7 @@ static void resizenodevector (lua_State *L, Table *t, int oldsize, int newsize)
       oldsize = 0;
       node = NULL; /* don't try to realloc `dummynode' pointer. */
     }
-    luaM_reallocvector(L, node, oldsize, newsize, Node);
+    reallocpart(L, t, node, oldsize, newsize, Node, CS_NODE);
     t->node = node;
     for (i=oldsize; i<newsize; i++) {
       Node *n = gnode(t, i);
@@ -453,7 +465,7 @@ static void resize (lua_State *L, Table *t, int nasize, int nhsize) {
         setobjt2t(L, luaH_setnum(L, t, i+1), &t->array[i]);
     }
     /* shrink array */
-    luaM_reallocvector(L, t->array, oldasize, nasize, TValue);
+    reallocpart(L, t, t->array, oldasize, nasize, TValue, CS_ARRAY);
   }
 }
 
@@ -510,8 +522,8 @@ Table *luaH_new (lua_State *L, int narray, int nhash) {
 
 void luaH_free (lua_State *L, Table *t) {
   if (t->node != dummynode)
-    luaM_freearray(L, t->node, sizenode(t), Node);
-  luaM_freearray(L, t->array, t->sizearray, TValue);
+    luaCS_realloc(L, t, t->node, sizenode(t)*sizeof(Node), 0, CS_NODE);
+  luaCS_realloc(L, t, t->array, t->sizearray*sizeof(TValue), 0, CS_ARRAY);
   luaM_free(L, t);
 }
 
@@ -748,6 +760,158 @@ int luaH_getn_ro (void *t) {
   return len;
 }
 
+
+/*
+** {=============================================================
+** In place sort of the array part, for arrays of numbers (no NaNs) or
+** of strings in the default order: the values are compared directly
+** instead of going through the stack.
+** ==============================================================
+*/
+
+#define SORT_CUTOFF	12  /* insertion sort below this size */
+
+#define rawlt(L,isnum,a,b) \
+	((isnum) ? nvalue(a) < nvalue(b) : luaV_lessthan(L, a, b))
+
+#define rawswap(a,b)	{ TValue temp_ = *(a); *(a) = *(b); *(b) = temp_; }
+
+
+/* binary insertion sort; stable */
+static void rawinsertion (lua_State *L, int isnum, TValue *a, int n) {
+  int i;
+  for (i = 1; i < n; i++) {
+    TValue v = a[i];
+    int lo = 0, hi = i;
+    while (lo < hi) {  /* find the first element greater than v */
+      int m = (lo + hi) / 2;
+      if (rawlt(L, isnum, &v, &a[m])) hi = m;
+      else lo = m + 1;
+    }
+    memmove(a + lo + 1, a + lo, (i - lo) * sizeof(TValue));
+    a[lo] = v;
+  }
+}
+
+
+static void rawsiftdown (lua_State *L, int isnum, TValue *a, int i, int n) {
+  for (;;) {
+    int c = 2*i + 1;
+    if (c >= n) break;
+    if (c + 1 < n && rawlt(L, isnum, &a[c], &a[c+1])) c++;
+    if (!rawlt(L, isnum, &a[i], &a[c])) break;
+    rawswap(&a[i], &a[c]);
+    i = c;
+  }
+}
+
+
+static void rawheapsort (lua_State *L, int isnum, TValue *a, int n) {
+  int i;
+  for (i = n/2 - 1; i >= 0; i--)
+    rawsiftdown(L, isnum, a, i, n);
+  for (i = n - 1; i > 0; i--) {
+    rawswap(&a[0], &a[i]);
+    rawsiftdown(L, isnum, a, 0, i);
+  }
+}
+
+
+/* quicksort that turns to heapsort when it recurses 'depth' times */
+static void rawintrosort (lua_State *L, int isnum, TValue *a, int n,
+                          int depth) {
+  while (n > SORT_CUTOFF) {
+    TValue *lo = a, *hi = a + n - 1, *i, *j;
+    TValue p;
+    if (depth-- == 0) {
+      rawheapsort(L, isnum, a, n);
+      return;
+    }
+    /* median of three; a[0] <= P <= a[n-1] also stop the scans below */
+    i = a + n/2;
+    if (rawlt(L, isnum, i, lo)) rawswap(i, lo);
+    if (rawlt(L, isnum, hi, i)) {
+      rawswap(hi, i);
+      if (rawlt(L, isnum, i, lo)) rawswap(i, lo);
+    }
+    p = *i;
+    i = lo; j = hi;
+    for (;;) {  /* invariant: a[0..i] <= P <= a[j..n-1] */
+      do i++; while (rawlt(L, isnum, i, &p));
+      do j--; while (rawlt(L, isnum, &p, j));
+      if (i >= j) break;
+      rawswap(i, j);
+    }
+    /* a[0..i-1] <= P <= a[i..n-1]; recurse into the smaller part */
+    if (i - a < n - (i - a)) {
+      rawintrosort(L, isnum, a, cast_int(i - a), depth);
+      n -= cast_int(i - a);
+      a = i;
+    }
+    else {
+      rawintrosort(L, isnum, i, n - cast_int(i - a), depth);
+      n = cast_int(i - a);
+    }
+  }
+  rawinsertion(L, isnum, a, n);
+}
+
+
+/* merge sort using 'tmp' (n/2 values); stable */
+static void rawmergesort (lua_State *L, int isnum, TValue *a, int n,
+                          TValue *tmp) {
+  int m = n/2, i = 0, j = m, k = 0;
+  if (n <= SORT_CUTOFF) {
+    rawinsertion(L, isnum, a, n);
+    return;
+  }
+  rawmergesort(L, isnum, a, m, tmp);
+  rawmergesort(L, isnum, a + m, n - m, tmp);
+  if (!rawlt(L, isnum, &a[m], &a[m-1]))  /* already in order? */
+    return;
+  memcpy(tmp, a, m * sizeof(TValue));
+  while (i < m && j < n) {
+    if (rawlt(L, isnum, &a[j], &tmp[i])) a[k++] = a[j++];
+    else a[k++] = tmp[i++];
+  }
+  while (i < m) a[k++] = tmp[i++];
+}
+
+
+/*
+** Sorts t[1..n] if it can be done on the raw values (merge sort if
+** 'stable'). Returns 0 if the array must be sorted through the API.
+*/
+int luaH_sort (lua_State *L, Table *t, int n, int stable) {
+  TValue *tmp = NULL;
+  int i, isnum, depth;
+  if (n < 2)  /* nothing to sort */
+    return 1;
+  if (n > t->sizearray)  /* part of it in the hash part? */
+    return 0;
+  isnum = ttisnumber(&t->array[0]);
+  for (i = 0; i < n; i++) {
+    const TValue *o = &t->array[i];
+    if (isnum ? (!ttisnumber(o) || nvalue(o) != nvalue(o)) : !ttisstring(o))
+      return 0;
+  }
+  if (stable) {
+    if (n > SORT_CUTOFF)  /* may compact the tables and move the array */
+      tmp = luaM_newvector(L, n/2, TValue);
+    rawmergesort(L, isnum, t->array, n, tmp);
+    if (tmp)
+      luaM_freearray(L, tmp, n/2, TValue);
+  }
+  else {
+    for (depth = 0, i = n; i > 1; i >>= 1)
+      depth += 2;  /* 2*log2(n) */
+    rawintrosort(L, isnum, t->array, n, depth);
+  }
+  return 1;
+}
+
+/* }============================================================= */
+
 #if defined(LUA_DEBUG)
 
 Node *luaH_mainposition (const Table *t, const TValue *key) {
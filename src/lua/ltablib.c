@@ -254,13 +254,66 @@ static void auxsort (lua_State *L, int l, int u) {
   }  /* repeat the routine for the larger one */
 }
 
+
 static int sort (lua_State *L) {
   int n = aux_getn(L, 1);
   luaL_checkstack(L, 40, "");  /* assume array is smaller than 2^40 */
   if (!lua_isnoneornil(L, 2))  /* is there a 2nd argument? */
     luaL_checktype(L, 2, LUA_TFUNCTION);
   lua_settop(L, 2);  /* make sure there is two arguments */
-  auxsort(L, 1, n);
+  if (!lua_isnil(L, 2) || !lua_rawsort(L, 1, n, 0))
+    auxsort(L, 1, n);
+  return 0;
+}
+
+
+/* merges a[l..m] and a[m+1..u] using the temporary table at index 3 */
+static void auxmerge (lua_State *L, int l, int m, int u) {
+  int i, j = m+1, k = l;
+  for (i = l; i <= m; i++) {  /* move the first half out of the way */
+    lua_rawgeti(L, 1, i);
+    lua_rawseti(L, 3, i-l+1);
+  }
+  i = l;
+  while (i <= m && j <= u) {
+    lua_rawgeti(L, 1, j);
+    lua_rawgeti(L, 3, i-l+1);
+    if (sort_comp(L, -2, -1)) {  /* a[j] < tmp[i]? */
+      lua_pop(L, 1);
+      lua_rawseti(L, 1, k++);
+      j++;
+    }
+    else {  /* take tmp[i] on ties, to keep the sort stable */
+      lua_rawseti(L, 1, k++);
+      lua_pop(L, 1);
+      i++;
+    }
+  }
+  while (i <= m) {
+    lua_rawgeti(L, 3, i-l+1);
+    lua_rawseti(L, 1, k++);
+    i++;
+  }
+}
+
+static void auxmergesort (lua_State *L, int l, int u) {
+  int m;
+  if (l >= u) return;
+  m = (l+u)/2;
+  auxmergesort(L, l, m);
+  auxmergesort(L, m+1, u);
+  auxmerge(L, l, m, u);
+}
+
+static int stablesort (lua_State *L) {
+  int n = aux_getn(L, 1);
+  if (!lua_isnoneornil(L, 2))  /* is there a 2nd argument? */
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+  lua_settop(L, 2);  /* make sure there is two arguments */
+  if (!lua_isnil(L, 2) || !lua_rawsort(L, 1, n, 1)) {
+    lua_createtable(L, n/2 + 1, 0);  /* temporary table */
+    auxmergesort(L, 1, n);
+  }
   return 0;
 }
 
@@ -279,6 +332,7 @@ const LUA_REG_TYPE tab_funcs[] = {
   {LSTRKEY("remove"), LFUNCVAL(tremove)},
   {LSTRKEY("setn"), LFUNCVAL(setn)},
   {LSTRKEY("sort"), LFUNCVAL(sort)},
+  {LSTRKEY("stablesort"), LFUNCVAL(stablesort)},
   {LNILKEY, LNILVAL}
 };
 
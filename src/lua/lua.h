@@ -66,6 +66,16 @@ typedef int (*lua_Writer) (lua_State *L, const void* p, size_t sz, void* ud);
 typedef void * (*lua_Alloc) (void *ud, void *ptr, size_t osize, size_t nsize);
 
 
+/*
+** a piece of a string built in several parts (see lua_pushchunks)
+*/
+typedef struct lua_Chunk {
+  struct lua_Chunk *next;
+  size_t len;
+  const char *data;
+} lua_Chunk;
+
+
 /*
 ** basic types
 */
@@ -110,6 +120,7 @@ typedef LUA_INTEGER lua_Integer;
 LUA_API lua_State *(lua_newstate) (lua_Alloc f, void *ud);
 LUA_API void       (lua_close) (lua_State *L);
 LUA_API lua_State *(lua_newthread) (lua_State *L);
+LUA_API lua_State *(lua_newthreadsize) (lua_State *L, int stacksize);
 
 LUA_API lua_CFunction (lua_atpanic) (lua_State *L, lua_CFunction panicf);
 
@@ -162,6 +173,7 @@ LUA_API void  (lua_pushnumber) (lua_State *L, lua_Number n);
 LUA_API void  (lua_pushinteger) (lua_State *L, lua_Integer n);
 LUA_API void  (lua_pushlstring) (lua_State *L, const char *s, size_t l);
 LUA_API void  (lua_pushrolstring) (lua_State *L, const char *s, size_t l);
+LUA_API void  (lua_pushchunks) (lua_State *L, const lua_Chunk *c, size_t l);
 LUA_API void  (lua_pushstring) (lua_State *L, const char *s);
 LUA_API const char *(lua_pushvfstring) (lua_State *L, const char *fmt,
                                                       va_list argp);
@@ -194,6 +206,7 @@ LUA_API void  (lua_settable) (lua_State *L, int idx);
 LUA_API void  (lua_setfield) (lua_State *L, int idx, const char *k);
 LUA_API void  (lua_rawset) (lua_State *L, int idx);
 LUA_API void  (lua_rawseti) (lua_State *L, int idx, int n);
+LUA_API int   (lua_rawsort) (lua_State *L, int idx, int n, int stable);
 LUA_API int   (lua_setmetatable) (lua_State *L, int objindex);
 LUA_API int   (lua_setfenv) (lua_State *L, int idx);
 
@@ -231,6 +244,9 @@ LUA_API int  (lua_status) (lua_State *L);
 #define LUA_GCSETSTEPMUL	7
 #define LUA_GCSETMEMLIMIT	8
 #define LUA_GCGETMEMLIMIT	9
+#define LUA_GCSTACKCOUNT	10
+#define LUA_GCSTACKCOUNTB	11
+#define LUA_GCCOMPACT		12
 
 LUA_API int (lua_gc) (lua_State *L, int what, int data);
 
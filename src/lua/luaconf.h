@@ -537,11 +537,28 @@
 #define LUAI_MAXUPVALUES	60
 
 
+/*
+@@ LUAI_ARENABLOCK is the size of the blocks of the scratch arena used
+@* by the parser and the code generator while compiling a chunk.
+** CHANGE it if compiling large sources needs fewer (bigger) blocks or
+** your heap has trouble finding contiguous memory of this size.
+*/
+#define LUAI_ARENABLOCK		512
+
+
 /*
 @@ LUAL_BUFFERSIZE is the buffer size used by the lauxlib buffer system.
 */
 #define LUAL_BUFFERSIZE		BUFSIZ
 
+/*
+@@ LUAL_BUFFERCHUNKSIZE is the size of the chunks that hold the contents
+@* of a lauxlib buffer once they no longer fit in LUAL_BUFFERSIZE.
+** CHANGE it if you want bigger (fewer) or smaller (less fragmenting)
+** chunks when building large strings.
+*/
+#define LUAL_BUFFERCHUNKSIZE	LUAL_BUFFERSIZE
+
 /* }================================================================== */
 
 
@@ -585,6 +602,10 @@
 /*
 @@ LUA_NUMBER_SCAN is the format for reading numbers.
 @@ LUA_NUMBER_FMT is the format for writing numbers.
+@@ LUAI_NUMPRECISION is the precision of LUA_NUMBER_FMT (the number
+@* conversions in lobject.c write "%.<LUAI_NUMPRECISION>g" themselves
+@* and use lua_number2str only for the values they cannot round exactly).
+** CHANGE it together with LUA_NUMBER_FMT (15 at most).
 @@ lua_number2str converts a number to a string.
 @@ LUAI_MAXNUMBER2STR is maximum size of previous conversion.
 @@ lua_str2number converts a string to a number.
@@ -600,6 +621,7 @@
 #else
 #define LUA_NUMBER_SCAN		"%lf"
 #define LUA_NUMBER_FMT		"%.14g"
+#define LUAI_NUMPRECISION	14
 #endif // #if defined LUA_NUMBER_INTEGRAL
 #define lua_number2str(s,n)	sprintf((s), LUA_NUMBER_FMT, (n))
 #define LUAI_MAXNUMBER2STR	32 /* 16 digits, sign, point, and \0 */
@@ -748,6 +770,17 @@ union luai_Cast { double l_d; long l_l; };
 #define LUA_MAXCAPTURES		10
 
 
+/*
+@@ LUA_PATCACHE_SIZE is the number of compiled patterns kept by the
+@* string library.
+@@ LUA_PATCACHE_LEN is the length of the longest pattern it compiles.
+** CHANGE them to trade RAM (about 5*LUA_PATCACHE_LEN bytes per entry)
+** for speed; LUA_PATCACHE_SIZE 0 always interprets the patterns.
+*/
+#define LUA_PATCACHE_SIZE	4
+#define LUA_PATCACHE_LEN	48
+
+
 /*
 @@ lua_tmpnam is the function that the OS library uses to create a
 @* temporary name.
@@ -69,9 +69,8 @@ int luaV_tostring (lua_State *L, StkId obj) {
   else {
     char s[LUAI_MAXNUMBER2STR];
     ptrdiff_t objr = savestack(L, obj);
-    lua_Number n = nvalue(obj);
-    lua_number2str(s, n);
-    setsvalue2s(L, restorestack(L, objr), luaS_new(L, s));
+    int l = luaO_fmtnum(s, nvalue(obj));
+    setsvalue2s(L, restorestack(L, objr), luaS_newlstr(L, s, l));
     return 1;
   }
 }
@@ -324,23 +323,29 @@ void luaV_concat (lua_State *L, int total, int last) {
     StkId top = L->base + last + 1;
     fixedstack(L);
     int n = 2;  /* number of elements handled in this pass (at least 2) */
-    if (!(ttisstring(top-2) || ttisnumber(top-2)) || !tostring(L, top-1)) {
+    if (!(ttisstring(top-2) || ttisnumber(top-2)) ||
+        !(ttisstring(top-1) || ttisnumber(top-1))) {
       unfixedstack(L);
       if (!call_binTM(L, top-2, top-1, top-2, TM_CONCAT)) {
         /* restore 'top' pointer, since stack might have been reallocted */
         top = L->base + last + 1;
         luaG_concaterror(L, top-2, top-1);
       }
-    } else if (tsvalue(top-1)->len == 0) { /* second op is empty? */
+    } else if (ttisstring(top-1) &&
+               tsvalue(top-1)->len == 0) { /* second op is empty? */
       (void)tostring(L, top - 2);  /* result is first op (as string) */
     } else {
       /* at least two string values; get as many as possible */
-      size_t tl = tsvalue(top-1)->len;
+      /* (numbers are written straight into the buffer, not interned) */
+      size_t tl = ttisstring(top-1) ? tsvalue(top-1)->len
+                                    : LUAI_MAXNUMBER2STR;
       char *buffer;
       int i;
-      /* collect total length */
-      for (n = 1; n < total && tostring(L, top-n-1); n++) {
-        size_t l = tsvalue(top-n-1)->len;
+      /* collect total length (numbers count for their maximum length) */
+      for (n = 1; n < total &&
+                  (ttisstring(top-n-1) || ttisnumber(top-n-1)); n++) {
+        size_t l = ttisstring(top-n-1) ? tsvalue(top-n-1)->len
+                                       : LUAI_MAXNUMBER2STR;
         if (l >= max_sizet - tl) luaG_runerror(L, "string length overflow");
         tl += l;
       }
@@ -348,9 +353,13 @@ void luaV_concat (lua_State *L, int total, int last) {
       buffer = luaZ_openspace(L, &G(L)->buff, tl);
       tl = 0;
       for (i=n; i>0; i--) {  /* concat all strings */
-        size_t l = tsvalue(top-i)->len;
-        memcpy(buffer+tl, svalue(top-i), l);
-        tl += l;
+        if (ttisnumber(top-i))
+          tl += luaO_fmtnum(buffer+tl, nvalue(top-i));
+        else {
+          size_t l = tsvalue(top-i)->len;
+          memcpy(buffer+tl, svalue(top-i), l);
+          tl += l;
+        }
       }
       setsvalue2s(L, top-n, luaS_newlstr(L, buffer, tl));
       luaZ_resetbuffer(&G(L)->buff);
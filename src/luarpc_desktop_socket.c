@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+
+#include "lua.h"
+#include "lualib.h"
+#include "lauxlib.h"
+
+#include "luarpc_rpc.h"
+
+#ifdef LUA_RPC
+#include "desktop_conf.h"
+#endif
+
+#ifdef LUARPC_ENABLE_SOCKET
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define SOCKET_TIMEOUT_S 10 // Receive timeout on connections (seconds)
+
+// Setup Transport
+void transport_init (Transport *tpt)
+{
+  tpt->fd = INVALID_TRANSPORT;
+  tpt->listening = 0;
+}
+
+static void transport_throw_errno( enum exception_type type )
+{
+  struct exception e;
+
+  e.errnum = transport_errno;
+  e.type = type;
+  Throw( e );
+}
+
+// Set the options of a connected socket: no delay for small writes (every
+// frame is a single write) and a receive timeout
+static void socket_setup( int fd )
+{
+  int one = 1;
+  struct timeval tv;
+
+  tv.tv_sec = SOCKET_TIMEOUT_S;
+  tv.tv_usec = 0;
+  setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+  setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof( tv ) );
+#ifdef SO_NOSIGPIPE
+  setsockopt( fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof( one ) );
+#endif
+}
+
+// Open Listener / Server
+//   rpc.listen( port ) or rpc.listen( "address", port )
+void transport_open_listener(lua_State *L, ServerHandle *handle)
+{
+  struct sockaddr_in addr;
+  int fd, one = 1, port_arg = lua_gettop( L ) > 2 ? 2 : 1;
+
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl( INADDR_ANY );
+  if( port_arg == 2 )
+  {
+    struct hostent *h = gethostbyname( luaL_checkstring( L, 1 ) );
+    if( h == NULL || h->h_addrtype != AF_INET )
+      luaL_error( L, "unknown host" );
+    memcpy( &addr.sin_addr, h->h_addr_list[ 0 ], sizeof( addr.sin_addr ) );
+  }
+  if( !lua_isnumber( L, port_arg ) )
+    luaL_error( L, "port must be a number" );
+  addr.sin_port = htons( ( unsigned short )lua_tointeger( L, port_arg ) );
+
+  fd = socket( AF_INET, SOCK_STREAM, 0 );
+  if( fd < 0 )
+    transport_throw_errno( fatal );
+  setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+  if( bind( fd, ( struct sockaddr * )&addr, sizeof( addr ) ) < 0 || listen( fd, RPC_MAX_CLIENTS ) < 0 )
+  {
+    close( fd );
+    transport_throw_errno( fatal );
+  }
+  handle->ltpt.fd = fd;
+  handle->ltpt.listening = 1;
+}
+
+// Open Connection / Client
+//   rpc.connect( "host", port )
+int transport_open_connection(lua_State *L, Handle *handle)
+{
+  struct sockaddr_in addr;
+  struct hostent *h;
+  int fd;
+
+  check_num_args (L,3); // 1st arg is host, 2nd is port, 3rd is handle
+  if (!lua_isstring (L,1))
+    luaL_error(L,"first argument must be host name or address");
+  if (!lua_isnumber (L,2))
+    luaL_error(L,"second argument must be port number");
+
+  h = gethostbyname( lua_tostring( L, 1 ) );
+  if( h == NULL || h->h_addrtype != AF_INET )
+    luaL_error( L, "unknown host" );
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sin_family = AF_INET;
+  memcpy( &addr.sin_addr, h->h_addr_list[ 0 ], sizeof( addr.sin_addr ) );
+  addr.sin_port = htons( ( unsigned short )lua_tointeger( L, 2 ) );
+
+  fd = socket( AF_INET, SOCK_STREAM, 0 );
+  if( fd < 0 )
+    transport_throw_errno( fatal );
+  if( connect( fd, ( struct sockaddr * )&addr, sizeof( addr ) ) < 0 )
+  {
+    close( fd );
+    transport_throw_errno( fatal );
+  }
+  socket_setup( fd );
+  handle->tpt.fd = fd;
+
+  return 1;
+}
+
+// Accept Connection
+void transport_accept (Transport *tpt, Transport *atpt)
+{
+  struct exception e;
+  int fd;
+  TRANSPORT_VERIFY_OPEN;
+
+  do
+    fd = accept( tpt->fd, NULL, NULL );
+  while( fd < 0 && errno == EINTR );
+  if( fd < 0 )
+    transport_throw_errno( nonfatal );
+  socket_setup( fd );
+  atpt->fd = fd;
+}
+
+// Wait for a new connection or a request
+void transport_wait (ServerHandle *handle, int accept)
+{
+  fd_set fds;
+  int i, maxfd = -1;
+
+  FD_ZERO( &fds );
+  if( accept && handle->ltpt.fd != INVALID_TRANSPORT )
+  {
+    FD_SET( handle->ltpt.fd, &fds );
+    maxfd = handle->ltpt.fd;
+  }
+  for( i = 0; i < RPC_MAX_CLIENTS; i ++ )
+    if( handle->atpt[ i ].fd != INVALID_TRANSPORT )
+    {
+      FD_SET( handle->atpt[ i ].fd, &fds );
+      if( handle->atpt[ i ].fd > maxfd )
+        maxfd = handle->atpt[ i ].fd;
+    }
+  if( maxfd < 0 )
+    return;
+  if( select( maxfd + 1, &fds, NULL, NULL, NULL ) < 0 && errno != EINTR )
+    transport_throw_errno( fatal );
+}
+
+// Read & Write to Transport
+//   errors on a connection only close the connection (nonfatal)
+void transport_read_buffer (Transport *tpt, u8 *buffer, int length)
+{
+  int n;
+  struct exception e;
+  TRANSPORT_VERIFY_OPEN;
+
+  while( length > 0 )
+  {
+    n = recv( tpt->fd, buffer, length, 0 );
+    if( n == 0 )
+    {
+      e.errnum = ERR_EOF;
+      e.type = nonfatal;
+      Throw( e );
+    }
+    if( n < 0 )
+    {
+      if( errno == EINTR )
+        continue;
+      e.errnum = ( errno == EAGAIN || errno == EWOULDBLOCK ) ? ERR_NODATA : transport_errno;
+      e.type = nonfatal;
+      Throw( e );
+    }
+    buffer += n;
+    length -= n;
+  }
+}
+
+void transport_write_buffer( Transport *tpt, const u8 *buffer, int length )
+{
+  int n;
+  struct exception e;
+  TRANSPORT_VERIFY_OPEN;
+
+  while( length > 0 )
+  {
+    n = send( tpt->fd, buffer, length, MSG_NOSIGNAL );
+    if( n < 0 )
+    {
+      if( errno == EINTR )
+        continue;
+      transport_throw_errno( nonfatal );
+    }
+    buffer += n;
+    length -= n;
+  }
+}
+
+// Check if data is available on connection without reading (or if a
+// connection is pending on a listening transport):
+//    - 1 = data available, 0 = no data available
+int transport_readable (Transport *tpt)
+{
+  fd_set fds;
+  struct timeval tv = { 0, 0 };
+  int ret;
+
+  if (tpt->fd == INVALID_TRANSPORT)
+    return 0;
+
+  FD_ZERO( &fds );
+  FD_SET( tpt->fd, &fds );
+  ret = select( tpt->fd + 1, &fds, NULL, NULL, &tv );
+  if( ret < 0 && errno != EINTR )
+    transport_throw_errno( fatal );
+
+  return ( ret > 0 );
+}
+
+// Check if transport is open:
+//    1 = connection open, 0 = connection closed
+int transport_is_open (Transport *tpt)
+{
+  return (tpt->fd != INVALID_TRANSPORT);
+}
+
+// Shut down connection
+void transport_close (Transport *tpt)
+{
+  if (tpt->fd != INVALID_TRANSPORT)
+  {
+    close( tpt->fd );
+    tpt->fd = INVALID_TRANSPORT;
+  }
+}
+
+#endif // LUARPC_ENABLE_SOCKET
@@ -0,0 +1,294 @@
+// LuaRPC transport over TCP/IP (elua_net)
+
+#include "lua.h"
+#include "lualib.h"
+#include "lauxlib.h"
+#include "platform.h"
+#include "platform_conf.h"
+#include "luarpc_rpc.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined( BUILD_RPC ) && defined( BUILD_RPC_TCP )
+
+#include "elua_net.h"
+#include "uip.h"
+
+#define RPC_NET_CONNS           ( RPC_MAX_CLIENTS + 1 )
+#define RPC_NET_TIMEOUT         10000000 // receive timeout in us
+
+// uIP delivers a whole packet to a receive (or drops what doesn't fit) and
+// can't tell if data is waiting without receiving it, so every connection
+// has a buffer for a packet and a receive running in the background while
+// the buffer is empty
+typedef struct
+{
+  int sock;                           // socket using this buffer (-1 if free)
+  u8 receiving;                       // background receive started
+  elua_net_size pos, len;             // unread data in buf
+  u8 buf[ UIP_RECEIVE_WINDOW ];
+} rpc_net_conn;
+
+static rpc_net_conn net_conns[ RPC_NET_CONNS ];
+static int net_conns_init;
+
+static rpc_net_conn *net_conn_find( int sock )
+{
+  int i;
+
+  if( !net_conns_init )
+  {
+    for( i = 0; i < RPC_NET_CONNS; i ++ )
+      net_conns[ i ].sock = -1;
+    net_conns_init = 1;
+  }
+  for( i = 0; i < RPC_NET_CONNS; i ++ )
+    if( net_conns[ i ].sock == sock )
+      return net_conns + i;
+  return NULL;
+}
+
+static rpc_net_conn *net_conn_alloc( int sock )
+{
+  rpc_net_conn *c = net_conn_find( -1 );
+
+  if( c )
+  {
+    c->sock = sock;
+    c->receiving = 0;
+    c->pos = c->len = 0;
+  }
+  return c;
+}
+
+// Return the number of unread bytes of the connection (receiving more if
+// needed), 0 if there are none yet or -1 on error
+static int net_conn_fill( rpc_net_conn *c )
+{
+  elua_net_size n;
+
+  if( c->pos < c->len )
+    return c->len - c->pos;
+  if( !c->receiving )
+  {
+    if( elua_net_recv_start( c->sock, c->buf, sizeof( c->buf ) ) < 0 )
+      return -1;
+    c->receiving = 1;
+  }
+  if( ( n = elua_net_recv_poll( c->sock, sizeof( c->buf ) ) ) == 0 )
+    return 0;
+  c->receiving = 0;
+  if( n > 0 )
+  {
+    c->pos = 0;
+    c->len = n;
+  }
+  return n;
+}
+
+// Setup Transport
+void transport_init( Transport *tpt )
+{
+  tpt->fd = INVALID_TRANSPORT;
+  tpt->tmr_id = PLATFORM_TIMER_SYS_ID;
+  tpt->listening = 0;
+}
+
+// Open Listener / Server
+//   rpc.listen( port, [timer_id] )
+void transport_open_listener( lua_State *L, ServerHandle *handle )
+{
+  unsigned port;
+
+  if( !lua_isnumber( L, 1 ) )
+    luaL_error( L, "1st arg must be port number" );
+  port = ( unsigned )lua_tonumber( L, 1 );
+  if( lua_gettop( L ) > 2 )
+  {
+    handle->ltpt.tmr_id = ( unsigned )luaL_checkinteger( L, 2 );
+    if( !platform_timer_exists( handle->ltpt.tmr_id ) )
+      luaL_error( L, "invalid timer id" );
+  }
+  if( elua_listen( ( u16 )port, TRUE ) < 0 )
+    luaL_error( L, "TCP/IP not available" );
+
+  handle->ltpt.fd = ( int )port;
+  handle->ltpt.listening = 1;
+}
+
+// Open Connection / Client
+//   rpc.connect( ip, port, [timer_id] ), ip is a string or a number returned by net.packip
+int transport_open_connection( lua_State *L, Handle *handle )
+{
+  struct exception e;
+  elua_net_ip ip;
+  unsigned temp[ 4 ], i;
+  int sock;
+
+  if( !lua_isnumber( L, 2 ) )
+    return luaL_error( L, "2nd arg must be port number" );
+  if( lua_gettop( L ) > 3 )
+  {
+    handle->tpt.tmr_id = ( unsigned )luaL_checkinteger( L, 3 );
+    if( !platform_timer_exists( handle->tpt.tmr_id ) )
+      return luaL_error( L, "invalid timer id" );
+  }
+  if( lua_type( L, 1 ) == LUA_TNUMBER )
+    ip.ipaddr = ( u32 )lua_tonumber( L, 1 );
+  else
+  {
+    const char *host = luaL_checkstring( L, 1 );
+
+    if( sscanf( host, "%u.%u.%u.%u", temp, temp + 1, temp + 2, temp + 3 ) == 4 )
+      for( i = 0; i < 4; i ++ )
+        ip.ipbytes[ i ] = ( u8 )temp[ i ];
+    else
+      ip = elua_net_lookup( host );
+  }
+  if( ip.ipaddr == 0 )
+    return luaL_error( L, "unknown host" );
+
+  if( ( sock = elua_net_socket( ELUA_NET_SOCK_STREAM ) ) < 0 ||
+      elua_net_connect( sock, ip, ( u16 )lua_tonumber( L, 2 ) ) < 0 ||
+      net_conn_alloc( sock ) == NULL )
+  {
+    if( sock >= 0 )
+      elua_net_close( sock );
+    e.errnum = ERR_CONNECT;
+    e.type = fatal;
+    Throw( e );
+  }
+  handle->tpt.fd = sock;
+
+  return 1;
+}
+
+// Accept Connection
+void transport_accept( Transport *tpt, Transport *atpt )
+{
+  struct exception e;
+  elua_net_ip from;
+  int sock;
+  TRANSPORT_VERIFY_OPEN;
+
+  while( ( sock = elua_accept( ( u16 )tpt->fd, tpt->tmr_id, 0, &from ) ) < 0 );
+  if( net_conn_alloc( sock ) == NULL )
+  {
+    elua_net_close( sock );
+    e.errnum = ERR_CONNECT;
+    e.type = nonfatal;
+    Throw( e );
+  }
+  atpt->fd = sock;
+  atpt->tmr_id = tpt->tmr_id;
+}
+
+// Wait for a new connection or a request
+void transport_wait( ServerHandle *handle, int accept )
+{
+  int i;
+
+  while( 1 )
+  {
+    if( accept && transport_readable( &handle->ltpt ) )
+      return;
+    for( i = 0; i < RPC_MAX_CLIENTS; i ++ )
+      if( transport_readable( &handle->atpt[ i ] ) )
+        return;
+  }
+}
+
+// Read & Write to Transport
+//   errors on a connection only close the connection (nonfatal)
+void transport_read_buffer( Transport *tpt, u8 *buffer, int length )
+{
+  struct exception e;
+  rpc_net_conn *c;
+  timer_data_type tmrstart;
+  int n;
+  TRANSPORT_VERIFY_OPEN;
+
+  c = net_conn_find( tpt->fd );
+  tmrstart = platform_timer_start( tpt->tmr_id );
+  while( length > 0 )
+  {
+    n = net_conn_fill( c );
+    if( n < 0 )
+    {
+      e.errnum = ERR_EOF;
+      e.type = nonfatal;
+      Throw( e );
+    }
+    if( n == 0 )
+    {
+      // the receive keeps running, the data is not lost if we time out
+      if( platform_timer_get_diff_crt( tpt->tmr_id, tmrstart ) >= RPC_NET_TIMEOUT )
+      {
+        e.errnum = ERR_NODATA;
+        e.type = nonfatal;
+        Throw( e );
+      }
+      continue;
+    }
+    if( n > length )
+      n = length;
+    memcpy( buffer, c->buf + c->pos, n );
+    c->pos += n;
+    buffer += n;
+    length -= n;
+    tmrstart = platform_timer_start( tpt->tmr_id );
+  }
+}
+
+void transport_write_buffer( Transport *tpt, const u8 *buffer, int length )
+{
+  struct exception e;
+  TRANSPORT_VERIFY_OPEN;
+
+  if( elua_net_send( tpt->fd, buffer, length ) != length )
+  {
+    e.errnum = ERR_EOF;
+    e.type = nonfatal;
+    Throw( e );
+  }
+}
+
+// Check if data is available on connection without reading (or if a
+// connection is pending on a listening transport):
+//     - 1 = data available, 0 = no data available
+// (a connection with an error is readable, so the error is found by reading)
+int transport_readable( Transport *tpt )
+{
+  if( tpt->fd == INVALID_TRANSPORT )
+    return 0;
+  if( tpt->listening )
+    return elua_net_accept_ready( ( u16 )tpt->fd );
+  return net_conn_fill( net_conn_find( tpt->fd ) ) != 0;
+}
+
+// Check if transport is open:
+//    - 1 = connection open, 0 = connection closed
+int transport_is_open( Transport *tpt )
+{
+  return ( tpt->fd != INVALID_TRANSPORT );
+}
+
+// Shut down connection
+void transport_close( Transport *tpt )
+{
+  rpc_net_conn *c;
+
+  if( tpt->fd == INVALID_TRANSPORT )
+    return;
+  if( tpt->listening )
+    elua_listen( ( u16 )tpt->fd, FALSE );
+  else
+  {
+    if( ( c = net_conn_find( tpt->fd ) ) != NULL )
+      c->sock = -1;
+    elua_net_close( tpt->fd );
+  }
+  tpt->fd = INVALID_TRANSPORT;
+}
+
+#endif // #if defined( BUILD_RPC ) && defined( BUILD_RPC_TCP )
@@ -0,0 +1,129 @@
+// LZF block compression (the format of liblzf)
+// A block is a sequence of:
+//   - literal runs: a byte 000LLLLL followed by L + 1 literal bytes
+//   - back references: a byte LLLOOOOO (LLL != 0) followed by L - 7 when
+//     LLL is 7, then by the low 8 bits of the offset. L + 2 bytes are copied
+//     from O + 1 bytes back in the output.
+// Every block is compressed on its own, so the decompressor needs no memory
+// but its output and the compressor only needs its hash table.
+
+#include <string.h>
+#include "type.h"
+#include "lzf.h"
+
+#define LZF_HSIZE             ( 1 << LZF_HLOG )
+#define LZF_MAX_LIT           32
+#define LZF_MAX_OFF           8192
+#define LZF_MAX_REF           ( 7 + 255 + 2 )
+#define LZF_ERR               0xFFFFFFFFUL
+
+// Multiplicative hash of 3 bytes (u32 is larger than 32 bits on some hosts)
+#define LZF_HASH( p )         ( ( ( ( ( ( u32 )( p )[ 0 ] << 16 ) | ( ( u32 )( p )[ 1 ] << 8 ) | ( p )[ 2 ] ) * 2654435761UL ) & 0xFFFFFFFFUL ) >> ( 32 - LZF_HLOG ) )
+
+// Positions of the last 3-byte sequences seen. The entries are never
+// cleared: a match is always checked against the data before it's used.
+static u16 lzf_htab[ LZF_HSIZE ];
+
+// Write the literals in[ 0, len ) at out[ op ], return the new output
+// position or LZF_ERR if they don't fit
+static u32 lzf_literals( const u8 *in, u32 len, u8 *out, u32 op, u32 outlen )
+{
+  u32 n;
+
+  while( len > 0 )
+  {
+    n = len < LZF_MAX_LIT ? len : LZF_MAX_LIT;
+    if( op + n + 1 > outlen )
+      return LZF_ERR;
+    out[ op ++ ] = ( u8 )( n - 1 );
+    memcpy( out + op, in, n );
+    op += n;
+    in += n;
+    len -= n;
+  }
+  return op;
+}
+
+u32 lzf_compress( const u8 *in, u32 inlen, u8 *out, u32 outlen )
+{
+  u32 ip = 0, lit = 0, op = 0, ref, off, len, maxlen, h;
+
+  if( inlen > LZF_MAX_BLOCK )
+    return 0;
+  while( ip + 2 < inlen )
+  {
+    h = LZF_HASH( in + ip );
+    ref = lzf_htab[ h ];
+    lzf_htab[ h ] = ( u16 )ip;
+    if( ref >= ip || ( off = ip - ref - 1 ) >= LZF_MAX_OFF ||
+        in[ ref ] != in[ ip ] || in[ ref + 1 ] != in[ ip + 1 ] || in[ ref + 2 ] != in[ ip + 2 ] )
+    {
+      ip ++;
+      continue;
+    }
+
+    // Found a match, see how long it is
+    maxlen = inlen - ip < LZF_MAX_REF ? inlen - ip : LZF_MAX_REF;
+    for( len = 3; len < maxlen && in[ ref + len ] == in[ ip + len ]; len ++ );
+    if( ( op = lzf_literals( in + lit, ip - lit, out, op, outlen ) ) == LZF_ERR || op + 3 > outlen )
+      return 0;
+    if( len - 2 < 7 )
+      out[ op ++ ] = ( u8 )( ( ( len - 2 ) << 5 ) | ( off >> 8 ) );
+    else
+    {
+      out[ op ++ ] = ( u8 )( ( 7 << 5 ) | ( off >> 8 ) );
+      out[ op ++ ] = ( u8 )( len - 2 - 7 );
+    }
+    out[ op ++ ] = ( u8 )( off & 0xFF );
+
+    // Remember the sequences in the match too
+    for( ip ++, len --; len > 0 && ip + 2 < inlen; ip ++, len -- )
+      lzf_htab[ LZF_HASH( in + ip ) ] = ( u16 )ip;
+    ip += len;
+    lit = ip;
+  }
+  if( ( op = lzf_literals( in + lit, inlen - lit, out, op, outlen ) ) == LZF_ERR )
+    return 0;
+  return op;
+}
+
+u32 lzf_decompress( const u8 *in, u32 inlen, u8 *out, u32 outlen )
+{
+  u32 ip = 0, op = 0, len, off;
+  u8 c;
+
+  while( ip < inlen )
+  {
+    c = in[ ip ++ ];
+    if( c < 32 )
+    {
+      // Literal run
+      len = c + 1;
+      if( ip + len > inlen || op + len > outlen )
+        return 0;
+      memcpy( out + op, in + ip, len );
+      ip += len;
+      op += len;
+    }
+    else
+    {
+      // Back reference (the copy can overlap its source)
+      len = c >> 5;
+      if( len == 7 )
+      {
+        if( ip >= inlen )
+          return 0;
+        len += in[ ip ++ ];
+      }
+      len += 2;
+      if( ip >= inlen )
+        return 0;
+      off = ( ( u32 )( c & 0x1F ) << 8 ) + in[ ip ++ ] + 1;
+      if( off > op || op + len > outlen )
+        return 0;
+      for( ; len > 0; len --, op ++ )
+        out[ op ] = out[ op - off ];
+    }
+  }
+  return op;
+}
@@ -57,13 +57,19 @@ void boot_rpc( void )
   lua_State *L = lua_open();
   luaL_openlibs(L);  /* open libraries */
   
+#ifndef BUILD_RPC_TCP
   // Set up UART for 8N1 w/ adjustable baud rate
   platform_uart_setup( RPC_UART_ID, RPC_UART_SPEED, 8, PLATFORM_UART_PARITY_NONE, PLATFORM_UART_STOPBITS_1 );
+#endif
   
   // Start RPC Server
   lua_getglobal( L, "rpc" );
   lua_getfield( L, -1, "server" );
+#ifdef BUILD_RPC_TCP
+  lua_pushnumber( L, RPC_TCP_PORT );
+#else
   lua_pushnumber( L, RPC_UART_ID );
+#endif
   lua_pushnumber( L, RPC_TIMER_ID );
   lua_pcall( L, 2, 0, 0 );
 }
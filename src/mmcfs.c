@@ -320,7 +320,9 @@ static const DM_DEVICE mmcfs_device =
   mmcfs_mkdir_r,        // mkdir
   mmcfs_unlink_r,       // unlink
   mmcfs_unlink_r,       // rmdir
-  mmcfs_rename_r        // rename
+  mmcfs_rename_r,       // rename
+  NULL,                 // fsync
+  NULL                  // stat
 };
 
 int mmcfs_init()
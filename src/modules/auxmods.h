@@ -61,6 +61,12 @@ LUALIB_API int ( luaopen_i2c )( lua_State *L );
 #define AUXLIB_FS "fs"
 LUALIB_API int ( luaopen_fs )( lua_State *L );
 
+#define AUXLIB_SCHED "sched"
+LUALIB_API int ( luaopen_sched )( lua_State *L );
+
+#define AUXLIB_FIX "fix"
+LUALIB_API int ( luaopen_fix )( lua_State *L );
+
 // Helper macros
 #define MOD_CHECK_ID( mod, id )\
   if( !platform_ ## mod ## _exists( id ) )\
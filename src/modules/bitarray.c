@@ -7,10 +7,12 @@
 #include "auxmods.h"
 #include "lrotable.h"
 #include <string.h>
+#include <stddef.h>
 
 #define META_NAME                 "eLua.bitarray"
 #define bitarray_check( L )      ( bitarray_t* )luaL_checkudata( L, 1, META_NAME )
 #define ROUND_SIZE(s)            ( ( ( s ) >> 3 ) + ( ( s ) & 7 ? 1 : 0 ) )
+#define ROUND_WORDS(s)           ( ( ( s ) + sizeof( u32 ) - 1 ) / sizeof( u32 ) )
 
 // Unpack modes
 enum
@@ -20,17 +22,37 @@ enum
 };
  
 // Structure that describes our array
+// The values are stored in 32-bit words, so arrays of 16 and 32 bit elements
+// are always aligned and the bulk operations can work a word at a time
 typedef struct
 {
   u32 capacity;
   u8 elsize;
-  u8 values[ 1 ];
+  union
+  {
+    u8 b[ sizeof( u32 ) ];
+    u16 h[ sizeof( u32 ) / sizeof( u16 ) ];
+    u32 w[ 1 ];
+  } values;
 } bitarray_t;
 
 // Index shift values/masks
 static const u8 bitarray_index_shift[] = { 0, 3, 2, 0, 1 };
 static const u8 bitarray_index_mask[] = { 0, 0x01, 0x03, 0, 0x0F };
 
+// Helper: create a new array and leave it on the stack
+static bitarray_t* bitarray_alloc( lua_State *L, u32 capacity, u8 elsize )
+{
+  bitarray_t *pa;
+
+  pa = ( bitarray_t* )lua_newuserdata( L, offsetof( bitarray_t, values ) + ROUND_WORDS( ROUND_SIZE( capacity * elsize ) ) * sizeof( u32 ) );
+  pa->capacity = capacity;
+  pa->elsize = elsize;
+  luaL_getmetatable( L, META_NAME );
+  lua_setmetatable( L, -2 );
+  return pa;
+}
+
 // Lua: array = bitarray.new( capacity, [element_size_bits], [fill] ), or
 //      array = bitarray.new( "string", [element_size_bits] ), or
 //      array = bitarray.new( lua_array, [element_size_bits] )
@@ -81,59 +103,81 @@ static int bitarray_new( lua_State *L )
   total = ROUND_SIZE( capacity * elsize );
   if( total <= 0 )
     return luaL_error( L, "invalid arguments.");
-  pa = ( bitarray_t* )lua_newuserdata( L, sizeof( bitarray_t ) + total - 1 );
-  pa->capacity = capacity;
-  pa->elsize = elsize;
+  pa = bitarray_alloc( L, capacity, elsize );
   
   if( buf )
-    memcpy( pa->values, buf, temp );
+    memcpy( pa->values.b, buf, temp );
   else if( fromarray )
   {
     for( total = 1; total <= temp; total ++ )
     {
       lua_rawgeti( L, 1, total );
-      pa->values[ total - 1 ] = lua_tointeger( L, -1 );
+      pa->values.b[ total - 1 ] = lua_tointeger( L, -1 );
       lua_pop( L, 1 );
     }
   }
   else
-    memset( pa->values, fill, total );
-  luaL_getmetatable( L, META_NAME );
-  lua_setmetatable( L, -2 );
+    memset( pa->values.b, fill, total );
   return 1;
 }
 
 // Helper: get the value at the given index
 static u32 bitarray_getval( bitarray_t *pa, u32 idx )
 {
-  u32 shift, val = 0;
+  u32 shift;
   u8 rest, mask;
   
   idx --;
-  if( pa->elsize < 8 )        // sub-byte elements
+  switch( pa->elsize )
   {
-    shift = idx >> bitarray_index_shift[ pa->elsize ];
-    mask = 1 << bitarray_index_shift[ pa->elsize ];
-    rest = idx & ( mask - 1 );
-    val = pa->values[ shift ];
-    val = ( val >> ( ( mask - 1 - rest ) * pa->elsize ) ) & bitarray_index_mask[ pa->elsize ]; 
+    case 8:
+      return pa->values.b[ idx ];
+        
+    case 16:
+      return pa->values.h[ idx ];
+        
+    case 32:
+      return pa->values.w[ idx ];
+
+    default:                  // sub-byte elements
+      shift = idx >> bitarray_index_shift[ pa->elsize ];
+      mask = 1 << bitarray_index_shift[ pa->elsize ];
+      rest = idx & ( mask - 1 );
+      return ( pa->values.b[ shift ] >> ( ( mask - 1 - rest ) * pa->elsize ) ) & bitarray_index_mask[ pa->elsize ]; 
   }
-  else      // one byte or more elements
-    switch( pa->elsize )
-    {
-      case 8:
-        val = pa->values[ idx ];
-        break;
+}
+
+// Helper: set the value at the given index
+static void bitarray_setval( bitarray_t *pa, u32 idx, u32 newval )
+{
+  u32 shift, val;
+  u8 rest, mask;
+
+  idx --;
+  switch( pa->elsize )
+  {
+    case 8:
+      pa->values.b[ idx ] = ( u8 )newval;
+      break;
         
-      case 16:
-        val = *( ( u16* )pa->values + idx );
-        break;
+    case 16:
+      pa->values.h[ idx ] = ( u16 )newval;
+      break;
         
-      case 32:
-        val = *( ( u32* )pa->values + idx );
-        break;  
-    }
-  return val;
+    case 32:
+      pa->values.w[ idx ] = newval;
+      break;  
+
+    default:                  // sub-byte elements
+      shift = idx >> bitarray_index_shift[ pa->elsize ];
+      mask = 1 << bitarray_index_shift[ pa->elsize ];
+      rest = idx & ( mask - 1 );
+      val = pa->values.b[ shift ];
+      val &= ~( bitarray_index_mask[ pa->elsize ] << ( ( mask - 1 - rest ) * pa->elsize ) );
+      val |= ( newval & bitarray_index_mask[ pa->elsize ] ) << ( ( mask - 1 - rest ) * pa->elsize );
+      pa->values.b[ shift ] = val; 
+      break;
+  }    
 }
 
 // Lua: value = array[ idx ]
@@ -154,40 +198,13 @@ static int bitarray_get( lua_State *L )
 static int bitarray_set( lua_State *L )
 {
   bitarray_t *pa;
-  u32 idx, shift, newval, val = 0;
-  u8 rest, mask;
+  u32 idx;
    
   pa = bitarray_check( L );
   idx = ( u32 )luaL_checkinteger( L, 2 );
-  newval = ( u32 )luaL_checkinteger( L, 3 );
   if( ( idx <= 0 ) || ( idx > pa->capacity ) )
     return luaL_error( L, "invalid index." );
-  idx --;
-  if( pa->elsize < 8 )        // sub-byte elements
-  {
-    shift = idx >> bitarray_index_shift[ pa->elsize ];
-    mask = 1 << bitarray_index_shift[ pa->elsize ];
-    rest = idx & ( mask - 1 );
-    val = pa->values[ shift ];
-    val &= ~( bitarray_index_mask[ pa->elsize ] << ( ( mask - 1 - rest ) * pa->elsize ) );
-    val |= newval << ( ( mask - 1 - rest ) * pa->elsize );
-    pa->values[ shift ] = val; 
-  }
-  else      // one byte or more elements
-    switch( pa->elsize )
-    {
-      case 8:
-        pa->values[ idx ] = ( u8 )newval;
-        break;
-        
-      case 16:
-        *( ( u16* )pa->values + idx ) = ( u16 )newval;
-        break;
-        
-      case 32:
-        *( ( u32* )pa->values + idx ) = ( u32 )newval;
-        break;  
-    }    
+  bitarray_setval( pa, idx, ( u32 )luaL_checkinteger( L, 3 ) );
   return 0;
 }
 
@@ -237,7 +254,8 @@ static int bitarray_tostring( lua_State *L )
 {
   luaL_Buffer b;
   bitarray_t *pa;
-  u32 idx;
+  u32 idx, k, chunk;
+  char *p;
   u8 mode = BITARRAY_UNPACK_SEQ;
   const char *ptextmode;
    
@@ -255,11 +273,17 @@ static int bitarray_tostring( lua_State *L )
   if( ( mode == BITARRAY_UNPACK_SEQ ) && ( pa->elsize > 8 ) )
     return luaL_error( L, "element size too large." );
   luaL_buffinit( L, &b );
-  if( mode == BITARRAY_UNPACK_SEQ )
-    for( idx = 1; idx <= pa->capacity; idx  ++ )
-      luaL_addchar( &b, bitarray_getval( pa, idx ) );
-  else
-    luaL_addlstring( &b, ( char* )pa->values, ROUND_SIZE( pa->capacity * pa->elsize ) );
+  if( mode == BITARRAY_UNPACK_SEQ && pa->elsize < 8 )
+    for( idx = 1; idx <= pa->capacity; idx += chunk )
+    {
+      chunk = pa->capacity - idx + 1 > LUAL_BUFFERSIZE ? LUAL_BUFFERSIZE : pa->capacity - idx + 1;
+      p = luaL_prepbuffer( &b );
+      for( k = 0; k < chunk; k ++ )
+        p[ k ] = ( char )bitarray_getval( pa, idx + k );
+      luaL_addsize( &b, chunk );
+    }
+  else    // raw data (same as the sequence for 8 bit elements)
+    luaL_addlstring( &b, ( char* )pa->values.b, ROUND_SIZE( pa->capacity * pa->elsize ) );
   luaL_pushresult( &b );
   return 1;  
 }
@@ -283,9 +307,10 @@ static int bitarray_totable( lua_State *L )
     else
       return luaL_error( L, "invalid mode string." );
   }
-  if( ( mode == BITARRAY_UNPACK_SEQ ) && ( pa->elsize > 8 ) )
-    return luaL_error( L, "element size too large." );
-  lua_newtable( L );    
+  if( mode == BITARRAY_UNPACK_SEQ )
+    lua_createtable( L, pa->capacity, 0 );
+  else
+    lua_createtable( L, ROUND_SIZE( pa->capacity * pa->elsize ), 0 );
   if( mode == BITARRAY_UNPACK_SEQ )
     for( idx = 1; idx <= pa->capacity; idx ++ )
     {
@@ -295,12 +320,699 @@ static int bitarray_totable( lua_State *L )
   else
     for( idx = 0; idx < ROUND_SIZE( pa->capacity * pa->elsize ); idx ++ )
     {
-      lua_pushinteger( L, pa->values[ idx ] );
+      lua_pushinteger( L, pa->values.b[ idx ] );
       lua_rawseti( L, -2, idx + 1 );
     }
   return 1;  
 }
 
+// ****************************************************************************
+// Bulk operations
+// These work on bitarrays and on binary strings. The bits of a buffer are
+// numbered from 1, starting with the most significant bit of the first byte
+// (the same order as the elements of an array with 1 bit elements). The
+// loops handle one 32-bit word at a time; memcpy lets the compiler use plain
+// word loads on targets that allow unaligned access.
+
+enum
+{
+  BITARRAY_OP_AND,
+  BITARRAY_OP_OR,
+  BITARRAY_OP_XOR,
+  BITARRAY_OP_NOT
+};
+
+// Buffer of a bulk operation
+typedef struct
+{
+  u8 *data;
+  u32 len;
+  u32 bits;
+  bitarray_t *pa;
+} bitarray_buf_t;
+
+// Helper: get the buffer of the array or string at the given index
+static void bitarray_getbuf( lua_State *L, int idx, bitarray_buf_t *pb )
+{
+  size_t len;
+  
+  if( lua_type( L, idx ) == LUA_TSTRING )
+  {
+    pb->data = ( u8* )lua_tolstring( L, idx, &len );
+    pb->len = ( u32 )len;
+    pb->bits = ( u32 )len << 3;
+    pb->pa = NULL;
+  }
+  else
+  {
+    pb->pa = ( bitarray_t* )luaL_checkudata( L, idx, META_NAME );
+    pb->data = pb->pa->values.b;
+    pb->bits = pb->pa->capacity * pb->pa->elsize;
+    pb->len = ROUND_SIZE( pb->bits );
+  }
+}
+
+// Helper: clear the unused bits at the end of an array
+static void bitarray_clearpad( bitarray_buf_t *pb )
+{
+  if( pb->bits & 7 )
+    pb->data[ pb->len - 1 ] &= ( u8 )( 0xFF << ( 8 - ( pb->bits & 7 ) ) );
+}
+
+// Helper: count the 1 bits in a word
+static u32 bitarray_popcount32( u32 w )
+{
+  w = w - ( ( w >> 1 ) & 0x55555555 );
+  w = ( w & 0x33333333 ) + ( ( w >> 2 ) & 0x33333333 );
+  return ( ( ( w + ( w >> 4 ) ) & 0x0F0F0F0F ) * 0x01010101 ) >> 24;
+}
+
+#define BITARRAY_BULK_LOOP( expr )\
+  for( ; len >= sizeof( u32 ); len -= sizeof( u32 ), dst += sizeof( u32 ), a += sizeof( u32 ), b += sizeof( u32 ) )\
+  {\
+    memcpy( &wa, a, sizeof( u32 ) );\
+    memcpy( &wb, b, sizeof( u32 ) );\
+    wa = expr;\
+    memcpy( dst, &wa, sizeof( u32 ) );\
+  }\
+  for( ; len; len --, dst ++, a ++, b ++ )\
+  {\
+    wa = *a;\
+    wb = *b;\
+    *dst = ( u8 )( expr );\
+  }
+
+// Helper: dst = a op b for 'len' bytes
+static void bitarray_bulkop( u8 *dst, const u8 *a, const u8 *b, u32 len, int op )
+{
+  u32 wa, wb;
+  
+  switch( op )
+  {
+    case BITARRAY_OP_AND:
+      BITARRAY_BULK_LOOP( wa & wb );
+      break;
+
+    case BITARRAY_OP_OR:
+      BITARRAY_BULK_LOOP( wa | wb );
+      break;
+
+    case BITARRAY_OP_XOR:
+      BITARRAY_BULK_LOOP( wa ^ wb );
+      break;
+
+    case BITARRAY_OP_NOT:
+      BITARRAY_BULK_LOOP( ~wa );
+      break;
+  }
+}
+
+// Helper for the bulk logical operations
+// The result is written to the array given after the operands, or to a new
+// array (if the first operand is an array) or to a new string
+static int bitarray_bulk( lua_State *L, int op )
+{
+  bitarray_buf_t a, b, d;
+  int didx = op == BITARRAY_OP_NOT ? 2 : 3;
+  luaL_Buffer lb;
+  u32 i, chunk;
+  
+  bitarray_getbuf( L, 1, &a );
+  if( op != BITARRAY_OP_NOT )
+  {
+    bitarray_getbuf( L, 2, &b );
+    if( b.len != a.len )
+      return luaL_error( L, "length mismatch." );
+  }
+  else
+    b = a;
+  if( !lua_isnoneornil( L, didx ) )
+  {
+    bitarray_getbuf( L, didx, &d );
+    if( d.pa == NULL )
+      return luaL_error( L, "destination must be a bitarray." );
+    if( d.len != a.len )
+      return luaL_error( L, "length mismatch." );
+    lua_pushvalue( L, didx );
+  }
+  else if( a.pa )
+  {
+    d.pa = bitarray_alloc( L, a.pa->capacity, a.pa->elsize );
+    d.data = d.pa->values.b;
+    d.len = a.len;
+    d.bits = a.bits;
+  }
+  else
+  {
+    luaL_buffinit( L, &lb );
+    for( i = 0; i < a.len; i += chunk )
+    {
+      chunk = a.len - i > LUAL_BUFFERSIZE ? LUAL_BUFFERSIZE : a.len - i;
+      bitarray_bulkop( ( u8* )luaL_prepbuffer( &lb ), a.data + i, b.data + i, chunk, op );
+      luaL_addsize( &lb, chunk );
+    }
+    luaL_pushresult( &lb );
+    return 1;
+  }
+  bitarray_bulkop( d.data, a.data, b.data, a.len, op );
+  bitarray_clearpad( &d );
+  return 1;
+}
+
+// Lua: res = bitarray.band( a, b, [dest] )
+static int bitarray_band( lua_State *L )
+{
+  return bitarray_bulk( L, BITARRAY_OP_AND );
+}
+
+// Lua: res = bitarray.bor( a, b, [dest] )
+static int bitarray_bor( lua_State *L )
+{
+  return bitarray_bulk( L, BITARRAY_OP_OR );
+}
+
+// Lua: res = bitarray.bxor( a, b, [dest] )
+static int bitarray_bxor( lua_State *L )
+{
+  return bitarray_bulk( L, BITARRAY_OP_XOR );
+}
+
+// Lua: res = bitarray.bnot( a, [dest] )
+static int bitarray_bnot( lua_State *L )
+{
+  return bitarray_bulk( L, BITARRAY_OP_NOT );
+}
+
+// Lua: count = bitarray.popcount( buf )
+static int bitarray_popcount( lua_State *L )
+{
+  bitarray_buf_t a;
+  const u8 *p;
+  u32 i, w, count = 0, full;
+  
+  bitarray_getbuf( L, 1, &a );
+  full = a.bits >> 3;
+  p = a.data;
+  for( i = 0; i + sizeof( u32 ) <= full; i += sizeof( u32 ), p += sizeof( u32 ) )
+  {
+    memcpy( &w, p, sizeof( u32 ) );
+    count += bitarray_popcount32( w );
+  }
+  for( ; i < full; i ++, p ++ )
+    count += bitarray_popcount32( *p );
+  if( a.bits & 7 )
+    count += bitarray_popcount32( *p & ( u8 )( 0xFF << ( 8 - ( a.bits & 7 ) ) ) );
+  lua_pushinteger( L, count );
+  return 1;
+}
+
+// Helper for ffs/ffc: find the first bit that differs from the bits in 'inv'
+static int bitarray_find( lua_State *L, u8 inv )
+{
+  bitarray_buf_t a;
+  lua_Integer start = luaL_optinteger( L, 2, 1 );
+  u32 pos, i, w, winv = inv ? 0xFFFFFFFF : 0;
+  u8 c;
+  
+  bitarray_getbuf( L, 1, &a );
+  if( start <= 0 )
+    return luaL_error( L, "invalid index." );
+  pos = ( u32 )start - 1;
+  if( pos >= a.bits )
+    return 0;
+  i = pos >> 3;
+  c = ( a.data[ i ] ^ inv ) & ( 0xFF >> ( pos & 7 ) );
+  if( c == 0 )
+  {
+    for( i ++; i + sizeof( u32 ) <= a.len; i += sizeof( u32 ) )
+    {
+      memcpy( &w, a.data + i, sizeof( u32 ) );
+      if( w != winv )
+        break;
+    }
+    while( i < a.len && ( c = a.data[ i ] ^ inv ) == 0 )
+      i ++;
+    if( i == a.len )
+      return 0;
+  }
+  for( pos = i << 3; ( c & 0x80 ) == 0; c <<= 1 )
+    pos ++;
+  if( pos >= a.bits )
+    return 0;
+  lua_pushinteger( L, pos + 1 );
+  return 1;
+}
+
+// Lua: pos = bitarray.ffs( buf, [start] )
+static int bitarray_ffs( lua_State *L )
+{
+  return bitarray_find( L, 0 );
+}
+
+// Lua: pos = bitarray.ffc( buf, [start] )
+static int bitarray_ffc( lua_State *L )
+{
+  return bitarray_find( L, 0xFF );
+}
+
+// Helper: read 'n' bits (at most 8) starting at bit 'pos', aligned to the most significant bit
+static u8 bitarray_readbits( const u8 *src, u32 pos, u32 n )
+{
+  u32 shift = pos & 7;
+  u8 val;
+  
+  src += pos >> 3;
+  val = ( u8 )( src[ 0 ] << shift );
+  if( shift + n > 8 )
+    val |= src[ 1 ] >> ( 8 - shift );
+  return val;
+}
+
+// Helper: write 'n' bits (aligned to the MSB of 'val') at bit 'pos', without crossing a byte
+static void bitarray_writebits( u8 *dst, u32 pos, u8 val, u32 n )
+{
+  u8 mask = ( u8 )( 0xFF << ( 8 - n ) ) >> ( pos & 7 );
+  
+  dst += pos >> 3;
+  *dst = ( *dst & ~mask ) | ( ( val >> ( pos & 7 ) ) & mask );
+}
+
+// Helper: copy 'n' bits from 'src' (starting at bit 'spos') to 'dst' (starting at bit 'dpos')
+// The ranges can overlap only if the destination comes first
+static void bitarray_copybits( u8 *dst, u32 dpos, const u8 *src, u32 spos, u32 n )
+{
+  u32 i, k, shift;
+  const u8 *s;
+
+  // Align the destination to a byte
+  if( dpos & 7 )
+  {
+    k = 8 - ( dpos & 7 );
+    if( k > n )
+      k = n;
+    bitarray_writebits( dst, dpos, bitarray_readbits( src, spos, k ), k );
+    dpos += k;
+    spos += k;
+    n -= k;
+  }
+  // Whole bytes, then the remaining bits
+  dst += dpos >> 3;
+  s = src + ( spos >> 3 );
+  k = n >> 3;
+  if( ( shift = spos & 7 ) == 0 )
+    memmove( dst, s, k );
+  else
+    for( i = 0; i < k; i ++ )
+      dst[ i ] = ( u8 )( ( s[ i ] << shift ) | ( s[ i + 1 ] >> ( 8 - shift ) ) );
+  if( n & 7 )
+    bitarray_writebits( dst + k, 0, bitarray_readbits( s + k, shift, n & 7 ), n & 7 );
+}
+
+// Helper: copy 'n' bits between buffers (positions start at 0), with any overlap
+static void bitarray_movebits( lua_State *L, u8 *dst, u32 dpos, const u8 *src, u32 spos, u32 n )
+{
+  u32 first, last;
+  u8 *temp;
+
+  if( src == dst && dpos > spos && dpos < spos + n )
+  {
+    // Overlapping ranges with the destination last: work from a copy of the source bytes
+    first = spos >> 3;
+    last = ( spos + n - 1 ) >> 3;
+    temp = ( u8* )lua_newuserdata( L, last - first + 1 );
+    memcpy( temp, src + first, last - first + 1 );
+    src = temp;
+    spos &= 7;
+  }
+  bitarray_copybits( dst, dpos, src, spos, n );
+}
+
+// Lua: bitarray.bitcopy( dest, destpos, src, srcpos, count )
+static int bitarray_bitcopy( lua_State *L )
+{
+  bitarray_buf_t d, s;
+  lua_Integer dpos = luaL_checkinteger( L, 2 );
+  lua_Integer spos = luaL_checkinteger( L, 4 );
+  lua_Integer n = luaL_checkinteger( L, 5 );
+  
+  bitarray_getbuf( L, 1, &d );
+  if( d.pa == NULL )
+    return luaL_error( L, "destination must be a bitarray." );
+  bitarray_getbuf( L, 3, &s );
+  if( n < 0 || dpos <= 0 || spos <= 0 || ( u32 )( dpos - 1 + n ) > d.bits || ( u32 )( spos - 1 + n ) > s.bits )
+    return luaL_error( L, "invalid range." );
+  if( n > 0 )
+    bitarray_movebits( L, d.data, ( u32 )dpos - 1, s.data, ( u32 )spos - 1, ( u32 )n );
+  return 0;
+}
+
+// Lua: bitarray.shift( array, count )
+// A positive count moves the bits towards the end of the array, a negative
+// one towards the start. The vacated bits are set to 0.
+static int bitarray_shift( lua_State *L )
+{
+  bitarray_buf_t a;
+  lua_Integer n = luaL_checkinteger( L, 2 );
+  u32 count, bytes, shift, i;
+  u8 *p;
+  
+  bitarray_getbuf( L, 1, &a );
+  if( a.pa == NULL )
+    return luaL_error( L, "argument must be a bitarray." );
+  count = ( u32 )( n < 0 ? -n : n );
+  p = a.data;
+  if( count >= a.bits )
+  {
+    memset( p, 0, a.len );
+    return 0;
+  }
+  bytes = count >> 3;
+  shift = count & 7;
+  if( n > 0 )
+  {
+    memmove( p + bytes, p, a.len - bytes );
+    memset( p, 0, bytes );
+    if( shift )
+    {
+      for( i = a.len - 1; i > bytes; i -- )
+        p[ i ] = ( u8 )( ( p[ i ] >> shift ) | ( p[ i - 1 ] << ( 8 - shift ) ) );
+      p[ bytes ] >>= shift;
+    }
+  }
+  else if( n < 0 )
+  {
+    bitarray_clearpad( &a );
+    memmove( p, p + bytes, a.len - bytes );
+    memset( p + a.len - bytes, 0, bytes );
+    if( shift )
+    {
+      for( i = 0; i + 1 < a.len - bytes; i ++ )
+        p[ i ] = ( u8 )( ( p[ i ] << shift ) | ( p[ i + 1 ] >> ( 8 - shift ) ) );
+      p[ i ] <<= shift;
+    }
+  }
+  bitarray_clearpad( &a );
+  return 0;
+}
+
+// CRC tables (one entry per byte value)
+// CRC-8: polynomial 0x07, initial value 0
+static const u8 bitarray_crc8_table[] =
+{
+  0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31,
+  0x24, 0x23, 0x2A, 0x2D, 0x70, 0x77, 0x7E, 0x79, 0x6C, 0x6B, 0x62, 0x65,
+  0x48, 0x4F, 0x46, 0x41, 0x54, 0x53, 0x5A, 0x5D, 0xE0, 0xE7, 0xEE, 0xE9,
+  0xFC, 0xFB, 0xF2, 0xF5, 0xD8, 0xDF, 0xD6, 0xD1, 0xC4, 0xC3, 0xCA, 0xCD,
+  0x90, 0x97, 0x9E, 0x99, 0x8C, 0x8B, 0x82, 0x85, 0xA8, 0xAF, 0xA6, 0xA1,
+  0xB4, 0xB3, 0xBA, 0xBD, 0xC7, 0xC0, 0xC9, 0xCE, 0xDB, 0xDC, 0xD5, 0xD2,
+  0xFF, 0xF8, 0xF1, 0xF6, 0xE3, 0xE4, 0xED, 0xEA, 0xB7, 0xB0, 0xB9, 0xBE,
+  0xAB, 0xAC, 0xA5, 0xA2, 0x8F, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9D, 0x9A,
+  0x27, 0x20, 0x29, 0x2E, 0x3B, 0x3C, 0x35, 0x32, 0x1F, 0x18, 0x11, 0x16,
+  0x03, 0x04, 0x0D, 0x0A, 0x57, 0x50, 0x59, 0x5E, 0x4B, 0x4C, 0x45, 0x42,
+  0x6F, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7D, 0x7A, 0x89, 0x8E, 0x87, 0x80,
+  0x95, 0x92, 0x9B, 0x9C, 0xB1, 0xB6, 0xBF, 0xB8, 0xAD, 0xAA, 0xA3, 0xA4,
+  0xF9, 0xFE, 0xF7, 0xF0, 0xE5, 0xE2, 0xEB, 0xEC, 0xC1, 0xC6, 0xCF, 0xC8,
+  0xDD, 0xDA, 0xD3, 0xD4, 0x69, 0x6E, 0x67, 0x60, 0x75, 0x72, 0x7B, 0x7C,
+  0x51, 0x56, 0x5F, 0x58, 0x4D, 0x4A, 0x43, 0x44, 0x19, 0x1E, 0x17, 0x10,
+  0x05, 0x02, 0x0B, 0x0C, 0x21, 0x26, 0x2F, 0x28, 0x3D, 0x3A, 0x33, 0x34,
+  0x4E, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5C, 0x5B, 0x76, 0x71, 0x78, 0x7F,
+  0x6A, 0x6D, 0x64, 0x63, 0x3E, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2C, 0x2B,
+  0x06, 0x01, 0x08, 0x0F, 0x1A, 0x1D, 0x14, 0x13, 0xAE, 0xA9, 0xA0, 0xA7,
+  0xB2, 0xB5, 0xBC, 0xBB, 0x96, 0x91, 0x98, 0x9F, 0x8A, 0x8D, 0x84, 0x83,
+  0xDE, 0xD9, 0xD0, 0xD7, 0xC2, 0xC5, 0xCC, 0xCB, 0xE6, 0xE1, 0xE8, 0xEF,
+  0xFA, 0xFD, 0xF4, 0xF3
+};
+
+// CRC-16 (CCITT): polynomial 0x1021, initial value 0xFFFF
+static const u16 bitarray_crc16_table[] =
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+  0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+  0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+  0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+  0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+  0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+  0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+  0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+  0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+  0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+  0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+  0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+  0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+  0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+  0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+  0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+  0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+  0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+  0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+  0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+  0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+  0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+  0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+  0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+  0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+  0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+  0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+  0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+  0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+  0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+  0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
+// CRC-32 (IEEE 802.3, reflected): polynomial 0xEDB88320
+static const u32 bitarray_crc32_table[] =
+{
+  0x00000000UL, 0x77073096UL, 0xEE0E612CUL, 0x990951BAUL, 0x076DC419UL, 0x706AF48FUL,
+  0xE963A535UL, 0x9E6495A3UL, 0x0EDB8832UL, 0x79DCB8A4UL, 0xE0D5E91EUL, 0x97D2D988UL,
+  0x09B64C2BUL, 0x7EB17CBDUL, 0xE7B82D07UL, 0x90BF1D91UL, 0x1DB71064UL, 0x6AB020F2UL,
+  0xF3B97148UL, 0x84BE41DEUL, 0x1ADAD47DUL, 0x6DDDE4EBUL, 0xF4D4B551UL, 0x83D385C7UL,
+  0x136C9856UL, 0x646BA8C0UL, 0xFD62F97AUL, 0x8A65C9ECUL, 0x14015C4FUL, 0x63066CD9UL,
+  0xFA0F3D63UL, 0x8D080DF5UL, 0x3B6E20C8UL, 0x4C69105EUL, 0xD56041E4UL, 0xA2677172UL,
+  0x3C03E4D1UL, 0x4B04D447UL, 0xD20D85FDUL, 0xA50AB56BUL, 0x35B5A8FAUL, 0x42B2986CUL,
+  0xDBBBC9D6UL, 0xACBCF940UL, 0x32D86CE3UL, 0x45DF5C75UL, 0xDCD60DCFUL, 0xABD13D59UL,
+  0x26D930ACUL, 0x51DE003AUL, 0xC8D75180UL, 0xBFD06116UL, 0x21B4F4B5UL, 0x56B3C423UL,
+  0xCFBA9599UL, 0xB8BDA50FUL, 0x2802B89EUL, 0x5F058808UL, 0xC60CD9B2UL, 0xB10BE924UL,
+  0x2F6F7C87UL, 0x58684C11UL, 0xC1611DABUL, 0xB6662D3DUL, 0x76DC4190UL, 0x01DB7106UL,
+  0x98D220BCUL, 0xEFD5102AUL, 0x71B18589UL, 0x06B6B51FUL, 0x9FBFE4A5UL, 0xE8B8D433UL,
+  0x7807C9A2UL, 0x0F00F934UL, 0x9609A88EUL, 0xE10E9818UL, 0x7F6A0DBBUL, 0x086D3D2DUL,
+  0x91646C97UL, 0xE6635C01UL, 0x6B6B51F4UL, 0x1C6C6162UL, 0x856530D8UL, 0xF262004EUL,
+  0x6C0695EDUL, 0x1B01A57BUL, 0x8208F4C1UL, 0xF50FC457UL, 0x65B0D9C6UL, 0x12B7E950UL,
+  0x8BBEB8EAUL, 0xFCB9887CUL, 0x62DD1DDFUL, 0x15DA2D49UL, 0x8CD37CF3UL, 0xFBD44C65UL,
+  0x4DB26158UL, 0x3AB551CEUL, 0xA3BC0074UL, 0xD4BB30E2UL, 0x4ADFA541UL, 0x3DD895D7UL,
+  0xA4D1C46DUL, 0xD3D6F4FBUL, 0x4369E96AUL, 0x346ED9FCUL, 0xAD678846UL, 0xDA60B8D0UL,
+  0x44042D73UL, 0x33031DE5UL, 0xAA0A4C5FUL, 0xDD0D7CC9UL, 0x5005713CUL, 0x270241AAUL,
+  0xBE0B1010UL, 0xC90C2086UL, 0x5768B525UL, 0x206F85B3UL, 0xB966D409UL, 0xCE61E49FUL,
+  0x5EDEF90EUL, 0x29D9C998UL, 0xB0D09822UL, 0xC7D7A8B4UL, 0x59B33D17UL, 0x2EB40D81UL,
+  0xB7BD5C3BUL, 0xC0BA6CADUL, 0xEDB88320UL, 0x9ABFB3B6UL, 0x03B6E20CUL, 0x74B1D29AUL,
+  0xEAD54739UL, 0x9DD277AFUL, 0x04DB2615UL, 0x73DC1683UL, 0xE3630B12UL, 0x94643B84UL,
+  0x0D6D6A3EUL, 0x7A6A5AA8UL, 0xE40ECF0BUL, 0x9309FF9DUL, 0x0A00AE27UL, 0x7D079EB1UL,
+  0xF00F9344UL, 0x8708A3D2UL, 0x1E01F268UL, 0x6906C2FEUL, 0xF762575DUL, 0x806567CBUL,
+  0x196C3671UL, 0x6E6B06E7UL, 0xFED41B76UL, 0x89D32BE0UL, 0x10DA7A5AUL, 0x67DD4ACCUL,
+  0xF9B9DF6FUL, 0x8EBEEFF9UL, 0x17B7BE43UL, 0x60B08ED5UL, 0xD6D6A3E8UL, 0xA1D1937EUL,
+  0x38D8C2C4UL, 0x4FDFF252UL, 0xD1BB67F1UL, 0xA6BC5767UL, 0x3FB506DDUL, 0x48B2364BUL,
+  0xD80D2BDAUL, 0xAF0A1B4CUL, 0x36034AF6UL, 0x41047A60UL, 0xDF60EFC3UL, 0xA867DF55UL,
+  0x316E8EEFUL, 0x4669BE79UL, 0xCB61B38CUL, 0xBC66831AUL, 0x256FD2A0UL, 0x5268E236UL,
+  0xCC0C7795UL, 0xBB0B4703UL, 0x220216B9UL, 0x5505262FUL, 0xC5BA3BBEUL, 0xB2BD0B28UL,
+  0x2BB45A92UL, 0x5CB36A04UL, 0xC2D7FFA7UL, 0xB5D0CF31UL, 0x2CD99E8BUL, 0x5BDEAE1DUL,
+  0x9B64C2B0UL, 0xEC63F226UL, 0x756AA39CUL, 0x026D930AUL, 0x9C0906A9UL, 0xEB0E363FUL,
+  0x72076785UL, 0x05005713UL, 0x95BF4A82UL, 0xE2B87A14UL, 0x7BB12BAEUL, 0x0CB61B38UL,
+  0x92D28E9BUL, 0xE5D5BE0DUL, 0x7CDCEFB7UL, 0x0BDBDF21UL, 0x86D3D2D4UL, 0xF1D4E242UL,
+  0x68DDB3F8UL, 0x1FDA836EUL, 0x81BE16CDUL, 0xF6B9265BUL, 0x6FB077E1UL, 0x18B74777UL,
+  0x88085AE6UL, 0xFF0F6A70UL, 0x66063BCAUL, 0x11010B5CUL, 0x8F659EFFUL, 0xF862AE69UL,
+  0x616BFFD3UL, 0x166CCF45UL, 0xA00AE278UL, 0xD70DD2EEUL, 0x4E048354UL, 0x3903B3C2UL,
+  0xA7672661UL, 0xD06016F7UL, 0x4969474DUL, 0x3E6E77DBUL, 0xAED16A4AUL, 0xD9D65ADCUL,
+  0x40DF0B66UL, 0x37D83BF0UL, 0xA9BCAE53UL, 0xDEBB9EC5UL, 0x47B2CF7FUL, 0x30B5FFE9UL,
+  0xBDBDF21CUL, 0xCABAC28AUL, 0x53B39330UL, 0x24B4A3A6UL, 0xBAD03605UL, 0xCDD70693UL,
+  0x54DE5729UL, 0x23D967BFUL, 0xB3667A2EUL, 0xC4614AB8UL, 0x5D681B02UL, 0x2A6F2B94UL,
+  0xB40BBE37UL, 0xC30C8EA1UL, 0x5A05DF1BUL, 0x2D02EF8DUL
+};
+
+// Lua: crc = bitarray.crc8( buf, [crc] )
+static int bitarray_crc8( lua_State *L )
+{
+  bitarray_buf_t a;
+  u8 crc = ( u8 )luaL_optinteger( L, 2, 0 );
+  const u8 *p;
+  u32 i;
+  
+  bitarray_getbuf( L, 1, &a );
+  for( i = 0, p = a.data; i < a.len; i ++ )
+    crc = bitarray_crc8_table[ crc ^ *p ++ ];
+  lua_pushinteger( L, crc );
+  return 1;
+}
+
+// Lua: crc = bitarray.crc16( buf, [crc] )
+static int bitarray_crc16( lua_State *L )
+{
+  bitarray_buf_t a;
+  u16 crc = ( u16 )luaL_optinteger( L, 2, 0xFFFF );
+  const u8 *p;
+  u32 i;
+  
+  bitarray_getbuf( L, 1, &a );
+  for( i = 0, p = a.data; i < a.len; i ++ )
+    crc = ( u16 )( ( crc << 8 ) ^ bitarray_crc16_table[ ( crc >> 8 ) ^ *p ++ ] );
+  lua_pushinteger( L, crc );
+  return 1;
+}
+
+// Lua: crc = bitarray.crc32( buf, [crc] )
+static int bitarray_crc32( lua_State *L )
+{
+  bitarray_buf_t a;
+  u32 crc = ~( u32 )luaL_optnumber( L, 2, 0 );
+  const u8 *p;
+  u32 i;
+  
+  bitarray_getbuf( L, 1, &a );
+  for( i = 0, p = a.data; i < a.len; i ++ )
+    crc = bitarray_crc32_table[ ( crc ^ *p ++ ) & 0xFF ] ^ ( crc >> 8 );
+  lua_pushnumber( L, ( lua_Number )( u32 )~crc );
+  return 1;
+}
+
+// ****************************************************************************
+// Element ranges
+// Whole 32-bit words of elements are handled at once (the storage is word
+// aligned), the elements before and after them one at a time.
+
+// Helper: the value 'val' repeated over a storage word
+static u32 bitarray_pattern( bitarray_t *pa, u32 val )
+{
+  u32 pattern = 0;
+  u16 half;
+  u8 i;
+
+  switch( pa->elsize )
+  {
+    case 8:
+      pattern = ( val & 0xFF ) * 0x01010101UL;
+      break;
+
+    case 16:
+      half = ( u16 )val;
+      memcpy( &pattern, &half, sizeof( u16 ) );
+      memcpy( ( u8* )&pattern + sizeof( u16 ), &half, sizeof( u16 ) );
+      break;
+
+    case 32:
+      pattern = val;
+      break;
+
+    default:
+      for( i = 0; i < 8; i += pa->elsize )
+        pattern = ( pattern << pa->elsize ) | ( val & bitarray_index_mask[ pa->elsize ] );
+      pattern *= 0x01010101UL;
+      break;
+  }
+  return pattern;
+}
+
+// Helper: the index of the last element of the run that starts at 'idx'
+static u32 bitarray_runend( bitarray_t *pa, u32 idx )
+{
+  u32 val = bitarray_getval( pa, idx );
+  u32 mask = 32 / pa->elsize - 1, pattern, w;
+
+  for( idx ++; idx <= pa->capacity && ( ( idx - 1 ) & mask ); idx ++ )
+    if( bitarray_getval( pa, idx ) != val )
+      return idx - 1;
+  pattern = bitarray_pattern( pa, val );
+  for( w = ( idx - 1 ) / ( mask + 1 ); idx + mask <= pa->capacity && pa->values.w[ w ] == pattern; w ++ )
+    idx += mask + 1;
+  for( ; idx <= pa->capacity; idx ++ )
+    if( bitarray_getval( pa, idx ) != val )
+      break;
+  return idx - 1;
+}
+
+// Lua: bitarray.fill( array, value, [first], [last] )
+static int bitarray_fill( lua_State *L )
+{
+  bitarray_t *pa;
+  u32 val, first, last, mask, pattern, w;
+  
+  pa = bitarray_check( L );
+  val = ( u32 )luaL_checkinteger( L, 2 );
+  first = ( u32 )luaL_optinteger( L, 3, 1 );
+  last = ( u32 )luaL_optinteger( L, 4, pa->capacity );
+  if( first == 0 || last > pa->capacity || first > last + 1 )
+    return luaL_error( L, "invalid range." );
+  mask = 32 / pa->elsize - 1;
+  for( ; first <= last && ( ( first - 1 ) & mask ); first ++ )
+    bitarray_setval( pa, first, val );
+  pattern = bitarray_pattern( pa, val );
+  for( w = ( first - 1 ) / ( mask + 1 ); first + mask <= last; w ++ )
+  {
+    pa->values.w[ w ] = pattern;
+    first += mask + 1;
+  }
+  for( ; first <= last; first ++ )
+    bitarray_setval( pa, first, val );
+  return 0;
+}
+
+// Lua: bitarray.copy( dest, destidx, src, [srcidx], [count] )
+// 'src' is an array with the same element size or a string
+static int bitarray_copy( lua_State *L )
+{
+  bitarray_buf_t d, s;
+  lua_Integer didx = luaL_checkinteger( L, 2 );
+  lua_Integer sidx = luaL_optinteger( L, 4, 1 );
+  lua_Integer n;
+  u32 elsize, scap;
+  
+  bitarray_getbuf( L, 1, &d );
+  if( d.pa == NULL )
+    return luaL_error( L, "destination must be a bitarray." );
+  bitarray_getbuf( L, 3, &s );
+  elsize = d.pa->elsize;
+  if( s.pa && s.pa->elsize != elsize )
+    return luaL_error( L, "element size mismatch." );
+  scap = s.bits / elsize;
+  n = luaL_optinteger( L, 5, ( lua_Integer )scap - sidx + 1 );
+  if( n < 0 || didx <= 0 || sidx <= 0 || ( u32 )( didx - 1 + n ) > d.pa->capacity || ( u32 )( sidx - 1 + n ) > scap )
+    return luaL_error( L, "invalid range." );
+  if( n > 0 )
+    bitarray_movebits( L, d.data, ( u32 )( didx - 1 ) * elsize, s.data, ( u32 )( sidx - 1 ) * elsize, ( u32 )n * elsize );
+  return 0;
+}
+
+// Lua iterator for runs: returns ( first, count, value ) for each run of equal elements
+// The control value is the first element of the previous run, so its end is found again
+static int bitarray_runs_iter( lua_State *L )
+{
+  bitarray_t *pa;
+  u32 idx, last;
+  
+  pa = bitarray_check( L );
+  idx = ( u32 )luaL_checkinteger( L, 2 );
+  idx = idx == 0 ? 1 : bitarray_runend( pa, idx ) + 1;
+  if( idx > pa->capacity )
+    return 0;
+  last = bitarray_runend( pa, idx );
+  lua_pushinteger( L, idx );
+  lua_pushinteger( L, last - idx + 1 );
+  lua_pushinteger( L, bitarray_getval( pa, idx ) );
+  return 3;
+}
+
+// Lua: for first, count, value in bitarray.runs( array ) do ... end
+static int bitarray_runs( lua_State *L )
+{
+  bitarray_check( L );
+#if LUA_OPTIMIZE_MEMORY > 0
+  lua_pushlightfunction( L, bitarray_runs_iter );
+#else
+  lua_pushcclosure( L, bitarray_runs_iter, 0 );
+#endif
+  lua_pushvalue( L, 1 );
+  lua_pushinteger ( L, 0 );
+  return 3;
+}
+
 // Module function map
 #define MIN_OPT_LEVEL 2
 #include "lrodefs.h"
@@ -310,6 +1022,21 @@ const LUA_REG_TYPE bitarray_map[] =
   { LSTRKEY( "pairs" ), LFUNCVAL( bitarray_pairs ) },
   { LSTRKEY( "tostring" ), LFUNCVAL( bitarray_tostring ) },
   { LSTRKEY( "totable" ), LFUNCVAL( bitarray_totable ) },
+  { LSTRKEY( "fill" ), LFUNCVAL( bitarray_fill ) },
+  { LSTRKEY( "copy" ), LFUNCVAL( bitarray_copy ) },
+  { LSTRKEY( "runs" ), LFUNCVAL( bitarray_runs ) },
+  { LSTRKEY( "band" ), LFUNCVAL( bitarray_band ) },
+  { LSTRKEY( "bor" ), LFUNCVAL( bitarray_bor ) },
+  { LSTRKEY( "bxor" ), LFUNCVAL( bitarray_bxor ) },
+  { LSTRKEY( "bnot" ), LFUNCVAL( bitarray_bnot ) },
+  { LSTRKEY( "popcount" ), LFUNCVAL( bitarray_popcount ) },
+  { LSTRKEY( "ffs" ), LFUNCVAL( bitarray_ffs ) },
+  { LSTRKEY( "ffc" ), LFUNCVAL( bitarray_ffc ) },
+  { LSTRKEY( "bitcopy" ), LFUNCVAL( bitarray_bitcopy ) },
+  { LSTRKEY( "shift" ), LFUNCVAL( bitarray_shift ) },
+  { LSTRKEY( "crc8" ), LFUNCVAL( bitarray_crc8 ) },
+  { LSTRKEY( "crc16" ), LFUNCVAL( bitarray_crc16 ) },
+  { LSTRKEY( "crc32" ), LFUNCVAL( bitarray_crc32 ) },
   { LNILKEY, LNILVAL } 
 };
 
@@ -19,6 +19,22 @@
 #include <malloc.h>
 #endif
 
+#ifdef BUILD_MEMPOOL
+#include "mpool.h"
+#endif
+
+#ifdef BUILD_ALLOC_TRACE
+#include "alloctrace.h"
+#endif
+
+#ifdef BUILD_COMPACT_SPACE
+#include "lcompact.h"
+#endif
+
+#ifdef BUILD_HEAP_REGIONS
+#include "heapreg.h"
+#endif
+
 #if defined( USE_GIT_REVISION )
 #include "git_version.h"
 #else
@@ -41,7 +57,9 @@ static int elua_egc_setup( lua_State *L )
 static int elua_heapstats( lua_State *L )
 {
 #ifndef USE_SIMPLE_ALLOCATOR // the simple allocator doesn't offer memory usage data
-#ifdef USE_MULTIPLE_ALLOCATOR
+#if defined( BUILD_HEAP_REGIONS )
+  struct mallinfo m = heapreg_mallinfo();
+#elif defined( USE_MULTIPLE_ALLOCATOR )
   struct mallinfo m = dlmallinfo();
 #else
   struct mallinfo m = mallinfo();
@@ -55,6 +73,174 @@ static int elua_heapstats( lua_State *L )
 #endif // #ifndef USE_SIMPLE_ALLOCATOR
 }
 
+// Lua: stats = elua.heapregions()
+// Returns an array with one table per RAM region (start, size, used, peak, allocs, failed)
+// Only available if heap regions are enabled
+static int elua_heapregions( lua_State *L )
+{
+#ifdef BUILD_HEAP_REGIONS
+  heapreg_stats s;
+  unsigned id;
+
+  lua_newtable( L );
+  for( id = 0; heapreg_get_stats( id, &s ); id ++ )
+  {
+    lua_createtable( L, 0, 6 );
+    lua_pushinteger( L, s.start );
+    lua_setfield( L, -2, "start" );
+    lua_pushinteger( L, s.size );
+    lua_setfield( L, -2, "size" );
+    lua_pushinteger( L, s.used );
+    lua_setfield( L, -2, "used" );
+    lua_pushinteger( L, s.peak );
+    lua_setfield( L, -2, "peak" );
+    lua_pushinteger( L, s.allocs );
+    lua_setfield( L, -2, "allocs" );
+    lua_pushinteger( L, s.failed );
+    lua_setfield( L, -2, "failed" );
+    lua_rawseti( L, -2, id + 1 );
+  }
+  return 1;
+#else // #ifdef BUILD_HEAP_REGIONS
+  return luaL_error( L, "heap regions not enabled." );
+#endif // #ifdef BUILD_HEAP_REGIONS
+}
+
+// Lua: stats = elua.poolstats()
+// Returns an array with one table per size class (size, perslab, slabs, inuse, peak, allocs)
+// Only available if the memory pools are enabled
+static int elua_poolstats( lua_State *L )
+{
+#ifdef BUILD_MEMPOOL
+  mpool_stats s;
+  unsigned cls;
+
+  lua_newtable( L );
+  for( cls = 0; mpool_get_stats( cls, &s ); cls ++ )
+  {
+    lua_createtable( L, 0, 6 );
+    lua_pushinteger( L, s.objsize );
+    lua_setfield( L, -2, "size" );
+    lua_pushinteger( L, s.perslab );
+    lua_setfield( L, -2, "perslab" );
+    lua_pushinteger( L, s.slabs );
+    lua_setfield( L, -2, "slabs" );
+    lua_pushinteger( L, s.inuse );
+    lua_setfield( L, -2, "inuse" );
+    lua_pushinteger( L, s.peak );
+    lua_setfield( L, -2, "peak" );
+    lua_pushinteger( L, s.allocs );
+    lua_setfield( L, -2, "allocs" );
+    lua_rawseti( L, -2, cls + 1 );
+  }
+  return 1;
+#else // #ifdef BUILD_MEMPOOL
+  return luaL_error( L, "memory pools not enabled." );
+#endif // #ifdef BUILD_MEMPOOL
+}
+
+// Lua: stats = elua.compactstats()
+// Returns a table with the state of the compacting space for table parts
+// (size, used, holes, misses, compactions, moved)
+// Only available if the compacting space is enabled
+static int elua_compactstats( lua_State *L )
+{
+#ifdef BUILD_COMPACT_SPACE
+  CSStats s;
+
+  if( !luaCS_getstats( L, &s ) )
+    return luaL_error( L, "compacting space not allocated." );
+  lua_createtable( L, 0, 6 );
+  lua_pushinteger( L, s.size );
+  lua_setfield( L, -2, "size" );
+  lua_pushinteger( L, s.used );
+  lua_setfield( L, -2, "used" );
+  lua_pushinteger( L, s.holes );
+  lua_setfield( L, -2, "holes" );
+  lua_pushinteger( L, s.misses );
+  lua_setfield( L, -2, "misses" );
+  lua_pushinteger( L, s.compactions );
+  lua_setfield( L, -2, "compactions" );
+  lua_pushinteger( L, s.moved );
+  lua_setfield( L, -2, "moved" );
+  return 1;
+#else // #ifdef BUILD_COMPACT_SPACE
+  return luaL_error( L, "compacting space not enabled." );
+#endif // #ifdef BUILD_COMPACT_SPACE
+}
+
+#ifdef BUILD_ALLOC_TRACE
+// Lua: elua.alloctrace_start( filename )
+static int elua_alloctrace_start( lua_State *L )
+{
+  const char *fname = luaL_checkstring( L, 1 );
+
+  if( !alloctrace_start( fname ) )
+    return luaL_error( L, "unable to open %s", fname );
+  return 0;
+}
+
+// Lua: elua.alloctrace_stop()
+static int elua_alloctrace_stop( lua_State *L )
+{
+  alloctrace_stop();
+  return 0;
+}
+
+#define setintfield( L, name, v )\
+  lua_pushinteger( L, v );\
+  lua_setfield( L, -2, name )
+
+// Lua: results = elua.alloctrace_replay( filename, [ interval ] )
+static int elua_alloctrace_replay( lua_State *L )
+{
+  const char *fname = luaL_checkstring( L, 1 );
+  unsigned interval = ( unsigned )luaL_optinteger( L, 2, ALLOCTRACE_DEF_INTERVAL );
+  alloctrace_result r;
+  alloctrace_sample *ps;
+  unsigned i;
+  int res;
+
+  if( ( res = alloctrace_replay( fname, interval, &r ) ) == ALLOCTRACE_ERR_OPEN )
+    return luaL_error( L, "unable to open %s", fname );
+  else if( res == ALLOCTRACE_ERR_FORMAT )
+    return luaL_error( L, "invalid trace file %s", fname );
+  else if( res == ALLOCTRACE_ERR_NOMEM )
+    return luaL_error( L, "not enough memory to replay %s", fname );
+  lua_newtable( L );
+#if defined( USE_MULTIPLE_ALLOCATOR )
+  lua_pushliteral( L, "multiple" );
+#elif defined( USE_SIMPLE_ALLOCATOR )
+  lua_pushliteral( L, "simple" );
+#else
+  lua_pushliteral( L, "newlib" );
+#endif
+  lua_setfield( L, -2, "allocator" );
+  setintfield( L, "ops", r.ops );
+  setintfield( L, "allocs", r.allocs );
+  setintfield( L, "reallocs", r.reallocs );
+  setintfield( L, "frees", r.frees );
+  setintfield( L, "failed", r.failed );
+  setintfield( L, "peak", r.peak );
+  setintfield( L, "time_us", r.time_us );
+  lua_createtable( L, r.nsamples, 0 );
+  for( i = 0, ps = r.samples; i < r.nsamples; i ++, ps ++ )
+  {
+    lua_createtable( L, 0, 5 );
+    setintfield( L, "ops", ps->ops );
+    setintfield( L, "inuse", ps->inuse );
+    setintfield( L, "free", ps->free );
+    setintfield( L, "largest", ps->largest );
+    // Fragmentation: percent of the free memory not usable as a single block
+    setintfield( L, "frag", ps->free ? 100 - ( u32 )( ( u64 )ps->largest * 100 / ps->free ) : 0 );
+    lua_rawseti( L, -2, i + 1 );
+  }
+  lua_setfield( L, -2, "samples" );
+  free( r.samples );
+  return 1;
+}
+#endif // #ifdef BUILD_ALLOC_TRACE
+
 // Lua: elua.version()
 static int elua_version( lua_State *L )
 {
@@ -110,6 +296,14 @@ const LUA_REG_TYPE elua_map[] =
 {
   { LSTRKEY( "egc_setup" ), LFUNCVAL( elua_egc_setup ) },
   { LSTRKEY( "heapstats" ), LFUNCVAL( elua_heapstats ) },
+  { LSTRKEY( "heapregions" ), LFUNCVAL( elua_heapregions ) },
+  { LSTRKEY( "poolstats" ), LFUNCVAL( elua_poolstats ) },
+  { LSTRKEY( "compactstats" ), LFUNCVAL( elua_compactstats ) },
+#ifdef BUILD_ALLOC_TRACE
+  { LSTRKEY( "alloctrace_start" ), LFUNCVAL( elua_alloctrace_start ) },
+  { LSTRKEY( "alloctrace_stop" ), LFUNCVAL( elua_alloctrace_stop ) },
+  { LSTRKEY( "alloctrace_replay" ), LFUNCVAL( elua_alloctrace_replay ) },
+#endif
   { LSTRKEY( "version" ), LFUNCVAL( elua_version ) },
   { LSTRKEY( "save_history" ), LFUNCVAL( elua_save_history ) },
 #ifdef BUILD_SHELL
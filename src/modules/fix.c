@@ -0,0 +1,522 @@
+// Module for fixed point arithmetic
+// Numbers are Q16.16 (16 integer bits and 16 fractional bits in a 32 bit
+// integer) unless specified otherwise, so that integer only builds
+// (LUA_NUMBER_INTEGRAL) can do signal processing without floating point.
+// All the operations saturate to fix.MAX / fix.MIN instead of wrapping.
+// The trigonometric functions use CORDIC and log/exp use shift and add
+// reductions; their tables are constant, so they live in ROM.
+
+#include "lua.h"
+#include "lualib.h"
+#include "lauxlib.h"
+#include "auxmods.h"
+#include "lrotable.h"
+#include "type.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#ifndef LUA_NUMBER_INTEGRAL
+#include <math.h>
+#endif
+
+#define FIX_FRAC_BITS           16
+#define FIX_ONE                 ( 1L << FIX_FRAC_BITS )
+#define FIX_MAX                 0x7FFFFFFFL
+#define FIX_MIN                 ( -FIX_MAX - 1 )
+#define FIX_PI                  205887L
+#define FIX_E                   178145L
+#define FIX_MAX_DECIMALS        9
+
+// Internal formats: angles are Q3.29, CORDIC vectors Q2.30 and logarithms
+// Q8.56 (so that the error of ln(2) stays small when multiplied by the
+// exponent)
+#define FIX_PI_29               1686629713LL
+#define FIX_HALF_PI_29          843314857L
+#define FIX_CORDIC_K_30         652032874L
+#define FIX_LN2_56              49946518145322874LL
+#define FIX_CORDIC_STEPS        30
+
+// exp() saturates above ln(32768) and is 0 below ln(2^-17)
+#define FIX_EXP_MAX             681391L
+#define FIX_EXP_MIN             ( -772243L )
+
+// atan( 2^-i ), Q3.29
+static const s32 fix_atan_table[ FIX_CORDIC_STEPS ] =
+{
+  421657428, 248918915, 131521918, 66762579, 33510843, 16771758, 8387925,
+  4194219, 2097141, 1048575, 524288, 262144, 131072, 65536, 32768, 16384,
+  8192, 4096, 2048, 1024, 512, 256, 128, 64, 32, 16, 8, 4, 2, 1
+};
+
+// ln( 1 + 2^-i ) for i = 1 .. 30, Q8.56
+static const s64 fix_ln_table[ FIX_CORDIC_STEPS ] =
+{
+  29216840156602672LL, 16079187432780867LL, 8487162167882470LL,
+  4368464387551571LL, 2217331688082624LL, 1117194379296892LL,
+  560762316719737LL, 280926648371294LL, 140600228097092LL, 70334406792546LL,
+  35175784949419LL, 17590038910229LL, 8795556194983LL, 4397912298837LL,
+  2198989701803LL, 1099503239253LL, 549753716747LL, 274877382657LL,
+  137438822400LL, 68719443968LL, 34359730176LL, 17179867136LL, 8589934080LL,
+  4294967168LL, 2147483616LL, 1073741816LL, 536870910LL, 268435456LL,
+  134217728LL, 67108864LL
+};
+
+static s32 fix_sat( s64 v )
+{
+  if( v > FIX_MAX )
+    return FIX_MAX;
+  if( v < FIX_MIN )
+    return FIX_MIN;
+  return ( s32 )v;
+}
+
+// Shift right by 'n' bits, rounding to nearest
+static s64 fix_rshift_round( s64 v, int n )
+{
+  return n > 0 ? ( v + ( ( s64 )1 << ( n - 1 ) ) ) >> n : v;
+}
+
+static s32 fix_check( lua_State *L, int idx )
+{
+#ifdef LUA_NUMBER_INTEGRAL
+  lua_Integer n = luaL_checkinteger( L, idx );
+#else
+  lua_Number n = luaL_checknumber( L, idx );
+#endif
+
+  luaL_argcheck( L, n >= FIX_MIN && n <= FIX_MAX, idx, "fixed point number out of range" );
+  return ( s32 )lua_tointeger( L, idx );
+}
+
+static int fix_push( lua_State *L, s64 v )
+{
+  lua_pushinteger( L, fix_sat( v ) );
+  return 1;
+}
+
+// ****************************************************************************
+// Conversions
+
+// Lua: f = new( n )
+static int fix_new( lua_State *L )
+{
+#ifdef LUA_NUMBER_INTEGRAL
+  lua_Integer n = luaL_checkinteger( L, 1 );
+
+  // Clamp first so that the product can't overflow; fix_push saturates it
+  if( n > FIX_ONE )
+    n = FIX_ONE;
+  else if( n < -FIX_ONE )
+    n = -FIX_ONE;
+  return fix_push( L, ( s64 )n * FIX_ONE );
+#else
+  lua_Number n = floor( luaL_checknumber( L, 1 ) * FIX_ONE + 0.5 );
+
+  if( n > FIX_MAX )
+    n = FIX_MAX;
+  else if( n < FIX_MIN )
+    n = FIX_MIN;
+  return fix_push( L, ( s64 )n );
+#endif
+}
+
+// Lua: n = tonumber( f )
+static int fix_tonumber( lua_State *L )
+{
+#ifdef LUA_NUMBER_INTEGRAL
+  lua_pushinteger( L, fix_check( L, 1 ) >> FIX_FRAC_BITS );
+#else
+  lua_pushnumber( L, ( lua_Number )fix_check( L, 1 ) / FIX_ONE );
+#endif
+  return 1;
+}
+
+// Lua: i = toint( f )
+static int fix_toint( lua_State *L )
+{
+  lua_pushinteger( L, fix_check( L, 1 ) >> FIX_FRAC_BITS );
+  return 1;
+}
+
+// Lua: f = parse( s )
+static int fix_parse( lua_State *L )
+{
+  const char *s = luaL_checkstring( L, 1 );
+  const char *start;
+  s64 ip = 0, frac = 0, scale = 1;
+  int neg = 0;
+
+  while( isspace( ( unsigned char )*s ) )
+    s ++;
+  if( *s == '-' || *s == '+' )
+    neg = *s ++ == '-';
+  start = s;
+  for( ; isdigit( ( unsigned char )*s ); s ++ )
+    if( ip <= FIX_MAX )
+      ip = ip * 10 + ( *s - '0' );
+  if( *s == '.' )
+    for( s ++; isdigit( ( unsigned char )*s ); s ++ )
+      if( scale < 1000000000 )
+      {
+        frac = frac * 10 + ( *s - '0' );
+        scale *= 10;
+      }
+  while( isspace( ( unsigned char )*s ) )
+    s ++;
+  if( *s != '\0' || s == start || ( s == start + 1 && *start == '.' ) )
+    return luaL_error( L, "invalid fixed point number" );
+  ip = ( ip << FIX_FRAC_BITS ) + ( ( frac << FIX_FRAC_BITS ) + scale / 2 ) / scale;
+  return fix_push( L, neg ? -ip : ip );
+}
+
+// Lua: s = tostring( f, [decimals] )
+static int fix_tostring( lua_State *L )
+{
+  s32 f = fix_check( L, 1 );
+  int decimals = luaL_optinteger( L, 2, 4 );
+  u32 a = f < 0 ? 0 - ( u32 )f : ( u32 )f;
+  unsigned long ip = a >> FIX_FRAC_BITS;
+  unsigned long scale = 1, frac;
+  char buf[ 32 ];
+  int i, len;
+
+  if( decimals < 0 || decimals > FIX_MAX_DECIMALS )
+    return luaL_error( L, "invalid number of decimals" );
+  for( i = 0; i < decimals; i ++ )
+    scale *= 10;
+  frac = ( unsigned long )( ( ( u64 )( a & ( FIX_ONE - 1 ) ) * scale + FIX_ONE / 2 ) >> FIX_FRAC_BITS );
+  if( frac == scale )
+  {
+    ip ++;
+    frac = 0;
+  }
+  len = sprintf( buf, "%s%lu", f < 0 && ( ip > 0 || frac > 0 ) ? "-" : "", ip );
+  if( decimals > 0 )
+  {
+    buf[ len ++ ] = '.';
+    for( i = decimals - 1; i >= 0; i --, frac /= 10 )
+      buf[ len + i ] = ( char )( '0' + frac % 10 );
+    len += decimals;
+  }
+  lua_pushlstring( L, buf, len );
+  return 1;
+}
+
+// ****************************************************************************
+// Arithmetic
+
+// Lua: f = add( a, b )
+static int fix_add( lua_State *L )
+{
+  return fix_push( L, ( s64 )fix_check( L, 1 ) + fix_check( L, 2 ) );
+}
+
+// Lua: f = sub( a, b )
+static int fix_sub( lua_State *L )
+{
+  return fix_push( L, ( s64 )fix_check( L, 1 ) - fix_check( L, 2 ) );
+}
+
+// Lua: f = mul( a, b )
+static int fix_mul( lua_State *L )
+{
+  return fix_push( L, fix_rshift_round( ( s64 )fix_check( L, 1 ) * fix_check( L, 2 ), FIX_FRAC_BITS ) );
+}
+
+// Lua: f = div( a, b )
+static int fix_div( lua_State *L )
+{
+  s32 a = fix_check( L, 1 );
+  s32 b = fix_check( L, 2 );
+
+  if( b == 0 )
+    return luaL_error( L, "division by zero" );
+  return fix_push( L, ( s64 )a * FIX_ONE / b );
+}
+
+// Lua: f = abs( a )
+static int fix_abs( lua_State *L )
+{
+  s32 a = fix_check( L, 1 );
+
+  return fix_push( L, a < 0 ? -( s64 )a : a );
+}
+
+// Lua: q = mul31( a, b ), all Q1.31
+static int fix_mul31( lua_State *L )
+{
+  return fix_push( L, fix_rshift_round( ( s64 )fix_check( L, 1 ) * fix_check( L, 2 ), 31 ) );
+}
+
+// Lua: q = toq31( f )
+static int fix_toq31( lua_State *L )
+{
+  return fix_push( L, ( s64 )fix_check( L, 1 ) * ( 1L << ( 31 - FIX_FRAC_BITS ) ) );
+}
+
+// Lua: f = fromq31( q )
+static int fix_fromq31( lua_State *L )
+{
+  return fix_push( L, fix_rshift_round( fix_check( L, 1 ), 31 - FIX_FRAC_BITS ) );
+}
+
+// ****************************************************************************
+// Functions
+
+// Lua: f = sqrt( a )
+static int fix_sqrt( lua_State *L )
+{
+  s32 a = fix_check( L, 1 );
+  u64 v, res = 0, bit = ( u64 )1 << 62;
+
+  if( a < 0 )
+    return luaL_error( L, "square root of a negative number" );
+  v = ( u64 )a << FIX_FRAC_BITS;
+  while( bit > v )
+    bit >>= 2;
+  while( bit )
+  {
+    if( v >= res + bit )
+    {
+      v -= res + bit;
+      res = ( res >> 1 ) + bit;
+    }
+    else
+      res >>= 1;
+    bit >>= 2;
+  }
+  if( v > res )
+    res ++;
+  return fix_push( L, ( s64 )res );
+}
+
+// CORDIC rotation of (K, 0) by 'z' (Q3.29, |z| <= pi/2): cos and sin, Q2.30
+static void fix_cordic_rotate( s32 z, s32 *pcos, s32 *psin )
+{
+  s32 x = FIX_CORDIC_K_30, y = 0, t;
+  int i;
+
+  for( i = 0; i < FIX_CORDIC_STEPS; i ++ )
+  {
+    t = x;
+    if( z >= 0 )
+    {
+      x -= y >> i;
+      y += t >> i;
+      z -= fix_atan_table[ i ];
+    }
+    else
+    {
+      x += y >> i;
+      y -= t >> i;
+      z += fix_atan_table[ i ];
+    }
+  }
+  *pcos = x;
+  *psin = y;
+}
+
+// Returns the cosine and sine of the Q16.16 angle 'a' in Q16.16
+static void fix_sincos( s32 a, s32 *pcos, s32 *psin )
+{
+  s64 z = ( s64 )a * ( 1L << ( 29 - FIX_FRAC_BITS ) ) % ( 2 * FIX_PI_29 );
+  s32 c, s;
+  int neg = 0;
+
+  // Reduce to [-pi, pi], then to [-pi/2, pi/2] (which negates the cosine)
+  if( z > FIX_PI_29 )
+    z -= 2 * FIX_PI_29;
+  else if( z < -FIX_PI_29 )
+    z += 2 * FIX_PI_29;
+  if( z > FIX_HALF_PI_29 )
+  {
+    z = FIX_PI_29 - z;
+    neg = 1;
+  }
+  else if( z < -FIX_HALF_PI_29 )
+  {
+    z = -FIX_PI_29 - z;
+    neg = 1;
+  }
+  fix_cordic_rotate( ( s32 )z, &c, &s );
+  *pcos = ( s32 )fix_rshift_round( neg ? -( s64 )c : c, 30 - FIX_FRAC_BITS );
+  *psin = ( s32 )fix_rshift_round( s, 30 - FIX_FRAC_BITS );
+}
+
+// Lua: f = sin( a )
+static int fix_sin( lua_State *L )
+{
+  s32 c, s;
+
+  fix_sincos( fix_check( L, 1 ), &c, &s );
+  return fix_push( L, s );
+}
+
+// Lua: f = cos( a )
+static int fix_cos( lua_State *L )
+{
+  s32 c, s;
+
+  fix_sincos( fix_check( L, 1 ), &c, &s );
+  return fix_push( L, c );
+}
+
+// Lua: f = atan2( y, x )
+static int fix_atan2( lua_State *L )
+{
+  s64 y = fix_check( L, 1 );
+  s64 x = fix_check( L, 2 );
+  s64 z = 0, t, m;
+  int i;
+
+  if( x == 0 && y == 0 )
+    return fix_push( L, 0 );
+  if( x < 0 )
+  {
+    // Rotate by pi to the right half plane
+    z = y >= 0 ? FIX_PI_29 : -FIX_PI_29;
+    x = -x;
+    y = -y;
+  }
+  // Scale the vector so that its largest component is in [2^29, 2^30)
+  m = x > ( y < 0 ? -y : y ) ? x : ( y < 0 ? -y : y );
+  while( m < ( 1L << 29 ) )
+  {
+    m *= 2;
+    x *= 2;
+    y *= 2;
+  }
+  while( m >= ( 1L << 30 ) )
+  {
+    m >>= 1;
+    x >>= 1;
+    y >>= 1;
+  }
+  // CORDIC vectoring: rotate the vector to the x axis
+  for( i = 0; i < FIX_CORDIC_STEPS; i ++ )
+  {
+    t = x;
+    if( y > 0 )
+    {
+      x += y >> i;
+      y -= t >> i;
+      z += fix_atan_table[ i ];
+    }
+    else
+    {
+      x -= y >> i;
+      y += t >> i;
+      z -= fix_atan_table[ i ];
+    }
+  }
+  return fix_push( L, fix_rshift_round( z, 29 - FIX_FRAC_BITS ) );
+}
+
+// Lua: f = exp( a )
+static int fix_exp( lua_State *L )
+{
+  s32 a = fix_check( L, 1 );
+  s64 r, y = ( s64 )1 << 56;
+  s64 k;
+  int i;
+
+  if( a > FIX_EXP_MAX )
+    return fix_push( L, FIX_MAX );
+  if( a < FIX_EXP_MIN )
+    return fix_push( L, 0 );
+  // a = k * ln(2) + r, with 0 <= r < ln(2)
+  r = ( s64 )a * ( ( s64 )1 << ( 56 - FIX_FRAC_BITS ) );
+  k = r / FIX_LN2_56;
+  if( k * FIX_LN2_56 > r )
+    k --;
+  r -= k * FIX_LN2_56;
+  // exp(r) as a product of ( 1 + 2^-i ) factors
+  for( i = 0; i < FIX_CORDIC_STEPS; i ++ )
+    if( r >= fix_ln_table[ i ] )
+    {
+      r -= fix_ln_table[ i ];
+      y += y >> ( i + 1 );
+    }
+  // exp(r) ~= 1 + r for the remainder (r < 2^-30)
+  y += ( ( y >> 26 ) * r ) >> 30;
+  // y is Q8.56, the result is y * 2^k in Q16.16 (k <= 14)
+  return fix_push( L, fix_rshift_round( y, 56 - FIX_FRAC_BITS - ( int )k ) );
+}
+
+// Lua: f = log( a )
+static int fix_log( lua_State *L )
+{
+  s32 a = fix_check( L, 1 );
+  u32 m;
+  s64 acc = 0, res;
+  int msb, i;
+
+  if( a <= 0 )
+    return luaL_error( L, "logarithm of a non positive number" );
+  for( msb = 30; ( a & ( 1L << msb ) ) == 0; msb -- );
+  // a = m * 2^e, with m in [1, 2) as Q1.31 and e = msb - 16
+  m = ( u32 )a << ( 31 - msb );
+  // Multiply m by ( 1 + 2^-i ) factors until it reaches 2: ln(m) = ln(2) - sum
+  for( i = 0; i < FIX_CORDIC_STEPS; i ++ )
+    if( ( u64 )m + ( m >> ( i + 1 ) ) <= 0xFFFFFFFFUL )
+    {
+      m += m >> ( i + 1 );
+      acc += fix_ln_table[ i ];
+    }
+  // ln( 2 / m ) ~= ( 2 - m ) / 2 for the remainder
+  acc += ( ( ( u64 )1 << 32 ) - m ) << 24;
+  res = ( s64 )( msb - FIX_FRAC_BITS ) * FIX_LN2_56 + FIX_LN2_56 - acc;
+  return fix_push( L, fix_rshift_round( res, 56 - FIX_FRAC_BITS ) );
+}
+
+// Module function map
+#define MIN_OPT_LEVEL 2
+#include "lrodefs.h"
+const LUA_REG_TYPE fix_map[] =
+{
+  { LSTRKEY( "new" ), LFUNCVAL( fix_new ) },
+  { LSTRKEY( "tonumber" ), LFUNCVAL( fix_tonumber ) },
+  { LSTRKEY( "toint" ), LFUNCVAL( fix_toint ) },
+  { LSTRKEY( "parse" ), LFUNCVAL( fix_parse ) },
+  { LSTRKEY( "tostring" ), LFUNCVAL( fix_tostring ) },
+  { LSTRKEY( "add" ), LFUNCVAL( fix_add ) },
+  { LSTRKEY( "sub" ), LFUNCVAL( fix_sub ) },
+  { LSTRKEY( "mul" ), LFUNCVAL( fix_mul ) },
+  { LSTRKEY( "div" ), LFUNCVAL( fix_div ) },
+  { LSTRKEY( "abs" ), LFUNCVAL( fix_abs ) },
+  { LSTRKEY( "mul31" ), LFUNCVAL( fix_mul31 ) },
+  { LSTRKEY( "toq31" ), LFUNCVAL( fix_toq31 ) },
+  { LSTRKEY( "fromq31" ), LFUNCVAL( fix_fromq31 ) },
+  { LSTRKEY( "sqrt" ), LFUNCVAL( fix_sqrt ) },
+  { LSTRKEY( "sin" ), LFUNCVAL( fix_sin ) },
+  { LSTRKEY( "cos" ), LFUNCVAL( fix_cos ) },
+  { LSTRKEY( "atan2" ), LFUNCVAL( fix_atan2 ) },
+  { LSTRKEY( "exp" ), LFUNCVAL( fix_exp ) },
+  { LSTRKEY( "log" ), LFUNCVAL( fix_log ) },
+#if LUA_OPTIMIZE_MEMORY > 0
+  { LSTRKEY( "ONE" ), LNUMVAL( FIX_ONE ) },
+  { LSTRKEY( "PI" ), LNUMVAL( FIX_PI ) },
+  { LSTRKEY( "E" ), LNUMVAL( FIX_E ) },
+  { LSTRKEY( "MAX" ), LNUMVAL( FIX_MAX ) },
+  { LSTRKEY( "MIN" ), LNUMVAL( FIX_MIN ) },
+#endif
+  { LNILKEY, LNILVAL }
+};
+
+LUALIB_API int luaopen_fix( lua_State *L )
+{
+#if LUA_OPTIMIZE_MEMORY > 0
+  return 0;
+#else // #if LUA_OPTIMIZE_MEMORY > 0
+  luaL_register( L, AUXLIB_FIX, fix_map );
+
+  // Module constants
+  MOD_REG_NUMBER( L, "ONE", FIX_ONE );
+  MOD_REG_NUMBER( L, "PI", FIX_PI );
+  MOD_REG_NUMBER( L, "E", FIX_E );
+  MOD_REG_NUMBER( L, "MAX", FIX_MAX );
+  MOD_REG_NUMBER( L, "MIN", FIX_MIN );
+
+  return 1;
+#endif // #if LUA_OPTIMIZE_MEMORY > 0
+}
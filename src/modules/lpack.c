@@ -30,6 +30,17 @@
 #define OP_BIGENDIAN    '>'             /* big endian */
 #define OP_NATIVE       '='             /* native endian */
 
+#define PACK_FORMAT     "eLua.packfmt"  /* metatable of compiled formats */
+#define PACK_BUFFER     "eLua.packbuf"  /* metatable of buffers */
+
+/* Format strings are compiled to a list of operations before use. The
+   compiled form of the last few short formats is kept in a small cache */
+#ifndef PACK_CACHE_SIZE
+#define PACK_CACHE_SIZE 4               /* number of cached formats */
+#endif
+#define PACK_CACHE_LEN  32              /* longest cached format string */
+#define PACK_CACHE_OPS  16              /* most operations in a cached format */
+
 #include <ctype.h>
 #include <string.h>
 
@@ -37,12 +48,49 @@
 #include "lauxlib.h"
 #include "auxmods.h"
 #include "lrotable.h"
+#include "type.h"
+
+typedef struct PackOp
+{
+ unsigned char c;                       /* format code */
+ unsigned char swap;                    /* numbers need a byte swap */
+ unsigned int n;                        /* repeat count (length for OP_STRING) */
+} PackOp;
+
+typedef struct PackFormat               /* compiled format (userdata) */
+{
+ int nops;
+ PackOp ops[1];
+} PackFormat;
+
+typedef struct PackBuffer               /* buffer (userdata) */
+{
+ size_t size;
+ char data[1];
+} PackBuffer;
+
+typedef struct PackOut                  /* destination of pack */
+{
+ lua_State *L;
+ luaL_Buffer *b;                        /* string being built, or NULL */
+ char *p;                               /* buffer (if b is NULL) */
+ size_t pos,size;
+} PackOut;
 
-static void badcode(lua_State *L, int c)
+static const char codes[]=
+{
+ OP_ZSTRING, OP_BSTRING, OP_WSTRING, OP_SSTRING, OP_STRING, OP_NUMBER,
+#ifndef LUA_NUMBER_INTEGRAL
+ OP_FLOAT, OP_DOUBLE,
+#endif
+ OP_CHAR, OP_BYTE, OP_SHORT, OP_USHORT, OP_INT, OP_UINT, OP_LONG, OP_ULONG, 0
+};
+
+static void badcode(lua_State *L, int arg, int c)
 {
  char s[]="bad code `?'";
  s[sizeof(s)-3]=c;
- luaL_argerror(L,1,s);
+ luaL_argerror(L,arg,s);
 }
 
 static int doendian(int c)
@@ -55,17 +103,184 @@ static int doendian(int c)
  return 0;
 }
 
+#define SWAP16(x)       ((u16)(((x)>>8)|((x)<<8)))
+#define SWAP32(x)       (((x)>>24)|(((x)>>8)&0xFF00UL)|(((x)<<8)&0xFF0000UL)|((x)<<24))
+
 static void doswap(int swap, void *p, size_t n)
 {
- if (swap)
+ if (swap) switch (n)                   /* whole words for the usual sizes */
+ {
+  case 2:
+  {
+   u16 x;
+   memcpy(&x,p,2);
+   x=SWAP16(x);
+   memcpy(p,&x,2);
+   break;
+  }
+  case 4:
+  {
+   u32 x;
+   memcpy(&x,p,4);
+   x=SWAP32(x);
+   memcpy(p,&x,4);
+   break;
+  }
+  case 8:
+  {
+   u32 x[2],t;
+   memcpy(x,p,8);
+   t=SWAP32(x[0]);
+   x[0]=SWAP32(x[1]);
+   x[1]=t;
+   memcpy(p,x,8);
+   break;
+  }
+  default:
+  {
+   char *a=p;
+   int i,j;
+   for (i=0, j=( int )n-1, n=n/2; n--; i++, j--)
+   {
+    char t=a[i]; a[i]=a[j]; a[j]=t;
+   }
+  }
+ }
+}
+
+/* luaL_checkudata for the types of this module, without the registry lookup
+   by name: read-only metatables (which never move) are recognized by their
+   address, others are kept in the environment of the module functions */
+#define META_FORMAT     1
+#define META_BUFFER     2
+
+static void *checkudata(lua_State *L, int arg, const char *tname, int k)
+{
+ void *p=lua_touserdata(L,arg);
+#if LUA_OPTIMIZE_MEMORY > 0
+ static const void *meta[3];
+ if (p!=NULL && meta[k]!=NULL && lua_getmetatable(L,arg))
+ {
+  int ok=lua_topointer(L,-1)==meta[k];
+  lua_pop(L,1);
+  if (ok) return p;
+ }
+ p=luaL_checkudata(L,arg,tname);
+ luaL_getmetatable(L,tname);
+ if (lua_type(L,-1)==LUA_TROTABLE) meta[k]=lua_topointer(L,-1);
+ lua_pop(L,1);
+ return p;
+#else
+ if (p!=NULL && lua_getmetatable(L,arg))
+ {
+  int ok;
+  lua_rawgeti(L,LUA_ENVIRONINDEX,k);
+  ok=lua_rawequal(L,-1,-2);
+  lua_pop(L,2);
+  if (ok) return p;
+ }
+ return luaL_checkudata(L,arg,tname);
+#endif
+}
+
+#define checkformat(L,arg)      ((PackFormat*)checkudata(L,arg,PACK_FORMAT,META_FORMAT))
+#define checkbuffer(L,arg)      ((PackBuffer*)checkudata(L,arg,PACK_BUFFER,META_BUFFER))
+
+/* compile format f (argument arg) to at most maxops operations in ops;
+   returns the number of operations needed */
+static int compile(lua_State *L, int arg, const char *f, PackOp *ops, int maxops)
+{
+ int n=0;
+ int swap=0;
+ while (*f)
  {
-  char *a=p;
-  int i,j;
-  for (i=0, j=( int )n-1, n=n/2; n--; i++, j--)
+  int c=*f++;
+  unsigned int N=1;
+  if (isdigit((unsigned char)(*f)))
   {
-   char t=a[i]; a[i]=a[j]; a[j]=t;
+   N=0;
+   while (isdigit((unsigned char)(*f))) N=10*N+(*f++)-'0';
+  }
+  if (c==OP_LITTLEENDIAN || c==OP_BIGENDIAN || c==OP_NATIVE)
+   swap=doendian(c);
+  else if (c==' ' || c==',')
+   continue;
+  else if (strchr(codes,c)==NULL)
+   badcode(L,arg,c);
+  else
+  {
+   if (n<maxops)
+   {
+    ops[n].c=c;
+    ops[n].swap=swap;
+    ops[n].n=N;
+   }
+   n++;
   }
  }
+ return n;
+}
+
+#if PACK_CACHE_SIZE > 0
+typedef struct PackCache
+{
+ size_t len;
+ unsigned int stamp;
+ int nops;
+ char f[PACK_CACHE_LEN];
+ PackOp ops[PACK_CACHE_OPS];
+} PackCache;
+
+static PackCache cache[PACK_CACHE_SIZE];
+static unsigned int cachestamp;
+#endif
+
+/* get the operations of the format at arg (a compiled format or a string) */
+static const PackOp *getformat(lua_State *L, int arg, int *nops)
+{
+ size_t len;
+ const char *f;
+ PackOp *ops;
+ if (lua_type(L,arg)==LUA_TUSERDATA)
+ {
+  PackFormat *pf=checkformat(L,arg);
+  *nops=pf->nops;
+  return pf->ops;
+ }
+ f=luaL_checklstring(L,arg,&len);
+#if PACK_CACHE_SIZE > 0
+ if (len<PACK_CACHE_LEN)
+ {
+  PackCache *e,*victim=cache;
+  for (e=cache; e<cache+PACK_CACHE_SIZE; e++)
+  {
+   if (e->len==len && memcmp(e->f,f,len)==0)
+   {
+    e->stamp=++cachestamp;
+    *nops=e->nops;
+    return e->ops;
+   }
+   if (e->stamp<victim->stamp) victim=e;
+  }
+  victim->len=(size_t)-1;               /* invalid until compiled */
+  victim->nops=compile(L,arg,f,victim->ops,PACK_CACHE_OPS);
+  if (victim->nops<=PACK_CACHE_OPS)
+  {
+   memcpy(victim->f,f,len);
+   victim->len=len;
+   victim->stamp=++cachestamp;
+   *nops=victim->nops;
+   return victim->ops;
+  }
+ }
+#endif
+ /* not cached: compile to a temporary userdata, which takes the place of
+    the format string so the arguments after it keep their indexes */
+ *nops=compile(L,arg,f,NULL,0);
+ ops=(PackOp*)lua_newuserdata(L,*nops*sizeof(PackOp)+1);
+ compile(L,arg,f,ops,*nops);
+ lua_replace(L,arg);
+ return ops;
 }
 
 #define UNPACKNUMBER(OP,T)                      \
@@ -98,35 +313,34 @@ static void doswap(int swap, void *p, size_t n)
     break;                                      \
    }
 
-static int l_unpack(lua_State *L)               /** unpack(s,f,[init]) */
+/* unpack the source at sarg (string or buffer) with the format at farg,
+   starting at the position given at iarg */
+static int unpack_aux(lua_State *L, int sarg, int farg, int iarg)
 {
  size_t len;
- const char *s=luaL_checklstring(L,1,&len);
- const char *f=luaL_checkstring(L,2);
- int i=luaL_optnumber(L,3,1)-1;
+ const char *s;
+ const PackOp *op;
+ int nops;
+ int i=luaL_optnumber(L,iarg,1)-1;
  int n=0;
- int swap=0;
+ if (lua_type(L,sarg)==LUA_TUSERDATA)
+ {
+  PackBuffer *pb=checkbuffer(L,sarg);
+  s=pb->data;
+  len=pb->size;
+ }
+ else
+  s=luaL_checklstring(L,sarg,&len);
+ op=getformat(L,farg,&nops);
  lua_pushnil(L);
- while (*f)
+ for (; nops--; op++)
  {
-  int c=*f++;
-  int N=1;
-  if (isdigit((unsigned char)(*f)))
-  {
-   N=0;
-   while (isdigit((unsigned char)(*f))) N=10*N+(*f++)-'0';
-   if (N==0 && c==OP_STRING) { lua_pushliteral(L,""); ++n; }
-  }
+  int c=op->c;
+  int swap=op->swap;
+  unsigned int N=op->n;
+  if (N==0 && c==OP_STRING) { lua_pushliteral(L,""); ++n; }
   while (N--) switch (c)
   {
-   case OP_LITTLEENDIAN:
-   case OP_BIGENDIAN:
-   case OP_NATIVE:
-   {
-    swap=doendian(c);
-    N=0;
-    break;
-   }
    case OP_STRING:
    {
     ++N;
@@ -140,8 +354,10 @@ static int l_unpack(lua_State *L)               /** unpack(s,f,[init]) */
    case OP_ZSTRING:
    {
     size_t l;
+    const char *z;
     if (((unsigned long)i)>=len) goto done;
-    l=strlen(s+i);
+    z=memchr(s+i,0,len-i);
+    l=z ? (size_t)(z-(s+i)) : len-i;
     lua_pushlstring(L,s+i,l);
     i+=l+1;
     ++n;
@@ -163,11 +379,6 @@ static int l_unpack(lua_State *L)               /** unpack(s,f,[init]) */
    UNPACKNUMBER(OP_UINT, unsigned int)
    UNPACKNUMBER(OP_LONG, long)
    UNPACKNUMBER(OP_ULONG, unsigned long)
-   case ' ': case ',':
-    break;
-   default:
-    badcode(L,c);
-    break;
   }
  }
 done:
@@ -176,12 +387,29 @@ done:
  return n+1;
 }
 
+static int l_unpack(lua_State *L)               /** unpack(s,f,[init]) */
+{
+ return unpack_aux(L,1,2,3);
+}
+
+static void addout(PackOut *o, const void *s, size_t l)
+{
+ if (o->b!=NULL)
+  luaL_addlstring(o->b,s,l);
+ else
+ {
+  if (l>o->size-o->pos) luaL_error(o->L,"buffer too small");
+  memcpy(o->p+o->pos,s,l);
+  o->pos+=l;
+ }
+}
+
 #define PACKNUMBER(OP,T)                        \
    case OP:                                     \
    {                                            \
     T a=(T)luaL_checknumber(L,i++);             \
     doswap(swap,&a,sizeof(a));                  \
-    luaL_addlstring(&b,(void*)&a,sizeof(a));    \
+    addout(o,(void*)&a,sizeof(a));              \
     break;                                      \
    }
 
@@ -192,43 +420,27 @@ done:
     const char *a=luaL_checklstring(L,i++,&l);  \
     T ll=(T)l;                                  \
     doswap(swap,&ll,sizeof(ll));                \
-    luaL_addlstring(&b,(void*)&ll,sizeof(ll));  \
-    luaL_addlstring(&b,a,l);                    \
+    addout(o,(void*)&ll,sizeof(ll));            \
+    addout(o,a,l);                              \
     break;                                      \
    }
 
-static int l_pack(lua_State *L)                 /** pack(f,...) */
+/* pack the values from argument i on with the given operations */
+static void pack_aux(lua_State *L, const PackOp *op, int nops, int i, PackOut *o)
 {
- int i=2;
- const char *f=luaL_checkstring(L,1);
- int swap=0;
- luaL_Buffer b;
- luaL_buffinit(L,&b);
- while (*f)
+ for (; nops--; op++)
  {
-  int c=*f++;
-  int N=1;
-  if (isdigit((unsigned char)(*f)))
-  {
-   N=0;
-   while (isdigit((unsigned char)(*f))) N=10*N+(*f++)-'0';
-  }
+  int c=op->c;
+  int swap=op->swap;
+  unsigned int N=op->n;
   while (N--) switch (c)
   {
-   case OP_LITTLEENDIAN:
-   case OP_BIGENDIAN:
-   case OP_NATIVE:
-   {
-    swap=doendian(c);
-    N=0;
-    break;
-   }
    case OP_STRING:
    case OP_ZSTRING:
    {
     size_t l;
     const char *a=luaL_checklstring(L,i++,&l);
-    luaL_addlstring(&b,a,l+(c==OP_ZSTRING));
+    addout(o,a,l+(c==OP_ZSTRING));
     break;
    }
    PACKSTRING(OP_BSTRING, unsigned char)
@@ -247,27 +459,161 @@ static int l_pack(lua_State *L)                 /** pack(f,...) */
    PACKNUMBER(OP_UINT, unsigned int)
    PACKNUMBER(OP_LONG, long)
    PACKNUMBER(OP_ULONG, unsigned long)
-   case ' ': case ',':
-    break;
-   default:
-    badcode(L,c);
-    break;
   }
  }
+}
+
+static int l_pack(lua_State *L)                 /** pack(f,...) */
+{
+ int nops;
+ const PackOp *op=getformat(L,1,&nops);
+ luaL_Buffer b;
+ PackOut o;
+ o.L=L;
+ o.b=&b;
+ luaL_buffinit(L,&b);
+ pack_aux(L,op,nops,2,&o);
  luaL_pushresult(&b);
  return 1;
 }
 
+/* pack into the buffer at barg, from the position at parg, with the format
+   at farg; the values start at argument 4 */
+static int packinto_aux(lua_State *L, int barg, int parg, int farg)
+{
+ PackBuffer *pb=checkbuffer(L,barg);
+ lua_Integer pos=luaL_optinteger(L,parg,1);
+ int nops;
+ const PackOp *op=getformat(L,farg,&nops);
+ PackOut o;
+ if (pos<1 || (size_t)pos>pb->size+1) luaL_argerror(L,parg,"invalid position");
+ o.L=L;
+ o.b=NULL;
+ o.p=pb->data;
+ o.pos=(size_t)pos-1;
+ o.size=pb->size;
+ pack_aux(L,op,nops,4,&o);
+ lua_pushinteger(L,(lua_Integer)o.pos+1);
+ return 1;
+}
+
+static int l_packinto(lua_State *L)             /** packinto(buf,pos,f,...) */
+{
+ return packinto_aux(L,1,2,3);
+}
+
+static int l_compile(lua_State *L)              /** compile(f) */
+{
+ const char *f=luaL_checkstring(L,1);
+ int nops=compile(L,1,f,NULL,0);
+ PackFormat *pf=(PackFormat*)lua_newuserdata(L,sizeof(PackFormat)+(nops>0 ? nops-1 : 0)*sizeof(PackOp));
+ pf->nops=compile(L,1,f,pf->ops,nops);
+ luaL_getmetatable(L,PACK_FORMAT);
+ lua_setmetatable(L,-2);
+ return 1;
+}
+
+static int fmt_unpack(lua_State *L)             /** fmt:unpack(s,[init]) */
+{
+ return unpack_aux(L,2,1,3);
+}
+
+static int fmt_packinto(lua_State *L)           /** fmt:packinto(buf,pos,...) */
+{
+ return packinto_aux(L,2,3,1);
+}
+
+static int l_buffer(lua_State *L)               /** buffer(size|s) */
+{
+ size_t size;
+ const char *s=NULL;
+ PackBuffer *pb;
+ if (lua_type(L,1)==LUA_TNUMBER)
+ {
+  lua_Integer n=luaL_checkinteger(L,1);
+  if (n<0) luaL_argerror(L,1,"invalid size");
+  size=(size_t)n;
+ }
+ else
+  s=luaL_checklstring(L,1,&size);
+ pb=(PackBuffer*)lua_newuserdata(L,sizeof(PackBuffer)+size);
+ pb->size=size;
+ if (s) memcpy(pb->data,s,size); else memset(pb->data,0,size);
+ luaL_getmetatable(L,PACK_BUFFER);
+ lua_setmetatable(L,-2);
+ return 1;
+}
+
+static int l_tostring(lua_State *L)             /** tostring(buf,[i],[j]) */
+{
+ PackBuffer *pb=checkbuffer(L,1);
+ lua_Integer i=luaL_optinteger(L,2,1);
+ lua_Integer j=luaL_optinteger(L,3,(lua_Integer)pb->size);
+ if (i<1) i=1;
+ if (j>(lua_Integer)pb->size) j=(lua_Integer)pb->size;
+ if (i>j)
+  lua_pushliteral(L,"");
+ else
+  lua_pushlstring(L,pb->data+i-1,(size_t)(j-i+1));
+ return 1;
+}
+
+static int buf_len(lua_State *L)                /** #buf */
+{
+ PackBuffer *pb=checkbuffer(L,1);
+ lua_pushinteger(L,(lua_Integer)pb->size);
+ return 1;
+}
+
 #define MIN_OPT_LEVEL 2
 #include "lrodefs.h"
 const LUA_REG_TYPE pack_map[] =
 {
   { LSTRKEY( "pack" ),  LFUNCVAL( l_pack ) },
   { LSTRKEY( "unpack" ), LFUNCVAL( l_unpack ) },
+  { LSTRKEY( "packinto" ), LFUNCVAL( l_packinto ) },
+  { LSTRKEY( "compile" ), LFUNCVAL( l_compile ) },
+  { LSTRKEY( "buffer" ), LFUNCVAL( l_buffer ) },
+  { LSTRKEY( "tostring" ), LFUNCVAL( l_tostring ) },
+  { LNILKEY, LNILVAL }
+};
+
+static const LUA_REG_TYPE fmt_map[] =
+{
+  { LSTRKEY( "pack" ), LFUNCVAL( l_pack ) },
+  { LSTRKEY( "unpack" ), LFUNCVAL( fmt_unpack ) },
+  { LSTRKEY( "packinto" ), LFUNCVAL( fmt_packinto ) },
+#if LUA_OPTIMIZE_MEMORY > 0
+  { LSTRKEY( "__index" ), LROVAL( fmt_map ) },
+#endif
+  { LNILKEY, LNILVAL }
+};
+
+static const LUA_REG_TYPE buf_map[] =
+{
+  { LSTRKEY( "__len" ), LFUNCVAL( buf_len ) },
   { LNILKEY, LNILVAL }
 };
 
 int luaopen_pack( lua_State *L )
 {
-  LREGISTER( L, AUXLIB_PACK, pack_map );
+#if LUA_OPTIMIZE_MEMORY > 0
+  luaL_rometatable( L, PACK_FORMAT, ( void* )fmt_map );
+  luaL_rometatable( L, PACK_BUFFER, ( void* )buf_map );
+  return 0;
+#else // #if LUA_OPTIMIZE_MEMORY > 0
+  // The metatables are kept in the environment of the functions (see checkudata)
+  lua_createtable( L, 2, 0 );
+  lua_replace( L, LUA_ENVIRONINDEX );
+  luaL_newmetatable( L, PACK_FORMAT );
+  lua_pushvalue( L, -1 );
+  lua_setfield( L, -2, "__index" );
+  luaL_register( L, NULL, fmt_map );
+  lua_rawseti( L, LUA_ENVIRONINDEX, META_FORMAT );
+  luaL_newmetatable( L, PACK_BUFFER );
+  luaL_register( L, NULL, buf_map );
+  lua_rawseti( L, LUA_ENVIRONINDEX, META_BUFFER );
+  luaL_register( L, AUXLIB_PACK, pack_map );
+  return 1;
+#endif // #if LUA_OPTIMIZE_MEMORY > 0
 }
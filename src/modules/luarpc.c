@@ -42,6 +42,14 @@ void *alloca(size_t);
 
 #include "luarpc_rpc.h"
 
+// Compress the frames with LZF if the other side can
+#ifndef RPC_COMPRESS
+#define RPC_COMPRESS 0
+#endif
+#if RPC_COMPRESS
+#include "lzf.h"
+#endif
+
 
 #if defined( BUILD_RPC )
 
@@ -106,7 +114,18 @@ enum {
   RPC_TABLE_END,
   RPC_FUNCTION,
   RPC_FUNCTION_END,
-  RPC_REMOTE
+  RPC_REMOTE,
+  RPC_NUMARRAY,
+  RPC_STRREF
+};
+
+// Element types of RPC_NUMARRAY (the value is the element size)
+enum
+{
+  RPC_ARRAY_NUMBER = 0,
+  RPC_ARRAY_I8 = 1,
+  RPC_ARRAY_I16 = 2,
+  RPC_ARRAY_I32 = 4
 };
 
 // RPC Commands
@@ -115,7 +134,8 @@ enum
   RPC_CMD_CALL = 1,
   RPC_CMD_GET,
   RPC_CMD_CON,
-  RPC_CMD_NEWINDEX
+  RPC_CMD_NEWINDEX,
+  RPC_CMD_CALLID
 };
 
 // RPC Status Codes
@@ -126,7 +146,24 @@ enum
   RPC_DONE
 };
 
-enum { RPC_PROTOCOL_VERSION = 3 };
+// Frame markers (first byte of every frame after negotiation)
+enum
+{
+  RPC_FRAME = 0x46,
+  RPC_FRAME_LZF = 0x5A
+};
+
+enum { RPC_PROTOCOL_VERSION = 7 };
+
+// Flags in the last byte of the negotiation header
+enum
+{
+  RPC_HEADER_INTNUM = 0x01,
+  RPC_HEADER_LZF = 0x02
+};
+
+// Frames with less payload are never compressed
+#define RPC_COMPRESS_MIN 32
 
 
 // return a string representation of an error number
@@ -141,36 +178,210 @@ static const char * errorString( int n )
     case ERR_NODATA: return "no data received when attempting to read";
     case ERR_HEADER: return "header exchanged failed";
     case ERR_LONGFNAME: return "function name too long";
+    case ERR_CONNECT: return "can't open connection";
     default: return transport_strerror( n );
   }
 }
 
 
+// **************************************************************************
+// framing
+//   after negotiation every message is sent as one or more frames: RPC_FRAME,
+//   the sequence number of the message, the payload length (2 bytes, little
+//   endian) and the payload. Writes are collected in the transport buffer and
+//   sent when it is full or when the message is complete, so a whole request
+//   or reply usually takes a single write on the link. Replies carry the
+//   sequence number of their request. If both sides have RPC_COMPRESS, a
+//   payload that gets smaller with LZF is sent in a RPC_FRAME_LZF frame with
+//   the compressed length instead.
+
+#if RPC_COMPRESS
+// compressed payload of the frame being sent or received
+static u8 rpc_zbuf[ RPC_FRAME_HEADER + RPC_FRAME_SIZE ];
+#endif
+
+static void protocol_error( void )
+{
+  struct exception e;
+  e.errnum = ERR_PROTOCOL;
+  e.type = nonfatal;
+  Throw( e );
+}
+
+// drop any partially read or written message
+static void frame_reset( Transport *tpt )
+{
+  tpt->wlen = tpt->rpos = tpt->rlen = 0;
+  tpt->wdict_n = tpt->rdict_n = 0;
+}
+
+static void transport_message_init( Transport *tpt )
+{
+  frame_reset( tpt );
+  tpt->seq = tpt->rseq = 0;
+  tpt->wdict_ref = tpt->rdict_ref = LUA_NOREF;
+  tpt->fn_ref = LUA_NOREF;
+  tpt->fn_n = 0;
+}
+
+// send the buffered payload as one frame
+static void frame_send( Transport *tpt )
+{
+  u8 *h = tpt->wbuf;
+  u16 len = tpt->wlen;
+
+  h[ 0 ] = RPC_FRAME;
+#if RPC_COMPRESS
+  if( tpt->compress && len >= RPC_COMPRESS_MIN )
+  {
+    u16 zlen = ( u16 )lzf_compress( tpt->wbuf + RPC_FRAME_HEADER, len, rpc_zbuf + RPC_FRAME_HEADER, len - 1 );
+
+    if( zlen > 0 )
+    {
+      h = rpc_zbuf;
+      h[ 0 ] = RPC_FRAME_LZF;
+      len = zlen;
+    }
+  }
+#endif
+  h[ 1 ] = tpt->seq;
+  h[ 2 ] = ( u8 )( len & 0xFF );
+  h[ 3 ] = ( u8 )( len >> 8 );
+  tpt->wlen = 0;
+  transport_write_buffer( tpt, h, RPC_FRAME_HEADER + len );
+}
+
+// read the next frame into the transport buffer; 'marker' is the frame
+// marker if it was already read, 0 otherwise
+static void frame_receive( Transport *tpt, u8 marker )
+{
+  u8 h[ RPC_FRAME_HEADER ];
+  u16 len;
+
+  h[ 0 ] = marker;
+  transport_read_buffer( tpt, h + ( marker != 0 ), RPC_FRAME_HEADER - ( marker != 0 ) );
+  len = h[ 2 ] | ( h[ 3 ] << 8 );
+  if( len == 0 || len > RPC_FRAME_SIZE )
+    protocol_error();
+#if RPC_COMPRESS
+  if( h[ 0 ] == RPC_FRAME_LZF && tpt->compress )
+  {
+    transport_read_buffer( tpt, rpc_zbuf, len );
+    if( ( len = ( u16 )lzf_decompress( rpc_zbuf, len, tpt->rbuf, RPC_FRAME_SIZE ) ) == 0 )
+      protocol_error();
+  }
+  else
+#endif
+  if( h[ 0 ] == RPC_FRAME )
+    transport_read_buffer( tpt, tpt->rbuf, len );
+  else
+    protocol_error();
+  tpt->rseq = h[ 1 ];
+  tpt->rpos = 0;
+  tpt->rlen = len;
+}
+
+// read the next frame of the current message
+static void frame_continue( Transport *tpt )
+{
+  u8 seq = tpt->rseq;
+
+  frame_receive( tpt, 0 );
+  if( tpt->rseq != seq )
+    protocol_error();
+}
+
+// start reading a reply (client side); returns its sequence number
+static u8 transport_read_reply( Transport *tpt )
+{
+  struct exception e;
+  TRANSPORT_VERIFY_OPEN;
+  frame_reset( tpt );
+  frame_receive( tpt, 0 );
+  return tpt->rseq;
+}
+
+// read the command of the next request (server side); negotiation requests
+// are not framed
+static u8 transport_read_command( Transport *tpt )
+{
+  u8 b;
+  struct exception e;
+  TRANSPORT_VERIFY_OPEN;
+  frame_reset( tpt );
+  transport_read_buffer( tpt, &b, 1 );
+  if( b == RPC_CMD_CON )
+    return b;
+  if( b != RPC_FRAME && b != RPC_FRAME_LZF )
+    protocol_error();
+  frame_receive( tpt, b );
+  tpt->seq = tpt->rseq;
+  b = tpt->rbuf[ tpt->rpos ++ ];
+  return b;
+}
+
+// send the rest of the current message
+static void transport_flush( Transport *tpt )
+{
+  struct exception e;
+  TRANSPORT_VERIFY_OPEN;
+  if( tpt->wlen > 0 )
+    frame_send( tpt );
+}
+
 // **************************************************************************
 // transport layer generics
 
-// read arbitrary length from the transport into a string buffer.
-static void transport_read_string( Transport *tpt, const char *buffer, int length )
+// read arbitrary length from the current message into a buffer.
+static void transport_read_string( Transport *tpt, char *buffer, int length )
 {
-  transport_read_buffer( tpt, ( u8 * )buffer, length );
+  u8 *p = ( u8 * )buffer;
+  int n;
+
+  while( length > 0 )
+  {
+    if( tpt->rpos == tpt->rlen )
+      frame_continue( tpt );
+    n = tpt->rlen - tpt->rpos;
+    if( n > length )
+      n = length;
+    memcpy( p, tpt->rbuf + tpt->rpos, n );
+    tpt->rpos += n;
+    p += n;
+    length -= n;
+  }
 }
 
 
-// write arbitrary length string buffer to the transport
+// write arbitrary length buffer to the current message
 static void transport_write_string( Transport *tpt, const char *buffer, int length )
 {
-  transport_write_buffer( tpt, ( u8 * )buffer, length );
+  const u8 *p = ( const u8 * )buffer;
+  int n;
+
+  while( length > 0 )
+  {
+    n = RPC_FRAME_SIZE - tpt->wlen;
+    if( n > length )
+      n = length;
+    memcpy( tpt->wbuf + RPC_FRAME_HEADER + tpt->wlen, p, n );
+    tpt->wlen += n;
+    p += n;
+    length -= n;
+    if( tpt->wlen == RPC_FRAME_SIZE )
+      frame_send( tpt );
+  }
 }
 
 
 // read a u8 from the transport
 static u8 transport_read_u8( Transport *tpt )
 {
-  u8 b;
   struct exception e;
   TRANSPORT_VERIFY_OPEN;
-  transport_read_buffer( tpt, &b, 1 );
-  return b;
+  if( tpt->rpos == tpt->rlen )
+    frame_continue( tpt );
+  return tpt->rbuf[ tpt->rpos ++ ];
 }
 
 
@@ -179,7 +390,9 @@ static void transport_write_u8( Transport *tpt, u8 x )
 {
   struct exception e;
   TRANSPORT_VERIFY_OPEN;
-  transport_write_buffer( tpt, &x, 1 );
+  tpt->wbuf[ RPC_FRAME_HEADER + tpt->wlen ++ ] = x;
+  if( tpt->wlen == RPC_FRAME_SIZE )
+    frame_send( tpt );
 }
 
 static void swap_bytes( uint8_t *number, size_t numbersize )
@@ -204,7 +417,7 @@ static u32 transport_read_u32( Transport *tpt )
   union u32_bytes ub;
   struct exception e;
   TRANSPORT_VERIFY_OPEN;
-  transport_read_buffer ( tpt, ub.b, 4 );
+  transport_read_string( tpt, ( char * )ub.b, 4 );
   if( tpt->net_little != tpt->loc_little )
     swap_bytes( ( uint8_t * )ub.b, 4 );
   return ub.i;
@@ -220,7 +433,7 @@ static void transport_write_u32( Transport *tpt, u32 x )
   ub.i = ( uint32_t )x;
   if( tpt->net_little != tpt->loc_little )
     swap_bytes( ( uint8_t * )ub.b, 4 );
-  transport_write_buffer( tpt, ub.b, 4 );
+  transport_write_string( tpt, ( char * )ub.b, 4 );
 }
 
 // read a lua number from the transport
@@ -230,7 +443,7 @@ static lua_Number transport_read_number( Transport *tpt )
   u8 b[ tpt->lnum_bytes ];
   struct exception e;
   TRANSPORT_VERIFY_OPEN;
-  transport_read_buffer ( tpt, b, tpt->lnum_bytes );
+  transport_read_string( tpt, ( char * )b, tpt->lnum_bytes );
 
   if( tpt->net_little != tpt->loc_little )
     swap_bytes( ( uint8_t * )b, tpt->lnum_bytes );
@@ -277,25 +490,25 @@ static void transport_write_number( Transport *tpt, lua_Number x )
     {
       case 1: {
         int8_t y = ( int8_t )x;
-        transport_write_buffer( tpt, ( u8 * )&y, 1 );
+        transport_write_string( tpt, ( char * )&y, 1 );
       } break;
       case 2: {
         int16_t y = ( int16_t )x;
         if( tpt->net_little != tpt->loc_little )
           swap_bytes( ( uint8_t * )&y, 2 );
-        transport_write_buffer( tpt, ( u8 * )&y, 2 );
+        transport_write_string( tpt, ( char * )&y, 2 );
       } break;
       case 4: {
         int32_t y = ( int32_t )x;
         if( tpt->net_little != tpt->loc_little )
           swap_bytes( ( uint8_t * )&y, 4 );
-        transport_write_buffer( tpt,( u8 * )&y, 4 );
+        transport_write_string( tpt, ( char * )&y, 4 );
       } break;
       case 8: {
         int64_t y = ( int64_t )x;
         if( tpt->net_little != tpt->loc_little )
           swap_bytes( ( uint8_t * )&y, 8 );
-        transport_write_buffer( tpt, ( u8 * )&y, 8 );
+        transport_write_string( tpt, ( char * )&y, 8 );
       } break;
       default: lua_assert(0);
     }
@@ -304,7 +517,7 @@ static void transport_write_number( Transport *tpt, lua_Number x )
   {
     if( tpt->net_little != tpt->loc_little )
        swap_bytes( ( uint8_t * )&x, 8 );
-    transport_write_buffer( tpt, ( u8 * )&x, 8 );
+    transport_write_string( tpt, ( char * )&x, 8 );
   }
 }
 
@@ -357,18 +570,155 @@ static int read_variable( Transport *tpt, lua_State *L );
 // write a table at the given index in the stack. the index must be absolute
 // (i.e. positive).
 // @@@ circular table references will cause stack overflow!
+// push the key dictionary 'ref' of the transport, creating it if needed
+static void push_dict( lua_State *L, int *ref )
+{
+  if( *ref == LUA_NOREF )
+  {
+    lua_newtable( L );
+    lua_pushvalue( L, -1 );
+    *ref = luaL_ref( L, LUA_REGISTRYINDEX );
+  }
+  else
+    lua_rawgeti( L, LUA_REGISTRYINDEX, *ref );
+}
+
+// string keys are sent once per message, then as their index in the
+// message's dictionary; the dictionary maps the key to its index and the
+// index to the key, entries left from older messages are ignored
+static void write_key( Transport *tpt, lua_State *L, int key_index, int dict_index )
+{
+  if( lua_type( L, key_index ) == LUA_TSTRING )
+  {
+    lua_pushvalue( L, key_index );
+    lua_rawget( L, dict_index );
+    if( lua_isnumber( L, -1 ) && lua_tointeger( L, -1 ) < tpt->wdict_n )
+    {
+      u8 idx = ( u8 )lua_tointeger( L, -1 );
+      lua_rawgeti( L, dict_index, idx );
+      if( lua_rawequal( L, -1, key_index ) )
+      {
+        lua_pop( L, 2 );
+        transport_write_u8( tpt, RPC_STRREF );
+        transport_write_u8( tpt, idx );
+        return;
+      }
+      lua_pop( L, 1 );
+    }
+    lua_pop( L, 1 );
+    if( tpt->wdict_n < RPC_DICT_SIZE )
+    {
+      lua_pushvalue( L, key_index );
+      lua_pushinteger( L, tpt->wdict_n );
+      lua_rawset( L, dict_index );
+      lua_pushvalue( L, key_index );
+      lua_rawseti( L, dict_index, tpt->wdict_n );
+      tpt->wdict_n ++;
+    }
+  }
+  write_variable( tpt, L, key_index );
+}
+
+// return the element type of RPC_NUMARRAY that holds all the numbers in
+// t[ 1 .. count ]
+static int numarray_kind( lua_State *L, int table_index, u32 count )
+{
+  lua_Number x, lo = 0, hi = 0;
+  u32 i;
+
+  for( i = 1; i <= count; i ++ )
+  {
+    lua_rawgeti( L, table_index, i );
+    x = lua_tonumber( L, -1 );
+    lua_pop( L, 1 );
+    if( !( x >= -2147483648.0 && x <= 2147483647.0 ) || ( lua_Number )( int32_t )x != x )
+      return RPC_ARRAY_NUMBER;
+    if( x < lo )
+      lo = x;
+    if( x > hi )
+      hi = x;
+  }
+  if( lo >= -128 && hi <= 127 )
+    return RPC_ARRAY_I8;
+  if( lo >= -32768 && hi <= 32767 )
+    return RPC_ARRAY_I16;
+  return RPC_ARRAY_I32;
+}
+
+// write t[ 1 .. count ] as one block of numbers
+static void write_numarray( Transport *tpt, lua_State *L, int table_index, u32 count )
+{
+  int kind = numarray_kind( L, table_index, count );
+  union { int8_t i8; int16_t i16; int32_t i32; } v;
+  lua_Number x;
+  u32 i;
+
+  transport_write_u8( tpt, RPC_NUMARRAY );
+  transport_write_u8( tpt, ( u8 )kind );
+  transport_write_u32( tpt, count );
+  for( i = 1; i <= count; i ++ )
+  {
+    lua_rawgeti( L, table_index, i );
+    x = lua_tonumber( L, -1 );
+    lua_pop( L, 1 );
+    switch( kind )
+    {
+      case RPC_ARRAY_I8:
+        v.i8 = ( int8_t )x;
+        break;
+      case RPC_ARRAY_I16:
+        v.i16 = ( int16_t )x;
+        break;
+      case RPC_ARRAY_I32:
+        v.i32 = ( int32_t )x;
+        break;
+      default:
+        transport_write_number( tpt, x );
+        continue;
+    }
+    if( tpt->net_little != tpt->loc_little )
+      swap_bytes( ( uint8_t * )&v, kind );
+    transport_write_string( tpt, ( char * )&v, kind );
+  }
+}
+
+// the numbers at the start of the array part are sent as one RPC_NUMARRAY
+// block, the other entries as key/value pairs
 static void write_table( Transport *tpt, lua_State *L, int table_index )
 {
+  int dict_index;
+  u32 count = 0;
+  lua_Number k;
+
+  while( 1 )
+  {
+    lua_rawgeti( L, table_index, count + 1 );
+    if( lua_type( L, -1 ) != LUA_TNUMBER )
+      break;
+    lua_pop( L, 1 );
+    count ++;
+  }
+  lua_pop( L, 1 );
+  if( count > 0 )
+    write_numarray( tpt, L, table_index, count );
+
+  push_dict( L, &tpt->wdict_ref );
+  dict_index = lua_gettop( L );
   lua_pushnil( L );  // push first key
   while ( lua_next( L, table_index ) )
   {
-    // next key and value were pushed on the stack
-    write_variable( tpt, L, lua_gettop( L ) - 1 );
-    write_variable( tpt, L, lua_gettop( L ) );
+    // next key and value were pushed on the stack, skip the numbers already sent
+    k = lua_type( L, -2 ) == LUA_TNUMBER ? lua_tonumber( L, -2 ) : 0;
+    if( !( k >= 1 && k <= count && ( lua_Number )( u32 )k == k ) )
+    {
+      write_key( tpt, L, lua_gettop( L ) - 1, dict_index );
+      write_variable( tpt, L, lua_gettop( L ) );
+    }
 
     // remove value, keep key for next iteration
     lua_pop( L, 1 );
   }
+  lua_pop( L, 1 );
 }
 
 static int writer( lua_State *L, const void* b, size_t size, void* B ) {
@@ -506,18 +856,116 @@ static void write_variable( Transport *tpt, lua_State *L, int var_index )
 }
 
 
+static int read_value( Transport *tpt, lua_State *L, u8 type );
+
+// read a string and push it onto the stack, straight from the frame buffer
+static void read_string( Transport *tpt, lua_State *L )
+{
+  u32 len = transport_read_u32( tpt );
+  luaL_Buffer b;
+  u32 n;
+
+  if( ( u32 )( tpt->rlen - tpt->rpos ) >= len )
+  {
+    lua_pushlstring( L, ( const char * )tpt->rbuf + tpt->rpos, len );
+    tpt->rpos += len;
+    return;
+  }
+  luaL_buffinit( L, &b );
+  while( len > 0 )
+  {
+    if( tpt->rpos == tpt->rlen )
+      frame_continue( tpt );
+    n = tpt->rlen - tpt->rpos;
+    if( n > len )
+      n = len;
+    luaL_addlstring( &b, ( const char * )tpt->rbuf + tpt->rpos, n );
+    tpt->rpos += n;
+    len -= n;
+  }
+  luaL_pushresult( &b );
+}
+
+// read the RPC_NUMARRAY block into t[ 1 .. count ]
+static void read_numarray( Transport *tpt, lua_State *L, int table_index, u32 count, int kind )
+{
+  union { int8_t i8; int16_t i16; int32_t i32; } v;
+  lua_Number x;
+  u32 i;
+
+  for( i = 1; i <= count; i ++ )
+  {
+    if( kind == RPC_ARRAY_NUMBER )
+      x = transport_read_number( tpt );
+    else
+    {
+      transport_read_string( tpt, ( char * )&v, kind );
+      if( tpt->net_little != tpt->loc_little )
+        swap_bytes( ( uint8_t * )&v, kind );
+      x = kind == RPC_ARRAY_I8 ? v.i8 : kind == RPC_ARRAY_I16 ? v.i16 : v.i32;
+    }
+    lua_pushnumber( L, x );
+    lua_rawseti( L, table_index, i );
+  }
+}
+
+// read a table key (see write_key) and push it onto the stack
+static void read_key( Transport *tpt, lua_State *L, u8 type )
+{
+  u8 idx;
+
+  if( type == RPC_STRREF )
+  {
+    idx = transport_read_u8( tpt );
+    if( idx >= tpt->rdict_n )
+      protocol_error();
+    lua_rawgeti( L, LUA_REGISTRYINDEX, tpt->rdict_ref );
+    lua_rawgeti( L, -1, idx );
+    lua_remove( L, -2 );
+    return;
+  }
+  read_value( tpt, L, type );
+  if( type == RPC_STRING && tpt->rdict_n < RPC_DICT_SIZE )
+  {
+    push_dict( L, &tpt->rdict_ref );
+    lua_pushvalue( L, -2 );
+    lua_rawseti( L, -2, tpt->rdict_n ++ );
+    lua_pop( L, 1 );
+  }
+}
+
 // read a table and push in onto the stack
 static void read_table( Transport *tpt, lua_State *L )
 {
-  int table_index;
-  lua_newtable( L );
+  int table_index, kind = 0;
+  u32 count = 0, prealloc;
+  u8 type = transport_read_u8( tpt );
+
+  if( type == RPC_NUMARRAY )
+  {
+    kind = transport_read_u8( tpt );
+    count = transport_read_u32( tpt );
+    if( kind != RPC_ARRAY_NUMBER && kind != RPC_ARRAY_I8 && kind != RPC_ARRAY_I16 && kind != RPC_ARRAY_I32 )
+      protocol_error();
+    if( count > ( u32 )MAXINT )
+      protocol_error();
+  }
+  // the count comes from the other side: preallocate only as many elements
+  // as the rest of the frame can hold, the table grows as more frames come
+  prealloc = ( u32 )( tpt->rlen - tpt->rpos );
+  lua_createtable( L, ( int )( count < prealloc ? count : prealloc ), 0 );
   table_index = lua_gettop( L );
-  for ( ;; )
+  if( type == RPC_NUMARRAY )
   {
-    if( !read_variable( tpt, L ) )
-      return;
+    read_numarray( tpt, L, table_index, count, kind );
+    type = transport_read_u8( tpt );
+  }
+  while( type != RPC_TABLE_END )
+  {
+    read_key( tpt, L, type );
     read_variable( tpt, L );
     lua_rawset( L, table_index );
+    type = transport_read_u8( tpt );
   }
 }
 
@@ -539,13 +987,24 @@ static void read_function( Transport *tpt, lua_State *L )
   }
 }
 
+// read the length of a remote name, which the other side can't make longer
+// than a path of RPC_MAX_DEPTH names
+static u32 transport_read_name_len( Transport *tpt )
+{
+  u32 len = transport_read_u32( tpt );
+
+  if( len > RPC_MAX_NAME_CHARS )
+    protocol_error();
+  return len;
+}
+
 static void read_index( Transport *tpt, lua_State *L )
 {
   u32 len;
   char *funcname;
   char *token = NULL;
 
-  len = transport_read_u32( tpt ); // variable name length
+  len = transport_read_name_len( tpt ); // variable name length
   funcname = ( char * )alloca( len + 1 );
   transport_read_string( tpt, funcname, len );
   funcname[ len ] = 0;
@@ -566,9 +1025,14 @@ static void read_index( Transport *tpt, lua_State *L )
 // variable was read, or 0 if an end-table or end-function marker was read (in which case
 // nothing is pushed onto the stack).
 static int read_variable( Transport *tpt, lua_State *L )
+{
+  return read_value( tpt, L, transport_read_u8( tpt ) );
+}
+
+// read a variable of the given type (see read_variable)
+static int read_value( Transport *tpt, lua_State *L, u8 type )
 {
   struct exception e;
-  u8 type = transport_read_u8( tpt );
 
   switch( type )
   {
@@ -585,14 +1049,8 @@ static int read_variable( Transport *tpt, lua_State *L )
       break;
 
     case RPC_STRING:
-    {
-      u32 len = transport_read_u32( tpt );
-      char *s = ( char * )alloca( len + 1 );
-      transport_read_string( tpt, s, len );
-      s[ len ] = 0;
-      lua_pushlstring( L, s, len );
+      read_string( tpt, L );
       break;
-    }
 
     case RPC_TABLE:
       read_table( tpt, L );
@@ -621,6 +1079,37 @@ static int read_variable( Transport *tpt, lua_State *L )
 }
 
 
+// **************************************************************************
+// function ids
+//   a function called by name gets an id from the server, returned at the
+//   start of the reply, and the next calls send the id instead of the name.
+//   Both sides keep a table of ids per connection. The server maps the id to
+//   the keys on the path of the function (looked up again on every call, so
+//   a redefined function is still found) and the name to the id. The client
+//   maps the name to the id, and the sequence number of a call by name to
+//   the name until its reply is read. Calls by id also send a hash of the
+//   name, so an id given by a server that was restarted since (and may give
+//   the same id to another function) is refused instead of calling the wrong
+//   function.
+
+// 16 bit hash of a function name (FNV-1a, folded)
+static u16 name_hash( const char *name, size_t len )
+{
+  u32 h = 2166136261UL;
+
+  while( len -- )
+    h = ( h ^ ( u8 )*name ++ ) * 16777619UL;
+  return ( u16 )( ( h >> 16 ) ^ h );
+}
+
+// forget the function ids of the transport
+static void functions_release( lua_State *L, Transport *tpt )
+{
+  luaL_unref( L, LUA_REGISTRYINDEX, tpt->fn_ref );
+  tpt->fn_ref = LUA_NOREF;
+  tpt->fn_n = 0;
+}
+
 // **************************************************************************
 // rpc utilities
 
@@ -645,12 +1134,12 @@ static void client_negotiate( Transport *tpt )
   header[4] = ( char )RPC_PROTOCOL_VERSION;
   header[5] = tpt->loc_little;
   header[6] = tpt->lnum_bytes;
-  header[7] = tpt->loc_intnum;
-  transport_write_string( tpt, header, sizeof( header ) );
+  header[7] = tpt->loc_intnum | ( RPC_COMPRESS ? RPC_HEADER_LZF : 0 );
+  transport_write_buffer( tpt, ( u8 * )header, sizeof( header ) );
 
 
   // read server's response
-  transport_read_string( tpt, header, sizeof( header ) );
+  transport_read_buffer( tpt, ( u8 * )header, sizeof( header ) );
   if( header[0] != 'L' ||
       header[1] != 'R' ||
       header[2] != 'P' ||
@@ -665,7 +1154,10 @@ static void client_negotiate( Transport *tpt )
   // write configuration from response
   tpt->net_little = header[5];
   tpt->lnum_bytes = header[6];
-  tpt->net_intnum = header[7];
+  tpt->net_intnum = header[7] & RPC_HEADER_INTNUM;
+  tpt->compress = RPC_COMPRESS && ( header[7] & RPC_HEADER_LZF );
+  tpt->seq = 0;
+  frame_reset( tpt );
 }
 
 static void server_negotiate( Transport *tpt )
@@ -680,7 +1172,7 @@ static void server_negotiate( Transport *tpt )
   tpt->net_intnum = tpt->loc_intnum = ( char )( ( ( lua_Number )0.5 ) == 0 );
 
   // read and check header from client
-  transport_read_string( tpt, header, sizeof( header ) );
+  transport_read_buffer( tpt, ( u8 * )header, sizeof( header ) );
   if( header[0] != 'L' ||
       header[1] != 'R' ||
       header[2] != 'P' ||
@@ -703,16 +1195,28 @@ static void server_negotiate( Transport *tpt )
     tpt->lnum_bytes = header[ 6 ];
 
   // if lua_Number is integer on either side, use integer
-  if( header[ 7 ] != tpt->loc_intnum )
-    header[ 7 ] = tpt->net_intnum = 1;
+  if( ( header[ 7 ] & RPC_HEADER_INTNUM ) != tpt->loc_intnum )
+    tpt->net_intnum = 1;
+
+  // compress the frames if both sides can
+  tpt->compress = RPC_COMPRESS && ( header[ 7 ] & RPC_HEADER_LZF );
+  header[ 7 ] = tpt->net_intnum | ( tpt->compress ? RPC_HEADER_LZF : 0 );
 
   // send reconciled configuration to client
-  transport_write_string( tpt, header, sizeof( header ) );
+  transport_write_buffer( tpt, ( u8 * )header, sizeof( header ) );
+  frame_reset( tpt );
 }
 
 
+static void client_forget_functions( lua_State *L, Handle *h );
+
 static int generic_catch_handler(lua_State *L, Handle *handle, struct exception e )
 {
+  // the rest of the message and the outstanding replies are lost (with the
+  // function ids they carried)
+  frame_reset( &handle->tpt );
+  handle->read_reply_count = 0;
+  client_forget_functions( L, handle );
   deal_with_error( L, handle, errorString( e.errnum ) );
   switch( e.type )
   {
@@ -764,9 +1268,38 @@ Handle *handle_create( lua_State *L )
   h->error_handler = LUA_NOREF;
   h->async = 0;
   h->read_reply_count = 0;
+  h->pending_ref = LUA_NOREF;
+  h->pending_count = 0;
+  h->call_id = 0;
+  h->fn_gen = 0;
+  transport_message_init( &h->tpt );
   return h;
 }
 
+// forget the function ids of the connection (helpers check fn_gen before
+// using the id they keep)
+static void client_forget_functions( lua_State *L, Handle *h )
+{
+  functions_release( L, &h->tpt );
+  h->fn_gen ++;
+}
+
+static void handle_release( lua_State *L, Handle *h )
+{
+  luaL_unref( L, LUA_REGISTRYINDEX, h->pending_ref );
+  luaL_unref( L, LUA_REGISTRYINDEX, h->tpt.wdict_ref );
+  luaL_unref( L, LUA_REGISTRYINDEX, h->tpt.rdict_ref );
+  h->pending_ref = h->tpt.wdict_ref = h->tpt.rdict_ref = LUA_NOREF;
+  h->read_reply_count = h->pending_count = 0;
+  client_forget_functions( L, h );
+}
+
+static int handle_close( lua_State *L )
+{
+  handle_release( L, ( Handle * )luaL_checkudata( L, 1, "rpc.handle" ) );
+  return 0;
+}
+
 static Helper *helper_create( lua_State *L, Handle *handle, const char *funcname )
 {
   Helper *h = ( Helper * )lua_newuserdata( L, sizeof( Helper ) );
@@ -778,6 +1311,9 @@ static Helper *helper_create( lua_State *L, Handle *handle, const char *funcname
   h->handle = handle;
   h->parent = NULL;
   h->nparents = 0;
+  h->fid = 0;
+  h->fhash = 0;
+  h->fgen = handle->fn_gen;
   strncpy( h->funcname, funcname, NUM_FUNCNAME_CHARS );
   return h;
 }
@@ -863,20 +1399,165 @@ static void helper_remote_index( Helper *helper )
   transport_write_string( tpt, helper->funcname, ( int )strlen( helper->funcname ) );
 }
 
-static void helper_wait_ready( Transport *tpt, u8 cmd )
+// push the dotted name of the remote variable of a helper
+static void helper_push_name( lua_State *L, Helper *helper )
 {
-  struct exception e;
-  u8 cmdresp;
+  luaL_Buffer b;
+  Helper **hstack;
+  int i;
 
-  transport_write_u8( tpt, cmd );
-  cmdresp = transport_read_u8( tpt );
-  if( cmdresp != RPC_READY )
+  hstack = ( Helper ** )alloca( sizeof( Helper * ) * ( helper->nparents + 1 ) );
+  hstack[ helper->nparents ] = helper;
+  for( i = helper->nparents; i > 0; i -- )
+    hstack[ i - 1 ] = hstack[ i ]->parent;
+  luaL_buffinit( L, &b );
+  for( i = 0; i <= helper->nparents; i ++ )
   {
-    e.errnum = ERR_PROTOCOL;
-    e.type = nonfatal;
-    Throw( e );
+    if( i > 0 )
+      luaL_addchar( &b, '.' );
+    luaL_addstring( &b, hstack[ i ]->funcname );
+  }
+  luaL_pushresult( &b );
+}
+
+// the function id of a helper, or 0 if it must be called by name
+static u8 helper_function_id( lua_State *L, Helper *helper )
+{
+  Handle *h = helper->handle;
+
+  if( helper->fgen != h->fn_gen )
+  {
+    helper->fid = 0;
+    helper->fgen = h->fn_gen;
+  }
+  if( helper->fid == 0 && h->tpt.fn_ref != LUA_NOREF )
+  {
+    size_t len;
+    const char *name;
+
+    lua_rawgeti( L, LUA_REGISTRYINDEX, h->tpt.fn_ref );
+    helper_push_name( L, helper );
+    name = lua_tolstring( L, -1, &len );
+    helper->fhash = name_hash( name, len );
+    lua_rawget( L, -2 );
+    helper->fid = ( u8 )lua_tointeger( L, -1 );
+    lua_pop( L, 2 );
   }
+  return helper->fid;
+}
 
+// keep the function id returned by a call by name; a call by id that gets
+// no id back used an id the server doesn't know (it was restarted), so all
+// the ids are forgotten
+static void client_function_reply( lua_State *L, Handle *h, u8 fid )
+{
+  if( h->tpt.fn_ref == LUA_NOREF )
+    return;
+  lua_rawgeti( L, LUA_REGISTRYINDEX, h->tpt.fn_ref );
+  lua_rawgeti( L, -1, h->tpt.rseq );
+  if( lua_isnil( L, -1 ) )
+  {
+    lua_pop( L, 2 );
+    if( fid == 0 )
+      client_forget_functions( L, h );
+    return;
+  }
+  lua_pushnil( L );
+  lua_rawseti( L, -3, h->tpt.rseq );
+  if( fid != 0 )
+  {
+    lua_pushinteger( L, fid );
+    lua_rawset( L, -3 );
+  }
+  else
+    lua_pop( L, 1 );
+  lua_pop( L, 1 );
+}
+
+// read the reply of a call: pushes the results and returns their number, or
+// pushes the error message and returns -1
+static int client_read_results( lua_State *L, Handle *h )
+{
+  u32 i, nret;
+  Transport *tpt = &h->tpt;
+
+  client_function_reply( L, h, transport_read_u8( tpt ) );
+  if( transport_read_u8( tpt ) == 0 )
+  {
+    nret = transport_read_u32( tpt );
+    if( nret > ( u32 )MAXINT || !lua_checkstack( L, ( int )nret ) )
+      protocol_error();
+    for( i = 0; i < nret; i ++ )
+      read_variable( tpt, L );
+    return ( int )nret;
+  }
+  transport_read_u32( tpt ); // read code (not being used here)
+  read_string( tpt, L );
+  return -1;
+}
+
+// an async call is known to Lua by an id that counts all the async calls of
+// the handle, and on the link by the sequence number of its request. The
+// outstanding calls have consecutive ids and sequence numbers, so those of
+// the oldest one follow from those of the last one.
+#define PENDING_SEQ( h ) ( ( u8 )( ( h )->tpt.seq - ( h )->read_reply_count + 1 ) )
+#define PENDING_ID( h ) ( ( h )->call_id - ( u32 )( h )->read_reply_count + 1 )
+
+// read the reply of the oldest outstanding async call into the pending table
+// (a table of results or an error message, indexed by call id)
+static void client_read_pending( lua_State *L, Handle *h )
+{
+  int i, n, base = lua_gettop( L );
+  u8 seq = PENDING_SEQ( h );
+  u32 id = PENDING_ID( h );
+
+  if( transport_read_reply( &h->tpt ) != seq )
+    protocol_error();
+  n = client_read_results( L, h );
+  h->read_reply_count --;
+  h->pending_count ++;
+  if( h->pending_ref == LUA_NOREF )
+  {
+    lua_newtable( L );
+    h->pending_ref = luaL_ref( L, LUA_REGISTRYINDEX );
+  }
+  lua_rawgeti( L, LUA_REGISTRYINDEX, h->pending_ref );
+  if( n < 0 )
+    lua_pushvalue( L, -2 );
+  else
+  {
+    lua_createtable( L, n, 1 );
+    for( i = 1; i <= n; i ++ )
+    {
+      lua_pushvalue( L, base + i );
+      lua_rawseti( L, -2, i );
+    }
+    lua_pushinteger( L, n );
+    lua_setfield( L, -2, "n" );
+  }
+  lua_rawseti( L, -2, ( int )id );
+  lua_settop( L, base );
+}
+
+// start a request; synchronous requests first collect the replies of the
+// outstanding async calls
+static void client_request( lua_State *L, Handle *h, u8 cmd )
+{
+  if( !h->async || ( cmd != RPC_CMD_CALL && cmd != RPC_CMD_CALLID ) )
+    while( h->read_reply_count > 0 )
+      client_read_pending( L, h );
+
+  h->tpt.seq ++;
+  h->tpt.wdict_n = 0;
+  transport_write_u8( &h->tpt, cmd );
+}
+
+// send the request and start reading its reply
+static void client_reply( Handle *h )
+{
+  transport_flush( &h->tpt );
+  if( transport_read_reply( &h->tpt ) != h->tpt.seq )
+    protocol_error();
 }
 
 static int helper_get( lua_State *L, Helper *helper )
@@ -887,8 +1568,9 @@ static int helper_get( lua_State *L, Helper *helper )
 
   Try
   {
-    helper_wait_ready( tpt, RPC_CMD_GET );
+    client_request( L, helper->handle, RPC_CMD_GET );
     helper_remote_index( helper );
+    client_reply( helper->handle );
 
     read_variable( tpt, L );
 
@@ -902,39 +1584,6 @@ static int helper_get( lua_State *L, Helper *helper )
 }
 
 
-// static int helper_async( lua_State *L )
-// {
-//     /* first read out any pending return values for old async calls */
-//     for (; h->handle->read_reply_count > 0; h->handle->read_reply_count--) {
-//       ret_code = transport_read_u8 (tpt);   /* return code */
-//       if( ret_code == 0 )
-//       {
-//         /* read return arguments, ignore everything we read */
-//         nret = transport_read_u32( tpt );
-//
-//         for (i=0; i < ( ( int ) nret ); i++)
-//           read_variable (tpt,L);
-//
-//         lua_pop (L,nret);
-//       }
-//       else
-//       {
-//         /* read error and handle it */
-//         u32 code = transport_read_u32( tpt );
-//         u32 len = transport_read_u32( tpt );
-//         char *err_string = ( char * )alloca( len + 1 );
-//         transport_read_string( tpt, err_string, len );
-//         err_string[ len ] = 0;
-//
-//         deal_with_error( L, h->handle, err_string );
-//         freturn = 0;
-//       }
-//     }
-// }
-
-
-
-
 static int helper_call (lua_State *L)
 {
   struct exception e;
@@ -955,60 +1604,80 @@ static int helper_call (lua_State *L)
   }
   else
   {
+    // the outstanding calls must keep distinct sequence numbers and the
+    // replies not waited for yet are kept in RAM, so both are limited
+    if( h->handle->async && h->handle->read_reply_count + h->handle->pending_count >= RPC_MAX_PENDING )
+      return luaL_error( L, "too many async calls not waited for (maximum %d)", RPC_MAX_PENDING );
     Try
     {
-      int i,n;
-      u32 nret,ret_code;
-
-      // write function name
-      helper_wait_ready( tpt, RPC_CMD_CALL );
-      helper_remote_index( h );
-
-      // write number of arguments
-      n = lua_gettop( L );
-      transport_write_u32( tpt, n - 1 );
+      int i, n = lua_gettop( L );
+      size_t len;
+      const char *name;
+      u8 fid = helper_function_id( L, h ), gen;
 
-      // write each argument
-      for( i = 2; i <= n; i ++ )
-        write_variable( tpt, L, i );
-
-      /* if we're in async mode, we're done */
-      /*if ( h->handle->async )
+      for( ;; )
       {
-        h->handle->read_reply_count++;
-        freturn = 0;
-      }*/
+        // write function id or name
+        if( fid != 0 )
+        {
+          client_request( L, h->handle, RPC_CMD_CALLID );
+          transport_write_u8( tpt, fid );
+          transport_write_u8( tpt, ( u8 )( h->fhash & 0xFF ) );
+          transport_write_u8( tpt, ( u8 )( h->fhash >> 8 ) );
+        }
+        else
+        {
+          helper_push_name( L, h );
+          client_request( L, h->handle, RPC_CMD_CALL );
+          push_dict( L, &tpt->fn_ref ); // keep the name until the reply gives its id
+          lua_pushvalue( L, -2 );
+          lua_rawseti( L, -2, tpt->seq );
+          lua_pop( L, 1 );
+          name = lua_tolstring( L, -1, &len );
+          transport_write_u32( tpt, ( u32 )len );
+          transport_write_string( tpt, name, ( int )len );
+        }
+        gen = h->handle->fn_gen;
 
-      // read return code
-      ret_code = transport_read_u8( tpt );
+        // write number of arguments
+        transport_write_u32( tpt, n - 1 );
 
-      if ( ret_code == 0 )
-      {
-        // read return arguments
-        nret = transport_read_u32( tpt );
+        // write each argument
+        for( i = 2; i <= n; i ++ )
+          write_variable( tpt, L, i );
 
-        for ( i = 0; i < ( ( int ) nret ); i ++ )
-          read_variable( tpt, L );
+        // if we're in async mode, we're done: return the call id (an async
+        // call by an id the server doesn't know fails, as the arguments
+        // aren't kept to call again by name)
+        if ( h->handle->async )
+        {
+          transport_flush( tpt );
+          h->handle->read_reply_count ++;
+          h->handle->call_id ++;
+          lua_pushinteger( L, ( lua_Integer )h->handle->call_id );
+          freturn = 1;
+          break;
+        }
+        client_reply( h->handle );
+        freturn = client_read_results( L, h->handle );
 
-        freturn = ( int )nret;
-      }
-      else
-      {
-        // read error and handle it
-        transport_read_u32( tpt ); // read code (not being used here)
-        u32 len = transport_read_u32( tpt );
-        char *err_string = ( char * )alloca( len + 1 );
-        transport_read_string( tpt, err_string, len );
-        err_string[ len ] = 0;
-
-        deal_with_error( L, h->handle, err_string );
-        freturn = 0;
+        // the server didn't know the id (it was restarted, so the ids were
+        // forgotten) and didn't call anything: call again by name
+        if( fid == 0 || gen == h->handle->fn_gen )
+          break;
+        lua_settop( L, n );
+        fid = 0;
       }
     }
     Catch( e )
     {
       freturn = generic_catch_handler( L, h->handle, e );
     }
+    if( freturn < 0 )
+    {
+      deal_with_error( L, h->handle, lua_tostring( L, -1 ) );
+      freturn = 0;
+    }
   }
   return freturn;
 }
@@ -1032,23 +1701,20 @@ static int helper_newindex( lua_State *L )
   Try
   {
     // index destination on remote side
-    helper_wait_ready( tpt, RPC_CMD_NEWINDEX );
+    client_request( L, h->handle, RPC_CMD_NEWINDEX );
     helper_remote_index( h );
 
     write_variable( tpt, L, lua_gettop( L ) - 1 );
     write_variable( tpt, L, lua_gettop( L ) );
+    client_reply( h->handle );
 
     ret_code = transport_read_u8( tpt );
     if( ret_code != 0 )
     {
       // read error and handle it
       transport_read_u32( tpt ); // Read code (not using here)
-      u32 len = transport_read_u32( tpt );
-      char *err_string = ( char * )alloca( len + 1 );
-      transport_read_string( tpt, err_string, len );
-      err_string[ len ] = 0;
-
-      deal_with_error( L, h->handle, err_string );
+      read_string( tpt, L );
+      deal_with_error( L, h->handle, lua_tostring( L, -1 ) );
     }
 
     freturn = 0;
@@ -1072,6 +1738,9 @@ static Helper *helper_append( lua_State *L, Helper *helper, const char *funcname
   h->handle = helper->handle;
   h->parent = helper;
   h->nparents = helper->nparents + 1;
+  h->fid = 0;
+  h->fhash = 0;
+  h->fgen = helper->handle->fn_gen;
   strncpy ( h->funcname, funcname, NUM_FUNCNAME_CHARS );
   return h;
 }
@@ -1089,6 +1758,8 @@ static int helper_index( lua_State *L )
   s = lua_tostring( L, 2 );
   if ( strlen( s ) > NUM_FUNCNAME_CHARS - 1 )
     return luaL_error( L, errorString( ERR_LONGFNAME ) );
+  if( ( ( Helper * )lua_touserdata( L, 1 ) )->nparents + 1 >= RPC_MAX_DEPTH )
+    return luaL_error( L, "remote path too long (maximum %d names)", RPC_MAX_DEPTH );
 
   helper_append( L, ( Helper * )lua_touserdata( L, 1 ), s );
 
@@ -1112,25 +1783,38 @@ static int helper_close (lua_State *L)
 static ServerHandle *server_handle_create( lua_State *L )
 {
   ServerHandle *h = ( ServerHandle * )lua_newuserdata( L, sizeof( ServerHandle ) );
+  int i;
+
   luaL_getmetatable( L, "rpc.server_handle" );
   lua_setmetatable( L, -2 );
 
-  h->link_errs = 0;
-
+  h->next = 0;
   transport_init( &h->ltpt );
-  transport_init( &h->atpt );
+  transport_message_init( &h->ltpt );
+  for( i = 0; i < RPC_MAX_CLIENTS; i ++ )
+  {
+    h->link_errs[ i ] = 0;
+    transport_init( &h->atpt[ i ] );
+    transport_message_init( &h->atpt[ i ] );
+  }
   return h;
 }
 
-static void server_handle_shutdown( ServerHandle *h )
+static void server_handle_shutdown( lua_State *L, ServerHandle *h )
 {
+  int i;
+
   transport_close( &h->ltpt );
-  transport_close( &h->atpt );
+  for( i = 0; i < RPC_MAX_CLIENTS; i ++ )
+  {
+    transport_close( &h->atpt[ i ] );
+    functions_release( L, &h->atpt[ i ] );
+  }
 }
 
-static void server_handle_destroy( ServerHandle *h )
+static void server_handle_destroy( lua_State *L, ServerHandle *h )
 {
-  server_handle_shutdown( h );
+  server_handle_shutdown( L, h );
 }
 
 // **************************************************************************
@@ -1145,13 +1829,14 @@ static int rpc_connect( lua_State *L )
 {
   struct exception e;
   Handle *handle = 0;
+  u8 cmd = RPC_CMD_CON;
 
   Try
   {
     handle = handle_create ( L );
     transport_open_connection( L, handle );
 
-    transport_write_u8( &handle->tpt, RPC_CMD_CON );
+    transport_write_buffer( &handle->tpt, &cmd, 1 ); // not framed
     client_negotiate( &handle->tpt );
   }
   Catch( e )
@@ -1180,12 +1865,13 @@ static int rpc_close( lua_State *L )
     {
       Handle *handle = ( Handle * )lua_touserdata( L, 1 );
       transport_close( &handle->tpt );
+      handle_release( L, handle );
       return 0;
     }
     if( ismetatable_type( L, 1, "rpc.server_handle" ) )
     {
       ServerHandle *handle = ( ServerHandle * )lua_touserdata( L, 1 );
-      server_handle_shutdown( handle );
+      server_handle_shutdown( L, handle );
       return 0;
     }
   }
@@ -1194,28 +1880,107 @@ static int rpc_close( lua_State *L )
 }
 
 
-// rpc_async (handle,)
-//     this sets a handle's asynchronous calling mode (0/nil=off, other=on).
+// rpc_async( handle, flag )
+//     this sets a handle's asynchronous calling mode (false/nil/0=off,
+//     other=on). in async mode a call returns an id right after the request
+//     is sent; the results are collected with rpc.wait.
 //     (this is for the client only).
-//     @@@ Before re-enabling, this should be brought up to date with multi-command architecture
 
-// static int rpc_async (lua_State *L)
-// {
-//   Handle *handle;
-//   check_num_args( L, 2 );
-//
-//   if ( !lua_isuserdata( L, 1 ) || !ismetatable_type( L, 1, "rpc.handle" ) )
-//     my_lua_error( L, "first arg must be client handle" );
-//
-//   handle = ( Handle * )lua_touserdata( L, 1 );
-//
-//   if ( lua_isnil( L, 2 ) || ( lua_isnumber( L, 2 ) && lua_tonumber( L, 2 ) == 0) )
-//     handle->async = 0;
-//   else
-//     handle->async = 1;
-//
-//   return 0;
-// }
+static int rpc_async( lua_State *L )
+{
+  Handle *handle;
+  check_num_args( L, 2 );
+
+  if ( !lua_isuserdata( L, 1 ) || !ismetatable_type( L, 1, "rpc.handle" ) )
+    return luaL_error( L, "first arg must be client handle" );
+
+  handle = ( Handle * )lua_touserdata( L, 1 );
+
+  if ( !lua_toboolean( L, 2 ) || ( lua_isnumber( L, 2 ) && lua_tonumber( L, 2 ) == 0 ) )
+    handle->async = 0;
+  else
+    handle->async = 1;
+
+  return 0;
+}
+
+// rpc_wait( handle, id )
+//     returns the results of the async call with the given id. the replies of
+//     the calls made before it are kept until waited for.
+
+static int rpc_wait( lua_State *L )
+{
+  struct exception e;
+  Handle *h;
+  int i, n = -2;
+  u32 id;
+
+  check_num_args( L, 2 );
+  if ( !lua_isuserdata( L, 1 ) || !ismetatable_type( L, 1, "rpc.handle" ) )
+    return luaL_error( L, "first arg must be client handle" );
+  h = ( Handle * )lua_touserdata( L, 1 );
+  id = ( u32 )luaL_checkinteger( L, 2 );
+
+  Try
+  {
+    while( 1 )
+    {
+      if( h->pending_ref != LUA_NOREF )
+      {
+        lua_rawgeti( L, LUA_REGISTRYINDEX, h->pending_ref );
+        lua_rawgeti( L, -1, ( int )id );
+        if( !lua_isnil( L, -1 ) )
+        {
+          lua_pushnil( L );
+          lua_rawseti( L, 3, ( int )id );
+          h->pending_count --;
+          n = -3;
+          break;
+        }
+        lua_pop( L, 2 );
+      }
+      // stop unless the call is still outstanding
+      if( h->call_id - id >= ( u32 )h->read_reply_count )
+        break;
+      if( PENDING_ID( h ) == id ) // next reply on the link: no need to store it
+      {
+        if( transport_read_reply( &h->tpt ) != PENDING_SEQ( h ) )
+          protocol_error();
+        n = client_read_results( L, h );
+        h->read_reply_count --;
+        break;
+      }
+      client_read_pending( L, h );
+    }
+  }
+  Catch( e )
+  {
+    return generic_catch_handler( L, h, e );
+  }
+
+  if( n == -3 ) // stored reply
+  {
+    if( lua_isstring( L, -1 ) )
+      n = -1;
+    else
+    {
+      lua_getfield( L, 4, "n" );
+      n = ( int )lua_tointeger( L, -1 );
+      lua_pop( L, 1 );
+      luaL_checkstack( L, n, "too many results" );
+      for( i = 1; i <= n; i ++ )
+        lua_rawgeti( L, 4, i );
+    }
+  }
+  if( n == -2 )
+    return luaL_error( L, "no pending call with this id" );
+  if( n == -1 )
+  {
+    deal_with_error( L, h, lua_tostring( L, -1 ) );
+    return 0;
+  }
+  return n;
+}
 
 //****************************************************************************
 // lua remote function server
@@ -1223,50 +1988,125 @@ static int rpc_close( lua_State *L )
 //   stack on entry and exit. This sets a custom error handler to catch errors
 //   around the function call.
 
-static void read_cmd_call( Transport *tpt, lua_State *L )
+// push the table of the keys in the dotted name 'name' (changes 'name')
+static void push_path( lua_State *L, char *name )
 {
-  int i, stackpos, good_function, nargs;
-  u32 len;
-  char *funcname;
-  char *token = NULL;
+  char *token;
+  int n = 0;
 
-  // read function name
-  len = transport_read_u32( tpt ); /* function name string length */
-  funcname = ( char * )alloca( len + 1 );
-  transport_read_string( tpt, funcname, len );
-  funcname[ len ] = 0;
+  // @@@ strtok is not thread safe
+  lua_newtable( L );
+  for( token = strtok( name, "." ); token != NULL; token = strtok( NULL, "." ) )
+  {
+    lua_pushstring( L, token );
+    lua_rawseti( L, -2, ++ n );
+  }
+}
 
-  // get function
-  // @@@ perhaps handle more like variables instead of using a long string?
-  // @@@ also strtok is not thread safe
-  token = strtok( funcname, "." );
-  lua_getglobal( L, token );
-  if( LUA_ISCALLABLE( L, -1 ) || LUA_ISATABLE( L, -1 ) ) // only continue if non-nil
+// push the value found by indexing the globals with the keys of the path
+// table at 'path' in turn (path[ 0 ] is the hash of the name). returns 0, or the index of the key that gave a
+// value that can't be indexed (which is pushed instead)
+static int resolve_path( lua_State *L, int path )
+{
+  int i, n = ( int )lua_objlen( L, path );
+
+  lua_pushvalue( L, LUA_GLOBALSINDEX );
+  for( i = 1; i <= n; i ++ )
   {
-    token = strtok( NULL, "." );
+    lua_rawgeti( L, path, i );
+    lua_gettable( L, -2 );
+    lua_remove( L, -2 );
+    if( i < n && !LUA_ISATABLE( L, -1 ) )
+      return i;
+  }
+  return 0;
+}
 
-    // loop over remainder of string, leaving token with last value if
-    // indexing fails
-    while( token != NULL && ( LUA_ISCALLABLE( L, -1 ) || LUA_ISATABLE( L, -1 ) ) )
+static void read_cmd_call( Transport *tpt, lua_State *L, int by_id )
+{
+  int i, stackpos, good_function, nargs, fns, name, path, bad_key = 0;
+  u32 len;
+  u16 hash;
+  u8 fid = 0;
+  char *funcname;
+
+  push_dict( L, &tpt->fn_ref );
+  fns = lua_gettop( L );
+  name = fns + 1;
+  if( by_id )
+  {
+    fid = transport_read_u8( tpt );
+    hash = transport_read_u8( tpt );
+    hash |= transport_read_u8( tpt ) << 8;
+    lua_rawgeti( L, fns, fid );
+    if( lua_istable( L, -1 ) )
     {
-      lua_getfield( L, -1, token );
-      if ( LUA_ISCALLABLE( L, -1 ) || LUA_ISATABLE( L, -1 ) )
-      {
-        lua_remove( L, -2 );
-        token = strtok( NULL, "." );
-      }
+      lua_rawgeti( L, -1, 0 );
+      if( lua_tointeger( L, -1 ) != hash ) // id given to another function
+        lua_replace( L, -2 );
+      else
+        lua_pop( L, 1 );
     }
   }
+  else
+  {
+    // read function name
+    len = transport_read_name_len( tpt ); /* function name string length */
+    funcname = ( char * )alloca( len + 1 );
+    transport_read_string( tpt, funcname, len );
+    funcname[ len ] = 0;
+
+    lua_pushlstring( L, funcname, len );
+    lua_pushvalue( L, name );
+    lua_rawget( L, fns );
+    fid = ( u8 )lua_tointeger( L, -1 );
+    lua_pop( L, 1 );
+    if( fid != 0 ) // called by name before
+      lua_rawgeti( L, fns, fid );
+    else
+      push_path( L, funcname );
+  }
+  path = lua_gettop( L );
+
+  // get function
+  if( lua_istable( L, path ) )
+    bad_key = resolve_path( L, path );
+  else
+  {
+    fid = 0; // unknown id
+    lua_pushnil( L );
+  }
   stackpos = lua_gettop( L ) - 1;
-  good_function = LUA_ISCALLABLE( L, -1 );
+  good_function = bad_key == 0 && LUA_ISCALLABLE( L, -1 );
+
+  // give an id to a new function
+  if( good_function && fid == 0 && !by_id && tpt->fn_n < RPC_MAX_FUNCS )
+  {
+    size_t hlen;
+    const char *s = lua_tolstring( L, name, &hlen );
+
+    fid = ++ tpt->fn_n;
+    lua_pushinteger( L, name_hash( s, hlen ) );
+    lua_rawseti( L, path, 0 );
+    lua_pushvalue( L, path );
+    lua_rawseti( L, fns, fid );
+    lua_pushvalue( L, name );
+    lua_pushinteger( L, fid );
+    lua_rawset( L, fns );
+  }
 
   // read number of arguments
+  // (a Lua error would leave the Try block, so bad input is a protocol error)
   nargs = transport_read_u32( tpt );
+  if( nargs < 0 || !lua_checkstack( L, nargs ) )
+    protocol_error();
 
   // read in each argument, leave it on the stack
   for ( i = 0; i < nargs; i ++ )
     read_variable( tpt, L );
 
+  transport_write_u8( tpt, good_function ? fid : 0 );
+
   // call the function
   if( good_function )
   {
@@ -1297,21 +2137,31 @@ static void read_cmd_call( Transport *tpt, lua_State *L )
   else
   {
     // bad index or function call
-    const char *msg;
-    if ( lua_isnil( L, -1 ) )
-      msg = "undefined: ";
-    else if ( LUA_ISATABLE( L, -1 ) )
-      msg = "can't call table";
+    const char *msg, *token = "";
+    size_t errlen;
+    lua_settop( L, stackpos + 1 );
+    if ( !lua_istable( L, path ) )
+      msg = "unknown function id";
     else
-      msg = "not table/func: ";
-    if( token == NULL ) // should occur if "function" was actually a table
-      token = (char *)"";
-    int errlen = ( int )strlen( msg ) + strlen( token );
+    {
+      if ( lua_isnil( L, -1 ) )
+        msg = "undefined: ";
+      else if ( LUA_ISATABLE( L, -1 ) )
+        msg = "can't call table";
+      else
+        msg = "not table/func: ";
+      if ( !LUA_ISATABLE( L, -1 ) )
+      {
+        lua_rawgeti( L, path, bad_key ? bad_key : ( int )lua_objlen( L, path ) );
+        token = lua_isstring( L, -1 ) ? lua_tostring( L, -1 ) : "";
+      }
+    }
+    msg = lua_pushfstring( L, "%s%s", msg, token );
+    errlen = strlen( msg );
     transport_write_u8( tpt, 1 );
     transport_write_u32( tpt, LUA_ERRRUN );
-    transport_write_u32( tpt, errlen );
-    transport_write_string( tpt, msg, ( int )strlen( msg ) );
-    transport_write_string( tpt, token, strlen( token ) );
+    transport_write_u32( tpt, ( u32 )errlen );
+    transport_write_string( tpt, msg, ( int )errlen );
   }
   // empty the stack
   lua_settop ( L, 0 );
@@ -1325,7 +2175,7 @@ static void read_cmd_get( Transport *tpt, lua_State *L )
   char *token = NULL;
 
   // read function name
-  len = transport_read_u32( tpt ); // function name string length
+  len = transport_read_name_len( tpt ); // function name string length
   funcname = ( char * )alloca( len + 1 );
   transport_read_string( tpt, funcname, len );
   funcname[ len ] = 0;
@@ -1358,7 +2208,7 @@ static void read_cmd_newindex( Transport *tpt, lua_State *L )
   char *token = NULL;
 
   // read function name
-  len = transport_read_u32( tpt ); // function name string length
+  len = transport_read_name_len( tpt ); // function name string length
   funcname = ( char * )alloca( len + 1 );
   transport_read_string( tpt, funcname, len );
   funcname[ len ] = 0;
@@ -1422,7 +2272,7 @@ static ServerHandle *rpc_listen_helper( lua_State *L )
   Catch( e )
   {
     if( handle )
-      server_handle_destroy( handle );
+      server_handle_destroy( L, handle );
 
     deal_with_error( L, 0, errorString( e.errnum ) );
     return 0;
@@ -1445,10 +2295,53 @@ static int rpc_listen( lua_State *L )
 }
 
 
+// index of a free client slot of the server, or -1 if it is full
+static int server_free_client( ServerHandle *handle )
+{
+  int i;
+
+  for( i = 0; i < RPC_MAX_CLIENTS; i ++ )
+    if( !transport_is_open( &handle->atpt[ i ] ) )
+      return i;
+  return -1;
+}
+
+// index of the next client with a request waiting (clients are served in
+// turn), or -1 if there is none. a single client is served as soon as it is
+// connected (its request is waited for while reading it).
+static int server_ready_client( ServerHandle *handle )
+{
+  int i, n;
+
+  for( n = 0; n < RPC_MAX_CLIENTS; n ++ )
+  {
+    i = ( handle->next + n ) % RPC_MAX_CLIENTS;
+    if( transport_is_open( &handle->atpt[ i ] ) &&
+        ( RPC_MAX_CLIENTS == 1 || transport_readable( &handle->atpt[ i ] ) ) )
+    {
+      handle->next = ( i + 1 ) % RPC_MAX_CLIENTS;
+      return i;
+    }
+  }
+  return -1;
+}
+
+// check if a request or a new connection is waiting
+static int server_readable( ServerHandle *handle )
+{
+  int i;
+
+  for( i = 0; i < RPC_MAX_CLIENTS; i ++ )
+    if( transport_is_open( &handle->atpt[ i ] ) && transport_readable( &handle->atpt[ i ] ) )
+      return 1;
+  return server_free_client( handle ) >= 0 && transport_readable( &handle->ltpt );
+}
+
 // rpc_peek( server_handle ) --> 0 or 1
 static int rpc_peek( lua_State *L )
 {
   ServerHandle *handle;
+  int i, open;
 
   check_num_args( L, 1 );
   if ( !( lua_isuserdata( L, 1 ) && ismetatable_type( L, 1, "rpc.server_handle" ) ) )
@@ -1456,10 +2349,14 @@ static int rpc_peek( lua_State *L )
 
   handle = ( ServerHandle * )lua_touserdata( L, 1 );
 
-  // if accepting transport is open, see if there is any data to read
-  if ( transport_is_open( &handle->atpt ) )
+  // see if there is any data to read on the accepting transports, or a new
+  // connection on the listening transport
+  open = transport_is_open( &handle->ltpt );
+  for( i = 0; i < RPC_MAX_CLIENTS; i ++ )
+    open = open || transport_is_open( &handle->atpt[ i ] );
+  if ( open )
   {
-    if ( transport_readable( &handle->atpt ) )
+    if ( server_readable( handle ) )
       lua_pushnumber( L, 1 );
     else
       lua_pushnil( L );
@@ -1467,96 +2364,118 @@ static int rpc_peek( lua_State *L )
     return 1;
   }
 
-  // otherwise, see if there is a new connection on the listening transport
-  if ( transport_is_open( &handle->ltpt ) )
-  {
-    if ( transport_readable( &handle->ltpt ) )
-      lua_pushnumber ( L, 1 );
-    else
-      lua_pushnil( L );
-
-    return 1;
-  }
-
   lua_pushnumber( L, 0 );
   return 1;
 }
 
 
-static void rpc_dispatch_helper( lua_State *L, ServerHandle *handle )
+// read and execute one command from the accepting transport 'i'
+static void server_serve_client( lua_State *L, ServerHandle *handle, int i )
 {
   struct exception e;
+  Transport *tpt = &handle->atpt[ i ];
 
   Try
   {
-    // if accepting transport is open, read function calls
-    if ( transport_is_open( &handle->atpt ) )
+    switch ( transport_read_command( tpt ) )
     {
-      Try
-      {
-        switch ( transport_read_u8( &handle->atpt ) )
-        {
-          case RPC_CMD_CALL:  // call function
-            transport_write_u8( &handle->atpt, RPC_READY );
-            read_cmd_call( &handle->atpt, L );
-            break;
-          case RPC_CMD_GET: // get server-side variable for client
-            transport_write_u8( &handle->atpt, RPC_READY );
-            read_cmd_get( &handle->atpt, L );
-            break;
-          case RPC_CMD_CON: //  allow client to renegotiate active connection
-            server_negotiate( &handle->atpt );
-            break;
-          case RPC_CMD_NEWINDEX: // assign new variable on server
-            transport_write_u8( &handle->atpt, RPC_READY );
-            read_cmd_newindex( &handle->atpt, L );
-            break;
-          default: // complain and throw exception if unknown command
-            transport_write_u8(&handle->atpt, RPC_UNSUPPORTED_CMD );
-            e.type = nonfatal;
-            e.errnum = ERR_COMMAND;
-            Throw( e );
-        }
+      case RPC_CMD_CALL:  // call function
+        read_cmd_call( tpt, L, 0 );
+        break;
+      case RPC_CMD_CALLID:  // call function by id
+        read_cmd_call( tpt, L, 1 );
+        break;
+      case RPC_CMD_GET: // get server-side variable for client
+        read_cmd_get( tpt, L );
+        break;
+      case RPC_CMD_CON: //  allow client to renegotiate active connection
+        functions_release( L, tpt );
+        server_negotiate( tpt );
+        break;
+      case RPC_CMD_NEWINDEX: // assign new variable on server
+        read_cmd_newindex( tpt, L );
+        break;
+      default: // complain and throw exception if unknown command
+        transport_write_u8( tpt, RPC_UNSUPPORTED_CMD );
+        transport_flush( tpt );
+        e.type = nonfatal;
+        e.errnum = ERR_COMMAND;
+        Throw( e );
+    }
 
-        handle->link_errs = 0;
-      }
-      Catch( e )
-      {
-        switch( e.type )
+    // send the reply
+    transport_flush( tpt );
+    handle->link_errs[ i ] = 0;
+  }
+  Catch( e )
+  {
+    frame_reset( tpt );
+    lua_settop( L, 0 );
+    switch( e.type )
+    {
+      case fatal: // shutdown will initiate after throw
+        Throw( e );
+
+      case nonfatal:
+        handle->link_errs[ i ]++;
+        if ( handle->link_errs[ i ] > MAX_LINK_ERRS || e.errnum == ERR_EOF )
         {
-          case fatal: // shutdown will initiate after throw
-            Throw( e );
-
-          case nonfatal:
-            handle->link_errs++;
-            if ( handle->link_errs > MAX_LINK_ERRS )
-            {
-              handle->link_errs = 0;
-              Throw( e ); // remote connection will be closed
-            }
-            break;
-
-          default:
-            Throw( e );
+          handle->link_errs[ i ] = 0;
+          Throw( e ); // remote connection will be closed
         }
-      }
+        break;
+
+      default:
+        Throw( e );
     }
+  }
+}
+
+
+// accept a new connection from the listening transport on the accepting
+// transport 'i'
+static void server_accept_client( lua_State *L, ServerHandle *handle, int i )
+{
+  struct exception e;
+
+  transport_accept( &handle->ltpt, &handle->atpt[ i ] );
+  handle->link_errs[ i ] = 0;
+  functions_release( L, &handle->atpt[ i ] );
+
+  switch ( transport_read_command( &handle->atpt[ i ] ) )
+  {
+    case RPC_CMD_CON:
+      server_negotiate( &handle->atpt[ i ] );
+      break;
+    default: // connection must be established to issue any other commands
+      e.type = nonfatal;
+      e.errnum = ERR_COMMAND;
+      Throw( e ); // remote connection will be closed
+  }
+}
+
+
+static void rpc_dispatch_helper( lua_State *L, ServerHandle *handle )
+{
+  struct exception e;
+  volatile int client = -1;
+
+  Try
+  {
+#if RPC_MAX_CLIENTS > 1
+    transport_wait( handle, server_free_client( handle ) >= 0 );
+#endif
+    // serve the next client with a request waiting
+    client = server_ready_client( handle );
+    if ( client >= 0 )
+      server_serve_client( L, handle, client );
     else
     {
-      // if accepting transport is not open, accept a new connection from the
-      // listening transport
-      transport_accept( &handle->ltpt, &handle->atpt );
-
-      switch ( transport_read_u8( &handle->atpt ) )
-      {
-        case RPC_CMD_CON:
-          server_negotiate( &handle->atpt );
-          break;
-        default: // connection must be established to issue any other commands
-          e.type = nonfatal;
-          e.errnum = ERR_COMMAND;
-          Throw( e ); // remote connection will be closed
-      }
+      // otherwise accept a new connection (waiting for it if there are no
+      // other clients)
+      client = server_free_client( handle );
+      if ( client >= 0 && ( RPC_MAX_CLIENTS == 1 || transport_readable( &handle->ltpt ) ) )
+        server_accept_client( L, handle, client );
     }
   }
   Catch( e )
@@ -1564,12 +2483,13 @@ static void rpc_dispatch_helper( lua_State *L, ServerHandle *handle )
     switch( e.type )
     {
       case fatal:
-        server_handle_shutdown( handle );
+        server_handle_shutdown( L, handle );
         deal_with_error( L, 0, errorString( e.errnum ) );
         break;
 
       case nonfatal:
-        transport_close( &handle->atpt );
+        if ( client >= 0 )
+          transport_close( &handle->atpt[ client ] );
         break;
 
       default:
@@ -1598,7 +2518,7 @@ static int rpc_adispatch_helper( lua_State *L, ServerHandle * handle )
 {
   // Check if we have waiting data that we can dispatch on,
   // don't block if we don't have any data
-  if( transport_readable( &handle->atpt ) || transport_readable( &handle->ltpt ) )
+  if( server_readable( handle ) )
       rpc_dispatch_helper( L, handle );
 
   return 0;
@@ -1639,7 +2559,7 @@ static int rpc_server( lua_State *L )
     rpc_dispatch_helper( L, handle );
 
   luaL_unref( L, LUA_REGISTRYINDEX, shref );
-  server_handle_destroy( handle );
+  server_handle_destroy( L, handle );
   return 0;
 }
 
@@ -1682,6 +2602,7 @@ const LUA_REG_TYPE rpc_handle[] =
 {
   { LSTRKEY( "__index" ), LFUNCVAL( handle_index ) },
   { LSTRKEY( "__newindex"), LFUNCVAL( handle_newindex )},
+  { LSTRKEY( "__gc" ), LFUNCVAL( handle_close ) },
   { LNILKEY, LNILVAL }
 };
 
@@ -1709,7 +2630,8 @@ const LUA_REG_TYPE rpc_map[] =
   {  LSTRKEY( "peek" ), LFUNCVAL( rpc_peek ) },
   {  LSTRKEY( "dispatch" ), LFUNCVAL( rpc_dispatch ) },
   {  LSTRKEY( "adispatch" ), LFUNCVAL( rpc_adispatch ) },
-//  {  LSTRKEY( "rpc_async" ), LFUNCVAL( rpc_async ) },
+  {  LSTRKEY( "async" ), LFUNCVAL( rpc_async ) },
+  {  LSTRKEY( "wait" ), LFUNCVAL( rpc_wait ) },
 #if LUA_OPTIMIZE_MEMORY > 0
 // {  LSTRKEY("mode"), LSTRVAL( LUARPC_MODE ) },
 #endif // #if LUA_OPTIMIZE_MEMORY > 0
@@ -1745,6 +2667,7 @@ static const luaL_reg rpc_handle[] =
 {
   { "__index", handle_index },
   { "__newindex", handle_newindex },
+  { "__gc", handle_close },
   { NULL, NULL }
 };
 
@@ -1772,7 +2695,8 @@ static const luaL_reg rpc_map[] =
   { "peek", rpc_peek },
   { "dispatch", rpc_dispatch },
   { "adispatch", rpc_adispatch },
-//  { "rpc_async", rpc_async },
+  { "async", rpc_async },
+  { "wait", rpc_wait },
   { NULL, NULL }
 };
 
@@ -0,0 +1,432 @@
+// Module for cooperative scheduling of coroutines
+// Tasks (coroutines) block on events instead of polling them from Lua: timer
+// deadlines, UART buffer thresholds, ADC samples, pending network connections
+// and eLua interrupts. The run loop checks the wait conditions in C and only
+// resumes the tasks that became ready, so no Lua code runs while all the
+// tasks are waiting.
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "platform.h"
+#include "platform_conf.h"
+#include "auxmods.h"
+#include "lrotable.h"
+#include "buf.h"
+#include "sched.h"
+#include <string.h>
+#ifdef BUILD_ADC
+#include "elua_adc.h"
+#endif
+#ifdef BUILD_UIP
+#include "elua_net.h"
+#endif
+
+#ifndef SCHED_MAX_TASKS
+#define SCHED_MAX_TASKS         16
+#endif
+
+#define SCHED_NO_TASK           ( -1 )
+
+// What a task is waiting for
+enum
+{
+  SCHED_WAIT_NONE,              // ready to run
+  SCHED_WAIT_TIMER,             // only the timeout
+  SCHED_WAIT_UART,              // 'count' bytes in the buffer of UART 'resnum'
+  SCHED_WAIT_ADC,               // 'count' samples from ADC channel 'resnum'
+  SCHED_WAIT_ACCEPT,            // a connection request on port 'resnum'
+  SCHED_WAIT_INT                // interrupt 'id' (for 'resnum' if 'anyres' is 0)
+};
+
+typedef struct
+{
+  lua_State *co;                // the coroutine (NULL for a free slot)
+  int ref;                      // registry reference that keeps 'co' alive
+  int nargs;                    // arguments for the first resume, -1 after
+  u8 wait;                      // SCHED_WAIT_xxx
+  u8 timed;                     // 1 if 'timeout' is valid
+  u8 id, anyres;                // interrupt waits
+  u16 resnum;
+  u32 count;                    // bytes/samples, or first interrupt event to check
+  timer_data_type start, timeout;
+} sched_task;
+
+static sched_task sched_tasks[ SCHED_MAX_TASKS ];
+static unsigned sched_ntasks;
+static int sched_current = SCHED_NO_TASK;
+static u8 sched_running, sched_stop_req;
+
+// Return values of the condition check
+#define SCHED_NOT_READY         ( -1 )
+#define SCHED_TIMED_OUT         ( -2 )
+
+// ****************************************************************************
+// Interrupt events (written by the common interrupt handler)
+
+#ifdef BUILD_INT_HANDLERS
+
+#define SCHED_INT_LOG_EVENTS    3
+#define SCHED_INT_EVENTS        ( 1 << SCHED_INT_LOG_EVENTS )
+
+static struct
+{
+  elua_int_id id;
+  elua_int_resnum resnum;
+} sched_int_events[ SCHED_INT_EVENTS ];
+static volatile u32 sched_int_seq;
+static unsigned sched_int_waiters;
+
+void sched_int_notify( elua_int_id id, elua_int_resnum resnum )
+{
+  if( sched_int_waiters == 0 )
+    return;
+  sched_int_events[ sched_int_seq & ( SCHED_INT_EVENTS - 1 ) ].id = id;
+  sched_int_events[ sched_int_seq & ( SCHED_INT_EVENTS - 1 ) ].resnum = resnum;
+  sched_int_seq ++;
+}
+
+// Look for an event that matches the task in the events that happened since
+// the last check. Only the last SCHED_INT_EVENTS events are remembered.
+static int sched_check_int( sched_task *t )
+{
+  u32 seq, first;
+  int old_status, res = SCHED_NOT_READY;
+
+  old_status = platform_cpu_set_global_interrupts( PLATFORM_CPU_DISABLE );
+  seq = sched_int_seq;
+  first = seq - t->count > SCHED_INT_EVENTS ? seq - SCHED_INT_EVENTS : t->count;
+  for( ; first != seq; first ++ )
+    if( sched_int_events[ first & ( SCHED_INT_EVENTS - 1 ) ].id == t->id &&
+        ( t->anyres || sched_int_events[ first & ( SCHED_INT_EVENTS - 1 ) ].resnum == t->resnum ) )
+    {
+      res = sched_int_events[ first & ( SCHED_INT_EVENTS - 1 ) ].resnum;
+      first ++;
+      break;
+    }
+  t->count = first;
+  platform_cpu_set_global_interrupts( old_status );
+  return res;
+}
+
+#endif // #ifdef BUILD_INT_HANDLERS
+
+// ****************************************************************************
+// Helpers
+
+static timer_data_type sched_now()
+{
+  return platform_timer_sys_available() ? platform_timer_read_sys() : 0;
+}
+
+// Return the value the task must be resumed with if it is ready, or
+// SCHED_NOT_READY/SCHED_TIMED_OUT
+static int sched_check( sched_task *t, timer_data_type now )
+{
+  int res = SCHED_NOT_READY;
+
+  switch( t->wait )
+  {
+    case SCHED_WAIT_NONE:
+      return 1;
+
+#ifdef BUF_ENABLE_UART
+    case SCHED_WAIT_UART:
+      if( buf_get_count( BUF_ID_UART, t->resnum ) >= t->count )
+        res = 1;
+      break;
+#endif
+
+#ifdef BUILD_ADC
+    case SCHED_WAIT_ADC:
+      if( adc_samples_available( t->resnum ) >= t->count )
+        res = 1;
+      break;
+#endif
+
+#ifdef BUILD_UIP
+    case SCHED_WAIT_ACCEPT:
+      if( elua_net_accept_ready( t->resnum ) )
+        res = 1;
+      break;
+#endif
+
+#ifdef BUILD_INT_HANDLERS
+    case SCHED_WAIT_INT:
+      res = sched_check_int( t );
+      break;
+#endif
+  }
+  if( res == SCHED_NOT_READY && t->timed && platform_timer_get_diff_us( PLATFORM_TIMER_SYS_ID, t->start, now ) >= t->timeout )
+    res = t->wait == SCHED_WAIT_TIMER ? 1 : SCHED_TIMED_OUT;
+  return res;
+}
+
+static void sched_remove( lua_State *L, unsigned id )
+{
+  sched_task *t = sched_tasks + id;
+
+#ifdef BUILD_INT_HANDLERS
+  if( t->wait == SCHED_WAIT_INT )
+    sched_int_waiters --;
+#endif
+  luaL_unref( L, LUA_REGISTRYINDEX, t->ref );
+  t->co = NULL;
+  sched_ntasks --;
+}
+
+// Resume a task with the result of its wait
+// Returns 1 (with the error message on the stack of L) if the task failed
+static int sched_resume( lua_State *L, unsigned id, int res )
+{
+  sched_task *t = sched_tasks + id;
+  int nargs, status;
+
+  if( t->nargs >= 0 )
+  {
+    nargs = t->nargs;
+    t->nargs = -1;
+  }
+  else
+  {
+    nargs = 1;
+    if( res == SCHED_TIMED_OUT )
+      lua_pushboolean( t->co, 0 );
+    else if( t->wait == SCHED_WAIT_INT )
+      lua_pushinteger( t->co, res );
+    else
+      lua_pushboolean( t->co, 1 );
+  }
+#ifdef BUILD_INT_HANDLERS
+  if( t->wait == SCHED_WAIT_INT )
+    sched_int_waiters --;
+#endif
+  t->wait = SCHED_WAIT_NONE;
+  t->timed = 0;
+  sched_current = id;
+  status = lua_resume( t->co, nargs );
+  sched_current = SCHED_NO_TASK;
+  if( status == LUA_YIELD )
+  {
+    lua_settop( t->co, 0 );
+    return 0;
+  }
+  if( status != 0 )
+    lua_xmove( t->co, L, 1 );
+  sched_remove( L, id );
+  return status != 0;
+}
+
+// Return the task that called a wait function
+static sched_task* sched_get_current( lua_State *L )
+{
+  if( sched_current == SCHED_NO_TASK || sched_tasks[ sched_current ].co != L )
+    luaL_error( L, "not called from a scheduled task" );
+  return sched_tasks + sched_current;
+}
+
+// Put the calling task to sleep until its wait condition is met
+// The optional timeout (in microseconds) is at stack index 'toidx'
+static int sched_wait( lua_State *L, sched_task *t, int wait, int toidx )
+{
+  if( !lua_isnoneornil( L, toidx ) )
+  {
+    if( !platform_timer_sys_available() )
+      return luaL_error( L, "timeouts need the system timer" );
+    t->timeout = ( timer_data_type )luaL_checknumber( L, toidx );
+    t->start = platform_timer_read_sys();
+    t->timed = 1;
+  }
+  t->wait = wait;
+#ifdef BUILD_INT_HANDLERS
+  if( wait == SCHED_WAIT_INT )
+    sched_int_waiters ++;
+#endif
+  return lua_yield( L, 0 );
+}
+
+// ****************************************************************************
+// Lua interface
+
+// Lua: id = spawn( f, [ arg1, arg2, ... ] )
+static int sched_spawn( lua_State *L )
+{
+  unsigned id;
+  sched_task *t;
+  lua_State *co;
+  int n = lua_gettop( L );
+
+  luaL_checktype( L, 1, LUA_TFUNCTION );
+  for( id = 0; id < SCHED_MAX_TASKS && sched_tasks[ id ].co != NULL; id ++ );
+  if( id == SCHED_MAX_TASKS )
+    return luaL_error( L, "too many tasks" );
+  t = sched_tasks + id;
+  co = lua_newthread( L );
+  lua_insert( L, 1 );
+  lua_xmove( L, co, n );
+  memset( t, 0, sizeof( *t ) );
+  t->co = co;
+  t->nargs = n - 1;
+  t->ref = luaL_ref( L, LUA_REGISTRYINDEX );
+  sched_ntasks ++;
+  lua_pushinteger( L, id );
+  return 1;
+}
+
+// Lua: run()
+// Runs the tasks until all of them finish or stop() is called
+static int sched_run( lua_State *L )
+{
+  unsigned id;
+  int res;
+  timer_data_type now;
+
+  if( sched_running )
+    return luaL_error( L, "the scheduler is already running" );
+  sched_running = 1;
+  sched_stop_req = 0;
+  while( sched_ntasks > 0 && !sched_stop_req )
+  {
+    now = sched_now();
+    for( id = 0; id < SCHED_MAX_TASKS && !sched_stop_req; id ++ )
+      if( sched_tasks[ id ].co != NULL && ( res = sched_check( sched_tasks + id, now ) ) != SCHED_NOT_READY )
+        if( sched_resume( L, id, res ) )
+        {
+          sched_running = 0;
+          return luaL_error( L, "task %d: %s", id, lua_tostring( L, -1 ) );
+        }
+  }
+  sched_running = 0;
+  return 0;
+}
+
+// Lua: stop()
+// Makes run() return after the current task yields
+static int sched_stop( lua_State *L )
+{
+  sched_stop_req = 1;
+  return 0;
+}
+
+// Lua: yield()
+static int sched_yield( lua_State *L )
+{
+  sched_get_current( L );
+  return lua_yield( L, 0 );
+}
+
+// Lua: sleep( us )
+static int sched_sleep( lua_State *L )
+{
+  luaL_checknumber( L, 1 );
+  return sched_wait( L, sched_get_current( L ), SCHED_WAIT_TIMER, 1 );
+}
+
+// Lua: ok = wait_uart( id, count, [ timeout ] )
+static int sched_wait_uart( lua_State *L )
+{
+#ifdef BUF_ENABLE_UART
+  sched_task *t = sched_get_current( L );
+  unsigned id = luaL_checkinteger( L, 1 );
+
+  MOD_CHECK_ID( uart, id );
+  if( !buf_is_enabled( BUF_ID_UART, id ) )
+    return luaL_error( L, "uart %d is not buffered", id );
+  t->resnum = id;
+  t->count = luaL_checkinteger( L, 2 );
+  return sched_wait( L, t, SCHED_WAIT_UART, 3 );
+#else // #ifdef BUF_ENABLE_UART
+  return luaL_error( L, "UART buffering not enabled" );
+#endif // #ifdef BUF_ENABLE_UART
+}
+
+// Lua: ok = wait_adc( id, count, [ timeout ] )
+static int sched_wait_adc( lua_State *L )
+{
+#ifdef BUILD_ADC
+  sched_task *t = sched_get_current( L );
+  unsigned id = luaL_checkinteger( L, 1 );
+
+  MOD_CHECK_ID( adc, id );
+  t->resnum = id;
+  t->count = luaL_checkinteger( L, 2 );
+  return sched_wait( L, t, SCHED_WAIT_ADC, 3 );
+#else // #ifdef BUILD_ADC
+  return luaL_error( L, "ADC support not enabled" );
+#endif // #ifdef BUILD_ADC
+}
+
+// Lua: ok = wait_accept( port, [ timeout ] )
+static int sched_wait_accept( lua_State *L )
+{
+#ifdef BUILD_UIP
+  sched_task *t = sched_get_current( L );
+
+  t->resnum = luaL_checkinteger( L, 1 );
+  return sched_wait( L, t, SCHED_WAIT_ACCEPT, 2 );
+#else // #ifdef BUILD_UIP
+  return luaL_error( L, "networking not enabled" );
+#endif // #ifdef BUILD_UIP
+}
+
+// Lua: resnum = wait_int( inttype, [ resnum ], [ timeout ] )
+// Returns the resource number of the interrupt or false on timeout
+static int sched_wait_int( lua_State *L )
+{
+#ifdef BUILD_INT_HANDLERS
+  sched_task *t = sched_get_current( L );
+  unsigned id = luaL_checkinteger( L, 1 );
+
+  if( id < ELUA_INT_FIRST_ID || id > INT_ELUA_LAST )
+    return luaL_error( L, "invalid interrupt type" );
+  t->id = id;
+  t->anyres = lua_isnoneornil( L, 2 );
+  t->resnum = luaL_optinteger( L, 2, 0 );
+  t->count = sched_int_seq;
+  return sched_wait( L, t, SCHED_WAIT_INT, 3 );
+#else // #ifdef BUILD_INT_HANDLERS
+  return luaL_error( L, "interrupt support not enabled" );
+#endif // #ifdef BUILD_INT_HANDLERS
+}
+
+// Lua: n = count()
+static int sched_count( lua_State *L )
+{
+  lua_pushinteger( L, sched_ntasks );
+  return 1;
+}
+
+// Module function map
+#define MIN_OPT_LEVEL 2
+#include "lrodefs.h"
+const LUA_REG_TYPE sched_map[] =
+{
+  { LSTRKEY( "spawn" ), LFUNCVAL( sched_spawn ) },
+  { LSTRKEY( "run" ), LFUNCVAL( sched_run ) },
+  { LSTRKEY( "stop" ), LFUNCVAL( sched_stop ) },
+  { LSTRKEY( "yield" ), LFUNCVAL( sched_yield ) },
+  { LSTRKEY( "sleep" ), LFUNCVAL( sched_sleep ) },
+  { LSTRKEY( "wait_uart" ), LFUNCVAL( sched_wait_uart ) },
+  { LSTRKEY( "wait_adc" ), LFUNCVAL( sched_wait_adc ) },
+  { LSTRKEY( "wait_accept" ), LFUNCVAL( sched_wait_accept ) },
+  { LSTRKEY( "wait_int" ), LFUNCVAL( sched_wait_int ) },
+  { LSTRKEY( "count" ), LFUNCVAL( sched_count ) },
+  { LNILKEY, LNILVAL }
+};
+
+LUALIB_API int luaopen_sched( lua_State *L )
+{
+  // Tasks from a previous Lua state are gone
+  memset( sched_tasks, 0, sizeof( sched_tasks ) );
+  sched_ntasks = 0;
+  sched_current = SCHED_NO_TASK;
+  sched_running = 0;
+#ifdef BUILD_INT_HANDLERS
+  sched_int_waiters = 0;
+#endif
+#if LUA_OPTIMIZE_MEMORY > 0
+  return 0;
+#else // #if LUA_OPTIMIZE_MEMORY > 0
+  luaL_register( L, AUXLIB_SCHED, sched_map );
+  return 1;
+#endif // #if LUA_OPTIMIZE_MEMORY > 0
+}
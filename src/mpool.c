@@ -0,0 +1,260 @@
+// Size-class slab pools for small, fixed size Lua objects
+// Most of the objects allocated by the Lua VM (strings, upvalues, closures,
+// small tables and hash parts) are small and come in a handful of sizes.
+// Serving them from slabs removes the per-block header and the fragmentation
+// of the general purpose allocator. Lua always passes the size of the block
+// being freed, so the size class is known without a per-object header.
+
+#include "platform_conf.h"
+
+#ifdef BUILD_MEMPOOL
+
+#include "mpool.h"
+#include "type.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The blocks that are too large for the pools keep the placement policy of
+// the region aware heap
+#ifdef BUILD_HEAP_REGIONS
+#include "heapreg.h"
+#define mpool_sys_realloc( p, s )   heapreg_realloc_hint( p, s, heapreg_hint( s ) )
+#else
+#define mpool_sys_realloc( p, s )   realloc( p, s )
+#endif
+
+// Slab header, placed at the beginning of each slab
+typedef struct mpool_slab
+{
+  struct mpool_slab *next, *prev; // list of slabs of the same class with free objects
+  void *free;                     // free objects in this slab
+  u16 nfree;                      // number of free objects
+  u16 unused;                     // index of the first object never allocated
+  u8 cls;                         // size class of this slab
+} mpool_slab;
+
+#define MPOOL_HDR_SIZE          ( ( sizeof( mpool_slab ) + MPOOL_GRANULE - 1 ) & ~( MPOOL_GRANULE - 1 ) )
+#define MPOOL_OBJ_SIZE( cls )   ( ( ( cls ) + 1 ) << MPOOL_GRANULE_SHIFT )
+#define MPOOL_PER_SLAB( cls )   ( ( MEMPOOL_SLAB_SIZE - MPOOL_HDR_SIZE ) / MPOOL_OBJ_SIZE( cls ) )
+#define MPOOL_SLABS_INC         16
+
+// Size class data
+typedef struct
+{
+  mpool_slab *partial;          // slabs with at least one free object
+  mpool_slab *spare;            // a completely free slab kept to avoid thrashing
+  u32 slabs, inuse, peak, allocs;
+} mpool_class_data;
+
+static mpool_class_data mpool_classes[ MPOOL_NUM_CLASSES ];
+// All slabs sorted by address (used to find the slab of an object)
+static mpool_slab **mpool_slabs;
+static unsigned mpool_nslabs, mpool_maxslabs;
+
+// ****************************************************************************
+// Slab management
+
+// Return the index of the slab that contains 'ptr', or -1 if not found
+static int mpool_find_slab( const void *ptr )
+{
+  int lo = 0, hi = ( int )mpool_nslabs - 1, mid;
+  const char *p = ( const char* )ptr;
+
+  while( lo <= hi )
+  {
+    mid = ( lo + hi ) >> 1;
+    if( p < ( const char* )mpool_slabs[ mid ] )
+      hi = mid - 1;
+    else if( p >= ( const char* )mpool_slabs[ mid ] + MEMPOOL_SLAB_SIZE )
+      lo = mid + 1;
+    else
+      return mid;
+  }
+  return -1;
+}
+
+static void mpool_link( mpool_slab **head, mpool_slab *s )
+{
+  s->prev = NULL;
+  if( ( s->next = *head ) != NULL )
+    s->next->prev = s;
+  *head = s;
+}
+
+static void mpool_unlink( mpool_slab **head, mpool_slab *s )
+{
+  if( s->prev )
+    s->prev->next = s->next;
+  else
+    *head = s->next;
+  if( s->next )
+    s->next->prev = s->prev;
+}
+
+// Allocate a new slab for the given class and insert it in the slab index
+static mpool_slab* mpool_new_slab( unsigned cls )
+{
+  mpool_slab *s, **newslabs;
+  unsigned i;
+
+  if( mpool_nslabs == mpool_maxslabs )
+  {
+    if( ( newslabs = ( mpool_slab** )realloc( mpool_slabs, ( mpool_maxslabs + MPOOL_SLABS_INC ) * sizeof( mpool_slab* ) ) ) == NULL )
+      return NULL;
+    mpool_slabs = newslabs;
+    mpool_maxslabs += MPOOL_SLABS_INC;
+  }
+  if( ( s = ( mpool_slab* )malloc( MEMPOOL_SLAB_SIZE ) ) == NULL )
+    return NULL;
+  for( i = mpool_nslabs; i > 0 && mpool_slabs[ i - 1 ] > s; i -- )
+    mpool_slabs[ i ] = mpool_slabs[ i - 1 ];
+  mpool_slabs[ i ] = s;
+  mpool_nslabs ++;
+  s->free = NULL;
+  s->nfree = MPOOL_PER_SLAB( cls );
+  s->unused = 0;
+  s->cls = cls;
+  mpool_classes[ cls ].slabs ++;
+  return s;
+}
+
+// Return a free slab to the system allocator
+static void mpool_release_slab( mpool_slab *s )
+{
+  int idx = mpool_find_slab( s );
+
+  memmove( mpool_slabs + idx, mpool_slabs + idx + 1, ( mpool_nslabs - idx - 1 ) * sizeof( mpool_slab* ) );
+  mpool_nslabs --;
+  mpool_classes[ s->cls ].slabs --;
+  free( s );
+}
+
+// ****************************************************************************
+// Public interface
+
+// Allocate an object of 'size' bytes from its pool
+// Returns NULL if the size is not pooled or if a new slab can't be allocated
+void* mpool_alloc( size_t size )
+{
+  unsigned cls;
+  mpool_class_data *pc;
+  mpool_slab *s;
+  void *ptr;
+
+  if( !mpool_pooled( size ) )
+    return NULL;
+  pc = mpool_classes + ( cls = mpool_class( size ) );
+  if( ( s = pc->partial ) == NULL )
+  {
+    if( ( s = pc->spare ) != NULL )
+      pc->spare = NULL;
+    else if( ( s = mpool_new_slab( cls ) ) == NULL )
+      return NULL;
+    mpool_link( &pc->partial, s );
+  }
+  if( ( ptr = s->free ) != NULL )
+    s->free = *( void** )ptr;
+  else
+    ptr = ( char* )s + MPOOL_HDR_SIZE + s->unused ++ * MPOOL_OBJ_SIZE( cls );
+  if( -- s->nfree == 0 )
+    mpool_unlink( &pc->partial, s );
+  pc->allocs ++;
+  if( ++ pc->inuse > pc->peak )
+    pc->peak = pc->inuse;
+  return ptr;
+}
+
+// Return an object of 'size' bytes to its pool
+// Returns 0 if 'ptr' doesn't belong to a pool (and must be freed by the caller)
+int mpool_free( void *ptr, size_t size )
+{
+  int idx;
+  mpool_slab *s;
+  mpool_class_data *pc;
+
+  if( ptr == NULL || !mpool_pooled( size ) || ( idx = mpool_find_slab( ptr ) ) == -1 )
+    return 0;
+  s = mpool_slabs[ idx ];
+  pc = mpool_classes + s->cls;
+  *( void** )ptr = s->free;
+  s->free = ptr;
+  pc->inuse --;
+  if( s->nfree ++ == 0 )
+    mpool_link( &pc->partial, s );
+  if( s->nfree == MPOOL_PER_SLAB( s->cls ) )
+  {
+    mpool_unlink( &pc->partial, s );
+    if( pc->spare == NULL )
+    {
+      s->free = NULL;
+      s->unused = 0;
+      pc->spare = s;
+    }
+    else
+      mpool_release_slab( s );
+  }
+  return 1;
+}
+
+// realloc() replacement for the Lua allocator
+// Blocks move between the pools and the system allocator as their size changes.
+// A pooled size goes to the system allocator when its pool can't grow, and a
+// block that can't move to a smaller size stays where it is (Lua expects a
+// shrink to succeed, the collector shrinks strings and tables).
+void* mpool_realloc( void *ptr, size_t osize, size_t nsize )
+{
+  void *nptr;
+
+  if( ptr == NULL )
+    osize = 0;
+  if( nsize == 0 )
+  {
+    if( !mpool_free( ptr, osize ) )
+      free( ptr );
+    return NULL;
+  }
+  if( !mpool_pooled( osize ) && !mpool_pooled( nsize ) )
+    return mpool_sys_realloc( ptr, nsize );
+  if( ptr != NULL && mpool_pooled( osize ) && mpool_class( osize ) == mpool_class( nsize ) && mpool_find_slab( ptr ) != -1 )
+    return ptr;
+  if( ( nptr = mpool_alloc( nsize ) ) == NULL && ( nptr = mpool_sys_realloc( NULL, nsize ) ) == NULL )
+    return nsize <= osize ? ptr : NULL;
+  if( ptr != NULL )
+  {
+    memcpy( nptr, ptr, osize < nsize ? osize : nsize );
+    if( !mpool_free( ptr, osize ) )
+      free( ptr );
+  }
+  return nptr;
+}
+
+// Give the spare slabs back to the system allocator
+void mpool_trim()
+{
+  unsigned i;
+
+  for( i = 0; i < MPOOL_NUM_CLASSES; i ++ )
+    if( mpool_classes[ i ].spare )
+    {
+      mpool_release_slab( mpool_classes[ i ].spare );
+      mpool_classes[ i ].spare = NULL;
+    }
+}
+
+// Get statistics for a size class, returns 0 if the class is invalid
+int mpool_get_stats( unsigned cls, mpool_stats *pstats )
+{
+  mpool_class_data *pc = mpool_classes + cls;
+
+  if( cls >= MPOOL_NUM_CLASSES )
+    return 0;
+  pstats->objsize = MPOOL_OBJ_SIZE( cls );
+  pstats->perslab = MPOOL_PER_SLAB( cls );
+  pstats->slabs = pc->slabs;
+  pstats->inuse = pc->inuse;
+  pstats->peak = pc->peak;
+  pstats->allocs = pc->allocs;
+  return 1;
+}
+
+#endif // #ifdef BUILD_MEMPOOL
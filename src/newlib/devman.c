@@ -213,3 +213,20 @@ const char* dm_getaddr( int fd )
   return pinst->pdev->p_getaddr_r( _REENT, DM_GET_FD( fd ), pinst->pdata );
 }
 
+// Write the data a device keeps in its buffers for the file
+// (devices without buffers don't have a fsync function)
+int dm_fsync( int fd )
+{
+  const DM_INSTANCE_DATA *pinst;
+
+  pinst = dm_get_instance_at( DM_GET_DEVID( fd ) );
+  if( !pinst )
+  {
+    _REENT->_errno = EBADF;
+    return -1;
+  }
+  if( pinst->pdev->p_fsync_r == NULL )
+    return 0;
+  return pinst->pdev->p_fsync_r( _REENT, DM_GET_FD( fd ), pinst->pdata );
+}
+
@@ -97,7 +97,9 @@ static const DM_DEVICE std_device =
   NULL,                 // mkdir
   NULL,                 // unlink
   NULL,                 // rmdir
-  NULL                  // rename
+  NULL,                 // rename
+  NULL,                 // fsync
+  NULL                  // stat
 };
 
 
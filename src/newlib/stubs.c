@@ -18,6 +18,9 @@
 
 #ifdef USE_MULTIPLE_ALLOCATOR
 #include "dlmalloc.h"
+#ifdef BUILD_HEAP_REGIONS
+#include "heapreg.h"
+#endif
 #else
 #include <malloc.h>
 #endif
@@ -142,6 +145,36 @@ int _fstat_r( struct _reent *r, int file, struct stat *st )
   return -1;
 }
 
+// *****************************************************************************
+// _stat_r
+int _stat_r( struct _reent *r, const char *path, struct stat *st )
+{
+  char* actname;
+  int devid;
+  const DM_INSTANCE_DATA *pinst;
+
+  // Look for device, return error if not found or if function not implemented
+  if( ( devid = find_dm_entry( path, &actname ) ) == -1 )
+  {
+    r->_errno = ENODEV;
+    return -1;
+  }
+  pinst = dm_get_instance_at( devid );
+  if( pinst->pdev->p_stat_r == NULL )
+  {
+    r->_errno = ENOSYS;
+    return -1;
+  }
+
+  // Device found, call its function
+  return pinst->pdev->p_stat_r( r, actname, st, pinst->pdata );
+}
+
+int stat( const char *path, struct stat *st )
+{
+  return _stat_r( _REENT, path, st );
+}
+
 // *****************************************************************************
 // _lseek_r
 off_t _lseek_r( struct _reent *r, int file, off_t off, int whence )
@@ -425,8 +458,10 @@ int __ssvfscanf_r( struct _reent *r, FILE *stream, const char *format, va_list a
 // Allocator support
 
 // _sbrk_r (newlib) / elua_sbrk (multiple)
+#ifndef BUILD_HEAP_REGIONS
 static char *heap_ptr; 
 static int mem_index;
+#endif
 
 #ifdef USE_MULTIPLE_ALLOCATOR
 void* elua_sbrk( ptrdiff_t incr )
@@ -434,6 +469,10 @@ void* elua_sbrk( ptrdiff_t incr )
 void* _sbrk_r( struct _reent* r, ptrdiff_t incr )
 #endif
 {
+#ifdef BUILD_HEAP_REGIONS
+  // With heap regions all the memory belongs to the region mspaces
+  return ( void* )-1;
+#else
   void* ptr;
       
   // If increment is negative, return -1
@@ -470,12 +509,15 @@ void* _sbrk_r( struct _reent* r, ptrdiff_t incr )
   }  
 
   return ptr;
+#endif // #ifdef BUILD_HEAP_REGIONS
 } 
 
 // mallinfo()
 struct mallinfo mallinfo( void )
 {
-#ifdef USE_MULTIPLE_ALLOCATOR
+#if defined( BUILD_HEAP_REGIONS )
+  return heapreg_mallinfo();
+#elif defined( USE_MULTIPLE_ALLOCATOR )
   return dlmallinfo();
 #else
   return _mallinfo_r( _REENT );
@@ -485,7 +527,9 @@ struct mallinfo mallinfo( void )
 #if defined( USE_MULTIPLE_ALLOCATOR ) || defined( USE_SIMPLE_ALLOCATOR )
 // Redirect all allocator calls to our dlmalloc/salloc 
 
-#ifdef USE_MULTIPLE_ALLOCATOR
+#if defined( BUILD_HEAP_REGIONS )
+#define CNAME( func ) heapreg_##func
+#elif defined( USE_MULTIPLE_ALLOCATOR )
 #define CNAME( func ) dl##func
 #else
 #define CNAME( func ) s##func
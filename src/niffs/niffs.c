@@ -272,7 +272,9 @@ static const DM_DEVICE niffs_device =
   NULL,                // mkdir
   nffs_unlink_r,       // unlink
   NULL,                // rmdir
-  NULL                 // rename // TODO peter, this exists in niffs also if you want it
+  NULL,                // rename // TODO peter, this exists in niffs also if you want it
+  NULL,                // fsync
+  NULL                 // stat
 };
 
 static int platform_hal_erase_f(u8_t *addr, u32_t len) {
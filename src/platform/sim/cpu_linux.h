@@ -24,14 +24,24 @@
 // (start address and end address)
 extern void *memory_start_address;
 extern void *memory_end_address;
+extern void *memory2_start_address;
+extern void *memory2_end_address;
 
 // Default to 1M of memory if not specified
 #ifndef SIM_MEM_SIZE
 #define SIM_MEM_SIZE (1024 * 1024)
 #endif
 
+// Second memory region, used when the board has 2 internal RAMs
+// It emulates a larger (and slower) external RAM
+#ifndef SIM_MEM2_SIZE
+#define SIM_MEM2_SIZE (2 * 1024 * 1024)
+#endif
+
 #define INTERNAL_RAM1_FIRST_FREE ( void* )memory_start_address
 #define INTERNAL_RAM1_LAST_FREE  ( void* )memory_end_address
+#define INTERNAL_RAM2_FIRST_FREE ( void* )memory2_start_address
+#define INTERNAL_RAM2_LAST_FREE  ( void* )memory2_end_address
 
 #endif
 
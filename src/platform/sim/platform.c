@@ -88,18 +88,22 @@ static int kb_read( timer_data_type to )
 
 void *memory_start_address = 0;
 void *memory_end_address = 0;
+void *memory2_start_address = 0;
+void *memory2_end_address = 0;
 
 void platform_ll_init( void )
 {
-  // Initialise heap memory region.
+  // Initialise heap memory regions.
   memory_start_address = hostif_getmem( SIM_MEM_SIZE );
   memory_end_address = memory_start_address + SIM_MEM_SIZE;
+  memory2_start_address = hostif_getmem( SIM_MEM2_SIZE );
+  memory2_end_address = memory2_start_address + SIM_MEM2_SIZE;
 }
 
 int platform_init()
 {
   char memdata[80];
-  if( memory_start_address == NULL ) 
+  if( memory_start_address == NULL || memory2_start_address == NULL )
   {
     hostif_putstr( "platform_init(): mmap failed\n" );
     return PLATFORM_ERR;
@@ -118,7 +122,8 @@ int platform_init()
   term_clrscr();
   term_gotoxy( 1, 1 );
   // Show memory information
-  snprintf( memdata, 80, "RAM size is %u bytes (%uKB)\r\n", (unsigned)SIM_MEM_SIZE, (unsigned)SIM_MEM_SIZE / 1024 );
+  snprintf( memdata, 80, "RAM size is %u bytes (%uKB) + %u bytes (%uKB)\r\n", (unsigned)SIM_MEM_SIZE, (unsigned)SIM_MEM_SIZE / 1024,
+            (unsigned)SIM_MEM2_SIZE, (unsigned)SIM_MEM2_SIZE / 1024 );
   hostif_putstr( memdata );
 
   // All done
@@ -7,11 +7,17 @@
 #include "eluarpc.h"
 #include "platform.h"
 #include <stdio.h>
+#include <fcntl.h>
 #include "platform_conf.h"
 #include "buf.h"
+#include "lzf.h"
 
 #ifdef BUILD_RFS
 
+#ifndef RFS_COMPRESS
+#define RFS_COMPRESS          0
+#endif
+
 #if 0
 #define RFSDEBUG        printf
 #else
@@ -28,36 +34,122 @@ static p_rfsc_send rfsc_send;
 static p_rfsc_recv rfsc_recv;
 static timer_data_type rfsc_timeout;
 
+// Read-ahead: the client reads one file ahead (the last one read), with up
+// to 'rfsc_ra_window' pipelined "pread" requests. The data of 'fd' that
+// starts at file offset 'pos' is kept in rfsc_ra_buf[ start, start + len ).
+// The server file position is 'srvpos', which is past 'pos' when there is
+// data in the buffer. Every request is answered before rfsc_read returns,
+// as the receive buffer can't hold more than one response. The data is read
+// again when any file is opened for writing or written to on the server,
+// since it might be the same file.
+typedef struct
+{
+  int fd;
+  s32 pos, srvpos;
+  u32 start, len;
+  u8 seq;
+  u8 eof;
+} rfsc_ra_state;
+
+static u8 *rfsc_ra_buf;
+static u32 rfsc_ra_chunk;
+static unsigned rfsc_ra_window;
+static rfsc_ra_state rfsc_ra = { -1, -1, -1, 0, 0, 0, 0 };
+static u8 rfsc_ra_request[ RFS_PREAD_REQUEST_SIZE ];
+
+// Write-behind: the data written to a file is collected in a buffer that is
+// a ready "write" request. The request is sent when the buffer is full, when
+// the file is used otherwise and before an open. The client doesn't wait for
+// the response: up to RFSC_WB_MAX_PENDING responses wait in the receive
+// buffer, they are read when they arrive during a later write or before the
+// next request. A failed write is reported by the next write, fsync or close
+// of the file. The files with a failed write are kept apart from the buffers,
+// as a buffer passes to another file when the files written to outnumber the
+// buffers (if more than RFSC_WB_MAX_FAILED files fail, the oldest failure is
+// forgotten).
+#define RFSC_WB_MAX_BUFFERS       4
+#define RFSC_WB_MAX_PENDING       4
+#define RFSC_WB_MAX_FAILED        8
+#define RFSC_WB_RESPONSE_SIZE     ( ELUARPC_START_OFFSET + ELUARPC_START_SIZE + ELUARPC_RESPONSE_SIZE + ELUARPC_U32_SIZE + ELUARPC_END_SIZE )
+
+typedef struct
+{
+  u8 *buf;
+  int fd;
+  u32 len;
+} rfsc_wb_buffer;
+
+typedef struct
+{
+  int fd;
+  u32 count;
+  u8 z;
+} rfsc_wb_write;
+
+static rfsc_wb_buffer rfsc_wb[ RFSC_WB_MAX_BUFFERS ];
+static unsigned rfsc_wb_num, rfsc_wb_next;
+static u32 rfsc_wb_size;
+static rfsc_wb_write rfsc_wb_pending[ RFSC_WB_MAX_PENDING ];
+static unsigned rfsc_wb_head, rfsc_wb_npending;
+static u8 rfsc_wb_response[ RFSC_WB_RESPONSE_SIZE ];
+static int rfsc_wb_failed[ RFSC_WB_MAX_FAILED ];
+static unsigned rfsc_wb_next_failed;
+
+// Protocol version spoken by the server (0 if not asked yet)
+static u8 rfsc_version;
+
+// Compression: the file data is sent with "writez" and read with "preadz"
+// when the server knows them. The version is asked at the first open.
+#if RFS_COMPRESS
+#define RFSC_Z                ( rfsc_version >= 3 )
+#else
+#define RFSC_Z                0
+#endif
+
+// Batched readdir: the entries of directory 'rfsc_dir_d' returned by a
+// "readdirb" request are kept in rfsc_dir_buf[ pos, len ). Only one directory
+// is read this way at a time, another one is read an entry per request.
+static u8 *rfsc_dir_buf;
+static u32 rfsc_dir_size;
+static u32 rfsc_dir_d, rfsc_dir_pos, rfsc_dir_len;
+
 // ****************************************************************************
 // Client helpers
 
-static int rfsch_send_request_read_response()
+static void rfsch_flush()
 {
-  u16 temp16;
-  u32 readbytes;
-
 #ifndef ELUA_CPU_LINUX
   // Empty receive buffer
   while( rfsc_recv( rfsc_buffer, 1, 0 ) == 1 );
 #endif
+}
 
-  // Send request
-  if( eluarpc_get_packet_size( rfsc_buffer, &temp16 ) == ELUARPC_ERR )
+static int rfsch_send_request( const u8 *p )
+{
+  u16 temp16;
+
+  if( eluarpc_get_packet_size( p, &temp16 ) == ELUARPC_ERR )
   {
     RFSDEBUG( "[RFS] get packet size error\n" );
     return CLIENT_ERR;
   }
-  if( rfsc_send( rfsc_buffer, temp16 ) != temp16 )
+  if( rfsc_send( p, temp16 ) != temp16 )
   {
     RFSDEBUG( "[RFS] rfsc_send error\n" );
     return CLIENT_ERR;
   }
-  
-  // Get response
+  return CLIENT_OK;
+}
+
+static int rfsch_read_response()
+{
+  u16 temp16;
+  u32 readbytes;
+
   // First the length, then the rest of the data
   if( ( readbytes = rfsc_recv( rfsc_buffer, ELUARPC_START_OFFSET, rfsc_timeout ) ) != ELUARPC_START_OFFSET )
   {
-    RFSDEBUG( "[RFS] rfsc_recv (1) error: expected %u, got %u\n", ( unsigned )( temp16 - ELUARPC_START_OFFSET ), ( unsigned )readbytes );
+    RFSDEBUG( "[RFS] rfsc_recv (1) error: expected %u, got %u\n", ( unsigned )ELUARPC_START_OFFSET, ( unsigned )readbytes );
     return CLIENT_ERR;
   }
   if( eluarpc_get_packet_size( rfsc_buffer, &temp16 ) == ELUARPC_ERR )
@@ -73,6 +165,367 @@ static int rfsch_send_request_read_response()
   return CLIENT_OK;
 }
 
+static rfsc_wb_buffer *rfsch_wb_find( int fd )
+{
+  unsigned i;
+
+  for( i = 0; i < rfsc_wb_num; i ++ )
+    if( rfsc_wb[ i ].fd == fd )
+      return rfsc_wb + i;
+  return NULL;
+}
+
+// Remember that a write to 'fd' failed
+static void rfsch_wb_fail( int fd )
+{
+  unsigned i;
+
+  for( i = 0; i < RFSC_WB_MAX_FAILED; i ++ )
+    if( rfsc_wb_failed[ i ] == fd )
+      return;
+  for( i = 0; i < RFSC_WB_MAX_FAILED && rfsc_wb_failed[ i ] != -1; i ++ );
+  if( i == RFSC_WB_MAX_FAILED )
+  {
+    i = rfsc_wb_next_failed;
+    rfsc_wb_next_failed = ( rfsc_wb_next_failed + 1 ) % RFSC_WB_MAX_FAILED;
+  }
+  rfsc_wb_failed[ i ] = fd;
+}
+
+// Return 1 if a write to 'fd' failed since the last time it was asked
+static int rfsch_wb_take_error( int fd )
+{
+  unsigned i;
+
+  if( rfsc_wb_num == 0 ) // no write-behind (the table might not be set up)
+    return 0;
+  for( i = 0; i < RFSC_WB_MAX_FAILED; i ++ )
+    if( rfsc_wb_failed[ i ] == fd )
+    {
+      rfsc_wb_failed[ i ] = -1;
+      return 1;
+    }
+  return 0;
+}
+
+// The oldest pending write is done
+static void rfsch_wb_done( int ok )
+{
+  if( !ok )
+    rfsch_wb_fail( rfsc_wb_pending[ rfsc_wb_head ].fd );
+  rfsc_wb_head = ( rfsc_wb_head + 1 ) % RFSC_WB_MAX_PENDING;
+  rfsc_wb_npending --;
+}
+
+// Read the response of the oldest pending write ('got' bytes of it are
+// already in rfsc_wb_response)
+static void rfsch_wb_read_response( u32 got )
+{
+  u16 temp16;
+  u32 count;
+  int res;
+
+  if( rfsc_recv( rfsc_wb_response + got, ELUARPC_START_OFFSET - got, rfsc_timeout ) != ELUARPC_START_OFFSET - got ||
+      eluarpc_get_packet_size( rfsc_wb_response, &temp16 ) == ELUARPC_ERR || temp16 != RFSC_WB_RESPONSE_SIZE ||
+      rfsc_recv( rfsc_wb_response + ELUARPC_START_OFFSET, temp16 - ELUARPC_START_OFFSET, rfsc_timeout ) != temp16 - ELUARPC_START_OFFSET )
+    res = ELUARPC_ERR;
+  else if( rfsc_wb_pending[ rfsc_wb_head ].z )
+    res = remotefs_writez_read_response( rfsc_wb_response, &count );
+  else
+    res = remotefs_write_read_response( rfsc_wb_response, &count );
+  if( res == ELUARPC_ERR )
+  {
+    // The responses can't be matched anymore, all pending writes failed
+    RFSDEBUG( "[RFS] write response error\n" );
+    while( rfsc_wb_npending > 0 )
+      rfsch_wb_done( 0 );
+    return;
+  }
+  rfsch_wb_done( count == rfsc_wb_pending[ rfsc_wb_head ].count );
+}
+
+// Read the responses of the pending writes: all of them if 'wait' is set,
+// otherwise only the ones that started to arrive
+static void rfsch_wb_collect( int wait )
+{
+  while( rfsc_wb_npending > 0 )
+  {
+    if( wait )
+      rfsch_wb_read_response( 0 );
+#ifndef ELUA_CPU_LINUX
+    else if( rfsc_recv( rfsc_wb_response, 1, 0 ) == 1 )
+      rfsch_wb_read_response( 1 );
+#endif
+    else
+      break;
+  }
+}
+
+// Make a "writez" request in rfsc_buffer with the compressed data, return 0
+// if the data doesn't get smaller than the "write" request
+static int rfsch_writez_request( int fd, const u8 *buf, u32 count )
+{
+  u32 size;
+
+  if( !RFSC_Z || count <= ELUARPC_U8_SIZE )
+    return 0;
+  if( ( size = lzf_compress( buf, count, rfsc_buffer + RFS_WRITEZ_BUF_OFFSET, count - ELUARPC_U8_SIZE - 1 ) ) == 0 )
+    return 0;
+  remotefs_writez_write_request( rfsc_buffer, fd, RFS_COMPRESS_LZF, NULL, size );
+  return 1;
+}
+
+// Put the 'size' bytes of "preadz" data compressed with 'method' in 'buf'
+// (at most 'count' bytes), return the number of bytes or -1 on error
+static s32 rfsch_uncompress( u8 method, const u8 *pdata, u32 size, u8 *buf, u32 count )
+{
+  if( method == RFS_COMPRESS_NONE && size <= count )
+  {
+    memcpy( buf, pdata, size );
+    return ( s32 )size;
+  }
+  if( method == RFS_COMPRESS_LZF && size > 0 && ( size = lzf_decompress( pdata, size, buf, count ) ) > 0 )
+    return ( s32 )size;
+  RFSDEBUG( "[RFS] invalid compressed data\n" );
+  return -1;
+}
+
+// Forget the data read ahead, but not the place of the application in the
+// file: the next read asks for the data at this offset again
+static void rfsch_ra_invalidate()
+{
+  rfsc_ra.start = rfsc_ra.len = 0;
+  rfsc_ra.eof = 0;
+}
+
+// Send the data of a write-behind buffer, don't wait for the response. The
+// compressed data goes to rfsc_buffer, which is free between requests.
+static void rfsch_wb_send( rfsc_wb_buffer *pb )
+{
+  rfsc_wb_write *pw;
+  u8 z;
+
+  if( pb == NULL || pb->len == 0 )
+    return;
+  if( rfsc_wb_npending == RFSC_WB_MAX_PENDING )
+    rfsch_wb_read_response( 0 );
+  if( ( z = rfsch_writez_request( pb->fd, pb->buf + RFS_WRITE_BUF_OFFSET, pb->len ) ) == 0 )
+    remotefs_write_write_request( pb->buf, pb->fd, NULL, pb->len );
+  rfsch_ra_invalidate();
+  if( rfsch_send_request( z ? rfsc_buffer : pb->buf ) == CLIENT_OK )
+  {
+    pw = rfsc_wb_pending + ( rfsc_wb_head + rfsc_wb_npending ) % RFSC_WB_MAX_PENDING;
+    pw->fd = pb->fd;
+    pw->count = pb->len;
+    pw->z = z;
+    rfsc_wb_npending ++;
+  }
+  else
+    rfsch_wb_fail( pb->fd );
+  pb->len = 0;
+}
+
+static void rfsch_wb_send_all()
+{
+  unsigned i;
+
+  for( i = 0; i < rfsc_wb_num; i ++ )
+    rfsch_wb_send( rfsc_wb + i );
+}
+
+static s32 rfsch_wb_write( int fd, const u8 *buf, u32 count )
+{
+  rfsc_wb_buffer *pb;
+  u32 n, total = 0;
+
+  rfsch_wb_collect( 0 );
+  if( ( pb = rfsch_wb_find( fd ) ) == NULL )
+  {
+    // Use a free buffer or take the next one in turn
+    if( ( pb = rfsch_wb_find( -1 ) ) == NULL )
+    {
+      pb = rfsc_wb + rfsc_wb_next;
+      rfsc_wb_next = ( rfsc_wb_next + 1 ) % rfsc_wb_num;
+      rfsch_wb_send( pb );
+    }
+    pb->fd = fd;
+  }
+  if( rfsch_wb_take_error( fd ) )
+    return -1;
+  while( total < count )
+  {
+    n = count - total < rfsc_wb_size - pb->len ? count - total : rfsc_wb_size - pb->len;
+    memcpy( pb->buf + RFS_WRITE_BUF_OFFSET + pb->len, buf + total, n );
+    pb->len += n;
+    total += n;
+    if( pb->len == rfsc_wb_size )
+      rfsch_wb_send( pb );
+  }
+  return ( s32 )total;
+}
+
+static int rfsch_send_request_read_response()
+{
+  rfsch_wb_collect( 1 );
+  rfsch_flush();
+  if( rfsch_send_request( rfsc_buffer ) == CLIENT_ERR )
+    return CLIENT_ERR;
+  return rfsch_read_response();
+}
+
+// Return the protocol version of the server, ask the server the first time
+static unsigned rfsch_get_version()
+{
+  u8 version;
+
+  if( rfsc_version == 0 )
+  {
+    remotefs_version_write_request( rfsc_buffer, RFS_PROTOCOL_VERSION );
+    if( rfsch_send_request_read_response() == CLIENT_ERR )
+      return 1;
+    // A server that doesn't know this request sends it back
+    if( remotefs_version_read_response( rfsc_buffer, &version ) == ELUARPC_ERR || version == 0 )
+      version = 1;
+    rfsc_version = version;
+  }
+  return rfsc_version;
+}
+
+// Forget the read-ahead data. If 'sync' is set, move the server file
+// position back to the position of the application first.
+static void rfsch_ra_drop( int sync )
+{
+  if( rfsc_ra.fd == -1 )
+    return;
+  if( sync && rfsc_ra.pos != -1 && rfsc_ra.srvpos != rfsc_ra.pos )
+  {
+    remotefs_lseek_write_request( rfsc_buffer, rfsc_ra.fd, rfsc_ra.pos, RFS_LSEEK_SET );
+    rfsch_send_request_read_response();
+  }
+  rfsc_ra.fd = -1;
+}
+
+// Read 'count' bytes with pipelined "pread" requests: the data goes to 'buf'
+// first, then what was read past 'count' to the (empty) read-ahead buffer.
+// Compressed data is uncompressed in 'buf' if all of it goes there, else at
+// the end of the read-ahead data, which has room for a chunk until the last
+// response. Returns the number of bytes read or -1 if the read failed
+static s32 rfsch_ra_fill( u8 *buf, u32 count )
+{
+  unsigned sent = 0, recvd = 0, nreq;
+  u8 seq, method = RFS_COMPRESS_NONE, z = RFSC_Z;
+  s32 offset, reqoffset, res;
+  const u8 *pdata;
+  u8 *dst;
+  u32 n, total = 0;
+
+  // Ask for whole chunks, as many as fit after 'count' in the buffer
+  nreq = count / rfsc_ra_chunk + rfsc_ra_window;
+  rfsc_ra.start = rfsc_ra.len = 0;
+  rfsc_ra.eof = 0;
+  rfsch_wb_collect( 1 );
+  rfsch_flush();
+  while( recvd < sent || ( sent < nreq && !rfsc_ra.eof ) )
+  {
+    // Keep the window full
+    while( sent < nreq && sent - recvd < rfsc_ra_window && !rfsc_ra.eof )
+    {
+      reqoffset = rfsc_ra.pos == -1 ? -1 : ( s32 )( rfsc_ra.pos + total + rfsc_ra.len + ( sent - recvd ) * rfsc_ra_chunk );
+      if( z )
+        remotefs_preadz_write_request( rfsc_ra_request, rfsc_ra.fd, ( u8 )( rfsc_ra.seq + sent ), reqoffset, rfsc_ra_chunk );
+      else
+        remotefs_pread_write_request( rfsc_ra_request, rfsc_ra.fd, ( u8 )( rfsc_ra.seq + sent ), reqoffset, rfsc_ra_chunk );
+      if( rfsch_send_request( rfsc_ra_request ) == CLIENT_ERR )
+        return -1;
+      sent ++;
+    }
+
+    // Get the next response, check its place in the file
+    if( rfsch_read_response() == CLIENT_ERR )
+      return -1;
+    if( ( z ? remotefs_preadz_read_response( rfsc_buffer, &seq, &offset, &method, &pdata, &n ) :
+              remotefs_pread_read_response( rfsc_buffer, &seq, &offset, &pdata, &n ) ) == ELUARPC_ERR ||
+        seq != ( u8 )( rfsc_ra.seq + recvd ) || offset == -1 || n > rfsc_ra_chunk )
+    {
+      RFSDEBUG( "[RFS] invalid pread response\n" );
+      return -1;
+    }
+    if( method != RFS_COMPRESS_NONE )
+    {
+      dst = count - total >= rfsc_ra_chunk ? buf + total : rfsc_ra_buf + rfsc_ra.len;
+      if( ( res = rfsch_uncompress( method, pdata, n, dst, rfsc_ra_chunk ) ) == -1 )
+        return -1;
+      pdata = dst;
+      n = ( u32 )res;
+    }
+    recvd ++;
+    rfsc_ra.srvpos = offset + n;
+    if( rfsc_ra.eof )
+      continue;
+    if( rfsc_ra.pos == -1 )
+      rfsc_ra.pos = offset - total;
+    else if( offset != ( s32 )( rfsc_ra.pos + total + rfsc_ra.len ) )
+    {
+      RFSDEBUG( "[RFS] pread response for the wrong offset\n" );
+      return -1;
+    }
+    if( n < rfsc_ra_chunk )
+      rfsc_ra.eof = 1;
+    if( n == 0 )
+      continue;
+
+    // Data for the application, then for the read-ahead buffer
+    if( total < count )
+    {
+      u32 tocopy = n < count - total ? n : count - total;
+
+      memmove( buf + total, pdata, tocopy );
+      total += tocopy;
+      pdata += tocopy;
+      n -= tocopy;
+    }
+    memmove( rfsc_ra_buf + rfsc_ra.len, pdata, n );
+    rfsc_ra.len += n;
+  }
+  rfsc_ra.seq += sent;
+  rfsc_ra.pos += total;
+  return ( s32 )total;
+}
+
+static s32 rfsch_ra_read( int fd, u8 *buf, u32 count )
+{
+  u32 total;
+  s32 res;
+
+  // Start reading ahead this file
+  if( rfsc_ra.fd != fd )
+  {
+    rfsch_ra_drop( 1 );
+    rfsc_ra.fd = fd;
+    rfsc_ra.pos = rfsc_ra.srvpos = -1;
+    rfsc_ra.start = rfsc_ra.len = 0;
+  }
+
+  // Use the data already read first
+  total = count < rfsc_ra.len ? count : rfsc_ra.len;
+  memcpy( buf, rfsc_ra_buf + rfsc_ra.start, total );
+  rfsc_ra.start += total;
+  rfsc_ra.len -= total;
+  rfsc_ra.pos += total;
+  if( total == count || ( rfsc_ra.eof && total > 0 ) )
+    return ( s32 )total;
+
+  // Read the rest (and the next chunks)
+  if( ( res = rfsch_ra_fill( buf + total, count - total ) ) == -1 )
+  {
+    // The server position is not known anymore, the next request for this
+    // file won't find it in the read-ahead buffer
+    rfsc_ra.fd = -1;
+    return total > 0 ? ( s32 )total : -1;
+  }
+  return ( s32 )( total + res );
+}
+
 // ****************************************************************************
 // Client public interface
 
@@ -82,6 +535,39 @@ void rfsc_setup( u8 *pbuf, p_rfsc_send rfsc_send_func, p_rfsc_recv rfsc_recv_fun
   rfsc_send = rfsc_send_func;
   rfsc_recv = rfsc_recv_func;
   rfsc_timeout = timeout;
+  rfsc_version = 0;
+}
+
+void rfsc_setup_readahead( u8 *pbuf, u32 chunk, unsigned window )
+{
+  rfsc_ra_buf = pbuf;
+  rfsc_ra_chunk = chunk;
+  rfsc_ra_window = pbuf ? window : 0;
+  rfsc_ra.fd = -1;
+}
+
+void rfsc_setup_writebehind( u8 *pbuf, u32 bufsize, unsigned nbufs )
+{
+  unsigned i;
+
+  rfsc_wb_num = nbufs < RFSC_WB_MAX_BUFFERS ? nbufs : RFSC_WB_MAX_BUFFERS;
+  rfsc_wb_size = bufsize - ELUARPC_WRITE_REQUEST_EXTRA;
+  for( i = 0; i < rfsc_wb_num; i ++ )
+  {
+    rfsc_wb[ i ].buf = pbuf + i * bufsize;
+    rfsc_wb[ i ].fd = -1;
+    rfsc_wb[ i ].len = 0;
+  }
+  for( i = 0; i < RFSC_WB_MAX_FAILED; i ++ )
+    rfsc_wb_failed[ i ] = -1;
+  rfsc_wb_next = rfsc_wb_head = rfsc_wb_npending = rfsc_wb_next_failed = 0;
+}
+
+void rfsc_setup_readdir( u8 *pbuf, u32 size )
+{
+  rfsc_dir_buf = pbuf;
+  rfsc_dir_size = size < RFS_READDIRB_MAX_ENTRY ? 0 : size;
+  rfsc_dir_pos = rfsc_dir_len = 0;
 }
 
 void rfsc_set_timeout( timer_data_type timeout )
@@ -93,6 +579,14 @@ int rfsc_open( const char* pathname, int flags, int mode )
 {
   int fd;
 
+  // The file might be one with data in a write-behind buffer
+  rfsch_wb_send_all();
+#if RFS_COMPRESS
+  rfsch_get_version();
+#endif
+  if( flags & ( O_WRONLY | O_RDWR | O_TRUNC ) )
+    rfsch_ra_invalidate();
+
   // Make the request
   remotefs_open_write_request( rfsc_buffer, pathname, os_open_sys_flags_to_rfs_flags( flags ), mode );
 
@@ -108,15 +602,24 @@ int rfsc_open( const char* pathname, int flags, int mode )
 
 s32 rfsc_write( int fd, const void *buf, u32 count )
 {
+  int z;
+
+  if( fd == rfsc_ra.fd )
+    rfsch_ra_drop( 1 );
+  if( rfsc_wb_num > 0 )
+    return rfsch_wb_write( fd, ( const u8* )buf, count );
+
   // Make the request
-  remotefs_write_write_request( rfsc_buffer, fd, buf, count );
+  if( ( z = rfsch_writez_request( fd, buf, count ) ) == 0 )
+    remotefs_write_write_request( rfsc_buffer, fd, buf, count );
+  rfsch_ra_invalidate();
 
   // Send the request / get the response
   if( rfsch_send_request_read_response() == CLIENT_ERR )
     return -1;
   
   // Interpret the response
-  if( remotefs_write_read_response( rfsc_buffer, &count ) == ELUARPC_ERR )
+  if( ( z ? remotefs_writez_read_response( rfsc_buffer, &count ) : remotefs_write_read_response( rfsc_buffer, &count ) ) == ELUARPC_ERR )
     return -1;
   return ( s32 )count;
 }
@@ -124,6 +627,24 @@ s32 rfsc_write( int fd, const void *buf, u32 count )
 s32 rfsc_read( int fd, void *buf, u32 count )
 {
   const u8 *resbuf;
+  u8 seq, method;
+  s32 offset;
+  u32 size;
+
+  rfsch_wb_send( rfsch_wb_find( fd ) );
+  if( rfsc_ra_window > 0 )
+    return rfsch_ra_read( fd, buf, count );
+
+  // "preadz" from the current position
+  if( RFSC_Z )
+  {
+    remotefs_preadz_write_request( rfsc_buffer, fd, 0, -1, count );
+    if( rfsch_send_request_read_response() == CLIENT_ERR )
+      return -1;
+    if( remotefs_preadz_read_response( rfsc_buffer, &seq, &offset, &method, &resbuf, &size ) == ELUARPC_ERR || offset == -1 )
+      return -1;
+    return rfsch_uncompress( method, resbuf, size, buf, count );
+  }
 
   // Make the request
   remotefs_read_write_request( rfsc_buffer, fd, count );
@@ -143,6 +664,16 @@ s32 rfsc_lseek( int fd, s32 offset, int whence )
 {
   s32 res;
 
+  rfsch_wb_send( rfsch_wb_find( fd ) );
+
+  // The server is ahead of the application when reading ahead
+  if( fd == rfsc_ra.fd )
+  {
+    if( whence == SEEK_CUR && rfsc_ra.pos != -1 )
+      offset -= rfsc_ra.srvpos - rfsc_ra.pos;
+    rfsch_ra_drop( 0 );
+  }
+
   // Make the request
   remotefs_lseek_write_request( rfsc_buffer, fd, offset, os_lseek_sys_whence_to_rfs_whence( whence ) );
 
@@ -156,9 +687,23 @@ s32 rfsc_lseek( int fd, s32 offset, int whence )
   return res;
 }
 
+int rfsc_fsync( int fd )
+{
+  rfsch_wb_send( rfsch_wb_find( fd ) );
+  rfsch_wb_collect( 1 );
+  return rfsch_wb_take_error( fd ) ? -1 : 0;
+}
+
 int rfsc_close( int fd )
 {
-  int res;
+  int res, err;
+  rfsc_wb_buffer *pb;
+
+  if( fd == rfsc_ra.fd )
+    rfsch_ra_drop( 0 );
+  err = rfsc_fsync( fd );
+  if( ( pb = rfsch_wb_find( fd ) ) != NULL )
+    pb->fd = -1;
 
   // Make the request
   remotefs_close_write_request( rfsc_buffer, fd );
@@ -170,13 +715,15 @@ int rfsc_close( int fd )
   // Interpret the response
   if( remotefs_close_read_response( rfsc_buffer, &res ) == ELUARPC_ERR )
     return -1;
-  return res;
+  return err == -1 ? -1 : res;
 }
 
 u32 rfsc_opendir( const char* name )
 {
   u32 res;
 
+  rfsch_wb_send_all();
+
   // Make the request
   remotefs_opendir_write_request( rfsc_buffer, name );
   if( rfsch_send_request_read_response() == CLIENT_ERR )
@@ -190,6 +737,36 @@ u32 rfsc_opendir( const char* name )
 
 void rfsc_readdir( u32 d, const char **pname, u32 *psize, u32 *ptime )
 {
+  u8 nentries;
+  const u8 *pdata;
+  u32 size;
+
+  if( rfsc_dir_size > 0 && ( rfsc_dir_d == d || rfsc_dir_pos == rfsc_dir_len ) && rfsch_get_version() >= 2 )
+  {
+    // Get the next entries if there are none left
+    if( rfsc_dir_d != d || rfsc_dir_pos == rfsc_dir_len )
+    {
+      rfsc_dir_d = d;
+      rfsc_dir_pos = rfsc_dir_len = 0;
+      *pname = NULL;
+      remotefs_readdirb_write_request( rfsc_buffer, d, rfsc_dir_size );
+      if( rfsch_send_request_read_response() == CLIENT_ERR )
+        return;
+      if( remotefs_readdirb_read_response( rfsc_buffer, &nentries, &pdata, &size ) == ELUARPC_ERR || size > rfsc_dir_size )
+      {
+        // Maybe another server: ask the version again next time
+        rfsc_version = 0;
+        return;
+      }
+      if( nentries == 0 )
+        return;
+      memcpy( rfsc_dir_buf, pdata, size );
+      rfsc_dir_len = size;
+    }
+    rfsc_dir_pos = remotefs_readdirb_get_entry( rfsc_dir_buf + rfsc_dir_pos, pname, psize, ptime ) - rfsc_dir_buf;
+    return;
+  }
+
   // Make the request
   remotefs_readdir_write_request( rfsc_buffer, d );
   if( rfsch_send_request_read_response() == CLIENT_ERR )
@@ -207,6 +784,9 @@ int rfsc_closedir( u32 d )
 {
   int res;
 
+  if( rfsc_dir_d == d )
+    rfsc_dir_pos = rfsc_dir_len = 0;
+
   // Make the request
   remotefs_closedir_write_request( rfsc_buffer, d );
   if( rfsch_send_request_read_response() == CLIENT_ERR )
@@ -218,4 +798,35 @@ int rfsc_closedir( u32 d )
   return res;
 }  
 
+// Return -1 on error or the RFS_STAT_FLAG_xxx flags of the file. A server
+// without "stat" can only tell the size of a file, with open/lseek/close.
+int rfsc_stat( const char *name, u32 *psize, u32 *pftime )
+{
+  int res, fd;
+
+  rfsch_wb_send_all();
+  if( rfsch_get_version() < 2 )
+  {
+    if( ( fd = rfsc_open( name, O_RDONLY, 0 ) ) < 0 )
+      return -1;
+    res = rfsc_lseek( fd, 0, SEEK_END );
+    rfsc_close( fd );
+    if( res < 0 )
+      return -1;
+    *psize = ( u32 )res;
+    *pftime = 0;
+    return 0;
+  }
+
+  // Make the request
+  remotefs_stat_write_request( rfsc_buffer, name );
+  if( rfsch_send_request_read_response() == CLIENT_ERR )
+    return -1;
+
+  // Interpret the response
+  if( remotefs_stat_read_response( rfsc_buffer, &res, psize, pftime ) == ELUARPC_ERR )
+    return -1;
+  return res;
+}
+
 #endif // #ifdef BUILD_RFS
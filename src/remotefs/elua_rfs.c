@@ -14,6 +14,8 @@
 #include "hostif.h"
 #endif
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 
 #include "elua_rfs.h"
 
@@ -28,6 +30,10 @@
 #define RFS_TIMER_ID          PLATFORM_TIMER_SYS_ID
 #endif
 
+#ifndef RFS_COMPRESS
+#define RFS_COMPRESS          0
+#endif
+
 // Our RFS buffer
 // Compute the usable buffer size starting from RFS_BUFFER_SIZE (which is the
 // size of the serial buffer). A complete packet must fit in RFS_BUFFER_SIZE
@@ -35,6 +41,50 @@
 #define RFS_REAL_BUFFER_SIZE      ( ( 1 << RFS_BUFFER_SIZE ) - ELUARPC_WRITE_REQUEST_EXTRA )
 static u8 rfs_buffer[ 1 << RFS_BUFFER_SIZE ];
 
+// With compression the data is read with "preadz", which can return the
+// data uncompressed in a slightly larger response
+#if RFS_COMPRESS
+#define RFS_PREAD_EXTRA           RFS_PREADZ_RESPONSE_EXTRA
+#define RFS_REAL_READ_SIZE        ( ( 1 << RFS_BUFFER_SIZE ) - RFS_PREADZ_RESPONSE_EXTRA )
+#else
+#define RFS_PREAD_EXTRA           RFS_PREAD_RESPONSE_EXTRA
+#define RFS_REAL_READ_SIZE        RFS_REAL_BUFFER_SIZE
+#endif
+
+// Read-ahead buffer: RFS_READAHEAD chunks of file data, each as large as a
+// "pread" response in RFS_BUFFER_SIZE bytes allows. RFS_READAHEAD is also
+// the number of pipelined read requests (0 disables read-ahead).
+#ifndef RFS_READAHEAD
+#define RFS_READAHEAD             2
+#endif
+#if RFS_READAHEAD > 0
+#define RFS_READAHEAD_CHUNK       ( ( 1 << RFS_BUFFER_SIZE ) - RFS_PREAD_EXTRA )
+static u8 rfs_ra_buffer[ RFS_READAHEAD * RFS_READAHEAD_CHUNK ];
+#endif
+
+// Write-behind buffers: up to RFS_WRITE_BUFFERS files written at the same
+// time collect their data in a buffer of RFS_BUFFER_SIZE bytes, which is
+// sent without waiting for the response (0 disables write-behind)
+#ifndef RFS_WRITE_BUFFERS
+#define RFS_WRITE_BUFFERS         1
+#endif
+#if RFS_WRITE_BUFFERS > 0
+static u8 rfs_wb_buffer[ RFS_WRITE_BUFFERS << RFS_BUFFER_SIZE ];
+#endif
+
+// Directory buffer: the entries of a directory listing are requested as
+// many as fit in RFS_DIR_BUFFER bytes at a time, but no more than a
+// "readdirb" response in RFS_BUFFER_SIZE bytes allows (0 gets the entries
+// one at a time)
+#ifndef RFS_DIR_BUFFER
+#define RFS_DIR_BUFFER            256
+#endif
+#if RFS_DIR_BUFFER > 0
+#define RFS_DIR_BUFFER_MAX        ( ( 1 << RFS_BUFFER_SIZE ) - RFS_READDIRB_RESPONSE_EXTRA )
+#define RFS_REAL_DIR_BUFFER       ( RFS_DIR_BUFFER < RFS_DIR_BUFFER_MAX ? RFS_DIR_BUFFER : RFS_DIR_BUFFER_MAX )
+static u8 rfs_dir_buffer[ RFS_REAL_DIR_BUFFER ];
+#endif
+
 #ifdef ELUA_SIMULATOR
 static int rfs_read_fd, rfs_write_fd;
 #endif
@@ -51,6 +101,10 @@ static int rfs_close_r( struct _reent *r, int fd, void *pdata )
 
 static _ssize_t rfs_write_r( struct _reent *r, int fd, const void* ptr, size_t len, void *pdata )
 { 
+#if RFS_WRITE_BUFFERS > 0
+  // The client splits the data in full requests
+  return ( _ssize_t )rfsc_write( fd, ptr, len );
+#else
   s32 total = 0, res;
   u32 towrite;
   const u8 *p = ( const u8* )ptr;
@@ -70,19 +124,24 @@ static _ssize_t rfs_write_r( struct _reent *r, int fd, const void* ptr, size_t l
     p += towrite; 
   }
   return ( _ssize_t )total;
+#endif
 }
 
 static _ssize_t rfs_read_r( struct _reent *r, int fd, void* ptr, size_t len, void *pdata )
 {
+#if RFS_READAHEAD > 0
+  // The client splits the read in pipelined requests
+  return ( _ssize_t )rfsc_read( fd, ptr, len );
+#else
   s32 total = 0, res;
   u32 toread;
   u8 *p = ( u8* )ptr;
 
-  // Read in RFS_REAL_BUFFER_SIZE increments
+  // Read in RFS_REAL_READ_SIZE increments
 //  printf( "Got READ request for %d bytes\n", len );
   while( len )
   {
-    toread = len > RFS_REAL_BUFFER_SIZE ? RFS_REAL_BUFFER_SIZE : len;
+    toread = len > RFS_REAL_READ_SIZE ? RFS_REAL_READ_SIZE : len;
     if( ( res = rfsc_read( fd, p, toread ) ) == -1 )
       break;
     total += res; 
@@ -93,6 +152,7 @@ static _ssize_t rfs_read_r( struct _reent *r, int fd, void* ptr, size_t len, voi
     p += toread;
   }
   return ( _ssize_t )total;
+#endif
 }
 
 // lseek
@@ -125,6 +185,30 @@ static int rfs_closedir_r( struct _reent *r, void *d, void *pdata )
   return rfsc_closedir( ( u32 )d );
 }
 
+// fsync
+static int rfs_fsync_r( struct _reent *r, int fd, void *pdata )
+{
+  return rfsc_fsync( fd );
+}
+
+// stat
+static int rfs_stat_r( struct _reent *r, const char *path, struct stat *st, void *pdata )
+{
+  u32 size, ftime;
+  int res;
+
+  if( ( res = rfsc_stat( path, &size, &ftime ) ) == -1 )
+  {
+    r->_errno = ENOENT;
+    return -1;
+  }
+  memset( st, 0, sizeof( *st ) );
+  st->st_mode = ( res & RFS_STAT_FLAG_DIR ) ? S_IFDIR : S_IFREG;
+  st->st_size = size;
+  st->st_mtime = ftime;
+  return 0;
+}
+
 // ****************************************************************************
 // Remote FS serial transport functions
 
@@ -186,7 +270,9 @@ static const DM_DEVICE rfs_device =
   NULL,                 // mkdir
   NULL,                 // unlink
   NULL,                 // rmdir
-  NULL                  // rename
+  NULL,                 // rename
+  rfs_fsync_r,          // fsync
+  rfs_stat_r            // stat
 };
 
 int remotefs_init()
@@ -211,6 +297,15 @@ int remotefs_init()
   } 
 #endif
   rfsc_setup( rfs_buffer, rfs_send, rfs_recv, RFS_TIMEOUT );
+#if RFS_READAHEAD > 0
+  rfsc_setup_readahead( rfs_ra_buffer, RFS_READAHEAD_CHUNK, RFS_READAHEAD );
+#endif
+#if RFS_WRITE_BUFFERS > 0
+  rfsc_setup_writebehind( rfs_wb_buffer, 1 << RFS_BUFFER_SIZE, RFS_WRITE_BUFFERS );
+#endif
+#if RFS_DIR_BUFFER > 0
+  rfsc_setup_readdir( rfs_dir_buffer, RFS_REAL_DIR_BUFFER );
+#endif
   return dm_register( "/rfs", NULL, &rfs_device );
 }
 
@@ -200,4 +200,183 @@ int remotefs_closedir_read_request( const u8 *p, u32 *pd )
   return eluarpc_gen_read( p, "ol", RFS_OP_CLOSEDIR, pd );
 }
 
+// ****************************************************************************
+// Operation: pread
+// pread: ssize_t pread( int fd, void *buf, size_t count, off_t offset )
+
+void remotefs_pread_write_response( u8 *p, u8 seq, s32 offset, u32 readbytes )
+{
+  eluarpc_gen_write( p, "rcLp", RFS_OP_PREAD, seq, offset, NULL, readbytes );
+}
+
+int remotefs_pread_read_response( const u8 *p, u8 *pseq, s32 *poffset, const u8 **ppdata, u32 *preadbytes )
+{
+  return eluarpc_gen_read( p, "rcLp", RFS_OP_PREAD, pseq, poffset, ppdata, preadbytes );
+}
+
+void remotefs_pread_write_request( u8 *p, int fd, u8 seq, s32 offset, u32 count )
+{
+  eluarpc_gen_write( p, "oicLl", RFS_OP_PREAD, fd, seq, offset, count );
+}
+
+int remotefs_pread_read_request( const u8 *p, int *pfd, u8 *pseq, s32 *poffset, u32 *pcount )
+{
+  return eluarpc_gen_read( p, "oicLl", RFS_OP_PREAD, pfd, pseq, poffset, pcount );
+}
+
+// ****************************************************************************
+// Operation: version
+// version: u8 version( u8 version )
+
+void remotefs_version_write_response( u8 *p, u8 version )
+{
+  eluarpc_gen_write( p, "rc", RFS_OP_VERSION, version );
+}
+
+int remotefs_version_read_response( const u8 *p, u8 *pversion )
+{
+  return eluarpc_gen_read( p, "rc", RFS_OP_VERSION, pversion );
+}
+
+void remotefs_version_write_request( u8 *p, u8 version )
+{
+  eluarpc_gen_write( p, "oc", RFS_OP_VERSION, version );
+}
 
+int remotefs_version_read_request( const u8 *p, u8 *pversion )
+{
+  return eluarpc_gen_read( p, "oc", RFS_OP_VERSION, pversion );
+}
+
+// ****************************************************************************
+// Operation: readdirb
+// readdirb: u8 readdirb( u32 d, u32 maxsize )
+// Every entry is the size and the ftime (u32, little endian) followed by the
+// name with the terminating 0
+
+void remotefs_readdirb_write_response( u8 *p, u8 nentries, u32 size )
+{
+  eluarpc_gen_write( p, "rcp", RFS_OP_READDIRB, nentries, NULL, size );
+}
+
+int remotefs_readdirb_read_response( const u8 *p, u8 *pnentries, const u8 **ppdata, u32 *psize )
+{
+  return eluarpc_gen_read( p, "rcp", RFS_OP_READDIRB, pnentries, ppdata, psize );
+}
+
+void remotefs_readdirb_write_request( u8 *p, u32 d, u32 maxsize )
+{
+  eluarpc_gen_write( p, "oll", RFS_OP_READDIRB, d, maxsize );
+}
+
+int remotefs_readdirb_read_request( const u8 *p, u32 *pd, u32 *pmaxsize )
+{
+  return eluarpc_gen_read( p, "oll", RFS_OP_READDIRB, pd, pmaxsize );
+}
+
+static u8 *remotefs_put_u32( u8 *p, u32 data )
+{
+  *p ++ = data & 0xFF;
+  *p ++ = ( data >> 8 ) & 0xFF;
+  *p ++ = ( data >> 16 ) & 0xFF;
+  *p ++ = ( data >> 24 ) & 0xFF;
+  return p;
+}
+
+static const u8 *remotefs_get_u32( const u8 *p, u32 *pdata )
+{
+  *pdata = ( u32 )p[ 0 ] | ( ( u32 )p[ 1 ] << 8 ) | ( ( u32 )p[ 2 ] << 16 ) | ( ( u32 )p[ 3 ] << 24 );
+  return p + 4;
+}
+
+// Write an entry at 'p', return its size
+u32 remotefs_readdirb_put_entry( u8 *p, const char *name, u32 size, u32 ftime )
+{
+  u32 namelen = strlen( name ) + 1;
+
+  p = remotefs_put_u32( p, size );
+  p = remotefs_put_u32( p, ftime );
+  memcpy( p, name, namelen );
+  return 8 + namelen;
+}
+
+// Read the entry at 'p', return the next entry
+const u8* remotefs_readdirb_get_entry( const u8 *p, const char **pname, u32 *psize, u32 *pftime )
+{
+  p = remotefs_get_u32( p, psize );
+  p = remotefs_get_u32( p, pftime );
+  *pname = ( const char* )p;
+  return p + strlen( *pname ) + 1;
+}
+
+// ****************************************************************************
+// Operation: stat
+// stat: int stat( const char *name, u32 *psize, u32 *pftime )
+
+void remotefs_stat_write_response( u8 *p, int result, u32 size, u32 ftime )
+{
+  eluarpc_gen_write( p, "rill", RFS_OP_STAT, result, size, ftime );
+}
+
+int remotefs_stat_read_response( const u8 *p, int *presult, u32 *psize, u32 *pftime )
+{
+  return eluarpc_gen_read( p, "rill", RFS_OP_STAT, presult, psize, pftime );
+}
+
+void remotefs_stat_write_request( u8 *p, const char *name )
+{
+  eluarpc_gen_write( p, "op", RFS_OP_STAT, name, strlen( name ) + 1 );
+}
+
+int remotefs_stat_read_request( const u8 *p, const char **pname )
+{
+  return eluarpc_gen_read( p, "op", RFS_OP_STAT, pname, NULL );
+}
+
+// ****************************************************************************
+// Operation: writez
+// writez: ssize_t writez( int fd, u8 method, const void *buf, size_t count )
+
+void remotefs_writez_write_response( u8 *p, u32 result )
+{
+  eluarpc_gen_write( p, "rl", RFS_OP_WRITEZ, result );
+}
+
+int remotefs_writez_read_response( const u8 *p, u32 *presult )
+{
+  return eluarpc_gen_read( p, "rl", RFS_OP_WRITEZ, presult );
+}
+
+void remotefs_writez_write_request( u8 *p, int fd, u8 method, const void *buf, u32 count )
+{
+  eluarpc_gen_write( p, "oicp", RFS_OP_WRITEZ, fd, method, buf, count );
+}
+
+int remotefs_writez_read_request( const u8 *p, int *pfd, u8 *pmethod, const void **pbuf, u32 *pcount )
+{
+  return eluarpc_gen_read( p, "oicp", RFS_OP_WRITEZ, pfd, pmethod, pbuf, pcount );
+}
+
+// ****************************************************************************
+// Operation: preadz
+// preadz: ssize_t preadz( int fd, void *buf, size_t count, off_t offset )
+
+void remotefs_preadz_write_response( u8 *p, u8 seq, s32 offset, u8 method, u32 size )
+{
+  eluarpc_gen_write( p, "rcLcp", RFS_OP_PREADZ, seq, offset, method, NULL, size );
+}
+
+int remotefs_preadz_read_response( const u8 *p, u8 *pseq, s32 *poffset, u8 *pmethod, const u8 **ppdata, u32 *psize )
+{
+  return eluarpc_gen_read( p, "rcLcp", RFS_OP_PREADZ, pseq, poffset, pmethod, ppdata, psize );
+}
+
+void remotefs_preadz_write_request( u8 *p, int fd, u8 seq, s32 offset, u32 count )
+{
+  eluarpc_gen_write( p, "oicLl", RFS_OP_PREADZ, fd, seq, offset, count );
+}
+
+int remotefs_preadz_read_request( const u8 *p, int *pfd, u8 *pseq, s32 *poffset, u32 *pcount )
+{
+  return eluarpc_gen_read( p, "oicLl", RFS_OP_PREADZ, pfd, pseq, poffset, pcount );
+}
@@ -441,7 +441,9 @@ static const DM_DEVICE romfs_device =
   NULL,                 // mkdir
   NULL,                 // unlink
   NULL,                 // rmdir
-  NULL                  // rename
+  NULL,                 // rename
+  NULL,                 // fsync
+  NULL                  // stat
 };
 
 // ****************************************************************************
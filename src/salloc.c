@@ -94,72 +94,203 @@ static void s_create_new_block( char* where, char* next, char* prev )
   *temp = ( u32 )prev >> DYN_SIZE_MULT_SHIFT;
 }
 
-// Tries to compact free blocks
-static void s_compact_free( char* ptr )
+// ****************************************************************************
+// Segregated free lists (TLSF-like two level index)
+// Free blocks are kept in bins: the first level splits the sizes in powers
+// of 2, the second level splits each power of 2 in SL_COUNT equal ranges.
+// Two bitmaps keep track of the non-empty bins, so finding a suitable free
+// block takes a constant number of steps. A free block stores the links of
+// its bin list in its (otherwise unused) data area, so the block header is
+// unchanged. Adjacent free blocks are always merged, so a free block is
+// always surrounded by taken blocks.
+
+#define SL_LOG2                 2
+#define SL_COUNT                ( 1 << SL_LOG2 )
+#define FL_SHIFT                ( SL_LOG2 + DYN_SIZE_MULT_SHIFT )
+#define SMALL_BLOCK_SIZE        ( 1 << FL_SHIFT )
+// Blocks of 2^(FL_INDEX_MAX+1) bytes or more all go in the last bin
+#ifndef SALLOC_FL_INDEX_MAX
+#define SALLOC_FL_INDEX_MAX     24
+#endif
+#define FL_COUNT                ( SALLOC_FL_INDEX_MAX - FL_SHIFT + 2 )
+
+// Free list links (stored after the block header)
+#define s_next_free( ptr )      ( ( char* )*( u32* )( ( ptr ) + DYN_HEADER_SIZE ) )
+#define s_prev_free( ptr )      ( ( char* )*( ( u32* )( ( ptr ) + DYN_HEADER_SIZE ) + 1 ) )
+#define s_set_next_free( ptr, p ) *( u32* )( ( ptr ) + DYN_HEADER_SIZE ) = ( u32 )( p )
+#define s_set_prev_free( ptr, p ) *( ( u32* )( ( ptr ) + DYN_HEADER_SIZE ) + 1 ) = ( u32 )( p )
+
+static char* s_bins[ FL_COUNT ][ SL_COUNT ];
+static u32 s_fl_bitmap;
+static u8 s_sl_bitmap[ FL_COUNT ];
+
+// Index of the most significant bit set in 'v' ('v' must not be 0)
+static unsigned s_fls( u32 v )
 {
-  char *temp1, *temp2;
-  
-  s_mark_block_free( ptr );  
-  // Look for free blocks before and after, concatenate if possible
-  temp1 = temp2 = ptr;
-  while( s_is_block_free( temp1 ) )
-    temp1 = s_get_prev_block( temp1 );
-  temp1 = s_get_next_block( temp1 );      
-  while( s_is_block_free( temp2 ) )
-    temp2 = s_get_next_block( temp2 );    
-  if( temp1 != ptr || s_get_prev_block( temp2 ) != ptr )
+  return 31 - __builtin_clz( v );
+}
+
+// Index of the least significant bit set in 'v' ('v' must not be 0)
+static unsigned s_ffs( u32 v )
+{
+  return __builtin_ctz( v );
+}
+
+// Get the bin of a block with the given size
+static void s_mapping( size_t size, unsigned *fl, unsigned *sl )
+{
+  unsigned f;
+
+  if( size < SMALL_BLOCK_SIZE )
   {
-    s_set_next_block( temp1, temp2 );
-    s_set_prev_block( temp2, temp1 );
+    *fl = 0;
+    *sl = size >> DYN_SIZE_MULT_SHIFT;
+  }
+  else if( ( f = s_fls( size ) ) > SALLOC_FL_INDEX_MAX )
+  {
+    *fl = FL_COUNT - 1;
+    *sl = SL_COUNT - 1;
+  }
+  else
+  {
+    *sl = ( size >> ( f - SL_LOG2 ) ) ^ SL_COUNT;
+    *fl = f - FL_SHIFT + 1;
   }
 }
 
-// Utility function: find a free block in the dynamic memory part
-// Returns pointer to block for success, NULL for error
-static void* s_get_free_block( size_t size, void* pstart )
+// Insert a free block in its bin
+static void s_insert_free( char* ptr )
 {
-  char *temp, *pblock = NULL, *next;
-  size_t minsize = ( size_t )~0, bsize;
-  
-  if( !size )
-    return NULL;
-  size = s_act_size( size + DYN_HEADER_SIZE );  
-  temp = s_get_next_block( pstart );
-  // Best-fit only for now
-  while( temp )
+  unsigned fl, sl;
+  char *head;
+
+  s_mapping( s_get_block_size( ptr ), &fl, &sl );
+  head = s_bins[ fl ][ sl ];
+  s_set_next_free( ptr, head );
+  s_set_prev_free( ptr, NULL );
+  if( head )
+    s_set_prev_free( head, ptr );
+  s_bins[ fl ][ sl ] = ptr;
+  s_fl_bitmap |= 1UL << fl;
+  s_sl_bitmap[ fl ] |= 1 << sl;
+}
+
+// Remove a free block from its bin
+static void s_remove_free( char* ptr )
+{
+  unsigned fl, sl;
+  char *next = s_next_free( ptr ), *prev = s_prev_free( ptr );
+
+  s_mapping( s_get_block_size( ptr ), &fl, &sl );
+  if( next )
+    s_set_prev_free( next, prev );
+  if( prev )
+    s_set_next_free( prev, next );
+  else if( ( s_bins[ fl ][ sl ] = next ) == NULL )
+  {
+    s_sl_bitmap[ fl ] &= ~( 1 << sl );
+    if( s_sl_bitmap[ fl ] == 0 )
+      s_fl_bitmap &= ~( 1UL << fl );
+  }
+}
+
+// Find a free block of at least 'size' bytes (header included)
+static char* s_find_free( size_t size )
+{
+  unsigned fl, sl;
+  u32 map;
+  char *ptr;
+
+  // Round the size up to the next bin, so that any block from the bins
+  // found below is large enough
+  if( size >= SMALL_BLOCK_SIZE )
+    s_mapping( size + ( 1UL << ( s_fls( size ) - SL_LOG2 ) ) - 1, &fl, &sl );
+  else
+    s_mapping( size, &fl, &sl );
+  if( fl < FL_COUNT )
   {
-    if( s_is_block_free( temp ) )
+    if( ( map = s_sl_bitmap[ fl ] & ( ~0UL << sl ) ) == 0 )
     {
-      bsize = s_get_block_size( temp );      
-      if( ( size <= bsize ) && ( bsize < minsize ) )
+      map = fl + 1 < FL_COUNT ? s_fl_bitmap & ( ~0UL << ( fl + 1 ) ) : 0;
+      if( map != 0 )
       {
-        minsize = bsize;
-        pblock = temp;
+        fl = s_ffs( map );
+        map = s_sl_bitmap[ fl ];
       }
     }
-    temp = s_get_next_block( temp );
+    if( map != 0 )
+    {
+      // Only the last bin can hold blocks smaller than the request
+      for( ptr = s_bins[ fl ][ s_ffs( map ) ]; ptr; ptr = s_next_free( ptr ) )
+        if( s_get_block_size( ptr ) >= size )
+          return ptr;
+    }
   }
-  if( pblock == NULL )
-    return NULL;
-  s_mark_block_taken( pblock );
-  if( minsize > size && ( minsize - size ) >= DYN_MIN_SPLIT_SIZE )
+  // Nothing found after rounding up, look for a fit in the request's own bin
+  s_mapping( size, &fl, &sl );
+  for( ptr = s_bins[ fl ][ sl ]; ptr; ptr = s_next_free( ptr ) )
+    if( s_get_block_size( ptr ) >= size )
+      return ptr;
+  return NULL;
+}
+
+// Free a block, merging it with its free neighbours
+static void s_release_block( char* ptr )
+{
+  char *next = s_get_next_block( ptr ), *prev = s_get_prev_block( ptr );
+
+  if( s_is_block_free( next ) )
   {
-    temp = pblock + size;
-    next = s_get_next_block( pblock );
-    s_set_prev_block( temp, pblock );
-    s_set_next_block( temp, next );
-    s_set_prev_block( next, temp );
-    s_set_next_block( pblock, temp );
-    s_compact_free( temp );
+    s_remove_free( next );
+    next = s_get_next_block( next );
+    s_set_next_block( ptr, next );
+    s_set_prev_block( next, ptr );
   }
+  if( s_is_block_free( prev ) )
+  {
+    s_remove_free( prev );
+    s_set_next_block( prev, next );
+    s_set_prev_block( next, prev );
+    ptr = prev;
+  }
+  s_mark_block_free( ptr );
+  s_insert_free( ptr );
+}
+
+// Split 'size' bytes from the beginning of 'pblock', free the rest
+static void s_split_block( char* pblock, size_t size )
+{
+  char *temp = pblock + size, *next = s_get_next_block( pblock );
+
+  s_create_new_block( temp, next, pblock );
+  s_mark_block_taken( temp );
+  s_set_prev_block( next, temp );
+  s_set_next_block( pblock, temp );
+  s_release_block( temp );
+}
+
+// Utility function: find a free block in the dynamic memory part
+// Returns pointer to block for success, NULL for error
+static void* s_get_free_block( size_t size )
+{
+  char *pblock;
+
+  if( !size )
+    return NULL;
+  size = s_act_size( size + DYN_HEADER_SIZE );
+  if( ( pblock = s_find_free( size ) ) == NULL )
+    return NULL;
+  s_remove_free( pblock );
+  s_mark_block_taken( pblock );
+  if( s_get_block_size( pblock ) - size >= DYN_MIN_SPLIT_SIZE )
+    s_split_block( pblock, size );
   return pblock + DYN_HEADER_SIZE;
 }
 
 // Utility function: free a memory block
 static void s_free_block( char* ptr )
 {
-  ptr -= DYN_HEADER_SIZE;
-  s_compact_free( ptr );
+  s_release_block( ptr - DYN_HEADER_SIZE );
 }
 
 // Get 'real' block size
@@ -171,19 +302,11 @@ static size_t s_get_actual_block_size( char* ptr )
 // Shrinks the given block to its new size
 static void s_shrink_block( char* pblock, size_t size )
 {
-  char *temp, *next;
-  
   pblock -= DYN_HEADER_SIZE;
   size = s_act_size( size + DYN_HEADER_SIZE );  
   if( size >= s_get_block_size( pblock ) || ( s_get_block_size( pblock ) - size ) < DYN_MIN_SPLIT_SIZE )
     return;
-  temp = pblock + size;
-  next = s_get_next_block( pblock );
-  s_set_prev_block( temp, pblock );
-  s_set_next_block( temp, next );
-  s_set_prev_block( next, temp );
-  s_set_next_block( pblock, temp );    
-  s_compact_free( temp );
+  s_split_block( pblock, size );
 }
 
 static void s_init()
@@ -204,6 +327,7 @@ static void s_init()
     s_mark_block_taken( g1 );
     s_mark_block_taken( g2 );    
     s_mark_block_free( crt );
+    s_insert_free( crt );
     i ++;
   }   
   s_initialized = 1;
@@ -213,15 +337,9 @@ static void s_init()
 
 void* smalloc( size_t size )
 {
-  unsigned i = 0;
-  void *ptr = NULL, *pstart;
-
   if( !s_initialized )
     s_init();
-  while( ( pstart = platform_get_first_free_ram( i ++ ) ) != NULL )
-    if( ( ptr = s_get_free_block( size, pstart ) ) != NULL )
-      break;
-  return ptr;
+  return s_get_free_block( size );
 }
 
 void sfree( void* ptr )
@@ -277,5 +395,21 @@ void* srealloc( void* ptr, size_t size )
   return newptr;
 }
 
+// Return the number of bytes in the free blocks (headers excluded)
+size_t sfreebytes()
+{
+  unsigned fl, sl;
+  char *ptr;
+  size_t total = 0;
+
+  if( !s_initialized )
+    s_init();
+  for( fl = 0; fl < FL_COUNT; fl ++ )
+    for( sl = 0; sl < SL_COUNT; sl ++ )
+      for( ptr = s_bins[ fl ][ sl ]; ptr; ptr = s_next_free( ptr ) )
+        total += s_get_block_size( ptr ) - DYN_HEADER_SIZE;
+  return total;
+}
+
 #endif // #ifdef USE_SIMPLE_ALLOCATOR
 
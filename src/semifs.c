@@ -260,7 +260,9 @@ static const DM_DEVICE semifs_device =
   NULL,                  // mkdir
   NULL,                  // unlink
   NULL,                  // rmdir                   
-  NULL                   // rename
+  NULL,                  // rename
+  NULL,                  // fsync
+  NULL                   // stat
 };
 
 int semifs_init()
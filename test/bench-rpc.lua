@@ -0,0 +1,83 @@
+-- LuaRPC call rate benchmark
+--
+-- Start a server on the other end of the link, for example on an eLua
+-- board (or the simulator) with:
+--   rpc.server( uart_id, timer_id )
+-- or on the desktop (with a pair of ptys made by socat for a loopback test:
+-- socat pty,raw,echo=0,link=/tmp/rpc0 pty,raw,echo=0,link=/tmp/rpc1):
+--   luarpc -e 'rpc.server( "/tmp/rpc0" )'
+-- then run the benchmark against it:
+--   luarpc bench-rpc.lua /tmp/rpc1 [calls] [window] [textfile]
+-- The bulk test sends the text file (or generated Lua code) to the server
+-- and back, which shows the effect of RPC_COMPRESS.
+
+local port = arg[ 1 ] or "/dev/ttyS0"
+local calls = tonumber( arg[ 2 ] ) or 2000
+local window = tonumber( arg[ 3 ] ) or 32
+local textfile = arg[ 4 ]
+
+local slave = rpc.connect( port )
+
+-- the function is sent to the server, no server side setup needed
+slave.bench_add = function( a, b ) return a + b end
+assert( slave.bench_add( 1, 2 ) == 3, "remote call failed" )
+
+local function report( name, t )
+  if t > 0 then
+    print( string.format( "%-10s %6d calls in %3d s: %8.1f calls/s", name, calls, t, calls / t ) )
+  else
+    print( string.format( "%-10s %6d calls in < 1 s (use more calls)", name, calls ) )
+  end
+end
+
+-- synchronous calls: one round trip per call
+local start = os.time()
+for i = 1, calls do
+  slave.bench_add( i, 1 )
+end
+report( "sync", os.difftime( os.time(), start ) )
+
+-- pipelined calls: up to 'window' requests on the link at a time
+rpc.async( slave, true )
+local seqs, head = {}, 1
+start = os.time()
+for i = 1, calls do
+  seqs[ i ] = slave.bench_add( i, 1 )
+  if i - head + 1 == window then
+    assert( rpc.wait( slave, seqs[ head ] ) == head + 1, "bad result" )
+    head = head + 1
+  end
+end
+for i = head, calls do
+  assert( rpc.wait( slave, seqs[ i ] ) == i + 1, "bad result" )
+end
+report( "pipelined", os.difftime( os.time(), start ) )
+rpc.async( slave, false )
+
+-- bulk transfer: a text to the server and back
+local text
+if textfile then
+  local f = assert( io.open( textfile, "rb" ) )
+  text = f:read( "*a" )
+  f:close()
+else
+  local lines = {}
+  for i = 1, 500 do
+    lines[ i ] = string.format( "local v%d = math.floor( x * %d ) + y -- step %d\n", i, i * 7, i )
+  end
+  text = table.concat( lines )
+end
+slave.bench_echo = function( s ) return s end
+local reps = math.max( 1, math.floor( calls / 200 ) )
+start = os.time()
+for i = 1, reps do
+  assert( slave.bench_echo( text ) == text, "bad echo" )
+end
+local t = os.difftime( os.time(), start )
+if t > 0 then
+  print( string.format( "%-10s %6d bytes in %3d s: %8.1f bytes/s", "bulk", 2 * #text * reps, t, 2 * #text * reps / t ) )
+else
+  print( string.format( "%-10s %6d bytes in < 1 s (use more calls)", "bulk", 2 * #text * reps ) )
+end
+
+rpc.close( slave )
@@ -0,0 +1,73 @@
+-- Fixed point module test
+--
+-- Runs on any eLua build that has the fix module, including the integer
+-- only ones (no floating point literals are used):
+--   lua /rom/test-fix.lua
+-- The expected values are the exact results rounded to Q16.16; every
+-- function must be within one unit in the last place of them.
+
+local ONE = fix.ONE
+
+local function near( name, got, want )
+  assert( got - want <= 1 and want - got <= 1,
+          name .. ": got " .. got .. ", expected " .. want )
+end
+
+-- conversions
+assert( fix.new( 3 ) == 3 * ONE )
+assert( fix.new( -3 ) == -3 * ONE )
+assert( fix.new( 100000 ) == fix.MAX )
+assert( fix.new( -100000 ) == fix.MIN )
+assert( fix.toint( fix.new( -3 ) ) == -3 )
+assert( fix.parse( "-3.14159" ) == -205887 )
+assert( fix.parse( "0.5" ) == ONE / 2 )
+assert( fix.tostring( fix.parse( "-3.14159" ), 5 ) == "-3.14159" )
+assert( fix.tostring( fix.MIN ) == "-32768.0000" )
+assert( not pcall( fix.parse, "1e3" ) )
+
+-- saturating arithmetic
+assert( fix.add( fix.MAX, ONE ) == fix.MAX )
+assert( fix.sub( fix.MIN, ONE ) == fix.MIN )
+assert( fix.mul( fix.new( -3 ), fix.new( 5 ) ) == fix.new( -15 ) )
+assert( fix.mul( fix.new( 300 ), fix.new( 300 ) ) == fix.MAX )
+assert( fix.div( -ONE, 3 * ONE ) == -21845 )
+assert( fix.div( fix.new( -300 ), 1 ) == fix.MIN )
+assert( not pcall( fix.div, ONE, 0 ) )
+assert( fix.abs( fix.MIN ) == fix.MAX )
+assert( fix.toq31( -ONE ) == fix.MIN )
+assert( fix.fromq31( fix.toq31( -ONE / 2 ) ) == -ONE / 2 )
+assert( fix.mul31( fix.MIN, fix.MIN ) == fix.MAX )
+
+-- functions
+near( "sqrt(2)", fix.sqrt( 2 * ONE ), 92682 )
+near( "sqrt(MAX)", fix.sqrt( fix.MAX ), 11863283 )
+assert( not pcall( fix.sqrt, -1 ) )
+near( "sin(1)", fix.sin( ONE ), 55147 )
+near( "cos(1)", fix.cos( ONE ), 35409 )
+near( "sin(-0.5)", fix.sin( -ONE / 2 ), -31420 )
+near( "cos(-0.5)", fix.cos( -ONE / 2 ), 57513 )
+near( "sin(3)", fix.sin( 3 * ONE ), 9248 )
+near( "cos(3)", fix.cos( 3 * ONE ), -64880 )
+near( "sin(100)", fix.sin( 100 * ONE ), -33185 )
+near( "cos(100)", fix.cos( 100 * ONE ), 56513 )
+near( "atan2(3,4)", fix.atan2( 3, 4 ), 42172 )
+near( "atan2(-y,-x)", fix.atan2( -1, -1000000 ), -205887 )
+assert( fix.atan2( 0, 0 ) == 0 )
+near( "exp(1)", fix.exp( ONE ), fix.E )
+near( "exp(-5)", fix.exp( -5 * ONE ), 442 )
+near( "exp(10.33)", fix.exp( 677000 ), 2008301314 )
+assert( fix.exp( 20 * ONE ) == fix.MAX )
+assert( fix.exp( -20 * ONE ) == 0 )
+near( "log(10)", fix.log( 10 * ONE ), 150902 )
+near( "log(3/65536)", fix.log( 3 ), -654819 )
+near( "log(MAX)", fix.log( fix.MAX ), 681391 )
+assert( not pcall( fix.log, 0 ) )
+
+-- arguments that are not 32 bit integers are errors, not wrapped (only
+-- testable when Lua numbers are wider than 32 bits)
+if fix.MAX + 1 > fix.MAX then
+  assert( not pcall( fix.sin, fix.MAX + 1 ) )
+  assert( not pcall( fix.add, 0, fix.MIN - 1 ) )
+end
+
+print( "fix ok" )
@@ -0,0 +1,79 @@
+-- Remote file system read/write test
+--
+-- Start the RFS server on the desktop with an empty directory, for example:
+--   rfs_server ser:/dev/ttyUSB0,115200,none /tmp/rfsdir
+-- (or rfs_sim_server /tmp/rfsdir for the simulator), then run this script
+-- on the eLua board:
+--   lua /rfs/test-rfs.lua [bytes]
+-- after copying it to the server directory. The rfs*.tmp files it writes
+-- are left in the server directory.
+
+local bytes = tonumber( arg and arg[ 1 ] ) or 20000
+local dir = "/rfs/"
+
+local function content( n, seed )
+  local t = {}
+  for i = 1, n do
+    t[ i ] = string.char( 97 + ( i * seed ) % 26 )
+  end
+  return table.concat( t )
+end
+
+local function readall( name )
+  local f = assert( io.open( dir .. name, "rb" ) )
+  local s = f:read( "*a" )
+  f:close()
+  return s
+end
+
+-- small writes to two files at a time, read back after close
+local d1, d2 = content( bytes, 7 ), content( math.floor( bytes / 2 ), 11 )
+local f1 = assert( io.open( dir .. "rfs1.tmp", "wb" ) )
+local f2 = assert( io.open( dir .. "rfs2.tmp", "wb" ) )
+local p1, p2 = 1, 1
+local start = tmr.read()
+while p1 <= #d1 or p2 <= #d2 do
+  if p1 <= #d1 then
+    assert( f1:write( d1:sub( p1, p1 + 39 ) ) )
+    p1 = p1 + 40
+  end
+  if p2 <= #d2 then
+    assert( f2:write( d2:sub( p2, p2 + 16 ) ) )
+    p2 = p2 + 17
+  end
+end
+assert( f1:close() and f2:close() )
+local t = tmr.gettimediff( nil, start, tmr.read() )
+assert( readall( "rfs1.tmp" ) == d1, "rfs1.tmp: bad data" )
+assert( readall( "rfs2.tmp" ) == d2, "rfs2.tmp: bad data" )
+print( string.format( "write: %d bytes in %d ms", #d1 + #d2, t / 1000 ) )
+
+-- data written but not closed is seen after a flush
+local f = assert( io.open( dir .. "rfs3.tmp", "wb" ) )
+f:write( "first line\n" )
+assert( f:flush() )
+assert( readall( "rfs3.tmp" ) == "first line\n", "flush: data not written" )
+f:write( "second line\n" )
+f:close()
+assert( readall( "rfs3.tmp" ) == "first line\nsecond line\n", "close: data not written" )
+
+-- reads, seeks and writes on the same file
+f = assert( io.open( dir .. "rfs3.tmp", "r+b" ) )
+assert( f:read( 5 ) == "first" )
+assert( f:seek( "set", 6 ) == 6 )
+f:write( "LINE" )
+assert( f:seek( "cur" ) == 10 )
+assert( f:read( "*l" ) == "" )
+assert( f:read( "*l" ) == "second line" )
+assert( f:seek( "end" ) == 23 )
+f:write( "third" )
+f:close()
+assert( readall( "rfs3.tmp" ) == "first LINE\nsecond line\nthird", "seek: bad data" )
+
+-- read speed
+start = tmr.read()
+assert( readall( "rfs1.tmp" ) == d1 )
+t = tmr.gettimediff( nil, start, tmr.read() )
+print( string.format( "read: %d bytes in %d ms", #d1, t / 1000 ) )
+
+print( "all tests passed" )